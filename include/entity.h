@@ -81,9 +81,18 @@ void entity_draw(Entity *self);
 
 /**
  * @brief draw ALL active entities
+ * @note entities outside the camera frustum are skipped.
+ * Visible entities sharing a mesh and texture are drawn as one instanced draw
  */
 void entity_draw_all();
 
+/**
+ * @brief get how many entities the last entity_draw_all frustum culled
+ * @param visible (optional, output) entities that were drawn
+ * @param culled (optional, output) entities skipped for being outside the view frustum
+ */
+void entity_get_cull_stats(Uint32 *visible, Uint32 *culled);
+
 /**
  * @brief Call an entity's think function if it exists
  * @param self the entity in question
@@ -39,7 +39,8 @@ typedef struct
     Uint8                       framesPerLine;          /**<how many frames are per line in the sprite sheet*/
     Uint32                      frameWidth,frameHeight; /*<the size, in pixels, of the individual sprite frames*/
     VkBuffer                    buffer;
-    VkDeviceMemory              bufferMemory;
+    MemoryAllocation            bufferMemory;
+    Uint64                      uploadValue;            /**<upload timeline value the vertex buffer is ready at*/
     VkDescriptorSet            *descriptorSet;          /**<descriptor sets used for this sprite to render*/
 }Sprite;
 
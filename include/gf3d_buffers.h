@@ -3,6 +3,8 @@
 
 #include <vulkan/vulkan.h>
 
+#include "gf3d_memory.h"
+
 /**
  * @brief copy from one buffer to another
  * @param scrBuffer the buffer to copy from
@@ -12,12 +14,22 @@
 void gf3d_buffer_copy(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
 /**
- * @brief create and allocate the memory for a buffer
+ * @brief copy a range of one buffer into a range of another
+ * @param scrBuffer the buffer to copy from
+ * @param dstBuffer the buffer to copy to
+ * @param srcOffset where in srcBuffer to start reading
+ * @param dstOffset where in dstBuffer to start writing
+ * @param size how much to copy
+ */
+void gf3d_buffer_copy_region(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size);
+
+/**
+ * @brief create a buffer and bind it to memory from the device memory allocator
  * @param size how much memory to create
  * @param usage usage flags
  * @param properties memory properties
  * @param buffer (output) will be set with the handle to the buffer
- * @param bufferMemory (output) will be set with the handle to the bufferMemory
+ * @param allocation (output) will be set with the memory backing the buffer, mapped if host visible
  * @return 1 on success, 0 on failure
  */
 int gf3d_buffer_create(
@@ -25,6 +37,34 @@ int gf3d_buffer_create(
     VkBufferUsageFlags usage,
     VkMemoryPropertyFlags properties,
     VkBuffer * buffer,
-    VkDeviceMemory * bufferMemory);
+    MemoryAllocation * allocation);
+
+/**
+ * @brief create a buffer for data the GPU reads often, in device local memory that is also mapped when the device allows it
+ * @note when allocation->mapped is set write the data there directly, otherwise upload it.  Include VK_BUFFER_USAGE_TRANSFER_DST_BIT in usage for the upload case
+ * @param size how much memory to create
+ * @param usage usage flags
+ * @param buffer (output) will be set with the handle to the buffer
+ * @param allocation (output) will be set with the memory backing the buffer
+ * @return 1 on success, 0 on failure
+ */
+int gf3d_buffer_create_device_local(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer * buffer, MemoryAllocation * allocation);
+
+/**
+ * @brief create a short lived, host visible buffer to copy from, drawn from the transient pool
+ * @note free it as soon as the copy is done so the pool can start over
+ * @param size how much memory to create
+ * @param buffer (output) will be set with the handle to the buffer
+ * @param allocation (output) will be set with the memory backing the buffer, write the data to allocation->mapped
+ * @return 1 on success, 0 on failure
+ */
+int gf3d_buffer_create_staging(VkDeviceSize size, VkBuffer * buffer, MemoryAllocation * allocation);
+
+/**
+ * @brief destroy a buffer and give its memory back.  Safe to call on a buffer that was never created
+ * @param buffer the buffer to destroy, set to VK_NULL_HANDLE
+ * @param allocation the memory backing it, zeroed
+ */
+void gf3d_buffer_free(VkBuffer * buffer, MemoryAllocation * allocation);
 
 #endif
@@ -0,0 +1,126 @@
+#ifndef __GF3D_BUNDLE_H__
+#define __GF3D_BUNDLE_H__
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "gfc_types.h"
+#include "gfc_vector.h"
+#include "gfc_matrix.h"
+#include "gfc_color.h"
+
+#include "gf3d_memory.h"
+#include "gf3d_commands.h"
+#include "gf3d_vgraphics.h"
+#include "gf3d_model.h"
+
+#define GF3D_BUNDLE_PIPE_MAX 3  //the model pipeline for each vertex format and the sky pipeline
+
+/**
+ * @purpose one static draw baked into a bundle
+ */
+typedef struct
+{
+    Model          *model;
+    Bool            sky;        /**<drawn through the sky pipeline instead of the model pipeline*/
+    MeshInstance    instance;   /**<model matrix and color, sky draws push them instead*/
+    Vector4D        ambient;
+}BundleDraw;
+
+/**
+ * @purpose a bundle's command buffers for one frame in flight, only recorded over once that frame's fence is waited on
+ */
+typedef struct
+{
+    Command        *commandPool;                        /**<reset whenever the frame's buffers are recorded again*/
+    Pipeline       *pipes[GF3D_BUNDLE_PIPE_MAX];
+    VkCommandBuffer buffers[GF3D_BUNDLE_PIPE_MAX];      /**<one per pipeline the bundle draws with*/
+    Uint32          uboOffsets[GF3D_BUNDLE_PIPE_MAX];   /**<the frame uniform slice each was recorded to read*/
+    Uint32          pipeCount;
+    VkBuffer        instanceBuffer;                     /**<every draw's instance, by draw index*/
+    MemoryAllocation instanceAllocation;
+    Uint32          instanceMax;
+    Uint64          uploadValue;                        /**<upload timeline value covering everything drawn*/
+    Uint32          version;                            /**<the bundle version recorded, 0 for none*/
+}BundleFrame;
+
+/**
+ * @purpose a set of static draws recorded once into secondary command buffers and executed every frame it is drawn.
+ * The camera is read from the frame's uniform buffers, so it only has to be recorded again when it is edited
+ */
+typedef struct
+{
+    Uint8           _inuse;
+    SDL_mutex      *lock;           /**<edits come from the simulation thread while the render thread records*/
+    BundleDraw     *draws;
+    Uint32          drawCount;
+    Uint32          drawMax;
+    Uint32          version;        /**<bumped by every edit*/
+    SDL_atomic_t    queued;         /**<drawn in the frame being recorded*/
+    BundleFrame     frames[GF3D_VGRAPHICS_FRAMES_IN_FLIGHT];
+}Bundle;
+
+/**
+ * @brief set up the bundle manager, auto-cleaned up on program exit
+ * @note needs the command system and the mesh system
+ * @param max_bundles how many bundles can exist at once
+ */
+void gf3d_bundle_init(Uint32 max_bundles);
+
+/**
+ * @brief get a new empty bundle
+ * @return NULL on error or if there is no room, the bundle otherwise
+ */
+Bundle *gf3d_bundle_new();
+
+/**
+ * @brief free a bundle
+ * @note waits for the render thread and the GPU to be done with it
+ * @param bundle the bundle to free
+ */
+void gf3d_bundle_free(Bundle *bundle);
+
+/**
+ * @brief remove every draw from a bundle
+ * @param bundle the bundle to empty
+ */
+void gf3d_bundle_clear(Bundle *bundle);
+
+/**
+ * @brief bake a model draw into a bundle
+ * @note drawn at full detail with no cluster culling, those depend on the view.  Consecutive draws of the same model
+ * and ambient are drawn as one instanced draw.  The model must outlive the bundle or be cleared from it first
+ * @param bundle the bundle to add to
+ * @param model the model to draw
+ * @param modelMat where to draw it
+ * @param colorMod the color to multiply it by
+ * @param ambientLight the ambient light to draw it with
+ * @return 0 on error, 1 otherwise
+ */
+Bool gf3d_bundle_add_model(Bundle *bundle,Model *model,Matrix4 modelMat,Vector4D colorMod,Vector4D ambientLight);
+
+/**
+ * @brief bake a sky draw into a bundle
+ * @param bundle the bundle to add to
+ * @param model the sky model
+ * @param modelMat its model matrix
+ * @param color the color to multiply it by
+ * @return 0 on error, 1 otherwise
+ */
+Bool gf3d_bundle_add_sky(Bundle *bundle,Model *model,Matrix4 modelMat,Color color);
+
+/**
+ * @brief draw a bundle this frame
+ * @note call between gf3d_render_frame_begin and gf3d_render_frame_end like any other draw.  Its buffers are recorded
+ * again only when it has been edited since the frame in flight last recorded them
+ * @param bundle the bundle to draw
+ */
+void gf3d_bundle_draw(Bundle *bundle);
+
+/**
+ * @brief record the bundles drawn this frame that have changed and add every one of them to its pipelines
+ * @note called by gf3d_vgraphics_render_end before the pipelines are submitted
+ */
+void gf3d_bundle_flush();
+
+#endif
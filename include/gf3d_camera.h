@@ -3,9 +3,14 @@
 
 #include "gfc_matrix.h"
 
+#include "gf3d_frustum.h"
+
 typedef struct
 {
     Matrix4 cameraMat;      //final matrix to become the view matrix
+    Matrix4 projection;     //kept to build the frustum whenever the view changes
+    Frustum frustum;        //world space view frustum for culling
+    Vector3D eye;           //world space position the view matrix looks from
     Vector3D scale;
     Vector3D position;
     Vector3D rotation;      // pitch, roll, yaw
@@ -59,5 +64,23 @@ void gf3d_camera_set_scale(Vector3D scale);
  */
 void gf3d_camera_set_rotation(Vector3D rotation);
 
+/**
+ * @brief set the projection used to build the view frustum
+ * @note: gf3d_vgraphics_init sets this to match the rendering projection
+ * @param projection the projection matrix
+ */
+void gf3d_camera_set_projection(Matrix4 projection);
+
+/**
+ * @brief get the view frustum for the current view and projection
+ * @return a pointer to the camera's frustum, updated whenever the view changes
+ */
+Frustum *gf3d_camera_get_frustum();
+
+/**
+ * @brief get where the camera is looking from, however the view was set
+ * @return the world space eye position, recovered from the view matrix
+ */
+Vector3D gf3d_camera_get_eye_position();
 
 #endif
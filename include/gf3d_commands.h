@@ -13,6 +13,11 @@ typedef struct
     VkCommandBuffer    *commandBuffers;
     Uint32              commandBufferCount;
     Uint32              commandBufferNext;
+    VkCommandBuffer    *secondaryBuffers;       /**<recorded by pipelines and executed inside the frame render pass*/
+    Pipeline          **secondaryPipes;         /**<the pipeline each secondary was begun for*/
+    VkCommandBuffer    *executeBuffers;         /**<scratch for the secondaries in execution order, worker buffers included*/
+    Uint32              secondaryBufferCount;
+    Uint32              secondaryBufferNext;
 }Command;
 
 /**
@@ -22,6 +27,13 @@ typedef struct
  */
 void gf3d_command_system_init(Uint32 max_commands,VkDevice defaultDevice);
 
+/**
+ * @brief destroy a command pool and its command buffers
+ * @note the GPU must be done with every buffer in the pool
+ * @param com the command pool to free
+ */
+void gf3d_command_free(Command *com);
+
 /**
  * @brief setup up the command pool for graphics commands
  * @param count the number of command buffers to create
@@ -29,24 +41,103 @@ void gf3d_command_system_init(Uint32 max_commands,VkDevice defaultDevice);
  */
 Command * gf3d_command_graphics_pool_setup(Uint32 count);
 
+/**
+ * @brief setup up a command pool for commands submitted to the transfer queue
+ * @param count the number of command buffers to create
+ * @return NULL on error or a pointer to a setup command pool
+ */
+Command * gf3d_command_transfer_pool_setup(Uint32 count);
+
+/**
+ * @brief setup up a command pool for any queue family
+ * @param count the number of command buffers to create, 0 for a pool of only secondary command buffers
+ * @param queueFamily the family of the queue its command buffers are submitted to
+ * @return NULL on error or a pointer to a setup command pool
+ */
+Command * gf3d_command_pool_setup(Uint32 count,Uint32 queueFamily);
+
 VkCommandBuffer gf3d_command_begin_single_time(Command *com);
 
 void gf3d_command_end_single_time(Command *com, VkCommandBuffer commandBuffer);
 
 Uint32 gf3d_command_pool_get_used_buffer_count(Command *com);
 
+/**
+ * @brief allocate secondary command buffers for a command pool
+ * @param com the command pool to add them to
+ * @param count how many secondary command buffers to allocate
+ * @return 0 on error, 1 otherwise
+ */
+int gf3d_command_pool_add_secondary_buffers(Command *com,Uint32 count);
+
+/**
+ * @brief get the next unused secondary command buffer from the pool
+ * @param com the command pool to pull from
+ * @return VK_NULL_HANDLE if the pool is exhausted, a secondary command buffer otherwise
+ */
+VkCommandBuffer gf3d_command_get_secondary_buffer(Command *com);
+
+/**
+ * @brief reset a command pool so that all of its command buffers can be recorded again
+ * @note the GPU must be done with every buffer in the pool before this is called
+ * @param com the command pool to reset
+ */
+void gf3d_command_pool_reset(Command *com);
+
+/**
+ * @brief get the next unused command buffer from the pool
+ * @param com the command pool to pull from
+ * @return VK_NULL_HANDLE if the pool is exhausted, a command buffer otherwise
+ */
+VkCommandBuffer gf3d_command_get_graphics_buffer(Command *com);
+
 VkCommandBuffer * gf3d_command_pool_get_used_buffers(Command *com);
 
 /**
  * @brief begin recording a command that will take rendering pass information.  Submit all draw commands between this and gf3d_command_rendering_end
- * @param index the rendering frame to use
+ * @note this is a secondary command buffer from the current frame in flight's pool, it continues the frame render pass
+ * @param index the swap chain image to render to
  * @param pipe the pipeline to send the command to
  * @return the command buffer used for this drawing pass.
  */
 VkCommandBuffer gf3d_command_rendering_begin(Uint32 index,Pipeline *pipe);
 
+/**
+ * @brief begin recording a secondary command buffer for a pipeline from a given pool
+ * @note used by recording threads, each of which has its own pools.  See gf3d_pipeline_get_command_buffer
+ * @param com the command pool to take the secondary command buffer from
+ * @param index the swap chain image to render to
+ * @param pipe the pipeline to send the command to
+ * @return the command buffer used for this drawing pass.
+ */
+VkCommandBuffer gf3d_command_rendering_begin_from_pool(Command *com,Uint32 index,Pipeline *pipe);
+
+/**
+ * @brief begin recording a secondary command buffer that is kept and executed again in later frames
+ * @note it inherits no framebuffer, so it runs with any swap chain image.  Record over it only once the frames
+ * that executed it are done, see gf3d_bundle.h
+ * @param com the command pool to take the secondary command buffer from
+ * @param pipe the pipeline to bind
+ * @return VK_NULL_HANDLE on error, or the command buffer, end it with gf3d_command_rendering_end
+ */
+VkCommandBuffer gf3d_command_bundle_begin(Command *com,Pipeline *pipe);
+
+/**
+ * @brief finish recording a rendering command.  It is submitted with the rest of the frame in gf3d_vgraphics_render_end
+ * @param commandBuffer the command buffer returned by gf3d_command_rendering_begin
+ */
 void gf3d_command_rendering_end(VkCommandBuffer commandBuffer);
 
+/**
+ * @brief record the primary command buffer for a frame: one render pass that executes every secondary recorded from the pool
+ * @note each pipeline's recording thread buffers are executed right after its own secondary
+ * @param com the frame's command pool
+ * @param renderPass the frame render pass
+ * @param framebuffer the framebuffer for the acquired swap chain image
+ * @return VK_NULL_HANDLE on error, or the recorded primary command buffer ready for submission
+ */
+VkCommandBuffer gf3d_command_execute_render_pass(Command *com,VkRenderPass renderPass,VkFramebuffer framebuffer);
+
 void gf3d_command_configure_render_pass_end(VkCommandBuffer commandBuffer);
 
 
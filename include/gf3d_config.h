@@ -21,6 +21,7 @@ VkPipelineBindPoint gf3d_config_pipeline_bindpoint_from_str(const char *str);
 
 /**
  * @brief parse a json object containing VkSubpassDependency data
+ * @note stage masks may be a single string or an array of strings
  * @param config the json to parse
  * @return an empty VkDependencyFlags on error or configured VkSubpassDependency otherwise
  */
@@ -9,6 +9,8 @@ typedef struct
     VkPhysicalDevice device;                        /**vulkan device handle*/
     VkPhysicalDeviceProperties  deviceProperties;   /**<properties of the device*/
     VkPhysicalDeviceFeatures    deviceFeatures;     /**<features of the device*/
+    VkPhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures;  /**<descriptor indexing support, zeroed for pre 1.2 devices*/
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures;    /**<timeline semaphore support, zeroed for pre 1.2 devices*/
     int score;                                      /**<how many device features match ideal*/
 }GF3D_Device;
 
@@ -45,6 +47,44 @@ VkPhysicalDevice gf3d_devices_get_device_by_name(const char *name);
  */
 GF3D_Device *gf3d_device_get_chosen_gpu_info();
 
+/**
+ * @brief check if the logical device was created with the descriptor indexing features needed for a bindless texture table
+ * @note requires "bindless_textures" in the config and device support, otherwise textures fall back to a set per texture
+ * @return true if enabled, false otherwise
+ */
+Bool gf3d_device_bindless_enabled();
+
+/**
+ * @brief check if the logical device was created with timeline semaphores, needed to upload on a separate queue
+ * @return true if enabled, false otherwise
+ */
+Bool gf3d_device_timeline_semaphores_enabled();
+
+/**
+ * @brief check if the logical device was created with VK_KHR_draw_indirect_count, so the GPU can choose how many indirect draws run
+ * @return true if enabled, false otherwise
+ */
+Bool gf3d_device_draw_indirect_count_enabled();
+
+/**
+ * @brief record vkCmdDrawIndexedIndirectCountKHR, does nothing unless gf3d_device_draw_indirect_count_enabled
+ * @param commandBuffer the command buffer to record to
+ * @param buffer holds the VkDrawIndexedIndirectCommands
+ * @param offset where the first one is
+ * @param countBuffer holds the number of draws to run
+ * @param countBufferOffset where the count is
+ * @param maxDrawCount the most draws that can run
+ * @param stride bytes between commands
+ */
+void gf3d_device_cmd_draw_indexed_indirect_count(
+    VkCommandBuffer commandBuffer,
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    VkBuffer countBuffer,
+    VkDeviceSize countBufferOffset,
+    Uint32 maxDrawCount,
+    Uint32 stride);
+
 /**
  * @brief get the creation info needed to create a logical device based on what has been loaded and configured so far
  * @param enableValidationLayers if true, this will turn on validation layers. 
@@ -0,0 +1,74 @@
+#ifndef __GF3D_DRAW_QUEUE_H__
+#define __GF3D_DRAW_QUEUE_H__
+
+#include "gfc_types.h"
+#include "gfc_vector.h"
+
+#include "gf3d_mesh.h"
+
+/**
+ * @brief allocate the per frame draw queue, auto-cleaned up on program exit
+ * @note 3D draws are queued with a sort key (pass, pipeline, texture, mesh, depth) and recorded in key order at the end
+ * of the frame, so draws sharing state are recorded back to back and the bind caches skip the repeated binds
+ * @param itemMax how many draws a frame can queue, draws past that are recorded as they come
+ */
+void gf3d_draw_queue_init(Uint32 itemMax);
+
+/**
+ * @brief empty the queue for a new frame
+ * @note called by gf3d_vgraphics_render_start
+ */
+void gf3d_draw_queue_reset();
+
+/**
+ * @brief sort the frame's draws and record them into the pipelines' command buffers
+ * @note called by gf3d_vgraphics_render_end before the pipelines are submitted.  Opaque draws are recorded front to
+ * back across the recording threads, blended draws back to front on the calling thread
+ */
+void gf3d_draw_queue_flush();
+
+/**
+ * @brief queue an instanced draw through the model pipeline
+ * @note the instances are written to the frame's instance buffer now, see gf3d_mesh_render_instanced
+ * @param mesh the mesh to draw
+ * @param texture the texture to sample
+ * @param constants the ambient and texture index, copied
+ * @param instances the model matrix and color of each instance
+ * @param count how many instances to draw
+ * @param lod which level of detail to draw
+ */
+void gf3d_draw_queue_add_instanced(Mesh *mesh,Texture *texture,MeshPushConstants *constants,MeshInstance *instances,Uint32 count,Uint32 lod);
+
+/**
+ * @brief queue a single full detail instance whose clusters are culled when it is recorded, see gf3d_mesh_render_clustered
+ * @param mesh the mesh to draw
+ * @param texture the texture to sample
+ * @param constants the ambient and texture index, copied
+ * @param instance the model matrix and color, copied
+ */
+void gf3d_draw_queue_add_clustered(Mesh *mesh,Texture *texture,MeshPushConstants *constants,MeshInstance *instance);
+
+/**
+ * @brief queue an outline highlight draw, see gf3d_mesh_render_highlight
+ * @param mesh the mesh to draw
+ * @param constants the model matrix and highlight color, copied
+ * @param lod which level of detail to draw
+ */
+void gf3d_draw_queue_add_highlight(Mesh *mesh,HighlightPushConstants *constants,Uint32 lod);
+
+/**
+ * @brief queue a sky draw, see gf3d_mesh_render_sky
+ * @param mesh the mesh to draw
+ * @param texture the texture to sample
+ * @param constants the model matrix and color, copied
+ */
+void gf3d_draw_queue_add_sky(Mesh *mesh,Texture *texture,SkyPushConstants *constants);
+
+/**
+ * @brief queue a particle whose uniform buffer has been written, see gf3d_particle_render_queued
+ * @param position where the particle is, for sorting back to front
+ * @param uboOffset the offset of its slice of the particle uniform buffer this frame
+ */
+void gf3d_draw_queue_add_particle(Vector3D position,Uint32 uboOffset);
+
+#endif
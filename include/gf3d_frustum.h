@@ -0,0 +1,64 @@
+#ifndef __GF3D_FRUSTUM_H__
+#define __GF3D_FRUSTUM_H__
+
+#include "gfc_types.h"
+#include "gfc_vector.h"
+#include "gfc_matrix.h"
+
+/**
+ * @purpose the six planes bounding what the camera can see, in world space.
+ * Each plane is (normal.xyz, distance) with the normal facing into the volume
+ */
+typedef struct
+{
+    Vector4D    planes[6];      /**<left, right, bottom, top, near, far*/
+}Frustum;
+
+/**
+ * @brief extract the frustum planes from a view and projection matrix
+ * @param frustum (output) the planes are written here
+ * @param view the camera view matrix
+ * @param proj the projection matrix
+ */
+void gf3d_frustum_from_view_proj(Frustum *frustum, Matrix4 view, Matrix4 proj);
+
+/**
+ * @brief test a single bounding sphere against the frustum
+ * @param frustum the frustum to test against
+ * @param center world space center of the sphere
+ * @param radius world space radius of the sphere
+ * @return 1 if any part of the sphere may be visible, 0 if it is fully outside
+ */
+Bool gf3d_frustum_sphere_visible(Frustum *frustum, Vector3D center, float radius);
+
+/**
+ * @brief test a packed array of bounding spheres against the frustum, four at a time where SSE is available
+ * @param frustum the frustum to test against
+ * @param x world space x of each center
+ * @param y world space y of each center
+ * @param z world space z of each center
+ * @param radius world space radius of each sphere
+ * @param count how many spheres are in the arrays
+ * @param visible (output) set to 1 for each sphere that may be visible, 0 otherwise
+ * @return how many spheres may be visible
+ */
+Uint32 gf3d_frustum_cull_spheres(
+    Frustum *frustum,
+    const float *x,
+    const float *y,
+    const float *z,
+    const float *radius,
+    Uint32 count,
+    Uint8 *visible);
+
+/**
+ * @brief transform an object space bounding sphere by a model matrix
+ * @param modelMat the model matrix
+ * @param center object space center
+ * @param radius object space radius
+ * @param outCenter (output) world space center
+ * @return the world space radius, scaled by the largest axis scale of the matrix
+ */
+float gf3d_frustum_transform_sphere(Matrix4 modelMat, Vector3D center, float radius, Vector3D *outCenter);
+
+#endif
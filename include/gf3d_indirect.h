@@ -0,0 +1,74 @@
+#ifndef __GF3D_INDIRECT_H__
+#define __GF3D_INDIRECT_H__
+
+#include <vulkan/vulkan.h>
+
+#include "gfc_types.h"
+#include "gfc_vector.h"
+#include "gfc_matrix.h"
+
+#include "gf3d_model.h"
+
+#define GF3D_INDIRECT_BATCH_MAX 256 //most mesh, texture and ambient combinations drawn through the indirect path
+
+/**
+ * @purpose a model placed in the GPU driven scene.  It is culled and drawn every frame until it is freed, with no per
+ * frame work on the CPU
+ */
+typedef struct
+{
+    Uint8           _inuse;
+    Model          *model;
+    MeshInstance    instance;   /**<model matrix and color*/
+    Vector4D        ambient;
+}IndirectObject;
+
+/**
+ * @brief set up the GPU driven scene, auto-cleaned up on program exit
+ * @note objects are frustum culled by a compute pass that writes the indirect draw commands, so each mesh, texture and
+ * ambient combination costs one draw call however many objects use it.  Devices without multi draw indirect cull on
+ * the CPU into the draw queue instead.  Needs the mesh system and the command system
+ * @param object_max how many objects the scene can hold
+ */
+void gf3d_indirect_init(Uint32 object_max);
+
+/**
+ * @brief check if the scene is culled and drawn on the GPU
+ * @return 1 for the compute path, 0 if objects are culled on the CPU
+ */
+Bool gf3d_indirect_gpu_enabled();
+
+/**
+ * @brief add a model to the scene
+ * @note the model must outlive the object.  Drawn at full detail, levels of detail and clusters are not used
+ * @param model the model to draw
+ * @param modelMat where to draw it
+ * @param colorMod the color to multiply it by
+ * @param ambientLight the ambient light to draw it with, objects sharing it are drawn together
+ * @return NULL on error or if the scene is full, the object otherwise
+ */
+IndirectObject *gf3d_indirect_object_new(Model *model,Matrix4 modelMat,Vector4D colorMod,Vector4D ambientLight);
+
+/**
+ * @brief move an object
+ * @note only the moved objects are written again, but adding or freeing objects regroups and uploads the whole scene
+ * @param object the object to move
+ * @param modelMat its new model matrix
+ */
+void gf3d_indirect_object_set_matrix(IndirectObject *object,Matrix4 modelMat);
+
+/**
+ * @brief remove an object from the scene
+ * @param object the object to free
+ */
+void gf3d_indirect_object_free(IndirectObject *object);
+
+/**
+ * @brief upload any changes to the scene and record its draws for this frame
+ * @note called by gf3d_vgraphics_render_end before the pipelines are submitted
+ * @return the command buffer with the cull pass, to be submitted before the frame's render pass.
+ * VK_NULL_HANDLE if there is nothing to cull on the GPU
+ */
+VkCommandBuffer gf3d_indirect_flush();
+
+#endif
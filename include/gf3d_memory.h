@@ -0,0 +1,95 @@
+#ifndef __GF3D_MEMORY_H__
+#define __GF3D_MEMORY_H__
+
+#include <vulkan/vulkan.h>
+
+#include "gfc_types.h"
+
+typedef enum
+{
+    MU_Default = 0,     /**<long lived.  Small requests share size class pages, larger ones a free list block*/
+    MU_Transient,       /**<freed again right after use, such as staging data.  Bump allocated from a linear pool*/
+    MU_Dedicated,       /**<always gets a VkDeviceMemory of its own*/
+    MU_MAX
+}MemoryUsage;
+
+/**
+ * @purpose a range of device memory handed out by the allocator
+ */
+typedef struct
+{
+    VkDeviceMemory  memory;     /**<shared with the other allocations of the same block unless dedicated*/
+    VkDeviceSize    offset;     /**<where in memory the range starts, pass this to vkBind*Memory*/
+    VkDeviceSize    size;       /**<the size that was asked for*/
+    void           *mapped;     /**<host address of offset when the memory is host visible, NULL otherwise*/
+    void           *_block;     /**<the block the range came from*/
+    void           *_page;      /**<the size class page the range came from, NULL if none*/
+}MemoryAllocation;
+
+/**
+ * @purpose a snapshot of what the allocator holds
+ */
+typedef struct
+{
+    Uint32          blockCount;         /**<VkDeviceMemory objects held, dedicated ones included*/
+    Uint32          dedicatedCount;
+    Uint32          pageCount;          /**<size class pages carved out of the general blocks*/
+    Uint32          allocationCount;    /**<live allocations*/
+    VkDeviceSize    bytesReserved;      /**<total size of every block*/
+    VkDeviceSize    bytesUsed;          /**<total size of every live allocation, after rounding*/
+    float           fragmentation;      /**<how split up the free space of the general blocks is, 0 when it is all one range*/
+}MemoryStats;
+
+/**
+ * @brief set up the device memory allocator, auto-cleaned up on program exit
+ * @note must be called after the logical device is created and before anything allocates
+ * @param gpu the physical device, for its memory types
+ * @param device the logical device to allocate from
+ */
+void gf3d_memory_init(VkPhysicalDevice gpu,VkDevice device);
+
+/**
+ * @brief get a range of device memory
+ * @param requirements as reported by vkGet*MemoryRequirements for the resource
+ * @param properties the memory properties the resource needs
+ * @param usage how long the allocation lives, see MemoryUsage.  Large requests are always dedicated
+ * @param image true if the memory is for an optimally tiled image, which never share a block with buffers
+ * @param allocation (output) set to the range on success
+ * @return 1 on success, 0 on failure
+ */
+Bool gf3d_memory_allocate(
+    const VkMemoryRequirements *requirements,
+    VkMemoryPropertyFlags properties,
+    MemoryUsage usage,
+    Bool image,
+    MemoryAllocation *allocation);
+
+/**
+ * @brief allocate and bind the memory for an image
+ * @param image the image to back
+ * @param properties the memory properties the image needs
+ * @param allocation (output) set to the range on success
+ * @return 1 on success, 0 on failure
+ */
+Bool gf3d_memory_bind_image(VkImage image,VkMemoryPropertyFlags properties,MemoryAllocation *allocation);
+
+/**
+ * @brief give an allocation back.  Safe to call on a zeroed allocation
+ * @param allocation the allocation to free, it is zeroed
+ */
+void gf3d_memory_free(MemoryAllocation *allocation);
+
+/**
+ * @brief check if device local memory can be mapped without leaving the main device heap
+ * @note true on software drivers, integrated GPUs and with resizable BAR.  Data can then be written in place instead of staged
+ * @return 1 if it can, 0 otherwise
+ */
+Bool gf3d_memory_device_local_is_host_visible();
+
+/**
+ * @brief get a snapshot of how much memory the allocator holds and how it is used
+ * @param stats (output) filled in with the current numbers
+ */
+void gf3d_memory_get_stats(MemoryStats *stats);
+
+#endif
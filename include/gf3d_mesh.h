@@ -6,36 +6,76 @@
 #include "gfc_text.h"
 #include "gfc_matrix.h"
 #include "gf3d_pipeline.h"
+#include "gf3d_texture.h"
+#include "gf3d_frustum.h"
 
+/**
+ * @purpose per frame data shared by every draw through the model pipeline
+ */
 typedef struct
 {
-    Matrix4 model;
     Matrix4 view;
     Matrix4 proj;
-    Vector4D color; //color mod
-    Vector4D ambient;
     Vector4D LightPosition;
 }MeshUBO;
 
 /**
- * @purpose to send to calls to draw via the highlight pipeline
+ * @purpose per draw data pushed to the model pipeline, shared by every instance of the draw
+ */
+typedef struct
+{
+    Vector4D ambient;
+    Uint32   textureIndex;  /**<slot in the bindless texture table*/
+    Uint32   padding[3];    /**<the shader aligns the next vec4 to 16 bytes*/
+    Vector4D positionScale; /**<compact meshes: size of the bounds the positions are normalized against*/
+    Vector4D positionOffset;/**<compact meshes: minimum of those bounds*/
+}MeshPushConstants;
+
+/**
+ * @purpose per instance data for the model pipeline, read as instance rate vertex attributes
  */
 typedef struct
 {
     Matrix4 model;
+    Vector4D color; //color mod
+}MeshInstance;
+
+/**
+ * @purpose per frame data shared by every draw through the highlight pipeline
+ */
+typedef struct
+{
     Matrix4 view;
     Matrix4 proj;
-    Vector4D color; 
 }HighlightUBO;
 
+/**
+ * @purpose per draw data pushed to the highlight pipeline
+ */
 typedef struct
 {
     Matrix4 model;
+    Vector4D color; 
+    Vector4D positionScale; /**<compact meshes: size of the bounds the positions are normalized against*/
+    Vector4D positionOffset;/**<compact meshes: minimum of those bounds*/
+}HighlightPushConstants;
+
+/**
+ * @purpose per frame data for the sky pipeline.  The view has its translation removed
+ */
+typedef struct
+{
     Matrix4 view;
     Matrix4 proj;
-    Vector4D color; 
 }SkyUBO;
 
+typedef struct
+{
+    Matrix4 model;
+    Vector4D color; 
+    Uint32   textureIndex;  /**<slot in the bindless texture table*/
+}SkyPushConstants;
+
 typedef struct
 {
     Vector3D vertex;
@@ -48,25 +88,113 @@ typedef struct
     Uint32  verts[3];
 }Face;
 
+typedef enum
+{
+    MVF_Full,       /**<Vertex: float position, normal and texel, 32 bytes*/
+    MVF_Compact,    /**<CompactVertex: quantized position, octahedral normal, half float texel, 16 bytes*/
+    MVF_MAX
+}MeshVertexFormat;
+
+/**
+ * @purpose the compact vertex layout, decoded in the compact vertex shaders
+ */
+typedef struct
+{
+    Uint16  position[4];    /**<unorm16 within the mesh bounds, w unused*/
+    Sint16  normal[2];      /**<octahedral encoded, snorm16*/
+    Uint16  texel[2];       /**<half float*/
+}CompactVertex;
+
+#define GF3D_MESH_LOD_MAX 4
+
+/**
+ * @purpose one level of detail, a range of the shared index buffer drawing the same vertices with fewer triangles
+ */
+typedef struct
+{
+    Uint32  firstIndex;     /**<where the level starts in the mesh index buffer*/
+    Uint32  indexCount;
+    float   error;          /**<object space distance the surface may have moved from full detail*/
+}MeshLod;
+
+#define GF3D_MESH_CLUSTER_FACES 128
+
+/**
+ * @purpose a compact patch of the full detail level facing roughly one way, drawn or culled on its own
+ */
+typedef struct
+{
+    Vector3D    center;         /**<object space bounding sphere*/
+    float       radius;
+    Vector3D    coneAxis;       /**<average facing of the triangles*/
+    float       coneCutoff;     /**<sine of the cone half angle, 1 if the cone is too wide to cull with*/
+    Uint32      firstIndex;     /**<where the patch starts in the mesh index buffer*/
+    Uint32      indexCount;
+}MeshCluster;
+
 typedef struct
 {
     TextLine        filename;
     Uint32          _refCount;
     Uint8           _inuse;
     Uint32          vertexCount;
-    VkBuffer        buffer;
-    VkDeviceMemory  bufferMemory;
-    Uint32          faceCount;
-    VkBuffer        faceBuffer;
-    VkDeviceMemory  faceBufferMemory;
+    Uint32          vertexOffset;   /**<first vertex in the geometry arena, counted in vertices of this mesh's format*/
+    VkDeviceSize    vertexBytes;    /**<size of the vertex range held in the arena, 0 if none*/
+    Uint32          faceCount;      /**<faces in the index buffer, across every level of detail*/
+    Uint32          firstIndex;     /**<first index in the geometry arena, counted in indices of this mesh's index type*/
+    VkDeviceSize    indexBytes;     /**<size of the index range held in the arena, 0 if none*/
+    Uint64          uploadValue;    /**<upload timeline value a frame must wait on before drawing it*/
+    Vector3D        min;            /**<object space bounding box*/
+    Vector3D        max;
+    Vector3D        center;         /**<object space bounding sphere*/
+    float           radius;
+    MeshVertexFormat vertexFormat;  /**<layout of the vertex buffer*/
+    VkIndexType     indexType;      /**<16 bit when the mesh has fewer than 65536 vertices*/
+    MeshLod         lods[GF3D_MESH_LOD_MAX];    /**<full detail first*/
+    Uint32          lodCount;
+    MeshCluster    *clusters;       /**<full detail level split for culling, NULL for small meshes*/
+    Uint32          clusterCount;
 }Mesh;
 
+/**
+ * @purpose what has been bound to a command buffer recorded outside of a frame's draws, so repeated binds are skipped
+ */
+typedef struct
+{
+    VkDescriptorSet material;       /**<material set last bound*/
+    VkIndexType     indexType;      /**<index type the arena was last bound with*/
+}MeshBindState;
+
+/**
+ * @purpose where a run of VkDrawIndexedIndirectCommands written on the GPU lives, see gf3d_mesh_render_indirect
+ */
+typedef struct
+{
+    VkBuffer        buffer;         /**<holds the commands*/
+    VkDeviceSize    offset;         /**<of the first command*/
+    VkBuffer        countBuffer;    /**<holds how many of them to run, VK_NULL_HANDLE to run all of them*/
+    VkDeviceSize    countOffset;
+    Uint32          maxDrawCount;   /**<how many commands there are room for*/
+}MeshIndirectDraws;
+
 /**
  * @brief initializes the mesh system / configures internal data about mesh based rendering
  * @param mesh_max the maximum allowed simultaneous meshes supported at once.  Must be > 0
  */
 void gf3d_mesh_init(Uint32 mesh_max);
 
+/**
+ * @brief set how meshes built from source files are optimized before upload and caching
+ * @param mode the passes to run, see gf3d_mesh_optimize.h.  MO_Cache by default
+ */
+void gf3d_mesh_set_optimize_mode(Uint32 mode);
+
+/**
+ * @brief set which meshes are split into clusters for culling when they are built from source
+ * @param faces meshes with at least this many full detail faces are split, 0 splits none
+ */
+void gf3d_mesh_set_cluster_min_faces(Uint32 faces);
+
 /**
  * @brief load mesh data from the filename.
  * @note: currently only supporting obj files
@@ -75,6 +203,21 @@ void gf3d_mesh_init(Uint32 mesh_max);
  */
 Mesh *gf3d_mesh_load(const char *filename);
 
+/**
+ * @brief load mesh data from the filename into a specific vertex layout
+ * @param filename the name of the file to load
+ * @param format MVF_Full or MVF_Compact.  The same file may be loaded once in each
+ * @return NULL on error or Mesh data
+ */
+Mesh *gf3d_mesh_load_format(const char *filename,MeshVertexFormat format);
+
+/**
+ * @brief get the vertex format named in a config string
+ * @param name "full" or "compact"
+ * @return the format, MVF_Full if name is NULL or unknown
+ */
+MeshVertexFormat gf3d_mesh_vertex_format_from_string(const char *name);
+
 /**
  * @brief get the input attribute descriptions for mesh based rendering
  * @param count (optional, output) the number of attributes
@@ -94,7 +237,8 @@ VkVertexInputBindingDescription * gf3d_mesh_get_bind_description();
 void gf3d_mesh_free(Mesh *mesh);
 
 /**
- * @brief needs to be called once at the beginning of each render frame
+ * @brief needs to be called once at the beginning of each render frame, after the view has been set.
+ * Writes the frame's view and projection for each mesh pipeline
  */
 void gf3d_mesh_reset_pipes();
 
@@ -105,45 +249,171 @@ void gf3d_mesh_submit_pipe_commands();
 
 /**
  * @brief get the current command buffer for the mesh system
+ * @param format the model and highlight pipelines have one variant per vertex format
  */
-VkCommandBuffer gf3d_mesh_get_model_command_buffer();
-VkCommandBuffer gf3d_mesh_get_highlight_command_buffer();
+VkCommandBuffer gf3d_mesh_get_model_command_buffer(MeshVertexFormat format);
+VkCommandBuffer gf3d_mesh_get_highlight_command_buffer(MeshVertexFormat format);
 VkCommandBuffer gf3d_mesh_get_sky_command_buffer();
 
 
 /**
- * @brief adds a mesh to the render pass
+ * @brief adds one instanced draw of a mesh to the render pass
+ * @note: must be called within the render pass
+ * @param mesh the mesh to render
+ * @param commandBuffer the command buffer of the model pipeline for the mesh's vertex format
+ * @param texture the texture whose material set to sample, only rebound when it differs from the last draw
+ * @param constants the ambient and texture index shared by all instances, the position decode is filled in here
+ * @param instances the model matrix and color of each instance, copied into this frame's instance buffer
+ * @param count how many instances to draw
+ * @param lod which level of detail to draw, clamped to the levels the mesh has
+ */
+void gf3d_mesh_render_instanced(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, MeshPushConstants *constants, MeshInstance *instances, Uint32 count, Uint32 lod);
+
+/**
+ * @brief copy instances into this frame's instance buffer
+ * @note safe to call from any recording thread
+ * @param instances the model matrix and color of each instance
+ * @param count how many there are
+ * @param firstInstance (output) where they landed
+ * @return 1 on success, 0 if the frame is out of room
+ */
+Bool gf3d_mesh_write_instances(MeshInstance *instances,Uint32 count,Uint32 *firstInstance);
+
+/**
+ * @brief adds one instanced draw of instances already in this frame's instance buffer
  * @note: must be called within the render pass
  * @param mesh the mesh to render
- * @param com the command pool to use to handle the request we are rendering with
+ * @param commandBuffer the command buffer of the model pipeline for the mesh's vertex format
+ * @param texture the texture whose material set to sample
+ * @param constants the ambient and texture index, the position decode is filled in here
+ * @param firstInstance where gf3d_mesh_write_instances put them
+ * @param count how many instances to draw
+ * @param lod which level of detail to draw, clamped to the levels the mesh has
  */
-void gf3d_mesh_render(Mesh *mesh,VkCommandBuffer commandBuffer, VkDescriptorSet * descriptorSet);
+void gf3d_mesh_render_instances(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, MeshPushConstants *constants, Uint32 firstInstance, Uint32 count, Uint32 lod);
 
 /**
  * @brief adds a mesh to the render pass rendered as an outline highlight
  * @note: must be called within the render pass
  * @param mesh the mesh to render
- * @param com the command pool to use to handle the request we are rendering with
+ * @param commandBuffer the command buffer of the highlight pipeline for the mesh's vertex format
+ * @param constants the per draw model matrix and highlight color to push, the position decode is filled in here
+ * @param lod which level of detail to draw, clamped to the levels the mesh has
+ */
+void gf3d_mesh_render_highlight(Mesh *mesh,VkCommandBuffer commandBuffer, HighlightPushConstants *constants, Uint32 lod);
+
+/**
+ * @brief adds one instance of a mesh at full detail, skipping clusters that are off screen or face away from the eye
+ * @note: must be called within the render pass.  Meshes without clusters are drawn whole
+ * @param mesh the mesh to render
+ * @param commandBuffer the command buffer of the model pipeline for the mesh's vertex format
+ * @param texture the texture whose material set to sample
+ * @param constants the ambient and texture index, the position decode is filled in here
+ * @param instance the model matrix and color of the instance
+ * @param frustum the world space view frustum
+ * @param eye the world space camera position
  */
-void gf3d_mesh_render(Mesh *mesh,VkCommandBuffer commandBuffer, VkDescriptorSet * descriptorSet);
-void gf3d_mesh_render_highlight(Mesh *mesh,VkCommandBuffer commandBuffer, VkDescriptorSet * descriptorSet);
-void gf3d_mesh_render_sky(Mesh *mesh,VkCommandBuffer commandBuffer, VkDescriptorSet * descriptorSet);
+void gf3d_mesh_render_clustered(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, MeshPushConstants *constants, MeshInstance *instance, Frustum *frustum, Vector3D eye);
 
 /**
- * @brief create a mesh's internal buffers based on vertices
+ * @brief get how many mesh clusters were drawn and culled in the last frame recorded
+ * @note clusters are culled when the frame's queued draws are recorded, at the end of the frame
+ * @param drawn (optional, output) clusters that were drawn
+ * @param culled (optional, output) clusters that were skipped
+ */
+void gf3d_mesh_get_cluster_stats(Uint32 *drawn, Uint32 *culled);
+
+/**
+ * @brief adds a mesh to the render pass rendered as a sky
+ * @note: must be called within the render pass.  Only MVF_Full meshes are supported
+ * @param mesh the mesh to render
+ * @param commandBuffer the command buffer of the sky pipeline
+ * @param texture the texture whose material set to sample
+ * @param constants the per draw model matrix and color to push
+ */
+void gf3d_mesh_render_sky(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, SkyPushConstants *constants);
+
+/**
+ * @brief get the dynamic offset of this frame's view and projection for a mesh pipeline
+ * @note written first thing each frame by gf3d_mesh_reset_pipes
+ * @param pipe one of the mesh pipelines
+ * @return the offset into the pipeline's uniform ring for the current frame
+ */
+Uint32 gf3d_mesh_get_frame_ubo_offset(Pipeline *pipe);
+
+/**
+ * @brief bind what every draw on a mesh pipeline shares to a command buffer: set 0 at this frame's offset, the vertex arena and an instance buffer
+ * @param pipe the mesh pipeline the command buffer was begun with
+ * @param commandBuffer the command buffer to bind to
+ * @param bufferFrame the frame in flight whose set 0 to bind
+ * @param instanceBuffer bound to binding 1 for the model pipelines, VK_NULL_HANDLE for none
+ */
+void gf3d_mesh_bind_pipe_state(Pipeline *pipe,VkCommandBuffer commandBuffer,Uint32 bufferFrame,VkBuffer instanceBuffer);
+
+/**
+ * @brief forget what has been bound, for a command buffer that was just begun
+ * @param bound the bind state to clear
+ */
+void gf3d_mesh_bind_state_clear(MeshBindState *bound);
+
+/**
+ * @brief adds one instanced draw at full detail to a command buffer that is kept and replayed over many frames
+ * @note: see gf3d_bundle.h.  Nothing that depends on the view is chosen, so no level of detail or cluster culling
+ * @param mesh the mesh to render
+ * @param commandBuffer the command buffer begun with the model pipeline for the mesh's vertex format
+ * @param texture the texture whose material set to sample
+ * @param constants the ambient and texture index, the position decode is filled in here
+ * @param firstInstance where the instances are in the instance buffer bound with gf3d_mesh_bind_pipe_state
+ * @param count how many instances to draw
+ * @param bound what the command buffer has bound, updated
+ */
+void gf3d_mesh_render_bundle_instances(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, MeshPushConstants *constants, Uint32 firstInstance, Uint32 count, MeshBindState *bound);
+
+/**
+ * @brief adds draws of a mesh whose commands were written on the GPU to a command buffer
+ * @note: must be called within the render pass.  Each command draws its own range of the mesh and picks its instance
+ * with firstInstance, from the instance buffer bound with gf3d_mesh_bind_pipe_state
+ * @param mesh the mesh every command draws
+ * @param commandBuffer the command buffer begun with the model pipeline for the mesh's vertex format
+ * @param texture the texture whose material set to sample
+ * @param constants the ambient and texture index, the position decode is filled in here
+ * @param draws where the commands and their count are
+ * @param bound what the command buffer has bound, updated
+ */
+void gf3d_mesh_render_indirect(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, MeshPushConstants *constants, MeshIndirectDraws *draws, MeshBindState *bound);
+
+/**
+ * @brief adds a sky draw to a command buffer that is kept and replayed over many frames
+ * @param mesh the mesh to render, MVF_Full only
+ * @param commandBuffer the command buffer begun with the sky pipeline
+ * @param texture the texture whose material set to sample
+ * @param constants the model matrix and color to push
+ * @param bound what the command buffer has bound, updated
+ */
+void gf3d_mesh_render_bundle_sky(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, SkyPushConstants *constants, MeshBindState *bound);
+
+/**
+ * @brief upload a mesh's vertices and indices into the shared geometry arena
  * @param mesh the mesh handle to populate
  * @param vertices an array of vertices to make the mesh with
  * @param vcount how many vertices are in the array
  * @param faces an array of faces to make the mesh with
  * @param fcount how many faces are in the array
+ * @return 1 on success, 0 if the arena is out of room
  */
-void gf3d_mesh_create_vertex_buffer_from_vertices(Mesh *mesh,Vertex *vertices,Uint32 vcount,Face *faces,Uint32 fcount);
+Bool gf3d_mesh_create_vertex_buffer_from_vertices(Mesh *mesh,const Vertex *vertices,Uint32 vcount,const Face *faces,Uint32 fcount);
 
 /**
  * @brief get the pipeline that is used to render basic 3d meshes
  * @return NULL on error or the pipeline in question
  */
 Pipeline *gf3d_mesh_get_pipeline();
+
+/**
+ * @brief get the pipeline that renders MVF_Compact meshes
+ * @return NULL if it could not be created, the pipeline otherwise
+ */
+Pipeline *gf3d_mesh_get_compact_pipeline();
 Pipeline *gf3d_mesh_get_highlight_pipeline();
 Pipeline *gf3d_mesh_get_sky_pipeline();
 
@@ -0,0 +1,103 @@
+#ifndef __GF3D_MESH_ARENA_H__
+#define __GF3D_MESH_ARENA_H__
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "gfc_types.h"
+
+#include "gf3d_memory.h"
+
+/**
+ * @purpose an unused range of an arena
+ */
+typedef struct
+{
+    VkDeviceSize    offset;
+    VkDeviceSize    size;
+}MeshArenaBlock;
+
+/**
+ * @purpose a released range that frames still in flight may read, held until they are done
+ */
+typedef struct
+{
+    VkDeviceSize    offset;
+    VkDeviceSize    size;
+    Uint32          frame;          /**<the arena frame it was released in*/
+}MeshArenaRetired;
+
+/**
+ * @purpose one device local buffer that many meshes are suballocated from, so they share a single allocation and binding
+ */
+typedef struct
+{
+    VkBuffer        buffer;
+    MemoryAllocation allocation;    /**<mapped when the arena is written in place*/
+    VkDeviceSize    size;
+    VkDeviceSize    alignment;      /**<every range starts and ends on a multiple of this*/
+    VkDeviceSize    used;           /**<bytes handed out*/
+    MeshArenaBlock *freeBlocks;     /**<sorted by offset, neighbours are always merged*/
+    Uint32          freeCount;
+    Uint32          freeMax;
+    MeshArenaRetired *retired;      /**<only used when the buffer is mapped, staged uploads are ordered after earlier frames already*/
+    Uint32          retiredCount;
+    Uint32          retiredMax;
+    Uint32          frame;          /**<counts gf3d_mesh_arena_next_frame calls*/
+    SDL_mutex      *lock;           /**<meshes are made and deleted on the simulation thread while the render thread starts frames*/
+}MeshArena;
+
+/**
+ * @brief create the buffer for an arena, all of it free
+ * @note the buffer is mapped and written in place when device local memory is host visible, see gf3d_buffer_create_device_local
+ * @param arena the arena to set up
+ * @param size how many bytes the buffer holds
+ * @param alignment ranges are rounded to multiples of this
+ * @param usage what the buffer is bound as, VK_BUFFER_USAGE_TRANSFER_DST_BIT is added
+ * @param allocationMax the most ranges that will be held at once
+ * @return 1 on success, 0 on failure
+ */
+Bool gf3d_mesh_arena_create(MeshArena *arena,VkDeviceSize size,VkDeviceSize alignment,VkBufferUsageFlags usage,Uint32 allocationMax);
+
+/**
+ * @brief destroy the buffer of an arena.  Any ranges still held are no longer valid
+ * @param arena the arena to clean up
+ */
+void gf3d_mesh_arena_free(MeshArena *arena);
+
+/**
+ * @brief claim a range of the arena, the first that fits
+ * @param arena the arena to allocate from
+ * @param size how many bytes are needed
+ * @param offset (output) the byte offset of the range in the arena buffer
+ * @return 1 on success, 0 if no free range is large enough
+ */
+Bool gf3d_mesh_arena_alloc(MeshArena *arena,VkDeviceSize size,VkDeviceSize *offset);
+
+/**
+ * @brief give a range back to the arena
+ * @note for a mapped arena the range is not reused until the frames that may still read it are done, see gf3d_mesh_arena_next_frame
+ * @param arena the arena it came from
+ * @param offset the offset gf3d_mesh_arena_alloc returned
+ * @param size the size it was allocated with
+ */
+void gf3d_mesh_arena_release(MeshArena *arena,VkDeviceSize offset,VkDeviceSize size);
+
+/**
+ * @brief start a new frame, ranges released far enough back become free again
+ * @note call once per frame, after waiting on the fence of the frame being started
+ * @param arena the arena
+ */
+void gf3d_mesh_arena_next_frame(MeshArena *arena);
+
+/**
+ * @brief get the memory to write a range of the arena through
+ * @note a mapped arena gives the range itself.  Otherwise an upload is queued and the data must be written while holding gf3d_upload_lock, see gf3d_upload_buffer_reserve
+ * @param arena the arena to upload to
+ * @param offset where in the arena buffer the data goes
+ * @param size how many bytes will be written
+ * @return a pointer to size bytes of mapped memory, NULL on failure
+ */
+void *gf3d_mesh_arena_upload(MeshArena *arena,VkDeviceSize offset,VkDeviceSize size);
+
+#endif
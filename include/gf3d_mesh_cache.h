@@ -0,0 +1,102 @@
+#ifndef __GF3D_MESH_CACHE_H__
+#define __GF3D_MESH_CACHE_H__
+
+#include "gfc_types.h"
+
+#include "gf3d_mmap.h"
+#include "gf3d_mesh.h"
+#include "gf3d_obj_load.h"
+#include "gf3d_mesh_optimize.h"
+
+#define GF3D_MESH_CACHE_MAGIC   0x4d334647  //"GF3M" read little endian
+#define GF3D_MESH_CACHE_VERSION 6
+
+/**
+ * @purpose the header at the start of a .gf3dmesh file.  The vertex and index blocks follow at the given offsets
+ */
+typedef struct
+{
+    Uint32  magic;          /**<GF3D_MESH_CACHE_MAGIC*/
+    Uint32  version;        /**<GF3D_MESH_CACHE_VERSION, older caches are rebuilt*/
+    Uint64  sourceTime;     /**<modification time of the source obj when this was written*/
+    Uint64  sourceSize;     /**<size of the source obj when this was written*/
+    Uint32  vertexSize;     /**<sizeof(Vertex) of the writer*/
+    Uint32  vertexCount;
+    Uint32  faceCount;
+    Uint32  optimizeMode;   /**<the MeshOptimizeMode the data was written with*/
+    float   min[3];         /**<bounding box*/
+    float   max[3];
+    float   center[3];      /**<bounding sphere*/
+    float   radius;
+    Uint64  vertexOffset;   /**<byte offset of the vertex block from the start of the file*/
+    Uint64  faceOffset;     /**<byte offset of the index block from the start of the file*/
+    Uint32  lodCount;       /**<levels of detail in the index block, full detail first*/
+    struct
+    {
+        Uint32  firstIndex;
+        Uint32  indexCount;
+        float   error;
+    }lods[GF3D_MESH_LOD_MAX];
+    Uint32  clusterCount;   /**<clusters of the full detail level, 0 if it was not split*/
+    Uint64  clusterOffset;  /**<byte offset of the cluster block from the start of the file*/
+}MeshCacheHeader;
+
+/**
+ * @purpose an open, validated mesh cache.  The pointers point into the mapped file
+ */
+typedef struct
+{
+    MappedFile              file;
+    const MeshCacheHeader  *header;
+    const Vertex           *vertices;
+    const Face             *faces;
+    const MeshCluster      *clusters;   /**<NULL if the mesh was not split*/
+}MeshCache;
+
+/**
+ * @brief get the cache file name that goes with a source obj file
+ * @param filename the source file, ie: models/dino/dino.obj
+ * @param cachename (output) the cache file, ie: models/dino/dino.gf3dmesh
+ */
+void gf3d_mesh_cache_get_filename(const char *filename, TextLine cachename);
+
+/**
+ * @brief map the cache for a source file if it exists and is still current
+ * @param filename the source obj file
+ * @param optimizeMode the optimization the cached data must have been written with
+ * @param clusterMinFaces the cluster threshold in use, the cache is rebuilt if it would split the mesh differently
+ * @param cache (output) set with the mapped data
+ * @return 1 if a valid cache was opened, 0 if there is none or it is out of date
+ */
+Bool gf3d_mesh_cache_open(const char *filename, MeshOptimizeMode optimizeMode, Uint32 clusterMinFaces, MeshCache *cache);
+
+/**
+ * @brief unmap a cache opened with gf3d_mesh_cache_open
+ */
+void gf3d_mesh_cache_close(MeshCache *cache);
+
+/**
+ * @brief write the cache for a source file from its parsed obj data
+ * @param filename the source obj file
+ * @param obj the parsed and reorganized obj data, for the vertices and bounds
+ * @param faces the faces of every level of detail, back to back
+ * @param faceCount how many faces there are across all levels
+ * @param lods the index range of each level within faces
+ * @param lodCount how many levels there are
+ * @param clusters the clusters of the full detail level, may be NULL
+ * @param clusterCount how many clusters there are
+ * @param optimizeMode the optimization that was run on the obj data
+ * @return 1 on success, 0 on failure
+ */
+Bool gf3d_mesh_cache_write(
+    const char *filename,
+    ObjData *obj,
+    const Face *faces,
+    Uint32 faceCount,
+    const MeshLod *lods,
+    Uint32 lodCount,
+    const MeshCluster *clusters,
+    Uint32 clusterCount,
+    MeshOptimizeMode optimizeMode);
+
+#endif
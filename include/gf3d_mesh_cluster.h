@@ -0,0 +1,40 @@
+#ifndef __GF3D_MESH_CLUSTER_H__
+#define __GF3D_MESH_CLUSTER_H__
+
+#include "gfc_types.h"
+#include "gfc_vector.h"
+#include "gfc_matrix.h"
+
+#include "gf3d_mesh.h"
+#include "gf3d_frustum.h"
+#include "gf3d_mesh_optimize.h"
+
+/**
+ * @brief split faces into spatially compact clusters of up to GF3D_MESH_CLUSTER_FACES triangles that face roughly the same way
+ * @param faces the index triples, reordered in place so each cluster is one contiguous run
+ * @param faceCount how many faces there are
+ * @param vertices the vertices the faces index, for positions
+ * @param vertexCount how many vertices there are
+ * @param mode unless MO_None, the triangles of each cluster are reordered for the post transform cache
+ * @param clusters (output) set to the new cluster array, free() it when done
+ * @return how many clusters were built, 0 on error
+ */
+Uint32 gf3d_mesh_cluster_build(
+    Face *faces,
+    Uint32 faceCount,
+    const Vertex *vertices,
+    Uint32 vertexCount,
+    MeshOptimizeMode mode,
+    MeshCluster **clusters);
+
+/**
+ * @brief test a cluster of an instance against the view frustum and for facing entirely away from the eye
+ * @param cluster the cluster to test
+ * @param modelMat the model matrix of the instance
+ * @param frustum the world space view frustum
+ * @param eye the world space camera position
+ * @return 1 if any triangle of the cluster may be visible, 0 otherwise
+ */
+Bool gf3d_mesh_cluster_visible(const MeshCluster *cluster, Matrix4 modelMat, Frustum *frustum, Vector3D eye);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef __GF3D_MESH_OPTIMIZE_H__
+#define __GF3D_MESH_OPTIMIZE_H__
+
+#include "gfc_types.h"
+
+#include "gf3d_mesh.h"
+
+#define GF3D_MESH_OPTIMIZE_CACHE_SIZE 32    //simulated post transform cache entries
+
+typedef enum
+{
+    MO_None,        /**<leave the triangle and vertex order as loaded*/
+    MO_Cache,       /**<reorder triangles for the post transform cache, then vertices for fetch*/
+    MO_Overdraw,    /**<as MO_Cache, then sort clusters of triangles so outward facing ones draw first*/
+    MO_MAX
+}MeshOptimizeMode;
+
+/**
+ * @brief get the optimize mode named by a config string
+ * @param name "none", "cache" or "overdraw"
+ * @return the mode, MO_Cache if name is NULL or unknown
+ */
+MeshOptimizeMode gf3d_mesh_optimize_mode_from_string(const char *name);
+
+/**
+ * @brief reorder triangles for post transform vertex cache hits, using Tom Forsyth's linear speed vertex cache optimization
+ * @param faces the index triples to reorder in place
+ * @param faceCount how many faces there are
+ * @param vertexCount how many vertices the faces index
+ */
+void gf3d_mesh_optimize_vertex_cache(Face *faces,Uint32 faceCount,Uint32 vertexCount);
+
+/**
+ * @brief reorder clusters of cache optimized triangles so those facing out from the middle of the mesh draw first
+ * @note run after gf3d_mesh_optimize_vertex_cache, clusters split where the cache goes cold so the cache order mostly survives
+ * @param faces the index triples to reorder in place
+ * @param faceCount how many faces there are
+ * @param vertices the vertices the faces index, for positions
+ * @param vertexCount how many vertices there are
+ */
+void gf3d_mesh_optimize_overdraw(Face *faces,Uint32 faceCount,const Vertex *vertices,Uint32 vertexCount);
+
+/**
+ * @brief reorder vertices into the order the faces first use them, remapping the faces to match
+ * @param vertices the vertices to reorder in place
+ * @param vertexCount how many vertices there are
+ * @param faces the index triples to remap in place
+ * @param faceCount how many faces there are
+ * @return the new vertex count, vertices no face uses are dropped
+ */
+Uint32 gf3d_mesh_optimize_vertex_fetch(Vertex *vertices,Uint32 vertexCount,Face *faces,Uint32 faceCount);
+
+/**
+ * @brief simulate a FIFO post transform cache over the faces
+ * @param faces the index triples to measure
+ * @param faceCount how many faces there are
+ * @param vertexCount how many vertices the faces index
+ * @param atvr (optional, output) average transformed vertices per vertex, 1.0 is ideal
+ * @return average cache misses per triangle (ACMR), 0.5 is about ideal for a regular grid
+ */
+float gf3d_mesh_optimize_acmr(const Face *faces,Uint32 faceCount,Uint32 vertexCount,float *atvr);
+
+/**
+ * @brief run the optimization passes a mode calls for and log ACMR/ATVR before and after
+ * @param filename the mesh name, for the log
+ * @param mode which passes to run
+ * @param vertices the vertices, reordered in place
+ * @param vertexCount how many vertices there are
+ * @param faces the index triples, reordered in place
+ * @param faceCount how many faces there are
+ * @return the new vertex count
+ */
+Uint32 gf3d_mesh_optimize(
+    const char *filename,
+    MeshOptimizeMode mode,
+    Vertex *vertices,
+    Uint32 vertexCount,
+    Face *faces,
+    Uint32 faceCount);
+
+#endif
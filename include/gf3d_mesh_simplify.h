@@ -0,0 +1,53 @@
+#ifndef __GF3D_MESH_SIMPLIFY_H__
+#define __GF3D_MESH_SIMPLIFY_H__
+
+#include "gfc_types.h"
+
+#include "gf3d_mesh.h"
+#include "gf3d_mesh_optimize.h"
+
+/**
+ * @brief reduce the triangle count with quadric error metric edge collapses.
+ * Vertices are only ever collapsed onto other existing vertices, so the result still indexes the same vertex buffer
+ * @note vertices on a texture or normal seam, and vertices where open edges meet, are never moved
+ * @param faces the index triples to simplify in place, only the first (return value) are kept
+ * @param faceCount how many faces there are
+ * @param vertices the vertices the faces index, for positions
+ * @param vertexCount how many vertices there are
+ * @param targetFaceCount stop once there are this many faces or fewer
+ * @param error (optional, output) the largest object space distance the surface moved
+ * @return the new face count, which is more than targetFaceCount if the mesh could not be reduced that far
+ */
+Uint32 gf3d_mesh_simplify(
+    Face *faces,
+    Uint32 faceCount,
+    const Vertex *vertices,
+    Uint32 vertexCount,
+    Uint32 targetFaceCount,
+    float *error);
+
+/**
+ * @brief build the level of detail chain for a mesh, each level halving the triangles of the one before
+ * @param filename the mesh name, for the log
+ * @param mode unless MO_None, each coarser level is reordered for the post transform cache
+ * @param vertices the vertices shared by every level
+ * @param vertexCount how many vertices there are
+ * @param faces the full detail faces
+ * @param faceCount how many full detail faces there are
+ * @param lods (output) GF3D_MESH_LOD_MAX entries, filled with index ranges into the returned faces
+ * @param lodCount (output) how many levels were built, at least 1
+ * @param totalFaces (output) how many faces the returned array holds
+ * @return every level back to back, full detail first.  free() it when done.  NULL on error
+ */
+Face *gf3d_mesh_simplify_lods(
+    const char *filename,
+    MeshOptimizeMode mode,
+    const Vertex *vertices,
+    Uint32 vertexCount,
+    const Face *faces,
+    Uint32 faceCount,
+    MeshLod *lods,
+    Uint32 *lodCount,
+    Uint32 *totalFaces);
+
+#endif
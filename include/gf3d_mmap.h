@@ -0,0 +1,41 @@
+#ifndef __GF3D_MMAP_H__
+#define __GF3D_MMAP_H__
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "gfc_types.h"
+
+/**
+ * @purpose a read only view of a whole file mapped into memory
+ */
+typedef struct
+{
+    const void *data;       /**<start of the file contents*/
+    size_t      size;       /**<size of the file in bytes*/
+#ifdef _WIN32
+    HANDLE      file;
+    HANDLE      mapping;
+#else
+    int         fd;
+#endif
+}MappedFile;
+
+/**
+ * @brief map a file into memory for reading
+ * @param filename the file to map
+ * @param mapped (output) set with the mapping on success
+ * @return 1 on success, 0 if the file could not be opened or mapped
+ */
+Bool gf3d_mmap_open(const char *filename, MappedFile *mapped);
+
+/**
+ * @brief release a file mapping made with gf3d_mmap_open
+ * @param mapped the mapping to release.  Pointers into its data are no longer valid after this
+ */
+void gf3d_mmap_close(MappedFile *mapped);
+
+#endif
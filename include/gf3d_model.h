@@ -34,7 +34,8 @@
 
 /**
  * @purpose the model is a single instance of 3d mesh data.  Each can be drawn individually in the rendering pipeline.
- * Multiple models can reference the same mesh and texture data, but will have separate UBO data and descriptorSets
+ * Multiple models can reference the same mesh and texture data.  Per draw data is pushed with the draw and the
+ * material descriptor set belongs to the texture, so models sharing a texture share a set
  */
 typedef struct
 {
@@ -42,7 +43,6 @@ typedef struct
     TextLine                    filename;
     Mesh                    *   mesh;
     Texture                 *   texture;
-    VkDescriptorSet         *   descriptorSet;
 }Model;
 
 /**
@@ -75,13 +75,28 @@ Model * gf3d_model_load(const char * filename);
  */
 Model * gf3d_model_load_full(const char * modelFile,const char *textureFile);
 
+/**
+ * @brief load a model by its model and texture file paths with a chosen vertex layout
+ * @param modelFile where to find the model obj file
+ * @param textureFile where to find the image for the texture
+ * @param format MVF_Compact trades a little precision for half the vertex bandwidth
+ * @return NULL on error or the model file otherwise.
+ */
+Model * gf3d_model_load_full_format(const char * modelFile,const char *textureFile,MeshVertexFormat format);
+
 /**
  * @brief load a model from config file
- * @param json the json config to parse
+ * @param json the json config to parse, with "model", "texture" and optionally "vertexFormat" ("full" or "compact")
  * @return NULL on error, or the json 
  */
 Model * gf3d_model_load_from_config(SJson *json);
 
+/**
+ * @brief set how far a mesh may be simplified before it looks different
+ * @param bias the screen space error in pixels allowed before a coarser level of detail is drawn, 0 always draws full detail
+ */
+void gf3d_model_set_lod_bias(float bias);
+
 /**
  * @brief queue up a model for rendering
  * @param model the model to render
@@ -91,6 +106,15 @@ Model * gf3d_model_load_from_config(SJson *json);
  */
 void gf3d_model_draw(Model *model,Matrix4 modelMat,Vector4D colorMod,Vector4D ambient);
 
+/**
+ * @brief queue up many copies of a model as instanced draws, one per level of detail in use
+ * @param model the model to render, its mesh and texture are used for every instance
+ * @param instances the model matrix and color modulation of each copy, not modified
+ * @param count how many instances to draw
+ * @param ambient how much ambient light there is
+ */
+void gf3d_model_draw_instanced(Model *model,MeshInstance *instances,Uint32 count,Vector4D ambient);
+
 /**
  * @brief queue up a model for rendering as highlight wireframe
  * @param model the model to render
@@ -18,14 +18,21 @@ typedef struct
     
     Uint32 face_count;
 
-    Face *outFace;
+    Face *outFace;          /**<indices into faceVertices, three per face*/
     
-    Vertex *faceVertices;
+    Vertex *faceVertices;   /**<unique vertices, identical position/normal/texel corners are welded together*/
     Uint32  face_vert_count;
+
+    Vector3D min;       /**<axis aligned bounds of the vertices*/
+    Vector3D max;
+    Vector3D center;    /**<center of the bounding sphere*/
+    float    radius;    /**<radius of the bounding sphere*/
 }ObjData;
 
 /**
  * @brief parse an OBJ file into ObjData;
+ * @note the file is mapped once and split into line aligned chunks that are parsed in parallel.
+ * Faces may use v, v/vt, v//vn or v/vt/vn corners, negative indices, and any polygon, which is fanned into triangles
  * @param filename the name of the file to parse
  * @return NULL on error or ObjData otherwise.  Note: this must be freed with gf3d_obj_free
  */
@@ -33,4 +40,17 @@ ObjData *gf3d_obj_load_from_file(const char *filename);
 
 void gf3d_obj_free(ObjData *obj);
 
+/**
+ * @brief time repeated parses of an OBJ file and log the load time and throughput
+ * @param filename the file to parse
+ * @param iterations how many times to parse it
+ */
+void gf3d_obj_benchmark(const char *filename,Uint32 iterations);
+
+/**
+ * @brief calculate the bounding box and sphere of the obj vertices
+ * @param obj the obj data to update
+ */
+void gf3d_obj_get_bounds(ObjData *obj);
+
 #endif
@@ -38,6 +38,13 @@ void gf3d_particle_submit_pipe_commands();
  */
 void gf3d_particle_draw(Particle *particle);
 
+/**
+ * @brief record a queued particle into the calling thread's particle command buffer
+ * @note called by gf3d_draw_queue_flush
+ * @param uboOffset the offset of the particle's uniform buffer slice, written when it was drawn
+ */
+void gf3d_particle_render_queued(Uint32 uboOffset);
+
 /**
  * @brief draw a list of particles this frame
  * @param list list of GF3D_Particle's
@@ -3,16 +3,19 @@
 
 #include <vulkan/vulkan.h>
 
+#include "simple_json.h"
+
 #include "gfc_types.h"
 
 #include "gf3d_uniform_buffers.h"
 
+#define GF3D_PIPELINE_THREAD_MAX 8  //most recording threads besides the main thread, see gf3d_record.h
+#define GF3D_PIPELINE_BUNDLE_MAX 16 //most pre-recorded command buffers a pipeline executes in a frame, see gf3d_bundle.h
 
 typedef struct
 {
     Bool                    inUse;
     VkPipeline              pipeline;               /**<pipeline handle*/
-    VkRenderPass            renderPass;
     VkPipelineLayout        pipelineLayout;
     char                   *vertShader;             /**<the shader loaded from disk*/
     size_t                  vertSize;               /**<memory size of the shader*/
@@ -21,14 +24,17 @@ typedef struct
     size_t                  fragSize;               /**<memory size of the shader*/
     VkShaderModule          fragModule;             /**<the index of the shader module within the device*/
     VkDevice                device;
-    Uint32                 *descriptorCursor;       /**<keeps track of which descriptors have been used per frame*/
-    VkDescriptorPool       *descriptorPool;
-    VkDescriptorSetLayout   descriptorSetLayout;
-    VkDescriptorSet       **descriptorSets;
-    Uint32                  descriptorPoolCount;
+    VkDescriptorPool        descriptorPool;
+    VkDescriptorSetLayout   descriptorSetLayout;    /**<set 0, the pipeline's uniform data.  Set 1 is the texture material set*/
+    VkDescriptorSet        *descriptorSets;         /**<one set 0 per frame in flight, bound to that frame's uniform ring*/
     Uint32                  descriptorSetCount;
-    UniformBufferList      *uboList;                /**<for draw calls sent through this pipeline*/
-    VkCommandBuffer         commandBuffer;          /**<for current command*/
+    Uint32                  pushConstantSize;       /**<bytes of per draw data pushed to the vertex stage, 0 for none*/
+    Bool                    bindless;               /**<if the fragment shader indexes the bindless texture table, otherwise set 1 is a per texture set*/
+    UniformBufferList      *uboList;                /**<per frame ring of uniform data, one aligned slice per draw call, bound with dynamic offsets*/
+    VkCommandBuffer         commandBuffer;          /**<for current command, recorded on the main thread*/
+    VkCommandBuffer         threadBuffers[GF3D_PIPELINE_THREAD_MAX];/**<begun the first time each recording thread draws with the pipeline this frame*/
+    VkCommandBuffer         bundleBuffers[GF3D_PIPELINE_BUNDLE_MAX];/**<recorded outside the pipeline, executed after its own buffers*/
+    Uint32                  bundleCount;
 
 }Pipeline;
 
@@ -59,11 +65,13 @@ Pipeline *gf3d_pipeline_graphics_load(VkDevice device,const char *vertFile,const
  * @param device the logical device to create the pipeline for
  * @param configFile the filepath to the config file
  * @param extent the screen resolution this pipeline will be working towards
- * @param descriptorCount the number of concurrent descriptSets to be suppert per command, ie: how many models you want to support for a draw call  This should be based on maximum number of supported entities or graphic assets
- * @param vertexInputDescription the vertex input description to use
+ * @param descriptorCount how many uniform slices each frame's ring holds, ie: how many draw calls with their own uniform data you want to support per frame.  This should be based on maximum number of supported entities or graphic assets
+ * @param vertexInputDescription array of vertex input binding descriptions to use
+ * @param vertexBindingCount how many bindings are in vertexInputDescription, ie: 2 for per vertex and per instance data
  * @param vertextInputAttributeDescriptions list of how the attributes are described
  * @param vertexAttributeCount how many of the above are provided in the list
  * @param bufferSize the sizeof() the ubo to be used with this pipeline
+ * @param pushConstantSize the sizeof() the push constant block used by the vertex shader, 0 if it uses none
  * @returns NULL on error (see logs) or a pointer to a pipeline
 */
 Pipeline *gf3d_pipeline_create_from_config(
@@ -72,9 +80,20 @@ Pipeline *gf3d_pipeline_create_from_config(
     VkExtent2D extent,
     Uint32 descriptorCount,
     const VkVertexInputBindingDescription* vertexInputDescription,
+    Uint32 vertexBindingCount,
     const VkVertexInputAttributeDescription * vertextInputAttributeDescriptions,
     Uint32 vertexAttributeCount,
-    VkDeviceSize bufferSize);
+    VkDeviceSize bufferSize,
+    Uint32 pushConstantSize);
+
+/**
+ * @brief create a render pass from config
+ * @param device the logical device to create the render pass for
+ * @param config json object containing colorAttachment, depthAttachment, dependency and subpass descriptions
+ * @param renderPass (output) the created render pass
+ * @return 0 on error, 1 otherwise
+ */
+int gf3d_pipeline_render_pass_create(VkDevice device,SJson *config,VkRenderPass *renderPass);
 
 /**
  * @brief setup a pipeline for rendering a basic sprite
@@ -88,16 +107,17 @@ Pipeline *gf3d_pipeline_create_from_config(
 Pipeline *gf3d_pipeline_basic_sprite_create(VkDevice device,const char *vertFile,const char *fragFile,VkExtent2D extent,Uint32 descriptorCount);
 
 /**
- * @brief get a descriptor set to be used for the pipeline.  Provide the swap chain rendering frame.
+ * @brief get the pipeline's uniform descriptor set (set 0) for a frame in flight.
+ * @note the set is written once when the pipeline is created, select the draw's data with its dynamic offset
  * @param pipe the pipeline to get a descriptSet for
- * @param frame the swap chain rendering frame to get a descriptor set for.
+ * @param frame the frame in flight to get a descriptor set for (see gf3d_vgraphics_get_current_frame)
  */
 VkDescriptorSet * gf3d_pipeline_get_descriptor_set(Pipeline *pipe, Uint32 frame);
 
 /**
- * @brief reset the descriptor Set cursor for the given swap chain frame
+ * @brief rewind the uniform ring for the given frame in flight and begin recording the pipeline's commands
  * @param pipe the pipeline to reset
- * @param frame the swap chain rendering frame to reset the cursor for
+ * @param frame the frame in flight to reset (see gf3d_vgraphics_get_current_frame)
  */
 void gf3d_pipeline_reset_frame(Pipeline *pipe,Uint32 frame);
 
@@ -107,6 +127,26 @@ void gf3d_pipeline_reset_frame(Pipeline *pipe,Uint32 frame);
  */
 void gf3d_pipeline_submit_commands(Pipeline *pipe);
 
+/**
+ * @brief get the command buffer the calling thread records the pipeline's draws into this frame
+ * @note the main thread gets pipe->commandBuffer.  A recording thread gets its own, begun with the pipeline bound on first use
+ * @param pipe the pipeline to draw with
+ * @param started (optional, output) set to 1 if the buffer was just begun, so per frame state has to be bound to it
+ * @return VK_NULL_HANDLE on error, or the command buffer
+ */
+VkCommandBuffer gf3d_pipeline_get_command_buffer(Pipeline *pipe,Bool *started);
+
+/**
+ * @brief execute a command buffer recorded outside the pipeline with its draws this frame, from a bundle recorded in an
+ * earlier frame or the indirect scene's draws
+ * @note call from the thread that renders frames, between reset_frame and submit_commands.
+ * It is executed after the pipeline's own buffers, in the order added
+ * @param pipe the pipeline the command buffer was begun with
+ * @param commandBuffer a secondary begun with gf3d_command_bundle_begin, already ended
+ * @return 0 if the pipeline has no room left this frame, 1 otherwise
+ */
+Bool gf3d_pipeline_add_bundle_buffer(Pipeline *pipe,VkCommandBuffer commandBuffer);
+
 
 VkFormat gf3d_pipeline_find_depth_format();
 
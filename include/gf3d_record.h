@@ -0,0 +1,62 @@
+#ifndef __GF3D_RECORD_H__
+#define __GF3D_RECORD_H__
+
+#include "gfc_types.h"
+
+#include "gf3d_commands.h"
+
+#define GF3D_RECORD_THREAD_MAX GF3D_PIPELINE_THREAD_MAX
+
+/**
+ * @brief a range of draw work, recorded on whichever thread picks it up
+ * @note draws go through gf3d_pipeline_get_command_buffer, so each thread records into its own secondary command buffers
+ * @param data what was passed to gf3d_record_dispatch
+ * @param start the first item to draw
+ * @param end one past the last item to draw
+ */
+typedef void (*RecordJob)(void *data,Uint32 start,Uint32 end);
+
+/**
+ * @brief start the recording threads and their command pools, auto-cleaned up on program exit
+ * @note needs the command system
+ * @param threadCount how many threads record alongside the main thread, 0 to use one less than the cpu count.  Capped at GF3D_RECORD_THREAD_MAX
+ */
+void gf3d_record_init(Uint32 threadCount);
+
+/**
+ * @brief get how many threads record alongside the main thread
+ * @return 0 if all recording happens on the main thread
+ */
+Uint32 gf3d_record_get_thread_count();
+
+/**
+ * @brief get which recording thread the caller is
+ * @return 0 for the main thread (or any thread not started by gf3d_record), 1 to gf3d_record_get_thread_count() for recording threads
+ */
+Uint32 gf3d_record_get_thread();
+
+/**
+ * @brief get the command pool the calling recording thread takes its secondary command buffers from this frame
+ * @return NULL when called from the main thread
+ */
+Command *gf3d_record_get_command_pool();
+
+/**
+ * @brief reset every recording thread's command pool for the frame in flight being started
+ * @note called by gf3d_vgraphics_render_start after the frame's fence has been waited on
+ * @param frame the frame in flight, see gf3d_vgraphics_get_current_frame
+ */
+void gf3d_record_frame_begin(Uint32 frame);
+
+/**
+ * @brief split draw work across the recording threads and the main thread, returning once all of it is recorded
+ * @note items are handed out in chunks, so the order draws land in within a pipeline is not kept.
+ * Work that must draw in order, like the 2D overlay, should not be dispatched.  Called from a job, or from any thread
+ * other than the one calling gf3d_vgraphics_render_start, it runs the work inline
+ * @param job the function that records a range of items
+ * @param data passed to job
+ * @param count how many items there are
+ */
+void gf3d_record_dispatch(RecordJob job,void *data,Uint32 count);
+
+#endif
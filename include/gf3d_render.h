@@ -0,0 +1,138 @@
+#ifndef __GF3D_RENDER_H__
+#define __GF3D_RENDER_H__
+
+#include "gfc_types.h"
+#include "gfc_vector.h"
+#include "gfc_matrix.h"
+#include "gfc_color.h"
+#include "gfc_shape.h"
+
+#include "gf3d_frustum.h"
+#include "gf3d_model.h"
+#include "gf3d_particle.h"
+#include "gf3d_bundle.h"
+#include "gf2d_sprite.h"
+#include "gf2d_font.h"
+
+typedef void (*RenderFreeFunc)(void *data);
+
+/**
+ * @brief set up frame rendering, auto-cleaned up on program exit
+ * @note called by gf3d_vgraphics_init.  With a render thread the thread that called this is the simulation thread:
+ * its draw calls are written into a render packet buffer and replayed, with all of the vulkan work, on the render thread
+ * one frame behind.  Draws from any other thread are recorded directly
+ * @param threaded if true start the render thread, otherwise frames are rendered as they are drawn
+ */
+void gf3d_render_init(Bool threaded);
+
+/**
+ * @brief check if frames are rendered on their own thread
+ * @return 1 if a render thread is running, 0 if frames are rendered by the caller of gf3d_render_frame_end
+ */
+Bool gf3d_render_is_threaded();
+
+/**
+ * @brief start a frame's draws, replaces gf3d_vgraphics_render_start in the game loop
+ * @note the camera view is taken now, so update it first.  With a render thread this waits only when the thread
+ * is still replaying the frame before last
+ */
+void gf3d_render_frame_begin();
+
+/**
+ * @brief finish a frame's draws, replaces gf3d_vgraphics_render_end in the game loop
+ * @note with a render thread the frame is handed off and this returns without waiting for it to be drawn
+ */
+void gf3d_render_frame_end();
+
+/**
+ * @brief wait until the render thread has drawn every frame handed to it
+ * @note call before freeing anything the render thread may be drawing with that is not released through
+ * gf3d_render_defer_free.  Does nothing without a render thread
+ */
+void gf3d_render_wait_idle();
+
+/**
+ * @brief hold back releasing a resource the render packets may still point at
+ * @note models and sprites release through this.  The release runs on the simulation thread once every frame
+ * written up to now has been drawn
+ * @param freeFunc releases the resource
+ * @param data the resource to pass it
+ * @return 1 if the release was deferred, 0 if there is no render thread or the caller is not the simulation thread
+ * and the caller should release it now
+ */
+Bool gf3d_render_defer_free(RenderFreeFunc freeFunc,void *data);
+
+/**
+ * @brief get the view frustum of the frame being drawn
+ * @note on the render thread this is the frustum the frame's packets were written with, not the live camera's
+ * @return a pointer to the frustum, valid until the next frame
+ */
+Frustum *gf3d_render_get_frustum();
+
+/**
+ * @brief get the world space eye position of the frame being drawn
+ * @return the eye position the frame's packets were written with
+ */
+Vector3D gf3d_render_get_eye_position();
+
+/**
+ * @brief write an instanced model draw into the frame's render packets when called from the simulation thread
+ * @note called at the top of gf3d_model_draw_instanced, the instances are copied
+ * @return 1 if the draw was captured and should not be recorded now, 0 otherwise
+ */
+Bool gf3d_render_capture_instanced(Model *model,MeshInstance *instances,Uint32 count,Vector4D ambient);
+
+/**
+ * @brief write a highlight draw into the frame's render packets when called from the simulation thread
+ * @return 1 if the draw was captured and should not be recorded now, 0 otherwise
+ */
+Bool gf3d_render_capture_highlight(Model *model,Matrix4 modelMat,Vector4D highlight);
+
+/**
+ * @brief write a sky draw into the frame's render packets when called from the simulation thread
+ * @return 1 if the draw was captured and should not be recorded now, 0 otherwise
+ */
+Bool gf3d_render_capture_sky(Model *model,Matrix4 modelMat,Color color);
+
+/**
+ * @brief write a particle draw into the frame's render packets when called from the simulation thread
+ * @return 1 if the draw was captured and should not be recorded now, 0 otherwise
+ */
+Bool gf3d_render_capture_particle(Particle *particle);
+
+/**
+ * @brief write a bundle draw into the frame's render packets when called from the simulation thread
+ * @note only the bundle is written, edits to it show up in the next frame the render thread draws
+ * @return 1 if the draw was captured and should not be recorded now, 0 otherwise
+ */
+Bool gf3d_render_capture_bundle(Bundle *bundle);
+
+/**
+ * @brief write a sprite draw into the frame's render packets when called from the simulation thread
+ * @return 1 if the draw was captured and should not be recorded now, 0 otherwise
+ */
+Bool gf3d_render_capture_sprite(Sprite *sprite,Vector2D position,Vector2D scale,Vector3D rotation,Color color,Uint32 frame);
+
+/**
+ * @brief write a rectangle draw into the frame's render packets when called from the simulation thread
+ * @note its image is made on the render thread
+ * @param filled 1 for gf2d_draw_rect_filled, 0 for gf2d_draw_rect
+ * @return 1 if the draw was captured and should not be recorded now, 0 otherwise
+ */
+Bool gf3d_render_capture_rect(Rect rect,Color color,Bool filled);
+
+/**
+ * @brief write a line of text into the frame's render packets when called from the simulation thread
+ * @note the text is copied and rendered to an image on the render thread, which owns the font cache
+ * @return 1 if the draw was captured and should not be recorded now, 0 otherwise
+ */
+Bool gf3d_render_capture_text(char *text,Font *font,Color color,Vector2D position);
+
+/**
+ * @brief write a block of wrapped text into the frame's render packets when called from the simulation thread
+ * @note it is measured and wrapped on the render thread as well
+ * @return 1 if the draw was captured and should not be recorded now, 0 otherwise
+ */
+Bool gf3d_render_capture_text_wrap(char *text,Rect block,Color color,Font *font);
+
+#endif
@@ -4,6 +4,8 @@
 #include <vulkan/vulkan.h>
 #include "gfc_types.h"
 
+#include "gf3d_memory.h"
+
 #include "gf3d_pipeline.h"
 
 /**
@@ -36,9 +38,17 @@ VkFormat gf3d_swapchain_get_format();
 
 /**
  * @brief create frame buffers
- * @param pipe the pipeline to create the frame buffers for
+ * @param renderPass the frame render pass to create the frame buffers for
+ */
+void gf3d_swapchain_setup_frame_buffers(VkRenderPass renderPass);
+
+/**
+ * @brief rebuild the swap chain, its depth image and frame buffers after the surface changed
+ * @note the device must be idle.  The pipelines keep the viewport they were made with
+ * @param renderPass the frame render pass to create the frame buffers for
+ * @return false if the surface has no area (minimized) or the rebuild failed, try again later.  true on success
  */
-void gf3d_swapchain_setup_frame_buffers(Pipeline *pipe);
+Bool gf3d_swapchain_recreate(VkRenderPass renderPass);
 
 /**
  * @brief called at exit to clean up the swap chains
@@ -62,7 +72,7 @@ VkSwapchainKHR gf3d_swapchain_get();
 VkFramebuffer gf3d_swapchain_get_frame_buffer_by_index(Uint32 index);
 
 
-void gf3d_swapchain_create_image(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage* image, VkDeviceMemory* imageMemory);
+void gf3d_swapchain_create_image(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage* image, MemoryAllocation* imageMemory);
 
 void gf3d_swapchain_transition_image_layout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
 
@@ -5,6 +5,8 @@
 #include "gfc_types.h"
 #include "gfc_text.h"
 
+#include "gf3d_memory.h"
+
 typedef struct
 {
     Uint8               _inuse;
@@ -12,9 +14,12 @@ typedef struct
     Uint32              width,height;
     TextLine            filename;
     VkImage             textureImage;
-    VkDeviceMemory      textureImageMemory;
+    MemoryAllocation    textureImageMemory;
     VkImageView         textureImageView;
     VkSampler           textureSampler;
+    VkDescriptorSet     descriptorSet;  /**<material set (set 1) sampling only this texture, written once on load*/
+    Uint32              index;          /**<stable slot of this texture in the bindless texture table*/
+    Uint64              uploadValue;    /**<upload timeline value a frame must wait on before sampling it*/
     SDL_Surface        *surface;    /**<the image data in CPU space*/
 }Texture;
 
@@ -25,6 +30,29 @@ typedef struct
  */
 void gf3d_texture_init(Uint32 max_textures);
 
+/**
+ * @brief get the descriptor set layout pipelines that sample textures use as set 1
+ * @param bindless if the pipeline's fragment shader indexes the bindless table
+ * @note falls back to the per texture layout if the bindless table is not in use
+ * @return a pointer to the layout
+ */
+VkDescriptorSetLayout *gf3d_texture_get_descriptor_set_layout(Bool bindless);
+
+/**
+ * @brief get the set 1 to bind to draw with a texture
+ * @param tex the texture to draw with
+ * @param bindless if the pipeline's fragment shader indexes the bindless table
+ * @return the bindless table if bindless and it is in use, the texture's own material set otherwise
+ */
+VkDescriptorSet gf3d_texture_get_material_set(Texture *tex,Bool bindless);
+
+/**
+ * @brief check if textures are sampled from one bindless table indexed per draw
+ * @note when false each texture has its own material set that is bound when it changes
+ * @return true if the bindless table is in use
+ */
+Bool gf3d_texture_bindless_enabled();
+
 /**
  * @brief load a texture from file.
  * @param filename the path to the file to load
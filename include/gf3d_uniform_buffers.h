@@ -1,23 +1,42 @@
 #ifndef __GF3D_UNIFORM_BUFFERS_H__
 #define __GF3D_UNIFORM_BUFFERS_H__
 
+#include <SDL.h>
 #include <vulkan/vulkan.h>
 
 #include "gfc_types.h"
 
+#include "gf3d_memory.h"
+
+/**
+ * @purpose a slice of a frame's uniform ring buffer handed out for a single draw call
+ */
 typedef struct
 {
-    Uint8                   _inuse;                 /**<if this buffer is currently being used*/
     VkBuffer                uniformBuffer;      /**<buffer handle passed to render calls*/
-    VkDeviceMemory          uniformBufferMemory;/**<buffer memory for updating the data*/
+    Uint32                  offset;             /**<dynamic offset of this slice within uniformBuffer*/
+    void                   *data;               /**<persistently mapped memory to write the ubo data to*/
 }UniformBuffer;
 
+/**
+ * @purpose one ring buffer per frame in flight, persistently mapped
+ */
 typedef struct
 {
-    VkDevice         device;            /**<which device this is configured for*/
-    Uint32           buffer_count;
-    Uint32           buffer_frames;
-    UniformBuffer  **buffers;
+    VkBuffer                buffer;             /**<the whole ring for this frame*/
+    MemoryAllocation        allocation;
+    Uint8                  *mapped;             /**<host address of the start of the ring*/
+    SDL_atomic_t            next;               /**<next free slice this frame, claimed atomically so any recording thread can draw*/
+}UniformBufferFrame;
+
+typedef struct
+{
+    VkDevice            device;            /**<which device this is configured for*/
+    VkDeviceSize        bufferSize;        /**<sizeof() the data stored in each slice*/
+    VkDeviceSize        stride;            /**<bufferSize rounded up to the device's minUniformBufferOffsetAlignment*/
+    Uint32              buffer_count;      /**<how many slices fit in each frame's ring*/
+    Uint32              buffer_frames;
+    UniformBufferFrame *frames;
 }UniformBufferList;
 
 /**
@@ -26,7 +45,7 @@ typedef struct
  * @param bufferSize the sizeof() the data to be stored
  * @param bufferCount how many buffers in the list.  T
  * his should be large enough to support the number of calls per frame you will need
- * @param bufferFrames how many buffer frames to support.  This should match the swap chain length
+ * @param bufferFrames how many buffer frames to support.  This should match the number of frames in flight
  * @return NULL on error, or a new list of uniform buffers
  */
 UniformBufferList *gf3d_uniform_buffer_list_new(VkDevice device,VkDeviceSize bufferSize,Uint32 bufferCount,Uint32 bufferFrames);
@@ -38,12 +57,22 @@ UniformBufferList *gf3d_uniform_buffer_list_new(VkDevice device,VkDeviceSize buf
 void gf3d_uniform_buffer_list_free(UniformBufferList *list);
 
 /**
- * @brief get an unused uniform buffer from the list
+ * @brief bump allocate the next slice of the frame's ring buffer
+ * @note safe to call from any recording thread
  * @param list the list to get it from
  * @param bufferFrame the frame to get it from
- * @return NULL if no more buffers left, or a valid InformBuffer pointer
+ * @param ubo (output) set to the buffer, dynamic offset and mapped pointer of the slice
+ * @return 0 if no more space is left this frame, 1 otherwise
+ */
+int gf3d_uniform_buffer_list_get_buffer(UniformBufferList *list, Uint32 bufferFrame, UniformBuffer *ubo);
+
+/**
+ * @brief get the ring buffer used for a frame, for binding as a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+ * @param list the list to query
+ * @param bufferFrame the frame in question
+ * @return VK_NULL_HANDLE on error, or the buffer
  */
-UniformBuffer *gf3d_uniform_buffer_list_get_buffer(UniformBufferList *list, Uint32 bufferFrame);
+VkBuffer gf3d_uniform_buffer_list_get_frame_buffer(UniformBufferList *list, Uint32 bufferFrame);
 
 /**
  * @brief clear all of the uniform buffers that have been used for the buffer frame
@@ -0,0 +1,113 @@
+#ifndef __GF3D_UPLOAD_H__
+#define __GF3D_UPLOAD_H__
+
+#include <vulkan/vulkan.h>
+
+#include "gfc_types.h"
+
+#include "gf3d_commands.h"
+
+/**
+ * @purpose what a frame submit has to wait on and signal so it sees the uploads it uses
+ */
+typedef struct
+{
+    VkCommandBuffer         acquireBuffer;      /**<queue family ownership acquires to run ahead of the frame, VK_NULL_HANDLE if none*/
+    VkSemaphore             waitSemaphore;      /**<the upload timeline, VK_NULL_HANDLE if the frame needs nothing still in flight*/
+    Uint64                  waitValue;
+    VkPipelineStageFlags    waitStage;
+    VkSemaphore             signalSemaphore;    /**<the frame timeline, later uploads wait on it before overwriting what the frame reads*/
+    Uint64                  signalValue;
+}UploadFrameSync;
+
+/**
+ * @brief set up the staging ring and upload batches, auto-cleaned up on program exit
+ * @note needs the device memory allocator and the command system
+ * @param ringSize bytes of persistently mapped staging memory that uploads are written through
+ * @param frameBudget how many bytes streaming code should upload per frame, see gf3d_upload_budget_check.  0 for no limit
+ */
+void gf3d_upload_init(VkDeviceSize ringSize,VkDeviceSize frameBudget);
+
+/**
+ * @brief queue a copy into a buffer and get the staging memory to write the data to
+ * @note the data must be written before the batch is submitted.  Hold gf3d_upload_lock from before this call until the data is written, otherwise another thread can flush the batch first
+ * @param dst the buffer to copy to, it needs VK_BUFFER_USAGE_TRANSFER_DST_BIT
+ * @param dstOffset where in dst the data goes
+ * @param size how many bytes to copy
+ * @return a pointer to size bytes of mapped staging memory, NULL on failure
+ */
+void *gf3d_upload_buffer_reserve(VkBuffer dst,VkDeviceSize dstOffset,VkDeviceSize size);
+
+/**
+ * @brief queue a copy of host data into a buffer
+ * @param dst the buffer to copy to, it needs VK_BUFFER_USAGE_TRANSFER_DST_BIT
+ * @param dstOffset where in dst the data goes
+ * @param data the data to copy, it is staged right away so it can be freed on return
+ * @param size how many bytes to copy
+ * @return 1 on success, 0 on failure
+ */
+Bool gf3d_upload_buffer(VkBuffer dst,VkDeviceSize dstOffset,const void *data,VkDeviceSize size);
+
+/**
+ * @brief queue a copy of pixels into a whole image, along with its transitions to transfer and then to shader read
+ * @param image a single mip, single layer color image in VK_IMAGE_LAYOUT_UNDEFINED
+ * @param width the image width in pixels
+ * @param height the image height in pixels
+ * @param pixels tightly packed pixel data, it is staged right away so it can be freed on return
+ * @param size how many bytes of pixels there are
+ * @return 1 on success, 0 on failure
+ */
+Bool gf3d_upload_image(VkImage image,Uint32 width,Uint32 height,const void *pixels,VkDeviceSize size);
+
+/**
+ * @brief get the upload timeline value that covers everything queued so far
+ * @note store it with a resource right after uploading it and pass it to gf3d_upload_require when drawing with it
+ * @return the value, 0 when uploads share the graphics queue and need no waiting
+ */
+Uint64 gf3d_upload_get_pending_value();
+
+/**
+ * @brief note that this frame draws with a resource, so the frame waits for its upload on the GPU
+ * @note safe to call from any recording thread
+ * @param value what gf3d_upload_get_pending_value returned after the resource was uploaded
+ */
+void gf3d_upload_require(Uint64 value);
+
+/**
+ * @brief submit everything queued so far in one command buffer.  Does not wait for it
+ */
+void gf3d_upload_flush();
+
+/**
+ * @brief submit everything queued so far and block until the GPU has finished all of it
+ */
+void gf3d_upload_wait();
+
+/**
+ * @brief submit the frame's uploads ahead of its draws, retire finished batches and start a new budget
+ * @note called by gf3d_vgraphics_render_end before the frame is submitted
+ * @param com the frame's command pool, ownership acquires are recorded into one of its primary command buffers
+ * @param sync (output) what the frame submit must wait on and signal
+ */
+void gf3d_upload_frame_end(Command *com,UploadFrameSync *sync);
+
+/**
+ * @brief check if an upload fits in what is left of this frame's budget
+ * @note the first upload of a frame always fits, so large items still make progress
+ * @param size how many bytes the upload would be
+ * @return 1 if it should be done now, 0 if it should wait for a later frame
+ */
+Bool gf3d_upload_budget_check(VkDeviceSize size);
+
+/**
+ * @brief take the upload lock, every upload call takes it as well
+ * @note it can be taken more than once by the same thread, see gf3d_upload_buffer_reserve for why callers need it
+ */
+void gf3d_upload_lock();
+
+/**
+ * @brief release the upload lock taken with gf3d_upload_lock
+ */
+void gf3d_upload_unlock();
+
+#endif
@@ -11,6 +11,15 @@
 #define GF3D_VGRAPHICS_DISCRETE 1
 //Choosing whether to use discrete [1] or integrated graphics [0]
 
+#define GF3D_VGRAPHICS_FRAMES_IN_FLIGHT 2
+//How many frames the CPU is allowed to record ahead of the GPU
+
+#define GF3D_VGRAPHICS_FRAME_COMMAND_BUFFERS 16
+//How many secondary command buffers each frame in flight can record into (one per pipeline is plenty)
+
+#define GF3D_VGRAPHICS_BUNDLE_MAX 32
+//How many pre-recorded static draw bundles can exist at once, each has a command pool per frame in flight
+
 /**
  * @brief init Vulkan / SDL, setup device and initialize infrastructure for 3d graphics
  * @param config json file containing setup information
@@ -34,6 +43,26 @@ void gf3d_vgraphics_render_end();
  */
 Uint32  gf3d_vgraphics_get_current_buffer_frame();
 
+/**
+ * @brief get the frame in flight that is currently being recorded
+ * @note: per frame resources (descriptor pools, uniform buffers, command buffers) should be indexed by this, not the swap chain image
+ * @return a value from 0 to GF3D_VGRAPHICS_FRAMES_IN_FLIGHT - 1
+ */
+Uint32  gf3d_vgraphics_get_current_frame();
+
+/**
+ * @brief get the command pool for the frame in flight that is currently being recorded
+ * @note: it is reset at the start of every frame, so only use it for rendering commands
+ * @return NULL if graphics are not initialized, the command pool otherwise
+ */
+Command *gf3d_vgraphics_get_current_command_pool();
+
+/**
+ * @brief get the render pass that all pipelines draw within each frame
+ * @return VK_NULL_HANDLE if not yet initialized, the render pass otherwise
+ */
+VkRenderPass gf3d_vgraphics_get_render_pass();
+
 /**
  * @brief After initialization 
  */
@@ -78,7 +107,7 @@ UniformBufferObject gf3d_vgraphics_get_uniform_buffer_object();
 Pipeline *gf3d_vgraphics_get_graphics_overlay_pipeline();
 
 /**
- * @brief get a command from the graphics command pool
+ * @brief get the command pool used for one off commands (uploads, layout transitions)
  * @return NULL if non are left, or an empty command
  */
 Command *gf3d_vgraphics_get_graphics_command_pool();
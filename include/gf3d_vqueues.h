@@ -70,4 +70,15 @@ VkQueue gf3d_vqueues_get_present_queue();
  */
 VkQueue gf3d_vqueues_get_transfer_queue();
 
+/**
+ * @brief take the lock every queue submit, present and wait idle is made under
+ * @note queues need external synchronization and uploads are submitted from the simulation thread while the render thread submits frames
+ */
+void gf3d_vqueues_lock();
+
+/**
+ * @brief release the lock taken with gf3d_vqueues_lock
+ */
+void gf3d_vqueues_unlock();
+
 #endif
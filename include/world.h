@@ -22,6 +22,7 @@ typedef struct
     Color color;
     List *spawnList;        //entities to spawn
     List *entityList;       //entities that exist in the world
+    List *props;            //static models, drawn through the indirect scene
 }World;
 
 World *world_load(char *filename);
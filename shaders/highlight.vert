@@ -2,12 +2,15 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
     mat4 view;
     mat4 proj;
-    vec4 highlight;
 } ubo;
 
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+    vec4 highlight;
+} pc;
+
 out gl_PerVertex
 {
     vec4 gl_Position;
@@ -23,9 +26,9 @@ layout (location = 2) out vec4 outColor;
 void main()
 {
     vec4 tempNormal;
-    tempNormal = ubo.view * ubo.model * vec4(inNormal,1.0);
+    tempNormal = ubo.view * pc.model * vec4(inNormal,1.0);
     fragNormal = tempNormal.xyz;
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    gl_Position = ubo.proj * ubo.view * pc.model * vec4(inPosition, 1.0);
     fragTexCoord = inTexCoord;
-    outColor = ubo.highlight;
+    outColor = pc.highlight;
 }
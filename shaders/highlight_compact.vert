@@ -0,0 +1,46 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+    vec4 highlight;
+    vec4 positionScale;     //size of the mesh bounds
+    vec4 positionOffset;    //minimum of the mesh bounds
+} pc;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+layout(location = 0) in vec4 inPosition;        //unorm16 within the mesh bounds
+layout(location = 1) in vec2 inNormal;          //octahedral, snorm16
+layout(location = 2) in vec2 inTexCoord;        //half float
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) out vec2 fragTexCoord;
+layout (location = 2) out vec4 outColor;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += (n.x >= 0.0) ? -t : t;
+    n.y += (n.y >= 0.0) ? -t : t;
+    return normalize(n);
+}
+
+void main()
+{
+    vec4 tempNormal;
+    vec3 position = pc.positionOffset.xyz + inPosition.xyz * pc.positionScale.xyz;
+    tempNormal = ubo.view * pc.model * vec4(octDecode(inNormal),1.0);
+    fragNormal = tempNormal.xyz;
+    gl_Position = ubo.proj * ubo.view * pc.model * vec4(position, 1.0);
+    fragTexCoord = inTexCoord;
+    outColor = pc.highlight;
+}
@@ -2,12 +2,16 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
     mat4 view;
     mat4 proj;
-    vec4 color;
 } ubo;
 
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+    vec4 color;
+    uint textureIndex;
+} pc;
+
 out gl_PerVertex
 {
     vec4 gl_Position;
@@ -18,10 +22,12 @@ layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
 layout(location = 0) out vec2 fragTexCoord;
 layout(location = 1) out vec4 colorMod;
+layout(location = 2) flat out uint textureIndex;
 
 void main()
 {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    gl_Position = ubo.proj * ubo.view * pc.model * vec4(inPosition, 1.0);
     fragTexCoord = inTexCoord;
-    colorMod = ubo.color;
+    colorMod = pc.color;
+    textureIndex = pc.textureIndex;
 }
@@ -1,7 +1,7 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 1) uniform sampler2D texSampler;
+layout(set = 1, binding = 0) uniform sampler2D texSampler;
 layout(location = 0) in vec2 fragTexCoord;
 layout(location = 1) in vec4 colorMod;
 layout(location = 2) in float drawOrder;
@@ -10,6 +10,7 @@ layout(binding = 0) uniform UniformBufferObject {
     vec2 scale;
     vec2 frame_offset;
     float drawOrder;
+    uint textureIndex;
 } ubo;
 
 out gl_PerVertex
@@ -22,6 +23,7 @@ layout(location = 1) in vec2 inTexCoord;
 layout(location = 0) out vec2 fragTexCoord;
 layout(location = 1) out vec4 colorMod;
 layout(location = 2) out float drawOrder;
+layout(location = 3) flat out uint textureIndex;
 
 void main()
 {
@@ -40,4 +42,5 @@ void main()
     fragTexCoord = inTexCoord + ubo.frame_offset;
     colorMod = ubo.colorMod;
     drawOrder = ubo.drawOrder;
+    textureIndex = ubo.textureIndex;
 }
@@ -0,0 +1,19 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) in vec4 colorMod;
+layout(location = 2) in float drawOrder;
+layout(location = 3) flat in uint textureIndex;
+
+layout(location = 0) out vec4 outColor;
+
+
+void main()
+{
+    vec4 texColor = texture(textures[nonuniformEXT(textureIndex)], fragTexCoord);
+    outColor = texColor * colorMod;
+    gl_FragDepth = drawOrder;
+}
@@ -3,14 +3,29 @@
 
 #include "simple_logger.h"
 
+#include "gf3d_camera.h"
+#include "gf3d_record.h"
+
 #include "entity.h"
 
+#define ENTITY_DRAW_BATCH_MAX 256   //larger batches are split so they spread across the recording threads
+
 typedef struct
 {
     Entity *entity_list;
     Uint32  entity_count;
     Model   *cube;
-    
+    Entity **draw_list;     /**<scratch list of visible entities, sorted into batches each frame*/
+    MeshInstance *instances;/**<scratch instance data, each batch writes the slice matching its draw_list range*/
+    Uint32 *batch_start;    /**<where each batch begins in draw_list, plus one past the last*/
+    Uint32  batch_count;
+    float  *cull_x;         /**<packed world space bounding spheres of the draw candidates*/
+    float  *cull_y;
+    float  *cull_z;
+    float  *cull_radius;
+    Uint8  *cull_visible;   /**<frustum test results for the draw candidates*/
+    Uint32  visible_count;  /**<entities that passed the frustum test last draw*/
+    Uint32  culled_count;   /**<entities rejected by the frustum test last draw*/
 }EntityManager;
 
 static EntityManager entity_manager = {0};
@@ -23,6 +38,14 @@ void entity_system_close()
         entity_free(&entity_manager.entity_list[i]);        
     }
     free(entity_manager.entity_list);
+    free(entity_manager.draw_list);
+    free(entity_manager.instances);
+    free(entity_manager.batch_start);
+    free(entity_manager.cull_x);
+    free(entity_manager.cull_y);
+    free(entity_manager.cull_z);
+    free(entity_manager.cull_radius);
+    free(entity_manager.cull_visible);
     memset(&entity_manager,0,sizeof(EntityManager));
     slog("entity_system closed");
 }
@@ -35,6 +58,22 @@ void entity_system_init(Uint32 maxEntities)
         slog("failed to allocate entity list, cannot allocate ZERO entities");
         return;
     }
+    entity_manager.draw_list = gfc_allocate_array(sizeof(Entity *),maxEntities);
+    entity_manager.instances = gfc_allocate_array(sizeof(MeshInstance),maxEntities);
+    entity_manager.batch_start = gfc_allocate_array(sizeof(Uint32),maxEntities + 1);
+    entity_manager.cull_x = gfc_allocate_array(sizeof(float),maxEntities);
+    entity_manager.cull_y = gfc_allocate_array(sizeof(float),maxEntities);
+    entity_manager.cull_z = gfc_allocate_array(sizeof(float),maxEntities);
+    entity_manager.cull_radius = gfc_allocate_array(sizeof(float),maxEntities);
+    entity_manager.cull_visible = gfc_allocate_array(sizeof(Uint8),maxEntities);
+    if ((!entity_manager.draw_list)||(!entity_manager.instances)||(!entity_manager.batch_start)||
+        (!entity_manager.cull_x)||(!entity_manager.cull_y)||(!entity_manager.cull_z)||
+        (!entity_manager.cull_radius)||(!entity_manager.cull_visible))
+    {
+        slog("failed to allocate entity draw lists");
+        entity_system_close();
+        return;
+    }
     entity_manager.entity_count = maxEntities;
     atexit(entity_system_close);
     slog("entity_system initialized");
@@ -72,11 +111,15 @@ void entity_free(Entity *self)
 }
 
 
-void entity_draw(Entity *self)
+/**
+ * @brief fill in the instance data an entity is drawn with and queue its highlight if it is selected
+ * @return 0 if the entity is not to be drawn, 1 otherwise
+ */
+static Bool entity_draw_instance(Entity *self,MeshInstance *instance)
 {
-    if (!self)return;
-    if (self->hidden)return;
-    gf3d_model_draw(self->model,self->modelMat,gfc_color_to_vector4f(self->color),vector4d(1,1,1,1));
+    if ((!self)||(self->hidden)||(!self->model))return 0;
+    gfc_matrix_copy(instance->model,self->modelMat);
+    instance->color = gfc_color_to_vector4f(self->color);
     if (self->selected)
     {
         gf3d_model_draw_highlight(
@@ -84,19 +127,111 @@ void entity_draw(Entity *self)
             self->modelMat,
             gfc_color_to_vector4f(self->selectedColor));
     }
+    return 1;
+}
+
+void entity_draw(Entity *self)
+{
+    MeshInstance instance;
+    if (!entity_draw_instance(self,&instance))return;
+    gf3d_model_draw(self->model,instance.model,instance.color,vector4d(1,1,1,1));
+}
+
+/**
+ * @brief models are loaded per entity, so batches are formed by the mesh and texture they share
+ */
+static int entity_draw_compare(const void *a, const void *b)
+{
+    Model *ma = (*(Entity **)a)->model;
+    Model *mb = (*(Entity **)b)->model;
+    if (ma->mesh != mb->mesh)return ((size_t)ma->mesh < (size_t)mb->mesh) ? -1 : 1;
+    if (ma->texture != mb->texture)return ((size_t)ma->texture < (size_t)mb->texture) ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief record a range of the sorted batches, called from any recording thread
+ */
+static void entity_draw_batches(void *data,Uint32 start,Uint32 end)
+{
+    Uint32 b,i;
+    Model *batch;
+    MeshInstance *instances;
+    for (b = start; b < end; b++)
+    {
+        batch = entity_manager.draw_list[entity_manager.batch_start[b]]->model;
+        instances = &entity_manager.instances[entity_manager.batch_start[b]];
+        for (i = entity_manager.batch_start[b]; i < entity_manager.batch_start[b + 1]; i++)
+        {
+            // hidden entities never make it into the draw list, so every one here fills its slot
+            entity_draw_instance(entity_manager.draw_list[i],&instances[i - entity_manager.batch_start[b]]);
+        }
+        gf3d_model_draw_instanced(batch,instances,entity_manager.batch_start[b + 1] - entity_manager.batch_start[b],vector4d(1,1,1,1));
+    }
 }
 
 void entity_draw_all()
 {
-    int i;
+    int i,j;
+    Uint32 drawCount = 0;
+    Uint32 candidateCount = 0;
+    Entity *ent;
+    Model *batch;
+    Vector3D center;
     for (i = 0; i < entity_manager.entity_count; i++)
     {
-        if (!entity_manager.entity_list[i]._inuse)// not used yet
+        ent = &entity_manager.entity_list[i];
+        if (!ent->_inuse)// not used yet
         {
             continue;// skip this iteration of the loop
         }
-        entity_draw(&entity_manager.entity_list[i]);
+        if ((ent->hidden)||(!ent->model)||(!ent->model->mesh))continue;
+        entity_manager.cull_radius[candidateCount] = gf3d_frustum_transform_sphere(
+            ent->modelMat,
+            ent->model->mesh->center,
+            ent->model->mesh->radius,
+            &center);
+        entity_manager.cull_x[candidateCount] = center.x;
+        entity_manager.cull_y[candidateCount] = center.y;
+        entity_manager.cull_z[candidateCount] = center.z;
+        entity_manager.draw_list[candidateCount++] = ent;
+    }
+    entity_manager.visible_count = gf3d_frustum_cull_spheres(
+        gf3d_camera_get_frustum(),
+        entity_manager.cull_x,
+        entity_manager.cull_y,
+        entity_manager.cull_z,
+        entity_manager.cull_radius,
+        candidateCount,
+        entity_manager.cull_visible);
+    entity_manager.culled_count = candidateCount - entity_manager.visible_count;
+    for (i = 0; i < candidateCount; i++)
+    {
+        if (!entity_manager.cull_visible[i])continue;
+        entity_manager.draw_list[drawCount++] = entity_manager.draw_list[i];
+    }
+    if (!drawCount)return;
+    qsort(entity_manager.draw_list,drawCount,sizeof(Entity *),entity_draw_compare);
+    entity_manager.batch_count = 0;
+    for (i = 0; i < drawCount; i = j)
+    {
+        batch = entity_manager.draw_list[i]->model;
+        for (j = i; (j < drawCount)&&(j - i < ENTITY_DRAW_BATCH_MAX); j++)
+        {
+            ent = entity_manager.draw_list[j];
+            if ((ent->model->mesh != batch->mesh)||(ent->model->texture != batch->texture))break;
+        }
+        entity_manager.batch_start[entity_manager.batch_count++] = i;
     }
+    entity_manager.batch_start[entity_manager.batch_count] = drawCount;
+    // batches write disjoint instance slices, so they can be recorded on any thread in any order
+    gf3d_record_dispatch(entity_draw_batches,NULL,entity_manager.batch_count);
+}
+
+void entity_get_cull_stats(Uint32 *visible, Uint32 *culled)
+{
+    if (visible)*visible = entity_manager.visible_count;
+    if (culled)*culled = entity_manager.culled_count;
 }
 
 void entity_think(Entity *self)
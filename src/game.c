@@ -12,6 +12,10 @@
 #include "gf3d_camera.h"
 #include "gf3d_texture.h"
 #include "gf3d_particle.h"
+#include "gf3d_obj_load.h"
+#include "gf3d_memory.h"
+#include "gf3d_render.h"
+#include "gf3d_bundle.h"
 
 #include "gf2d_sprite.h"
 #include "gf2d_font.h"
@@ -27,6 +31,7 @@ extern int __DEBUG;
 int main(int argc,char *argv[])
 {
     int done = 0;
+    int objbench = 0;
     int a;
     
     Sprite *mouse = NULL;
@@ -38,6 +43,13 @@ int main(int argc,char *argv[])
     Particle particle[100];
     Matrix4 skyMat;
     Model *sky;
+    Bundle *staticScene;
+    Uint32 visibleCount = 0,culledCount = 0;
+    Uint32 clustersDrawn = 0,clustersCulled = 0;
+    TextLine cullStats;
+    TextLine clusterStats;
+    MemoryStats memoryStats;
+    TextLine memoryLine;
 
     for (a = 1; a < argc;a++)
     {
@@ -45,9 +57,20 @@ int main(int argc,char *argv[])
         {
             __DEBUG = 1;
         }
+        else if (strcmp(argv[a],"--objbench") == 0)
+        {
+            objbench = 1;
+        }
     }
     
     init_logger("gf3d.log",0);    
+    if (objbench)
+    {
+        gf3d_obj_benchmark("models/testworld.obj",10);
+        gf3d_obj_benchmark("models/dino/dino.obj",10);
+        slog_sync();
+        return 0;
+    }
     gfc_input_init("config/input.cfg");
     slog("gf3d begin");
     gf3d_vgraphics_init("config/setup.cfg");
@@ -90,13 +113,15 @@ int main(int argc,char *argv[])
     sky = gf3d_model_load("models/sky.model");
     gfc_matrix_identity(skyMat);
     gfc_matrix_scale(skyMat,vector3d(100,100,100));
+    // the sky never moves, so it is recorded once instead of every frame
+    staticScene = gf3d_bundle_new();
+    gf3d_bundle_add_sky(staticScene,sky,skyMat,gfc_color(1,1,1,1));
     
     // main game loop
     slog("gf3d main loop begin");
     while(!done)
     {
         gfc_input_update();
-        gf2d_font_update();
         SDL_GetMouseState(&mousex,&mousey);
         
         mouseFrame += 0.01;
@@ -105,12 +130,11 @@ int main(int argc,char *argv[])
         entity_think_all();
         entity_update_all();
         gf3d_camera_update_view();
-        gf3d_camera_get_view_mat4(gf3d_vgraphics_get_view_matrix());
 
-        gf3d_vgraphics_render_start();
+        gf3d_render_frame_begin();
 
             //3D draws
-                gf3d_model_draw_sky(sky,skyMat,gfc_color(1,1,1,1));
+                gf3d_bundle_draw(staticScene);
                 world_draw(w);
                 entity_draw_all();
                 
@@ -124,12 +148,28 @@ int main(int argc,char *argv[])
                 
                 gf2d_draw_rect(gfc_rect(10 ,10,1000,32),gfc_color8(255,255,255,255));
                 
+                entity_get_cull_stats(&visibleCount,&culledCount);
+                snprintf(cullStats,sizeof(TextLine),"entities visible: %u culled: %u",visibleCount,culledCount);
+                gf2d_font_draw_line_tag(cullStats,FT_Small,gfc_color(1,1,1,1), vector2d(10,46));
+                gf3d_mesh_get_cluster_stats(&clustersDrawn,&clustersCulled);
+                snprintf(clusterStats,sizeof(TextLine),"mesh clusters drawn: %u culled: %u",clustersDrawn,clustersCulled);
+                gf2d_font_draw_line_tag(clusterStats,FT_Small,gfc_color(1,1,1,1), vector2d(10,62));
+                gf3d_memory_get_stats(&memoryStats);
+                snprintf(memoryLine,sizeof(TextLine),"gpu memory: %u blocks %.1f/%.1f MiB %.0f%% fragmented",
+                    memoryStats.blockCount,
+                    memoryStats.bytesUsed / (1024.0 * 1024.0),
+                    memoryStats.bytesReserved / (1024.0 * 1024.0),
+                    memoryStats.fragmentation * 100.0);
+                gf2d_font_draw_line_tag(memoryLine,FT_Small,gfc_color(1,1,1,1), vector2d(10,78));
+                
                 gf2d_sprite_draw(mouse,vector2d(mousex,mousey),vector2d(2,2),vector3d(8,8,0),gfc_color(0.3,.9,1,0.9),(Uint32)mouseFrame);
-        gf3d_vgraphics_render_end();
+        gf3d_render_frame_end();
 
         if (gfc_input_command_down("exit"))done = 1; // exit condition
     }    
     
+    gf3d_render_wait_idle();
+    gf3d_bundle_free(staticScene);
     world_delete(w);
     
     vkDeviceWaitIdle(gf3d_vgraphics_get_default_logical_device());    
@@ -3,6 +3,7 @@
 #include "gfc_list.h"
 
 #include "gf3d_vgraphics.h"
+#include "gf3d_render.h"
 
 #include "gf2d_sprite.h"
 #include "gf2d_draw.h"
@@ -113,6 +114,7 @@ void gf2d_draw_rect(Rect rect,Color color)
     Shape shape;
     DrawImage *image = NULL;
     
+    if (gf3d_render_capture_rect(rect,color,0))return;
     shape = gfc_shape_from_rect(gfc_rect(0,0,rect.w,rect.h));
     image = gf2d_draw_image_get(shape,0);
     if (image)
@@ -151,6 +153,7 @@ void gf2d_draw_rect_filled(Rect rect,Color color)
     Shape shape;
     DrawImage *image = NULL;
     
+    if (gf3d_render_capture_rect(rect,color,1))return;
     shape = gfc_shape_from_rect(gfc_rect(0,0,rect.w,rect.h));
     image = gf2d_draw_image_get(shape,1);
     if (image)
@@ -7,6 +7,8 @@
 
 #include "gf3d_vgraphics.h"
 #include "gf3d_texture.h"
+#include "gf3d_upload.h"
+#include "gf3d_render.h"
 #include "gf2d_sprite.h"
 #include "gf2d_font.h"
 
@@ -37,6 +39,8 @@ void gf2d_font_close()
 {
     int i,c;
     FontImage *image;
+    // text packets point at the fonts, so the render thread has to be done with them
+    gf3d_render_wait_idle();
     for (i = 0;i < font_manager.font_max;i++)
     {
         if (font_manager.font_list[i].font != NULL)
@@ -356,6 +360,8 @@ void gf2d_font_draw_line(char *text,Font *font,Color color, Vector2D position)
     SDL_Surface *surface;
     Sprite *sprite;
     FontImage *image;
+    int w = 0,h = 0;
+    if (gf3d_render_capture_text(text,font,color,position))return;
     if (!text)
     {
         slog("cannot draw text, none provided");
@@ -376,6 +382,10 @@ void gf2d_font_draw_line(char *text,Font *font,Color color, Vector2D position)
         return;
     }
 
+    // new text is streamed in, so a burst of it waits for the next frame instead of stalling this one
+    TTF_SizeUTF8(font->font, text, &w,&h);
+    if (!gf3d_upload_budget_check((VkDeviceSize)w * h * 4))return;
+
     surface = TTF_RenderUTF8_Blended(font->font, text, gfc_color_to_sdl(color));
     if (!surface)
     {
@@ -559,6 +569,7 @@ void gf2d_font_draw_text_wrap(
     int i;
     int space;
     int lindex = 0;
+    if (gf3d_render_capture_text_wrap(thetext,block,color,font))return;
     if ((thetext == NULL)||(thetext[0] == '\0'))
     {
         slog("no text provided for draw.");
@@ -3,6 +3,8 @@
 #include "gfc_types.h"
 
 #include "gf3d_buffers.h"
+#include "gf3d_upload.h"
+#include "gf3d_render.h"
 #include "gf3d_swapchain.h"
 #include "gf3d_vgraphics.h"
 #include "gf3d_pipeline.h"
@@ -21,6 +23,7 @@ typedef struct
     Vector2D scale;
     Vector2D frame_offset;
     float drawOrder;
+    Uint32 textureIndex;    /**<slot in the bindless texture table*/
 }SpriteUBO;
 
 typedef struct
@@ -42,16 +45,17 @@ typedef struct
     VkDevice        device;           /**<logical vulkan device*/
     Pipeline       *pipe;             /**<the pipeline associated with sprite rendering*/
     VkBuffer        faceBuffer;       /**<memory handle for the face buffer (always two faces)*/
-    VkDeviceMemory  faceBufferMemory; /**<memory habdle for tge face memory*/
+    MemoryAllocation faceBufferMemory; /**<memory habdle for tge face memory*/
+    Uint64          faceUploadValue;  /**<upload timeline value the face buffer is ready at*/
     VkVertexInputAttributeDescription   attributeDescriptions[SPRITE_ATTRIBUTE_COUNT];
     VkVertexInputBindingDescription     bindingDescription;
     float           drawOrder;
+    VkDescriptorSet boundMaterial;    /**<texture set last bound this frame*/
 }SpriteManager;
 
-void gf2d_sprite_update_basic_descriptor_set(
+void gf2d_sprite_update_uniform_buffer(
     Sprite *sprite,
-    VkDescriptorSet descriptorSet,
-    Uint32 chainIndex,
+    UniformBuffer *ubo,
     Vector2D position,
     Vector2D scale,
     Vector3D rotation,
@@ -76,14 +80,9 @@ void gf2d_sprite_manager_close()
     }
     if (gf2d_sprite.faceBuffer != VK_NULL_HANDLE)
     {
-        vkDestroyBuffer(gf2d_sprite.device, gf2d_sprite.faceBuffer, NULL);
+        gf3d_buffer_free(&gf2d_sprite.faceBuffer, &gf2d_sprite.faceBufferMemory);
         slog("sprite manager face buffer freed");
     }
-    if (gf2d_sprite.faceBufferMemory != VK_NULL_HANDLE)
-    {
-        vkFreeMemory(gf2d_sprite.device, gf2d_sprite.faceBufferMemory, NULL);
-        slog("sprite manager face buffer memory freed");
-    }
 
     memset(&gf2d_sprite,0,sizeof(SpriteManager));
     slog("sprite manager closed");
@@ -91,12 +90,9 @@ void gf2d_sprite_manager_close()
 
 void gf2d_sprite_manager_init(Uint32 max_sprites)
 {
-    void* data;
     Uint32 count;
     SpriteFace faces[2];
     size_t bufferSize;    
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
 
     if (max_sprites == 0)
     {
@@ -118,18 +114,14 @@ void gf2d_sprite_manager_init(Uint32 max_sprites)
 
     bufferSize = sizeof(SpriteFace) * 2;
     
-    gf3d_buffer_create(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
-
-    vkMapMemory(gf2d_sprite.device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, faces, (size_t) bufferSize);
-    vkUnmapMemory(gf2d_sprite.device, stagingBufferMemory);
+    gf3d_buffer_create_device_local(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &gf2d_sprite.faceBuffer, &gf2d_sprite.faceBufferMemory);
 
-    gf3d_buffer_create(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &gf2d_sprite.faceBuffer, &gf2d_sprite.faceBufferMemory);
-
-    gf3d_buffer_copy(stagingBuffer, gf2d_sprite.faceBuffer, bufferSize);
-
-    vkDestroyBuffer(gf2d_sprite.device, stagingBuffer, NULL);
-    vkFreeMemory(gf2d_sprite.device, stagingBufferMemory, NULL);
+    if (gf2d_sprite.faceBufferMemory.mapped)memcpy(gf2d_sprite.faceBufferMemory.mapped, faces, bufferSize);
+    else
+    {
+        gf3d_upload_buffer(gf2d_sprite.faceBuffer, 0, faces, bufferSize);
+        gf2d_sprite.faceUploadValue = gf3d_upload_get_pending_value();
+    }
 
     gf2d_sprite_get_attribute_descriptions(&count);
     gf2d_sprite.pipe = gf3d_pipeline_create_from_config(
@@ -138,9 +130,11 @@ void gf2d_sprite_manager_init(Uint32 max_sprites)
         gf3d_vgraphics_get_view_extent(),
         max_sprites,
         gf2d_sprite_get_bind_description(),
+        1,
         gf2d_sprite_get_attribute_descriptions(NULL),
         count,
-        sizeof(SpriteUBO)
+        sizeof(SpriteUBO),
+        0
     );     
     
     slog("sprite manager initiliazed");
@@ -149,10 +143,11 @@ void gf2d_sprite_manager_init(Uint32 max_sprites)
 
 void gf3d_sprite_reset_pipes()
 {
-    Uint32 bufferFrame = gf3d_vgraphics_get_current_buffer_frame();
+    Uint32 bufferFrame = gf3d_vgraphics_get_current_frame();
     
     gf3d_pipeline_reset_frame(gf2d_sprite.pipe,bufferFrame);
     gf2d_sprite.drawOrder = 0;
+    gf2d_sprite.boundMaterial = VK_NULL_HANDLE;
 }
 
 void gf3d_sprite_submit_pipe_commands()
@@ -254,34 +249,36 @@ Sprite * gf2d_sprite_load(const char * filename,int frame_width,int frame_height
     return sprite;
 }
 
-void gf2d_sprite_free(Sprite *sprite)
+static void gf2d_sprite_release(void *data)
 {
-    if (!sprite)return;
+    Sprite *sprite = (Sprite *)data;
     sprite->_inuse--;
     if (sprite->_inuse <= 0)gf2d_sprite_delete(sprite);
 }
 
+void gf2d_sprite_free(Sprite *sprite)
+{
+    if (!sprite)return;
+    // a frame captured for the render thread may still draw with it
+    if (gf3d_render_defer_free(gf2d_sprite_release,sprite))return;
+    gf2d_sprite_release(sprite);
+}
+
 void gf2d_sprite_delete(Sprite *sprite)
 {
     if (!sprite)return;
     
-    if (sprite->buffer != VK_NULL_HANDLE)
-    {
-        vkDestroyBuffer(gf2d_sprite.device, sprite->buffer, NULL);
-    }
-    if (sprite->bufferMemory != VK_NULL_HANDLE)
-    {
-        vkFreeMemory(gf2d_sprite.device, sprite->bufferMemory, NULL);
-    }
+    gf3d_buffer_free(&sprite->buffer, &sprite->bufferMemory);
 
     gf3d_texture_free(sprite->texture);
     memset(sprite,0,sizeof(Sprite));
 }
 
 
-void gf2d_sprite_render(Sprite *sprite,VkCommandBuffer commandBuffer, VkDescriptorSet * descriptorSet)
+void gf2d_sprite_render(Sprite *sprite,VkCommandBuffer commandBuffer, VkDescriptorSet * descriptorSet, Uint32 uboOffset)
 {
     VkDeviceSize offsets[] = {0};
+    VkDescriptorSet material = VK_NULL_HANDLE;
     Pipeline *pipe;
     if (!sprite)
     {
@@ -289,11 +286,21 @@ void gf2d_sprite_render(Sprite *sprite,VkCommandBuffer commandBuffer, VkDescript
         return;
     }
     pipe = gf2d_sprite_get_pipeline();
+    gf3d_upload_require(sprite->uploadValue);
+    gf3d_upload_require(gf2d_sprite.faceUploadValue);
+    if (sprite->texture)gf3d_upload_require(sprite->texture->uploadValue);
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, &sprite->buffer, offsets);
     
     vkCmdBindIndexBuffer(commandBuffer, gf2d_sprite.faceBuffer, 0, VK_INDEX_TYPE_UINT32);
     
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe->pipelineLayout, 0, 1, descriptorSet, 0, NULL);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe->pipelineLayout, 0, 1, descriptorSet, 1, &uboOffset);
+    
+    if (sprite->texture)material = gf3d_texture_get_material_set(sprite->texture,pipe->bindless);
+    if ((material != VK_NULL_HANDLE)&&(material != gf2d_sprite.boundMaterial))
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe->pipelineLayout, 1, 1, &material, 0, NULL);
+        gf2d_sprite.boundMaterial = material;
+    }
     
     vkCmdDrawIndexed(commandBuffer, 6, 1, 0, 0, 0);
 }
@@ -303,8 +310,10 @@ void gf2d_sprite_draw(Sprite *sprite,Vector2D position,Vector2D scale,Vector3D r
 {
     VkDescriptorSet *descriptorSet = NULL;
     Uint32 buffer_frame;
+    UniformBuffer ubo = {0};
     VkCommandBuffer commandBuffer;
 
+    if (gf3d_render_capture_sprite(sprite,position,scale,rotation,color,frame))return;
     if (!sprite)
     {
         slog("cannot render a NULL sprite");
@@ -312,34 +321,26 @@ void gf2d_sprite_draw(Sprite *sprite,Vector2D position,Vector2D scale,Vector3D r
     }
     
     commandBuffer = gf2d_sprite.pipe->commandBuffer;
-    buffer_frame = gf3d_vgraphics_get_current_buffer_frame();
+    buffer_frame = gf3d_vgraphics_get_current_frame();
 
     descriptorSet = gf3d_pipeline_get_descriptor_set(gf2d_sprite.pipe, buffer_frame);
     if (descriptorSet == NULL)
     {
-        slog("failed to get a free descriptor Set for sprite rendering");
+        slog("failed to get the frame descriptor Set for sprite rendering");
         return;
     }
-    
-    gf2d_sprite_update_basic_descriptor_set(
-        sprite,
-        *descriptorSet,
-        buffer_frame,
-        position,
-        scale,
-        rotation,
-        color,
-        frame);
-    gf2d_sprite_render(sprite,commandBuffer,descriptorSet);
+    if (!gf3d_uniform_buffer_list_get_buffer(gf2d_sprite.pipe->uboList, buffer_frame, &ubo))
+    {
+        slog("failed to get a free uniform buffer for sprite rendering");
+        return;
+    }
+    gf2d_sprite_update_uniform_buffer(sprite,&ubo,position,scale,rotation,color,frame);
+    gf2d_sprite_render(sprite,commandBuffer,descriptorSet,ubo.offset);
 }
 
 void gf2d_sprite_create_vertex_buffer(Sprite *sprite)
 {
-    void *data = NULL;
-    VkDevice device = gf2d_sprite.device;
     size_t bufferSize;
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
     SpriteVertex vertices[] = {
         {
             {0,0},
@@ -360,18 +361,14 @@ void gf2d_sprite_create_vertex_buffer(Sprite *sprite)
     };
     bufferSize = sizeof(SpriteVertex) * 4;
     
-    gf3d_buffer_create(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
-    
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices, (size_t) bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    gf3d_buffer_create(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT|VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &sprite->buffer, &sprite->bufferMemory);
+    gf3d_buffer_create_device_local(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT|VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &sprite->buffer, &sprite->bufferMemory);
 
-    gf3d_buffer_copy(stagingBuffer, sprite->buffer, bufferSize);
-
-    vkDestroyBuffer(device, stagingBuffer, NULL);
-    vkFreeMemory(device, stagingBufferMemory, NULL);    
+    if (sprite->bufferMemory.mapped)memcpy(sprite->bufferMemory.mapped, vertices, bufferSize);
+    else
+    {
+        gf3d_upload_buffer(sprite->buffer, 0, vertices, bufferSize);
+        sprite->uploadValue = gf3d_upload_get_pending_value();
+    }
 }
 
 void gf2d_sprite_update_uniform_buffer(
@@ -383,7 +380,6 @@ void gf2d_sprite_update_uniform_buffer(
     Color color,
     Uint32 frame)
 {
-    void* data;
     SpriteUBO spriteUBO = {0};
     spriteUBO.size = vector2d(sprite->frameWidth,sprite->frameHeight);
     spriteUBO.extent = gf3d_vgraphics_get_view_extent_as_vector2d();;
@@ -399,98 +395,9 @@ void gf2d_sprite_update_uniform_buffer(
     gf2d_sprite.drawOrder += 0.000000001;
     spriteUBO.frame_offset.x = (frame%sprite->framesPerLine * sprite->frameWidth)/(float)sprite->texture->width;
     spriteUBO.frame_offset.y = (frame/sprite->framesPerLine * sprite->frameHeight)/(float)sprite->texture->height;
-    
-    vkMapMemory(gf2d_sprite.device, ubo->uniformBufferMemory, 0, sizeof(SpriteUBO), 0, &data);
-    
-        memcpy(data, &spriteUBO, sizeof(SpriteUBO));
-
-    vkUnmapMemory(gf2d_sprite.device, ubo->uniformBufferMemory);
-}
+    spriteUBO.textureIndex = sprite->texture->index;
 
-void gf2d_sprite_update_basic_descriptor_set(
-    Sprite *sprite,
-    VkDescriptorSet descriptorSet,
-    Uint32 chainIndex,
-    Vector2D position,
-    Vector2D scale,
-    Vector3D rotation,
-    Color color,
-    Uint32 frame)
-{
-    VkDescriptorImageInfo imageInfo = {0};
-    VkWriteDescriptorSet descriptorWrite[2] = {0};
-    VkDescriptorBufferInfo bufferInfo = {0};
-    UniformBuffer *ubo;
-
-    if (!sprite)
-    {
-        slog("no sprite provided for descriptor set update");
-        return;
-    }
-    if (descriptorSet == VK_NULL_HANDLE)
-    {
-        slog("null handle provided for descriptorSet");
-        return;
-    }
-
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = sprite->texture->textureImageView;
-    imageInfo.sampler = sprite->texture->textureSampler;
-
-    ubo = gf3d_uniform_buffer_list_get_buffer(gf2d_sprite.pipe->uboList, chainIndex);
-    gf2d_sprite_update_uniform_buffer(sprite,ubo,position,scale,rotation,color,frame);
-
-    bufferInfo.buffer = ubo->uniformBuffer;
-    bufferInfo.offset = 0;
-    bufferInfo.range = sizeof(SpriteUBO);        
-    
-    descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite[0].dstSet = descriptorSet;
-    descriptorWrite[0].dstBinding = 0;
-    descriptorWrite[0].dstArrayElement = 0;
-    descriptorWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrite[0].descriptorCount = 1;
-    descriptorWrite[0].pBufferInfo = &bufferInfo;
-
-    descriptorWrite[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite[1].dstSet = descriptorSet;
-    descriptorWrite[1].dstBinding = 1;
-    descriptorWrite[1].dstArrayElement = 0;
-    descriptorWrite[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrite[1].descriptorCount = 1;                        
-    descriptorWrite[1].pImageInfo = &imageInfo;
-    descriptorWrite[1].pTexelBufferView = NULL; // Optional
-
-    vkUpdateDescriptorSets(gf2d_sprite.device, 2, descriptorWrite, 0, NULL);
-}
-
-VkVertexInputBindingDescription * gf2d_sprite_get_bind_description()
-{
-    gf2d_sprite.bindingDescription.binding = 0;
-    gf2d_sprite.bindingDescription.stride = sizeof(SpriteVertex);
-    gf2d_sprite.bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-    return &gf2d_sprite.bindingDescription;
-}
-
-VkVertexInputAttributeDescription * gf2d_sprite_get_attribute_descriptions(Uint32 *count)
-{
-    gf2d_sprite.attributeDescriptions[0].binding = 0;
-    gf2d_sprite.attributeDescriptions[0].location = 0;
-    gf2d_sprite.attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-    gf2d_sprite.attributeDescriptions[0].offset = offsetof(SpriteVertex, vertex);
-    
-    gf2d_sprite.attributeDescriptions[1].binding = 0;
-    gf2d_sprite.attributeDescriptions[1].location = 1;
-    gf2d_sprite.attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
-    gf2d_sprite.attributeDescriptions[1].offset = offsetof(SpriteVertex, texel);
-    if (count)*count = SPRITE_ATTRIBUTE_COUNT;
-    return gf2d_sprite.attributeDescriptions;
-}
-
-Pipeline *gf2d_sprite_get_pipeline()
-{
-    return gf2d_sprite.pipe;
+    memcpy(ubo->data, &spriteUBO, sizeof(SpriteUBO));
 }
 
 /*eol@eof*/
@@ -4,11 +4,18 @@
 #include "gf3d_buffers.h"
 
 void gf3d_buffer_copy(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+{
+    gf3d_buffer_copy_region(srcBuffer, dstBuffer, 0, 0, size);
+}
+
+void gf3d_buffer_copy_region(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size)
 {
     VkBufferCopy copyRegion = {0};
 
     VkCommandBuffer commandBuffer = gf3d_command_begin_single_time(gf3d_vgraphics_get_graphics_command_pool());
     
+        copyRegion.srcOffset = srcOffset;
+        copyRegion.dstOffset = dstOffset;
         copyRegion.size = size;
         vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
@@ -16,11 +23,16 @@ void gf3d_buffer_copy(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
     
 }
 
-int gf3d_buffer_create(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer * buffer, VkDeviceMemory * bufferMemory)
+static int gf3d_buffer_create_usage(
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    MemoryUsage memoryUsage,
+    VkBuffer * buffer,
+    MemoryAllocation * allocation)
 {
     VkBufferCreateInfo bufferInfo = {0};
     VkMemoryRequirements memRequirements;
-    VkMemoryAllocateInfo allocInfo = {0};
 
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
@@ -35,19 +47,58 @@ int gf3d_buffer_create(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryProp
 
     vkGetBufferMemoryRequirements(gf3d_vgraphics_get_default_logical_device(), *buffer, &memRequirements);
 
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = gf3d_vgraphics_find_memory_type(memRequirements.memoryTypeBits, properties);
-
-    
-    if (vkAllocateMemory(gf3d_vgraphics_get_default_logical_device(), &allocInfo, NULL, bufferMemory) != VK_SUCCESS)
+    if (!gf3d_memory_allocate(&memRequirements, properties, memoryUsage, 0, allocation))
     {
         slog("failed to allocate buffer memory!");
+        vkDestroyBuffer(gf3d_vgraphics_get_default_logical_device(), *buffer, NULL);
+        *buffer = VK_NULL_HANDLE;
         return 0;
     }
 
-    vkBindBufferMemory(gf3d_vgraphics_get_default_logical_device(), *buffer, *bufferMemory, 0);
+    vkBindBufferMemory(gf3d_vgraphics_get_default_logical_device(), *buffer, allocation->memory, allocation->offset);
     return 1;
 }
 
+int gf3d_buffer_create(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer * buffer, MemoryAllocation * allocation)
+{
+    return gf3d_buffer_create_usage(size, usage, properties, MU_Default, buffer, allocation);
+}
+
+int gf3d_buffer_create_device_local(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer * buffer, MemoryAllocation * allocation)
+{
+    if ((gf3d_memory_device_local_is_host_visible())&&
+        (gf3d_buffer_create_usage(
+            size,
+            usage,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            MU_Default,
+            buffer,
+            allocation)))
+    {
+        return 1;
+    }
+    return gf3d_buffer_create_usage(size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MU_Default, buffer, allocation);
+}
+
+int gf3d_buffer_create_staging(VkDeviceSize size, VkBuffer * buffer, MemoryAllocation * allocation)
+{
+    return gf3d_buffer_create_usage(
+        size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        MU_Transient,
+        buffer,
+        allocation);
+}
+
+void gf3d_buffer_free(VkBuffer * buffer, MemoryAllocation * allocation)
+{
+    if ((buffer)&&(*buffer != VK_NULL_HANDLE))
+    {
+        vkDestroyBuffer(gf3d_vgraphics_get_default_logical_device(), *buffer, NULL);
+        *buffer = VK_NULL_HANDLE;
+    }
+    gf3d_memory_free(allocation);
+}
+
 /*eol@eof*/
@@ -0,0 +1,358 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "simple_logger.h"
+
+#include "gf3d_buffers.h"
+#include "gf3d_upload.h"
+#include "gf3d_render.h"
+#include "gf3d_bundle.h"
+
+typedef struct
+{
+    Bundle     *bundle_list;
+    Uint32      bundle_max;
+}BundleManager;
+
+static BundleManager gf3d_bundle = {0};
+
+void gf3d_bundle_delete(Bundle *bundle);
+
+void gf3d_bundle_close()
+{
+    int i;
+    if (gf3d_bundle.bundle_list != NULL)
+    {
+        // closed before the frames are, so the last of them may still be executing the buffers
+        vkDeviceWaitIdle(gf3d_vgraphics_get_default_logical_device());
+        for (i = 0; i < gf3d_bundle.bundle_max; i++)
+        {
+            gf3d_bundle_delete(&gf3d_bundle.bundle_list[i]);
+        }
+        free(gf3d_bundle.bundle_list);
+    }
+    memset(&gf3d_bundle,0,sizeof(BundleManager));
+    slog("bundle manager closed");
+}
+
+void gf3d_bundle_init(Uint32 max_bundles)
+{
+    if (!max_bundles)
+    {
+        slog("cannot initialize a bundle manager for 0 bundles");
+        return;
+    }
+    gf3d_bundle.bundle_list = (Bundle *)gfc_allocate_array(sizeof(Bundle),max_bundles);
+    if (!gf3d_bundle.bundle_list)
+    {
+        slog("failed to allocate bundle list");
+        return;
+    }
+    gf3d_bundle.bundle_max = max_bundles;
+    slog("bundle manager initialized");
+    atexit(gf3d_bundle_close);
+}
+
+void gf3d_bundle_delete(Bundle *bundle)
+{
+    int i;
+    if ((!bundle)||(!bundle->_inuse))return;
+    for (i = 0; i < GF3D_VGRAPHICS_FRAMES_IN_FLIGHT; i++)
+    {
+        gf3d_command_free(bundle->frames[i].commandPool);
+        gf3d_buffer_free(&bundle->frames[i].instanceBuffer,&bundle->frames[i].instanceAllocation);
+    }
+    if (bundle->lock)SDL_DestroyMutex(bundle->lock);
+    if (bundle->draws)free(bundle->draws);
+    memset(bundle,0,sizeof(Bundle));
+}
+
+Bundle *gf3d_bundle_new()
+{
+    int i,f;
+    Bundle *bundle;
+    for (i = 0; i < gf3d_bundle.bundle_max; i++)
+    {
+        if (gf3d_bundle.bundle_list[i]._inuse)continue;
+        bundle = &gf3d_bundle.bundle_list[i];
+        memset(bundle,0,sizeof(Bundle));
+        bundle->_inuse = 1;
+        bundle->version = 1;
+        bundle->lock = SDL_CreateMutex();
+        if (!bundle->lock)
+        {
+            slog("failed to create bundle lock: %s",SDL_GetError());
+            gf3d_bundle_delete(bundle);
+            return NULL;
+        }
+        for (f = 0; f < GF3D_VGRAPHICS_FRAMES_IN_FLIGHT; f++)
+        {
+            // a pool of its own, so recording the bundle again never touches the frame's buffers
+            bundle->frames[f].commandPool = gf3d_command_graphics_pool_setup(0);
+            if ((!bundle->frames[f].commandPool)||
+                (!gf3d_command_pool_add_secondary_buffers(bundle->frames[f].commandPool,GF3D_BUNDLE_PIPE_MAX)))
+            {
+                slog("failed to set up bundle command pool");
+                gf3d_bundle_delete(bundle);
+                return NULL;
+            }
+        }
+        return bundle;
+    }
+    slog("failed to get a new bundle, out of space");
+    return NULL;
+}
+
+void gf3d_bundle_free(Bundle *bundle)
+{
+    if ((!bundle)||(!bundle->_inuse))return;
+    gf3d_render_wait_idle();
+    vkDeviceWaitIdle(gf3d_vgraphics_get_default_logical_device());
+    gf3d_bundle_delete(bundle);
+}
+
+void gf3d_bundle_clear(Bundle *bundle)
+{
+    if ((!bundle)||(!bundle->_inuse))return;
+    SDL_LockMutex(bundle->lock);
+    bundle->drawCount = 0;
+    bundle->version++;
+    SDL_UnlockMutex(bundle->lock);
+}
+
+/**
+ * @brief claim the next draw of a bundle, growing the list if it is full
+ * @note the bundle must be locked
+ * @return NULL on error, or the draw, zeroed
+ */
+static BundleDraw *gf3d_bundle_draw_new(Bundle *bundle)
+{
+    BundleDraw *draws;
+    Uint32 drawMax;
+    if (bundle->drawCount >= bundle->drawMax)
+    {
+        drawMax = bundle->drawMax ? bundle->drawMax * 2 : 16;
+        draws = (BundleDraw *)realloc(bundle->draws,sizeof(BundleDraw) * drawMax);
+        if (!draws)
+        {
+            slog("failed to grow bundle to %i draws",drawMax);
+            return NULL;
+        }
+        bundle->draws = draws;
+        bundle->drawMax = drawMax;
+    }
+    memset(&bundle->draws[bundle->drawCount],0,sizeof(BundleDraw));
+    return &bundle->draws[bundle->drawCount++];
+}
+
+Bool gf3d_bundle_add_model(Bundle *bundle,Model *model,Matrix4 modelMat,Vector4D colorMod,Vector4D ambientLight)
+{
+    BundleDraw *draw;
+    if ((!bundle)||(!bundle->_inuse)||(!model)||(!model->mesh))return 0;
+    SDL_LockMutex(bundle->lock);
+    draw = gf3d_bundle_draw_new(bundle);
+    if (draw)
+    {
+        draw->model = model;
+        gfc_matrix_copy(draw->instance.model,modelMat);
+        vector4d_copy(draw->instance.color,colorMod);
+        vector4d_copy(draw->ambient,ambientLight);
+        bundle->version++;
+    }
+    SDL_UnlockMutex(bundle->lock);
+    return draw != NULL;
+}
+
+Bool gf3d_bundle_add_sky(Bundle *bundle,Model *model,Matrix4 modelMat,Color color)
+{
+    BundleDraw *draw;
+    if ((!bundle)||(!bundle->_inuse)||(!model)||(!model->mesh))return 0;
+    SDL_LockMutex(bundle->lock);
+    draw = gf3d_bundle_draw_new(bundle);
+    if (draw)
+    {
+        draw->model = model;
+        draw->sky = 1;
+        gfc_matrix_copy(draw->instance.model,modelMat);
+        draw->instance.color = gfc_color_to_vector4f(color);
+        bundle->version++;
+    }
+    SDL_UnlockMutex(bundle->lock);
+    return draw != NULL;
+}
+
+void gf3d_bundle_draw(Bundle *bundle)
+{
+    if ((!bundle)||(!bundle->_inuse))return;
+    if (gf3d_render_capture_bundle(bundle))return;
+    SDL_AtomicSet(&bundle->queued,1);
+}
+
+static Pipeline *gf3d_bundle_get_pipe(BundleDraw *draw)
+{
+    if (draw->sky)return gf3d_mesh_get_sky_pipeline();
+    if (draw->model->mesh->vertexFormat == MVF_Compact)return gf3d_mesh_get_compact_pipeline();
+    return gf3d_mesh_get_pipeline();
+}
+
+/**
+ * @brief check if a frame's buffers are still good for this frame: recorded from the current draws, reading this frame's uniform slices
+ */
+static Bool gf3d_bundle_frame_is_current(Bundle *bundle,BundleFrame *frame)
+{
+    Uint32 i;
+    if (frame->version != bundle->version)return 0;
+    for (i = 0; i < frame->pipeCount; i++)
+    {
+        if (frame->uboOffsets[i] != gf3d_mesh_get_frame_ubo_offset(frame->pipes[i]))return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief make sure a frame's instance buffer holds every draw of the bundle and write them to it
+ * @note the frame's fence has been waited on, so the GPU is not reading it
+ */
+static Bool gf3d_bundle_write_instances(Bundle *bundle,BundleFrame *frame)
+{
+    Uint32 i,instanceMax;
+    MeshInstance *mapped;
+    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (bundle->drawCount > frame->instanceMax)
+    {
+        gf3d_buffer_free(&frame->instanceBuffer,&frame->instanceAllocation);
+        frame->instanceMax = 0;
+        for (instanceMax = 16; instanceMax < bundle->drawCount; instanceMax *= 2);
+        // read every frame it is drawn, so keep it in the GPU's own memory when that can be mapped
+        if (gf3d_memory_device_local_is_host_visible())properties |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        if (!gf3d_buffer_create(
+            sizeof(MeshInstance) * instanceMax,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            properties,
+            &frame->instanceBuffer,
+            &frame->instanceAllocation))
+        {
+            slog("failed to create bundle instance buffer");
+            return 0;
+        }
+        frame->instanceMax = instanceMax;
+    }
+    mapped = (MeshInstance *)frame->instanceAllocation.mapped;
+    if (!mapped)return 0;
+    for (i = 0; i < bundle->drawCount; i++)
+    {
+        memcpy(&mapped[i],&bundle->draws[i].instance,sizeof(MeshInstance));
+    }
+    return 1;
+}
+
+/**
+ * @brief record a bundle's draws into the current frame's buffers, one per pipeline
+ * @note the bundle must be locked
+ */
+static void gf3d_bundle_record(Bundle *bundle,BundleFrame *frame,Uint32 bufferFrame)
+{
+    Uint32 i,p,count;
+    Pipeline *pipe;
+    BundleDraw *draw;
+    Mesh *mesh;
+    MeshBindState bound[GF3D_BUNDLE_PIPE_MAX];
+    MeshPushConstants constants;
+    SkyPushConstants skyConstants;
+
+    frame->version = 0;
+    frame->pipeCount = 0;
+    frame->uploadValue = 0;
+    gf3d_command_pool_reset(frame->commandPool);
+    if (!bundle->drawCount)
+    {
+        frame->version = bundle->version;
+        return;
+    }
+    if (!gf3d_bundle_write_instances(bundle,frame))return;
+    for (i = 0; i < bundle->drawCount; i += count)
+    {
+        draw = &bundle->draws[i];
+        mesh = draw->model->mesh;
+        count = 1;
+        pipe = gf3d_bundle_get_pipe(draw);
+        for (p = 0; p < frame->pipeCount; p++)
+        {
+            if (frame->pipes[p] == pipe)break;
+        }
+        if (p == frame->pipeCount)
+        {
+            frame->buffers[p] = gf3d_command_bundle_begin(frame->commandPool,pipe);
+            if (frame->buffers[p] == VK_NULL_HANDLE)break;
+            frame->pipes[p] = pipe;
+            frame->uboOffsets[p] = gf3d_mesh_get_frame_ubo_offset(pipe);
+            frame->pipeCount++;
+            gf3d_mesh_bind_state_clear(&bound[p]);
+            gf3d_mesh_bind_pipe_state(pipe,frame->buffers[p],bufferFrame,draw->sky ? VK_NULL_HANDLE : frame->instanceBuffer);
+        }
+        if (mesh->uploadValue > frame->uploadValue)frame->uploadValue = mesh->uploadValue;
+        if ((draw->model->texture)&&(draw->model->texture->uploadValue > frame->uploadValue))
+        {
+            frame->uploadValue = draw->model->texture->uploadValue;
+        }
+        if (draw->sky)
+        {
+            gfc_matrix_copy(skyConstants.model,draw->instance.model);
+            vector4d_copy(skyConstants.color,draw->instance.color);
+            skyConstants.textureIndex = draw->model->texture ? draw->model->texture->index : 0;
+            gf3d_mesh_render_bundle_sky(mesh,frame->buffers[p],draw->model->texture,&skyConstants,&bound[p]);
+            continue;
+        }
+        // the instances sit in draw order, so a run of the same model and ambient is one instanced draw
+        while ((i + count < bundle->drawCount)&&
+            (!bundle->draws[i + count].sky)&&
+            (bundle->draws[i + count].model == draw->model)&&
+            (memcmp(&bundle->draws[i + count].ambient,&draw->ambient,sizeof(Vector4D)) == 0))
+        {
+            count++;
+        }
+        memset(&constants,0,sizeof(MeshPushConstants));
+        vector4d_copy(constants.ambient,draw->ambient);
+        constants.textureIndex = draw->model->texture ? draw->model->texture->index : 0;
+        gf3d_mesh_render_bundle_instances(mesh,frame->buffers[p],draw->model->texture,&constants,i,count,&bound[p]);
+    }
+    for (p = 0; p < frame->pipeCount; p++)
+    {
+        gf3d_command_rendering_end(frame->buffers[p]);
+    }
+    // a buffer that could not be begun leaves the frame unrecorded, to be tried again next time
+    if (i < bundle->drawCount)
+    {
+        frame->pipeCount = 0;
+        return;
+    }
+    frame->version = bundle->version;
+}
+
+void gf3d_bundle_flush()
+{
+    Uint32 i,p,bufferFrame;
+    Bundle *bundle;
+    BundleFrame *frame;
+    bufferFrame = gf3d_vgraphics_get_current_frame();
+    for (i = 0; i < gf3d_bundle.bundle_max; i++)
+    {
+        bundle = &gf3d_bundle.bundle_list[i];
+        if (!bundle->_inuse)continue;
+        if (!SDL_AtomicSet(&bundle->queued,0))continue;
+        frame = &bundle->frames[bufferFrame];
+        SDL_LockMutex(bundle->lock);
+        if (!gf3d_bundle_frame_is_current(bundle,frame))
+        {
+            gf3d_bundle_record(bundle,frame,bufferFrame);
+        }
+        SDL_UnlockMutex(bundle->lock);
+        gf3d_upload_require(frame->uploadValue);
+        for (p = 0; p < frame->pipeCount; p++)
+        {
+            gf3d_pipeline_add_bundle_buffer(frame->pipes[p],frame->buffers[p]);
+        }
+    }
+}
+
+/*eol@eof*/
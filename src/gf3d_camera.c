@@ -6,6 +6,32 @@
 
 static Camera gf3d_camera = {0};
 
+void gf3d_camera_update_frustum()
+{
+    Matrix4 *view = &gf3d_camera.cameraMat;
+    gf3d_frustum_from_view_proj(&gf3d_camera.frustum,gf3d_camera.cameraMat,gf3d_camera.projection);
+    // the view is a rotation then a translation, so the eye is the translation rotated back and negated
+    gf3d_camera.eye.x = -((*view)[0][0] * (*view)[3][0] + (*view)[0][1] * (*view)[3][1] + (*view)[0][2] * (*view)[3][2]);
+    gf3d_camera.eye.y = -((*view)[1][0] * (*view)[3][0] + (*view)[1][1] * (*view)[3][1] + (*view)[1][2] * (*view)[3][2]);
+    gf3d_camera.eye.z = -((*view)[2][0] * (*view)[3][0] + (*view)[2][1] * (*view)[3][1] + (*view)[2][2] * (*view)[3][2]);
+}
+
+void gf3d_camera_set_projection(Matrix4 projection)
+{
+    memcpy(gf3d_camera.projection,projection,sizeof(Matrix4));
+    gf3d_camera_update_frustum();
+}
+
+Frustum *gf3d_camera_get_frustum()
+{
+    return &gf3d_camera.frustum;
+}
+
+Vector3D gf3d_camera_get_eye_position()
+{
+    return gf3d_camera.eye;
+}
+
 
 void gf3d_camera_get_view_mat4(Matrix4 *view)
 {
@@ -17,6 +43,7 @@ void gf3d_camera_set_view_mat4(Matrix4 *view)
 {
     if (!view)return;
     memcpy(gf3d_camera.cameraMat,view,sizeof(Matrix4));
+    gf3d_camera_update_frustum();
 }
 
 void gf3d_camera_look_at(
@@ -31,6 +58,7 @@ void gf3d_camera_look_at(
         target,
         up
     );
+    gf3d_camera_update_frustum();
 }
 
 void gf3d_camera_update_view()
@@ -69,7 +97,7 @@ void gf3d_camera_update_view()
     gf3d_camera.cameraMat[3][0] = vector3d_dot_product(xaxis, position);
     gf3d_camera.cameraMat[3][1] = vector3d_dot_product(yaxis, position);
     gf3d_camera.cameraMat[3][2] = vector3d_dot_product(zaxis, position);
-        
+    gf3d_camera_update_frustum();
 }
 
 void gf3d_camera_set_position(Vector3D position)
@@ -25,7 +25,7 @@ static CommandManager gf3d_commands = {0};
 void gf3d_command_pool_close();
 void gf3d_command_free(Command *com);
 void gf3d_command_buffer_begin(Command *com,Pipeline *pipe);
-void gf3d_command_configure_render_pass(VkCommandBuffer commandBuffer, VkRenderPass renderPass,VkFramebuffer framebuffer,VkPipeline graphicsPipeline,VkPipelineLayout pipelineLayout);
+void gf3d_command_configure_render_pass(VkCommandBuffer commandBuffer, VkRenderPass renderPass,VkFramebuffer framebuffer);
 
 void gf3d_command_system_close()
 {
@@ -82,11 +82,33 @@ void gf3d_command_free(Command *com)
     {
         free(com->commandBuffers);
     }
+    if (com->secondaryBuffers)
+    {
+        free(com->secondaryBuffers);
+    }
+    if (com->secondaryPipes)
+    {
+        free(com->secondaryPipes);
+    }
+    if (com->executeBuffers)
+    {
+        free(com->executeBuffers);
+    }
     memset(com,0,sizeof(Command));
 }
 
 
 Command * gf3d_command_graphics_pool_setup(Uint32 count)
+{
+    return gf3d_command_pool_setup(count,gf3d_vqueues_get_graphics_queue_family());
+}
+
+Command * gf3d_command_transfer_pool_setup(Uint32 count)
+{
+    return gf3d_command_pool_setup(count,gf3d_vqueues_get_transfer_queue_family());
+}
+
+Command * gf3d_command_pool_setup(Uint32 count,Uint32 queueFamily)
 {
     Command *com;
     VkCommandPoolCreateInfo poolInfo = {0};
@@ -100,7 +122,7 @@ Command * gf3d_command_graphics_pool_setup(Uint32 count)
     }
     
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.queueFamilyIndex = gf3d_vqueues_get_graphics_queue_family();
+    poolInfo.queueFamilyIndex = queueFamily;
     poolInfo.flags = 0; // Optional    
     
     if (vkCreateCommandPool(gf3d_commands.device, &poolInfo, NULL, &com->commandPool) != VK_SUCCESS)
@@ -109,6 +131,12 @@ Command * gf3d_command_graphics_pool_setup(Uint32 count)
         return NULL;
     }
     
+    if (!count)
+    {
+        slog("created command buffer pool");
+        return com;
+    }
+    
     com->commandBuffers = (VkCommandBuffer*)gfc_allocate_array(sizeof(VkCommandBuffer),count);
     if (!com->commandBuffers)
     {
@@ -134,6 +162,50 @@ Command * gf3d_command_graphics_pool_setup(Uint32 count)
     return com;
 }
 
+int gf3d_command_pool_add_secondary_buffers(Command *com,Uint32 count)
+{
+    VkCommandBufferAllocateInfo allocInfo = {0};
+    if ((!com)||(!count))return 0;
+    if (com->secondaryBuffers)
+    {
+        slog("command pool already has secondary command buffers");
+        return 0;
+    }
+    com->secondaryBuffers = (VkCommandBuffer*)gfc_allocate_array(sizeof(VkCommandBuffer),count);
+    com->secondaryPipes = (Pipeline**)gfc_allocate_array(sizeof(Pipeline*),count);
+    // every secondary may be followed by one buffer from each recording thread and the pipeline's bundles
+    com->executeBuffers = (VkCommandBuffer*)gfc_allocate_array(sizeof(VkCommandBuffer),count * (GF3D_PIPELINE_THREAD_MAX + GF3D_PIPELINE_BUNDLE_MAX + 1));
+    if ((!com->secondaryBuffers)||(!com->secondaryPipes)||(!com->executeBuffers))
+    {
+        slog("failed to allocate secondary command buffer array");
+        if (com->secondaryBuffers)free(com->secondaryBuffers);
+        if (com->secondaryPipes)free(com->secondaryPipes);
+        if (com->executeBuffers)free(com->executeBuffers);
+        com->secondaryBuffers = NULL;
+        com->secondaryPipes = NULL;
+        com->executeBuffers = NULL;
+        return 0;
+    }
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = com->commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = count;
+
+    if (vkAllocateCommandBuffers(gf3d_commands.device, &allocInfo, com->secondaryBuffers) != VK_SUCCESS)
+    {
+        slog("failed to allocate secondary command buffers!");
+        free(com->secondaryBuffers);
+        free(com->secondaryPipes);
+        free(com->executeBuffers);
+        com->secondaryBuffers = NULL;
+        com->secondaryPipes = NULL;
+        com->executeBuffers = NULL;
+        return 0;
+    }
+    com->secondaryBufferCount = count;
+    return 1;
+}
+
 VkCommandBuffer * gf3d_command_pool_get_used_buffers(Command *com)
 {
     if (!com)return NULL;
@@ -149,7 +221,9 @@ Uint32 gf3d_command_pool_get_used_buffer_count(Command *com)
 void gf3d_command_pool_reset(Command *com)
 {
     if (!com)return;
+    vkResetCommandPool(gf3d_commands.device, com->commandPool, 0);
     com->commandBufferNext = 0;
+    com->secondaryBufferNext = 0;
 }
 
 VkCommandBuffer gf3d_command_get_graphics_buffer(Command *com)
@@ -163,34 +237,150 @@ VkCommandBuffer gf3d_command_get_graphics_buffer(Command *com)
     return com->commandBuffers[com->commandBufferNext++];
 }
 
+VkCommandBuffer gf3d_command_get_secondary_buffer(Command *com)
+{
+    if (!com)return VK_NULL_HANDLE;
+    if (com->secondaryBufferNext >= com->secondaryBufferCount)
+    {
+        slog("out of secondary command buffers for the command pool");
+        return VK_NULL_HANDLE;
+    }
+    return com->secondaryBuffers[com->secondaryBufferNext++];
+}
+
 void gf3d_command_configure_render_pass_end(VkCommandBuffer commandBuffer)
 {
     vkCmdEndRenderPass(commandBuffer);
 }
 
 VkCommandBuffer gf3d_command_rendering_begin(Uint32 index,Pipeline *pipe)
+{
+    return gf3d_command_rendering_begin_from_pool(gf3d_vgraphics_get_current_command_pool(),index,pipe);
+}
+
+VkCommandBuffer gf3d_command_rendering_begin_from_pool(Command *com,Uint32 index,Pipeline *pipe)
 {
     VkCommandBuffer commandBuffer;
+    VkCommandBufferInheritanceInfo inheritanceInfo = {0};
+    VkCommandBufferBeginInfo beginInfo = {0};
+    
+    if ((!com)||(!pipe))return VK_NULL_HANDLE;
+    commandBuffer = gf3d_command_get_secondary_buffer(com);
+    if (commandBuffer == VK_NULL_HANDLE)
+    {
+        slog("failed to get a command buffer for rendering");
+        return VK_NULL_HANDLE;
+    }
+    com->secondaryPipes[com->secondaryBufferNext - 1] = pipe;
+    
+    // every pipeline draws inside the one frame render pass begun in gf3d_command_execute_render_pass
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = gf3d_vgraphics_get_render_pass();
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = gf3d_swapchain_get_frame_buffer_by_index(index);
     
-    commandBuffer = gf3d_command_begin_single_time(gf3d_vgraphics_get_graphics_command_pool());
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
     
-    gf3d_command_configure_render_pass(
-            commandBuffer,
-            pipe->renderPass,
-            gf3d_swapchain_get_frame_buffer_by_index(index),
-            pipe->pipeline,
-            pipe->pipelineLayout);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe->pipeline);
+    
+    return commandBuffer;
+}
+
+VkCommandBuffer gf3d_command_bundle_begin(Command *com,Pipeline *pipe)
+{
+    VkCommandBuffer commandBuffer;
+    VkCommandBufferInheritanceInfo inheritanceInfo = {0};
+    VkCommandBufferBeginInfo beginInfo = {0};
+    
+    if ((!com)||(!pipe))return VK_NULL_HANDLE;
+    commandBuffer = gf3d_command_get_secondary_buffer(com);
+    if (commandBuffer == VK_NULL_HANDLE)
+    {
+        slog("failed to get a command buffer for a bundle");
+        return VK_NULL_HANDLE;
+    }
+    com->secondaryPipes[com->secondaryBufferNext - 1] = pipe;
+    
+    // no framebuffer, so it can be executed whichever swap chain image the frame renders to
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = gf3d_vgraphics_get_render_pass();
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+    
+    // not one time submit, it is executed again every frame until it is recorded over
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe->pipeline);
     
     return commandBuffer;
 }
 
 void gf3d_command_rendering_end(VkCommandBuffer commandBuffer)
 {
+    if (commandBuffer == VK_NULL_HANDLE)return;
+    vkEndCommandBuffer(commandBuffer);
+}
+
+VkCommandBuffer gf3d_command_execute_render_pass(Command *com,VkRenderPass renderPass,VkFramebuffer framebuffer)
+{
+    Uint32 i,t,executeCount = 0;
+    Pipeline *pipe;
+    VkCommandBuffer commandBuffer;
+    VkCommandBufferBeginInfo beginInfo = {0};
+    
+    if (!com)return VK_NULL_HANDLE;
+    commandBuffer = gf3d_command_get_graphics_buffer(com);
+    if (commandBuffer == VK_NULL_HANDLE)
+    {
+        slog("failed to get a primary command buffer for the frame");
+        return VK_NULL_HANDLE;
+    }
+    
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    
+    gf3d_command_configure_render_pass(commandBuffer,renderPass,framebuffer);
+    
+    // secondaries were handed out in pipeline draw order, so they execute in that order too
+    for (i = 0; i < com->secondaryBufferNext; i++)
+    {
+        com->executeBuffers[executeCount++] = com->secondaryBuffers[i];
+        pipe = com->secondaryPipes[i];
+        if (!pipe)continue;
+        // draws recorded on other threads land after the pipeline's own, still before the next pipeline
+        for (t = 0; t < GF3D_PIPELINE_THREAD_MAX; t++)
+        {
+            if (pipe->threadBuffers[t] == VK_NULL_HANDLE)continue;
+            com->executeBuffers[executeCount++] = pipe->threadBuffers[t];
+        }
+        // then anything baked in an earlier frame for the pipeline
+        for (t = 0; t < pipe->bundleCount; t++)
+        {
+            com->executeBuffers[executeCount++] = pipe->bundleBuffers[t];
+        }
+    }
+    if (executeCount)
+    {
+        vkCmdExecuteCommands(commandBuffer, executeCount, com->executeBuffers);
+    }
+    
     gf3d_command_configure_render_pass_end(commandBuffer);
-    gf3d_command_end_single_time(gf3d_vgraphics_get_graphics_command_pool(), commandBuffer);
+    
+    vkEndCommandBuffer(commandBuffer);
+    return commandBuffer;
 }
 
-void gf3d_command_configure_render_pass(VkCommandBuffer commandBuffer, VkRenderPass renderPass,VkFramebuffer framebuffer,VkPipeline graphicsPipeline,VkPipelineLayout pipelineLayout)
+void gf3d_command_configure_render_pass(VkCommandBuffer commandBuffer, VkRenderPass renderPass,VkFramebuffer framebuffer)
 {
     VkClearValue clearValues[2] = {0};
     VkRenderPassBeginInfo renderPassInfo = {0};
@@ -207,8 +397,7 @@ void gf3d_command_configure_render_pass(VkCommandBuffer commandBuffer, VkRenderP
     renderPassInfo.clearValueCount = 2;
     renderPassInfo.pClearValues = clearValues;
     
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 }
 
 VkCommandBuffer gf3d_command_begin_single_time(Command* com)
@@ -247,8 +436,10 @@ void gf3d_command_end_single_time(Command *com, VkCommandBuffer commandBuffer)
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
 
+    gf3d_vqueues_lock();
     vkQueueSubmit(gf3d_vqueues_get_graphics_queue(), 1, &submitInfo, VK_NULL_HANDLE);
     vkQueueWaitIdle(gf3d_vqueues_get_graphics_queue());
+    gf3d_vqueues_unlock();
 
     vkFreeCommandBuffers(gf3d_commands.device, com->commandPool, 1, &commandBuffer);
 }
@@ -289,13 +289,15 @@ VkSubpassDependency gf3d_config_subpass_dependency(SJson *config)
     if (array)
     {
         str = sj_get_string_value(array);
-        dependency.srcStageMask = gf3d_config_pipeline_stage_flags_from_str(str);
+        if (str)dependency.srcStageMask = gf3d_config_pipeline_stage_flags_from_str(str);
+        else dependency.srcStageMask = gf3d_config_pipeline_stage_flags(array);
     }
     array = sj_object_get_value(config,"dstStageMask");
     if (array)
     {
         str = sj_get_string_value(array);
-        dependency.dstStageMask = gf3d_config_pipeline_stage_flags_from_str(str);
+        if (str)dependency.dstStageMask = gf3d_config_pipeline_stage_flags_from_str(str);
+        else dependency.dstStageMask = gf3d_config_pipeline_stage_flags(array);
     }
     array = sj_object_get_value(config,"srcAccessMask");
     if (array)
@@ -21,11 +21,20 @@ typedef struct
     int bestDevice;                 /**<index of the chosen physical device*/
     GF3D_Device *chosen_gpu;        /**< physical device to use for logical device*/
     VkSurfaceKHR renderSurface;     /**<vulkan surface target for the screen/window  owned by graphics*/
+    Bool bindless;                  /**<if the descriptor indexing features below are enabled on the logical device*/
+    VkPhysicalDeviceDescriptorIndexingFeatures enabledIndexingFeatures;
+    Bool timelineSemaphores;        /**<if timeline semaphores are enabled on the logical device*/
+    VkPhysicalDeviceTimelineSemaphoreFeatures enabledTimelineFeatures;
+    Bool drawIndirectCount;         /**<if VK_KHR_draw_indirect_count is enabled on the logical device*/
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount;  /**<loaded once the logical device exists*/
 }GF3D_DeviceManager;
 
 static GF3D_DeviceManager gf3d_device_manager = {0};
 
 int gf3d_devices_enumerate();
+void gf3d_device_setup_bindless();
+void gf3d_device_setup_timeline_semaphores();
+void gf3d_device_setup_draw_indirect_count();
 void gf3d_device_manager_determine_best();
 GF3D_Device *gf3d_device_get_info(VkPhysicalDevice device);
 VkDevice gf3d_device_create_logic_device(Bool enableValidationLayers);
@@ -56,6 +65,7 @@ void gf3d_device_manager_init(const char *config, VkInstance instance, VkSurface
 {
     SJson *deviceConfig;
     short int enable_validation = false;
+    short int enable_bindless = false;
     if (!instance)
     {
         slog("no vulkan instance provided, failed to init device manager");
@@ -100,7 +110,22 @@ void gf3d_device_manager_init(const char *config, VkInstance instance, VkSurface
     //setup device extensions
     gf3d_extensions_device_init(gf3d_device_manager.chosen_gpu->device,config);
 
+    sj_get_bool_value(sj_object_get_value(gf3d_device_manager.config,"bindless_textures"),&enable_bindless);
+    if (enable_bindless)
+    {
+        gf3d_device_setup_bindless();
+    }
+    gf3d_device_setup_timeline_semaphores();
+    gf3d_device_setup_draw_indirect_count();
+
     gf3d_device_create_logic_device(enable_validation);
+    if ((gf3d_device_manager.drawIndirectCount)&&(gf3d_device_manager.device != VK_NULL_HANDLE))
+    {
+        gf3d_device_manager.cmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(
+            gf3d_device_manager.device,
+            "vkCmdDrawIndexedIndirectCountKHR");
+        if (!gf3d_device_manager.cmdDrawIndexedIndirectCount)gf3d_device_manager.drawIndirectCount = false;
+    }
     
     atexit(gf3d_device_manager_close);
     if (__DEBUG)slog("gf3d_devices manager initialized");
@@ -110,6 +135,7 @@ GF3D_Device *gf3d_device_get_info(VkPhysicalDevice device)
 {
     GF3D_Device *device_info;
     SJson *device_config;
+    VkPhysicalDeviceFeatures2 features2 = {0};
     
     if (!device)return NULL;
     device_info = gfc_allocate_array(sizeof(GF3D_Device),1);
@@ -118,6 +144,18 @@ GF3D_Device *gf3d_device_get_info(VkPhysicalDevice device)
     device_info->device = device;
     vkGetPhysicalDeviceFeatures(device, &device_info->deviceFeatures);
     vkGetPhysicalDeviceProperties(device, &device_info->deviceProperties);
+    if (device_info->deviceProperties.apiVersion >= VK_API_VERSION_1_2)
+    {
+        // descriptor indexing and timeline semaphores are core in 1.2
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &device_info->descriptorIndexingFeatures;
+        device_info->descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+        device_info->descriptorIndexingFeatures.pNext = &device_info->timelineSemaphoreFeatures;
+        device_info->timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        vkGetPhysicalDeviceFeatures2(device, &features2);
+        device_info->descriptorIndexingFeatures.pNext = NULL;
+        device_info->timelineSemaphoreFeatures.pNext = NULL;
+    }
     
     device_config = sj_object_get_value(gf3d_device_manager.config,"devices");
     if (device_config)
@@ -248,6 +286,87 @@ VkPhysicalDevice gf3d_devices_get_best_device()
     return gf3d_device_manager.devices[gf3d_device_manager.bestDevice];
 }
 
+void gf3d_device_setup_bindless()
+{
+    GF3D_Device *gpu = gf3d_device_manager.chosen_gpu;
+    VkPhysicalDeviceDescriptorIndexingFeatures *supported;
+    if (!gpu)return;
+    supported = &gpu->descriptorIndexingFeatures;
+    if ((!supported->runtimeDescriptorArray)||
+        (!supported->descriptorBindingPartiallyBound)||
+        (!supported->descriptorBindingSampledImageUpdateAfterBind)||
+        (!supported->shaderSampledImageArrayNonUniformIndexing))
+    {
+        slog("device %s lacks descriptor indexing support, bindless textures disabled",gpu->deviceProperties.deviceName);
+        return;
+    }
+    // only turn on what the texture table uses
+    gf3d_device_manager.enabledIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    gf3d_device_manager.enabledIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+    gf3d_device_manager.enabledIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+    gf3d_device_manager.enabledIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    gf3d_device_manager.enabledIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    gf3d_device_manager.bindless = true;
+    if (__DEBUG)slog("bindless textures enabled");
+}
+
+Bool gf3d_device_bindless_enabled()
+{
+    return gf3d_device_manager.bindless;
+}
+
+void gf3d_device_setup_timeline_semaphores()
+{
+    GF3D_Device *gpu = gf3d_device_manager.chosen_gpu;
+    if (!gpu)return;
+    if (!gpu->timelineSemaphoreFeatures.timelineSemaphore)
+    {
+        slog("device %s lacks timeline semaphores, uploads stay on the graphics queue",gpu->deviceProperties.deviceName);
+        return;
+    }
+    gf3d_device_manager.enabledTimelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    gf3d_device_manager.enabledTimelineFeatures.timelineSemaphore = VK_TRUE;
+    gf3d_device_manager.timelineSemaphores = true;
+    if (__DEBUG)slog("timeline semaphores enabled");
+}
+
+Bool gf3d_device_timeline_semaphores_enabled()
+{
+    return gf3d_device_manager.timelineSemaphores;
+}
+
+void gf3d_device_setup_draw_indirect_count()
+{
+    GF3D_Device *gpu = gf3d_device_manager.chosen_gpu;
+    if (!gpu)return;
+    // the extension needs no feature struct, so it works the same on 1.1 devices and software rasterizers
+    if (!gf3d_extensions_enable(ET_Device,VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME))
+    {
+        slog("device %s lacks %s, indirect draws are not compacted",gpu->deviceProperties.deviceName,VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        return;
+    }
+    gf3d_device_manager.drawIndirectCount = true;
+    if (__DEBUG)slog("draw indirect count enabled");
+}
+
+Bool gf3d_device_draw_indirect_count_enabled()
+{
+    return gf3d_device_manager.drawIndirectCount;
+}
+
+void gf3d_device_cmd_draw_indexed_indirect_count(
+    VkCommandBuffer commandBuffer,
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    VkBuffer countBuffer,
+    VkDeviceSize countBufferOffset,
+    Uint32 maxDrawCount,
+    Uint32 stride)
+{
+    if (!gf3d_device_manager.cmdDrawIndexedIndirectCount)return;
+    gf3d_device_manager.cmdDrawIndexedIndirectCount(commandBuffer,buffer,offset,countBuffer,countBufferOffset,maxDrawCount,stride);
+}
+
 VkDevice gf3d_device_get()
 {
     return gf3d_device_manager.device;
@@ -303,6 +422,17 @@ VkDeviceCreateInfo gf3d_device_get_logical_device_info(Bool enableValidationLaye
     createInfo.queueCreateInfoCount = count;
 
     createInfo.pEnabledFeatures = &gf3d_device_manager.chosen_gpu->deviceFeatures;
+    // chain whichever feature structs are in use
+    if (gf3d_device_manager.timelineSemaphores)
+    {
+        gf3d_device_manager.enabledTimelineFeatures.pNext = (void *)createInfo.pNext;
+        createInfo.pNext = &gf3d_device_manager.enabledTimelineFeatures;
+    }
+    if (gf3d_device_manager.bindless)
+    {
+        gf3d_device_manager.enabledIndexingFeatures.pNext = (void *)createInfo.pNext;
+        createInfo.pNext = &gf3d_device_manager.enabledIndexingFeatures;
+    }
     
     
     createInfo.ppEnabledExtensionNames = gf3d_extensions_get_device_enabled_names(&count);
@@ -0,0 +1,420 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "simple_logger.h"
+
+#include "gf3d_frustum.h"
+#include "gf3d_record.h"
+#include "gf3d_render.h"
+#include "gf3d_particle.h"
+#include "gf3d_draw_queue.h"
+
+#define DQ_PASS_SHIFT   60
+#define DQ_DEPTH_MASK   0xffffff
+
+typedef enum
+{
+    DQP_Sky = 0,        //drawn behind everything, in any order
+    DQP_Opaque,
+    DQP_Highlight,
+    DQP_Transparent     //blended, must stay last and back to front
+}DrawQueuePass;
+
+typedef enum
+{
+    DQK_Instanced = 0,
+    DQK_Clustered,
+    DQK_Highlight,
+    DQK_Sky,
+    DQK_Particle
+}DrawQueueKind;
+
+/**
+ * @purpose everything needed to record one queued draw
+ */
+typedef struct
+{
+    Uint32          kind;
+    Uint32          lod;
+    Uint32          firstInstance;  /**<instanced draws: where their instances were written*/
+    Uint32          count;
+    Mesh           *mesh;
+    Texture        *texture;
+    union
+    {
+        MeshPushConstants       model;
+        HighlightPushConstants  highlight;
+        SkyPushConstants        sky;
+        Uint32                  uboOffset;  /**<particles*/
+    }constants;
+    MeshInstance    instance;       /**<clustered draws cull against it when recorded*/
+}DrawQueueItem;
+
+typedef struct
+{
+    DrawQueueItem  *items;
+    Uint64         *keys;           /**<key of each item, by the slot it was queued in*/
+    Uint32         *order;
+    Uint64         *sortKeys;       /**<radix sort scratch*/
+    Uint32         *sortOrder;
+    Uint32          itemMax;
+    SDL_atomic_t    count;          /**<slots claimed this frame, by any recording thread*/
+    Bool            overflowed;     /**<already warned this frame*/
+}DrawQueue;
+
+static DrawQueue gf3d_draw_queue = {0};
+
+void gf3d_draw_queue_close()
+{
+    if (gf3d_draw_queue.items)free(gf3d_draw_queue.items);
+    if (gf3d_draw_queue.keys)free(gf3d_draw_queue.keys);
+    if (gf3d_draw_queue.order)free(gf3d_draw_queue.order);
+    if (gf3d_draw_queue.sortKeys)free(gf3d_draw_queue.sortKeys);
+    if (gf3d_draw_queue.sortOrder)free(gf3d_draw_queue.sortOrder);
+    memset(&gf3d_draw_queue,0,sizeof(DrawQueue));
+    slog("draw queue closed");
+}
+
+void gf3d_draw_queue_init(Uint32 itemMax)
+{
+    if (!itemMax)
+    {
+        slog("cannot create a draw queue with no room");
+        return;
+    }
+    gf3d_draw_queue.items = (DrawQueueItem *)gfc_allocate_array(sizeof(DrawQueueItem),itemMax);
+    gf3d_draw_queue.keys = (Uint64 *)gfc_allocate_array(sizeof(Uint64),itemMax);
+    gf3d_draw_queue.order = (Uint32 *)gfc_allocate_array(sizeof(Uint32),itemMax);
+    gf3d_draw_queue.sortKeys = (Uint64 *)gfc_allocate_array(sizeof(Uint64),itemMax);
+    gf3d_draw_queue.sortOrder = (Uint32 *)gfc_allocate_array(sizeof(Uint32),itemMax);
+    if ((!gf3d_draw_queue.items)||(!gf3d_draw_queue.keys)||(!gf3d_draw_queue.order)||
+        (!gf3d_draw_queue.sortKeys)||(!gf3d_draw_queue.sortOrder))
+    {
+        slog("failed to allocate draw queue, draws are recorded unsorted");
+        gf3d_draw_queue_close();
+        return;
+    }
+    gf3d_draw_queue.itemMax = itemMax;
+    slog("draw queue initialized");
+    atexit(gf3d_draw_queue_close);
+}
+
+void gf3d_draw_queue_reset()
+{
+    SDL_AtomicSet(&gf3d_draw_queue.count,0);
+    gf3d_draw_queue.overflowed = 0;
+}
+
+/**
+ * @brief pack the sort key of a draw
+ * @note opaque passes group by state and then go front to back inside each group.  Blended draws are ordered by depth
+ * first, back to front, as they must be for blending to come out right
+ */
+static Uint64 gf3d_draw_queue_key(Uint32 pass,Uint32 pipeline,Uint32 texture,Uint32 mesh,Uint32 depth)
+{
+    Uint64 key = (Uint64)pass << DQ_PASS_SHIFT;
+    depth &= DQ_DEPTH_MASK;
+    if (pass == DQP_Transparent)
+    {
+        return key |
+            ((Uint64)(DQ_DEPTH_MASK - depth) << 36) |
+            ((Uint64)(pipeline & 0xf) << 32) |
+            ((Uint64)(texture & 0xffff) << 16) |
+            (Uint64)(mesh & 0xffff);
+    }
+    return key |
+        ((Uint64)(pipeline & 0xf) << 56) |
+        ((Uint64)(texture & 0xffff) << 40) |
+        ((Uint64)(mesh & 0xffff) << 24) |
+        (Uint64)depth;
+}
+
+/**
+ * @brief quantize a distance from the eye to 24 bits that sort the same way
+ */
+static Uint32 gf3d_draw_queue_depth(float distance)
+{
+    union
+    {
+        float   f;
+        Uint32  u;
+    }bits;
+    if (!(distance > 0))return 0;
+    // positive floats order the same as their bit patterns, the sign bit is always clear
+    bits.f = distance;
+    return (bits.u >> 7) & DQ_DEPTH_MASK;
+}
+
+/**
+ * @brief get the distance from the eye to the near side of a mesh's bounds placed by a model matrix
+ */
+static float gf3d_draw_queue_distance(Mesh *mesh,Matrix4 modelMat,Vector3D eye)
+{
+    Vector3D center;
+    float radius;
+    radius = gf3d_frustum_transform_sphere(modelMat,mesh->center,mesh->radius,&center);
+    return sqrtf(
+        (center.x - eye.x) * (center.x - eye.x) +
+        (center.y - eye.y) * (center.y - eye.y) +
+        (center.z - eye.z) * (center.z - eye.z)) - radius;
+}
+
+/**
+ * @brief the mesh part of a key: meshes with the same index type sort together, since that is what a mesh change rebinds
+ */
+static Uint32 gf3d_draw_queue_mesh_id(Mesh *mesh)
+{
+    Uint32 id = (Uint32)(((size_t)mesh / sizeof(Mesh)) & 0x7fff);
+    if (mesh->indexType == VK_INDEX_TYPE_UINT32)id |= 0x8000;
+    return id;
+}
+
+static Uint32 gf3d_draw_queue_texture_id(Texture *texture)
+{
+    return texture ? texture->index : 0;
+}
+
+/**
+ * @brief record one queued draw into the calling thread's command buffer for its pipeline
+ */
+static void gf3d_draw_queue_emit(DrawQueueItem *item)
+{
+    switch (item->kind)
+    {
+        case DQK_Instanced:
+            gf3d_mesh_render_instances(
+                item->mesh,
+                gf3d_mesh_get_model_command_buffer(item->mesh->vertexFormat),
+                item->texture,
+                &item->constants.model,
+                item->firstInstance,
+                item->count,
+                item->lod);
+            break;
+        case DQK_Clustered:
+            gf3d_mesh_render_clustered(
+                item->mesh,
+                gf3d_mesh_get_model_command_buffer(item->mesh->vertexFormat),
+                item->texture,
+                &item->constants.model,
+                &item->instance,
+                gf3d_render_get_frustum(),
+                gf3d_render_get_eye_position());
+            break;
+        case DQK_Highlight:
+            gf3d_mesh_render_highlight(
+                item->mesh,
+                gf3d_mesh_get_highlight_command_buffer(item->mesh->vertexFormat),
+                &item->constants.highlight,
+                item->lod);
+            break;
+        case DQK_Sky:
+            gf3d_mesh_render_sky(item->mesh,gf3d_mesh_get_sky_command_buffer(),item->texture,&item->constants.sky);
+            break;
+        case DQK_Particle:
+            gf3d_particle_render_queued(item->constants.uboOffset);
+            break;
+    }
+}
+
+/**
+ * @brief add a draw to this frame's queue, recording it now if the queue is full
+ */
+static void gf3d_draw_queue_push(Uint64 key,DrawQueueItem *item)
+{
+    Uint32 slot;
+    slot = (Uint32)SDL_AtomicAdd(&gf3d_draw_queue.count,1);
+    if (slot >= gf3d_draw_queue.itemMax)
+    {
+        if ((gf3d_draw_queue.itemMax)&&(!gf3d_draw_queue.overflowed))
+        {
+            gf3d_draw_queue.overflowed = 1;
+            slog("draw queue is full (%i), recording the rest of the frame unsorted",gf3d_draw_queue.itemMax);
+        }
+        gf3d_draw_queue_emit(item);
+        return;
+    }
+    memcpy(&gf3d_draw_queue.items[slot],item,sizeof(DrawQueueItem));
+    gf3d_draw_queue.keys[slot] = key;
+    gf3d_draw_queue.order[slot] = slot;
+}
+
+void gf3d_draw_queue_add_instanced(Mesh *mesh,Texture *texture,MeshPushConstants *constants,MeshInstance *instances,Uint32 count,Uint32 lod)
+{
+    DrawQueueItem item;
+    Vector3D eye;
+    float distance,nearest;
+    Uint32 i;
+    if ((!mesh)||(!constants)||(!instances)||(!count))return;
+    item.kind = DQK_Instanced;
+    item.mesh = mesh;
+    item.texture = texture;
+    item.count = count;
+    item.lod = lod;
+    memcpy(&item.constants.model,constants,sizeof(MeshPushConstants));
+    if (!gf3d_mesh_write_instances(instances,count,&item.firstInstance))return;
+    eye = gf3d_render_get_eye_position();
+    nearest = gf3d_draw_queue_distance(mesh,instances[0].model,eye);
+    for (i = 1; i < count; i++)
+    {
+        distance = gf3d_draw_queue_distance(mesh,instances[i].model,eye);
+        if (distance < nearest)nearest = distance;
+    }
+    gf3d_draw_queue_push(
+        gf3d_draw_queue_key(
+            DQP_Opaque,
+            mesh->vertexFormat,
+            gf3d_draw_queue_texture_id(texture),
+            gf3d_draw_queue_mesh_id(mesh),
+            gf3d_draw_queue_depth(nearest)),
+        &item);
+}
+
+void gf3d_draw_queue_add_clustered(Mesh *mesh,Texture *texture,MeshPushConstants *constants,MeshInstance *instance)
+{
+    DrawQueueItem item;
+    if ((!mesh)||(!constants)||(!instance))return;
+    item.kind = DQK_Clustered;
+    item.mesh = mesh;
+    item.texture = texture;
+    memcpy(&item.constants.model,constants,sizeof(MeshPushConstants));
+    memcpy(&item.instance,instance,sizeof(MeshInstance));
+    gf3d_draw_queue_push(
+        gf3d_draw_queue_key(
+            DQP_Opaque,
+            mesh->vertexFormat,
+            gf3d_draw_queue_texture_id(texture),
+            gf3d_draw_queue_mesh_id(mesh),
+            gf3d_draw_queue_depth(gf3d_draw_queue_distance(mesh,instance->model,gf3d_render_get_eye_position()))),
+        &item);
+}
+
+void gf3d_draw_queue_add_highlight(Mesh *mesh,HighlightPushConstants *constants,Uint32 lod)
+{
+    DrawQueueItem item;
+    if ((!mesh)||(!constants))return;
+    item.kind = DQK_Highlight;
+    item.mesh = mesh;
+    item.lod = lod;
+    memcpy(&item.constants.highlight,constants,sizeof(HighlightPushConstants));
+    gf3d_draw_queue_push(
+        gf3d_draw_queue_key(
+            DQP_Highlight,
+            mesh->vertexFormat,
+            0,
+            gf3d_draw_queue_mesh_id(mesh),
+            gf3d_draw_queue_depth(gf3d_draw_queue_distance(mesh,constants->model,gf3d_render_get_eye_position()))),
+        &item);
+}
+
+void gf3d_draw_queue_add_sky(Mesh *mesh,Texture *texture,SkyPushConstants *constants)
+{
+    DrawQueueItem item;
+    if ((!mesh)||(!constants))return;
+    item.kind = DQK_Sky;
+    item.mesh = mesh;
+    item.texture = texture;
+    memcpy(&item.constants.sky,constants,sizeof(SkyPushConstants));
+    gf3d_draw_queue_push(
+        gf3d_draw_queue_key(DQP_Sky,0,gf3d_draw_queue_texture_id(texture),gf3d_draw_queue_mesh_id(mesh),0),
+        &item);
+}
+
+void gf3d_draw_queue_add_particle(Vector3D position,Uint32 uboOffset)
+{
+    DrawQueueItem item;
+    Vector3D eye;
+    item.kind = DQK_Particle;
+    item.constants.uboOffset = uboOffset;
+    eye = gf3d_render_get_eye_position();
+    gf3d_draw_queue_push(
+        gf3d_draw_queue_key(
+            DQP_Transparent,
+            0,
+            0,
+            0,
+            gf3d_draw_queue_depth(sqrtf(
+                (position.x - eye.x) * (position.x - eye.x) +
+                (position.y - eye.y) * (position.y - eye.y) +
+                (position.z - eye.z) * (position.z - eye.z)))),
+        &item);
+}
+
+/**
+ * @brief least significant digit radix sort of the queued keys, a byte at a time
+ * @param count how many items are queued
+ * @param keys (output) the sorted keys
+ * @return the item slots in key order
+ */
+static Uint32 *gf3d_draw_queue_sort(Uint32 count,Uint64 **keys)
+{
+    Uint32 histogram[256];
+    Uint32 shift,i,sum,digit;
+    Uint64 *keysIn = gf3d_draw_queue.keys,*keysOut = gf3d_draw_queue.sortKeys,*keysSwap;
+    Uint32 *orderIn = gf3d_draw_queue.order,*orderOut = gf3d_draw_queue.sortOrder,*orderSwap;
+    for (shift = 0; shift < 64; shift += 8)
+    {
+        memset(histogram,0,sizeof(histogram));
+        for (i = 0; i < count; i++)
+        {
+            histogram[(keysIn[i] >> shift) & 0xff]++;
+        }
+        // every key has the same byte here, so the pass would not move anything
+        if (histogram[(keysIn[0] >> shift) & 0xff] == count)continue;
+        for (i = 0, sum = 0; i < 256; i++)
+        {
+            digit = histogram[i];
+            histogram[i] = sum;
+            sum += digit;
+        }
+        for (i = 0; i < count; i++)
+        {
+            digit = (keysIn[i] >> shift) & 0xff;
+            keysOut[histogram[digit]] = keysIn[i];
+            orderOut[histogram[digit]++] = orderIn[i];
+        }
+        keysSwap = keysIn;
+        keysIn = keysOut;
+        keysOut = keysSwap;
+        orderSwap = orderIn;
+        orderIn = orderOut;
+        orderOut = orderSwap;
+    }
+    *keys = keysIn;
+    return orderIn;
+}
+
+static void gf3d_draw_queue_emit_job(void *data,Uint32 start,Uint32 end)
+{
+    Uint32 *order = (Uint32 *)data;
+    Uint32 i;
+    for (i = start; i < end; i++)
+    {
+        gf3d_draw_queue_emit(&gf3d_draw_queue.items[order[i]]);
+    }
+}
+
+void gf3d_draw_queue_flush()
+{
+    Uint64 *keys;
+    Uint32 *order;
+    Uint32 count,blended;
+    count = (Uint32)SDL_AtomicGet(&gf3d_draw_queue.count);
+    if (count > gf3d_draw_queue.itemMax)count = gf3d_draw_queue.itemMax;
+    if (!count)return;
+    order = gf3d_draw_queue_sort(count,&keys);
+    for (blended = count; blended > 0; blended--)
+    {
+        if ((keys[blended - 1] >> DQ_PASS_SHIFT) != DQP_Transparent)break;
+    }
+    // threads each record a run of the sorted draws, so opaque draws stay grouped by state
+    gf3d_record_dispatch(gf3d_draw_queue_emit_job,order,blended);
+    // blending depends on the order the draws land in, so those are recorded here, in order
+    gf3d_draw_queue_emit_job(order,blended,count);
+    gf3d_draw_queue_reset();
+}
+
+/*eol@eof*/
@@ -0,0 +1,143 @@
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GF3D_FRUSTUM_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#include "gf3d_frustum.h"
+
+static void gf3d_frustum_plane_normalize(Vector4D *plane)
+{
+    float length;
+    length = sqrtf(plane->x * plane->x + plane->y * plane->y + plane->z * plane->z);
+    if (!length)return;
+    plane->x /= length;
+    plane->y /= length;
+    plane->z /= length;
+    plane->w /= length;
+}
+
+void gf3d_frustum_from_view_proj(Frustum *frustum, Matrix4 view, Matrix4 proj)
+{
+    int c,r,k,i;
+    Matrix4 clip;
+    Vector4D row[4];
+    if (!frustum)return;
+    // matrices are stored column major, [column][row], to match the shaders
+    for (c = 0; c < 4; c++)
+    {
+        for (r = 0; r < 4; r++)
+        {
+            clip[c][r] = 0;
+            for (k = 0; k < 4; k++)
+            {
+                clip[c][r] += proj[k][r] * view[c][k];
+            }
+        }
+    }
+    for (r = 0; r < 4; r++)
+    {
+        vector4d_set(row[r],clip[0][r],clip[1][r],clip[2][r],clip[3][r]);
+    }
+    vector4d_add(frustum->planes[0],row[3],row[0]);    //left
+    vector4d_sub(frustum->planes[1],row[3],row[0]);    //right
+    vector4d_add(frustum->planes[2],row[3],row[1]);    //bottom
+    vector4d_sub(frustum->planes[3],row[3],row[1]);    //top
+    vector4d_add(frustum->planes[4],row[3],row[2]);    //near, loose for a 0 to 1 depth range, which only keeps more
+    vector4d_sub(frustum->planes[5],row[3],row[2]);    //far
+    for (i = 0; i < 6; i++)
+    {
+        gf3d_frustum_plane_normalize(&frustum->planes[i]);
+    }
+}
+
+Bool gf3d_frustum_sphere_visible(Frustum *frustum, Vector3D center, float radius)
+{
+    int i;
+    Vector4D *plane;
+    if (!frustum)return 1;
+    for (i = 0; i < 6; i++)
+    {
+        plane = &frustum->planes[i];
+        if (plane->x * center.x + plane->y * center.y + plane->z * center.z + plane->w < -radius)return 0;
+    }
+    return 1;
+}
+
+Uint32 gf3d_frustum_cull_spheres(
+    Frustum *frustum,
+    const float *x,
+    const float *y,
+    const float *z,
+    const float *radius,
+    Uint32 count,
+    Uint8 *visible)
+{
+    Uint32 i = 0;
+    Uint32 visibleCount = 0;
+    if ((!frustum)||(!x)||(!y)||(!z)||(!radius)||(!visible))return 0;
+#ifdef GF3D_FRUSTUM_SSE
+    {
+        int p,mask;
+        __m128 px,py,pz,nr,d,inside;
+        __m128 nx[6],ny[6],nz[6],nw[6];
+        const __m128 zero = _mm_setzero_ps();
+        for (p = 0; p < 6; p++)
+        {
+            nx[p] = _mm_set1_ps(frustum->planes[p].x);
+            ny[p] = _mm_set1_ps(frustum->planes[p].y);
+            nz[p] = _mm_set1_ps(frustum->planes[p].z);
+            nw[p] = _mm_set1_ps(frustum->planes[p].w);
+        }
+        for (; i + 4 <= count; i += 4)
+        {
+            px = _mm_loadu_ps(&x[i]);
+            py = _mm_loadu_ps(&y[i]);
+            pz = _mm_loadu_ps(&z[i]);
+            nr = _mm_sub_ps(zero,_mm_loadu_ps(&radius[i]));
+            inside = _mm_cmpeq_ps(zero,zero);
+            for (p = 0; p < 6; p++)
+            {
+                d = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(nx[p],px),_mm_mul_ps(ny[p],py)),
+                    _mm_add_ps(_mm_mul_ps(nz[p],pz),nw[p]));
+                inside = _mm_and_ps(inside,_mm_cmpge_ps(d,nr));
+            }
+            mask = _mm_movemask_ps(inside);
+            visible[i] = mask & 1;
+            visible[i + 1] = (mask >> 1) & 1;
+            visible[i + 2] = (mask >> 2) & 1;
+            visible[i + 3] = (mask >> 3) & 1;
+            visibleCount += visible[i] + visible[i + 1] + visible[i + 2] + visible[i + 3];
+        }
+    }
+#endif
+    // whatever does not fill a full group of four, or everything without SSE
+    for (; i < count; i++)
+    {
+        visible[i] = gf3d_frustum_sphere_visible(frustum,vector3d(x[i],y[i],z[i]),radius[i]);
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+}
+
+float gf3d_frustum_transform_sphere(Matrix4 modelMat, Vector3D center, float radius, Vector3D *outCenter)
+{
+    int c;
+    float scale,maxScale = 0;
+    if (outCenter)
+    {
+        outCenter->x = modelMat[0][0] * center.x + modelMat[1][0] * center.y + modelMat[2][0] * center.z + modelMat[3][0];
+        outCenter->y = modelMat[0][1] * center.x + modelMat[1][1] * center.y + modelMat[2][1] * center.z + modelMat[3][1];
+        outCenter->z = modelMat[0][2] * center.x + modelMat[1][2] * center.y + modelMat[2][2] * center.z + modelMat[3][2];
+    }
+    for (c = 0; c < 3; c++)
+    {
+        scale = modelMat[c][0] * modelMat[c][0] + modelMat[c][1] * modelMat[c][1] + modelMat[c][2] * modelMat[c][2];
+        if (scale > maxScale)maxScale = scale;
+    }
+    return radius * sqrtf(maxScale);
+}
+
+/*eol@eof*/
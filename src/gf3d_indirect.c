@@ -0,0 +1,735 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "simple_logger.h"
+
+#include "gf3d_buffers.h"
+#include "gf3d_shaders.h"
+#include "gf3d_device.h"
+#include "gf3d_commands.h"
+#include "gf3d_vgraphics.h"
+#include "gf3d_frustum.h"
+#include "gf3d_render.h"
+#include "gf3d_upload.h"
+#include "gf3d_indirect.h"
+
+#define INDIRECT_GROUP_SIZE     64      //local_size_x of cull.comp
+#define INDIRECT_CULL_SHADER    "shaders/cull_comp.spv"
+#define INDIRECT_BATCH_NONE     0xffffffff
+
+/**
+ * @purpose what the cull pass reads for each object slot, laid out as CullObject in cull.comp (std430)
+ */
+typedef struct
+{
+    Vector4D    sphere;         /**<world space center and radius*/
+    Uint32      indexCount;     /**<0 for an empty slot*/
+    Uint32      firstIndex;
+    Sint32      vertexOffset;
+    Uint32      batch;          /**<which draw count the object adds to*/
+    Uint32      commandSlot;    /**<its own command when draws are not compacted*/
+    Uint32      batchFirst;     /**<first command of its batch*/
+    Uint32      padding[2];
+}IndirectCullObject;
+
+/**
+ * @purpose the cull pass push constants
+ */
+typedef struct
+{
+    Vector4D    planes[6];      /**<the frame's frustum*/
+    Uint32      objectCount;
+    Uint32      compact;        /**<1 when the draws are packed and counted on the GPU*/
+}IndirectCullConstants;
+
+/**
+ * @purpose objects sharing a mesh, texture and ambient, drawn with one indirect draw call
+ */
+typedef struct
+{
+    Mesh       *mesh;
+    Texture    *texture;
+    Vector4D    ambient;
+    Uint32      first;          /**<first command of the batch*/
+    Uint32      count;          /**<how many objects are in it*/
+}IndirectBatch;
+
+/**
+ * @purpose the scene as one frame in flight sees it, only written once that frame's fence is waited on
+ */
+typedef struct
+{
+    VkBuffer            objectBuffer;       /**<IndirectCullObject per slot, written by the host*/
+    MemoryAllocation    objectAllocation;
+    VkBuffer            instanceBuffer;     /**<MeshInstance per slot, bound to binding 1 of the model pipelines*/
+    MemoryAllocation    instanceAllocation;
+    VkBuffer            drawBuffer;         /**<VkDrawIndexedIndirectCommand per slot, written by the cull pass*/
+    MemoryAllocation    drawAllocation;
+    VkBuffer            countBuffer;        /**<draw count of each batch, written by the cull pass*/
+    MemoryAllocation    countAllocation;
+    VkDescriptorSet     descriptorSet;
+    Command            *commandPool;        /**<the cull pass and the draws, reset every frame*/
+    IndirectBatch       batches[GF3D_INDIRECT_BATCH_MAX];
+    Uint32              batchCount;
+    Uint32              objectCount;        /**<one past the highest slot in use*/
+    Uint32              version;            /**<the scene version uploaded, 0 for none*/
+    Uint32              layoutVersion;      /**<the batch layout uploaded, 0 for none*/
+    Uint32              dirtyFirst;         /**<first slot edited since the last upload*/
+    Uint32              dirtyEnd;           /**<one past the last slot edited, equal to dirtyFirst when clean*/
+}IndirectFrame;
+
+typedef struct
+{
+    VkDevice                device;
+    IndirectObject         *object_list;
+    Uint32                  object_max;
+    Uint32                 *objectBatch;        /**<scratch, the batch of each slot while uploading*/
+    Uint32                 *slotVersion;        /**<the version of each slot's last edit*/
+    Uint32                  highWater;          /**<one past the highest slot in use*/
+    SDL_mutex              *lock;               /**<objects are edited on the simulation thread while the render thread uploads them*/
+    Uint32                  version;            /**<bumped by every edit*/
+    Uint32                  layoutVersion;      /**<the version of the last add or free, which regroups the batches*/
+    Bool                    gpu;                /**<culled and drawn by the compute path, otherwise through the draw queue*/
+    Bool                    compact;            /**<the GPU counts the draws, otherwise every slot is drawn with 0 or 1 instances*/
+    VkDescriptorSetLayout   descriptorSetLayout;
+    VkDescriptorPool        descriptorPool;
+    VkPipelineLayout        pipelineLayout;
+    VkPipeline              pipeline;
+    IndirectFrame           frames[GF3D_VGRAPHICS_FRAMES_IN_FLIGHT];
+}IndirectManager;
+
+static IndirectManager gf3d_indirect = {0};
+
+static Bool gf3d_indirect_gpu_setup();
+
+void gf3d_indirect_close()
+{
+    int i;
+    IndirectFrame *frame;
+    if (gf3d_indirect.device != VK_NULL_HANDLE)
+    {
+        vkDeviceWaitIdle(gf3d_indirect.device);
+    }
+    for (i = 0; i < GF3D_VGRAPHICS_FRAMES_IN_FLIGHT; i++)
+    {
+        frame = &gf3d_indirect.frames[i];
+        gf3d_command_free(frame->commandPool);
+        gf3d_buffer_free(&frame->objectBuffer,&frame->objectAllocation);
+        gf3d_buffer_free(&frame->instanceBuffer,&frame->instanceAllocation);
+        gf3d_buffer_free(&frame->drawBuffer,&frame->drawAllocation);
+        gf3d_buffer_free(&frame->countBuffer,&frame->countAllocation);
+    }
+    if (gf3d_indirect.pipeline != VK_NULL_HANDLE)vkDestroyPipeline(gf3d_indirect.device,gf3d_indirect.pipeline,NULL);
+    if (gf3d_indirect.pipelineLayout != VK_NULL_HANDLE)vkDestroyPipelineLayout(gf3d_indirect.device,gf3d_indirect.pipelineLayout,NULL);
+    if (gf3d_indirect.descriptorPool != VK_NULL_HANDLE)vkDestroyDescriptorPool(gf3d_indirect.device,gf3d_indirect.descriptorPool,NULL);
+    if (gf3d_indirect.descriptorSetLayout != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorSetLayout(gf3d_indirect.device,gf3d_indirect.descriptorSetLayout,NULL);
+    }
+    if (gf3d_indirect.lock)SDL_DestroyMutex(gf3d_indirect.lock);
+    if (gf3d_indirect.object_list)free(gf3d_indirect.object_list);
+    if (gf3d_indirect.objectBatch)free(gf3d_indirect.objectBatch);
+    if (gf3d_indirect.slotVersion)free(gf3d_indirect.slotVersion);
+    memset(&gf3d_indirect,0,sizeof(IndirectManager));
+    slog("indirect scene closed");
+}
+
+void gf3d_indirect_init(Uint32 object_max)
+{
+    if (!object_max)
+    {
+        slog("cannot initialize an indirect scene for 0 objects");
+        return;
+    }
+    gf3d_indirect.device = gf3d_vgraphics_get_default_logical_device();
+    gf3d_indirect.object_list = (IndirectObject *)gfc_allocate_array(sizeof(IndirectObject),object_max);
+    gf3d_indirect.objectBatch = (Uint32 *)gfc_allocate_array(sizeof(Uint32),object_max);
+    gf3d_indirect.slotVersion = (Uint32 *)gfc_allocate_array(sizeof(Uint32),object_max);
+    gf3d_indirect.lock = SDL_CreateMutex();
+    if ((!gf3d_indirect.object_list)||(!gf3d_indirect.objectBatch)||(!gf3d_indirect.slotVersion)||(!gf3d_indirect.lock))
+    {
+        slog("failed to allocate indirect scene");
+        gf3d_indirect_close();
+        return;
+    }
+    gf3d_indirect.object_max = object_max;
+    gf3d_indirect.version = 1;
+    gf3d_indirect.layoutVersion = 1;
+    atexit(gf3d_indirect_close);
+    gf3d_indirect.gpu = gf3d_indirect_gpu_setup();
+    if (!gf3d_indirect.gpu)
+    {
+        slog("indirect scene is culled on the CPU");
+    }
+    slog("indirect scene initialized");
+}
+
+Bool gf3d_indirect_gpu_enabled()
+{
+    return gf3d_indirect.gpu;
+}
+
+/**
+ * @brief create the cull pass: its descriptor set layout, pipeline layout and compute pipeline
+ */
+static Bool gf3d_indirect_pipeline_create()
+{
+    int i;
+    char *shader;
+    size_t shaderSize = 0;
+    VkShaderModule module;
+    VkDescriptorSetLayoutBinding bindings[3] = {0};
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
+    VkPushConstantRange pushConstantRange = {0};
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
+    VkComputePipelineCreateInfo pipelineInfo = {0};
+    VkResult result;
+
+    // objects, draw commands, draw counts
+    for (i = 0; i < 3; i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 3;
+    layoutInfo.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(gf3d_indirect.device, &layoutInfo, NULL, &gf3d_indirect.descriptorSetLayout) != VK_SUCCESS)
+    {
+        slog("failed to create cull descriptor set layout");
+        return 0;
+    }
+
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(IndirectCullConstants);
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &gf3d_indirect.descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(gf3d_indirect.device, &pipelineLayoutInfo, NULL, &gf3d_indirect.pipelineLayout) != VK_SUCCESS)
+    {
+        slog("failed to create cull pipeline layout");
+        return 0;
+    }
+
+    shader = gf3d_shaders_load_data(INDIRECT_CULL_SHADER,&shaderSize);
+    if (!shader)
+    {
+        slog("failed to load cull shader %s",INDIRECT_CULL_SHADER);
+        return 0;
+    }
+    module = gf3d_shaders_create_module(shader,shaderSize,gf3d_indirect.device);
+    free(shader);
+    if (module == VK_NULL_HANDLE)
+    {
+        slog("failed to create cull shader module");
+        return 0;
+    }
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = gf3d_indirect.pipelineLayout;
+    result = vkCreateComputePipelines(gf3d_indirect.device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &gf3d_indirect.pipeline);
+    vkDestroyShaderModule(gf3d_indirect.device,module,NULL);
+    if (result != VK_SUCCESS)
+    {
+        slog("failed to create cull pipeline");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief create a frame's buffers, command pool and descriptor set
+ */
+static Bool gf3d_indirect_frame_create(IndirectFrame *frame)
+{
+    int i;
+    VkMemoryPropertyFlags hostProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    VkDescriptorSetAllocateInfo allocInfo = {0};
+    VkDescriptorBufferInfo bufferInfo[3] = {0};
+    VkWriteDescriptorSet descriptorWrite[3] = {0};
+
+    // the host writes these only when the scene changes, the GPU reads them every frame
+    if (gf3d_memory_device_local_is_host_visible())hostProperties |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    if ((!gf3d_buffer_create(
+            sizeof(IndirectCullObject) * gf3d_indirect.object_max,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            hostProperties,
+            &frame->objectBuffer,
+            &frame->objectAllocation))||
+        (!gf3d_buffer_create(
+            sizeof(MeshInstance) * gf3d_indirect.object_max,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            hostProperties,
+            &frame->instanceBuffer,
+            &frame->instanceAllocation))||
+        (!gf3d_buffer_create(
+            sizeof(VkDrawIndexedIndirectCommand) * gf3d_indirect.object_max,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &frame->drawBuffer,
+            &frame->drawAllocation))||
+        (!gf3d_buffer_create(
+            sizeof(Uint32) * GF3D_INDIRECT_BATCH_MAX,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &frame->countBuffer,
+            &frame->countAllocation)))
+    {
+        slog("failed to create indirect scene buffers");
+        return 0;
+    }
+    if ((!frame->objectAllocation.mapped)||(!frame->instanceAllocation.mapped))
+    {
+        slog("indirect scene buffers are not mapped");
+        return 0;
+    }
+
+    frame->commandPool = gf3d_command_graphics_pool_setup(1);
+    if ((!frame->commandPool)||(!gf3d_command_pool_add_secondary_buffers(frame->commandPool,MVF_MAX)))
+    {
+        slog("failed to set up indirect scene command pool");
+        return 0;
+    }
+
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = gf3d_indirect.descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &gf3d_indirect.descriptorSetLayout;
+    if (vkAllocateDescriptorSets(gf3d_indirect.device, &allocInfo, &frame->descriptorSet) != VK_SUCCESS)
+    {
+        slog("failed to allocate cull descriptor set");
+        return 0;
+    }
+    bufferInfo[0].buffer = frame->objectBuffer;
+    bufferInfo[1].buffer = frame->drawBuffer;
+    bufferInfo[2].buffer = frame->countBuffer;
+    for (i = 0; i < 3; i++)
+    {
+        bufferInfo[i].offset = 0;
+        bufferInfo[i].range = VK_WHOLE_SIZE;
+        descriptorWrite[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite[i].dstSet = frame->descriptorSet;
+        descriptorWrite[i].dstBinding = i;
+        descriptorWrite[i].dstArrayElement = 0;
+        descriptorWrite[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrite[i].descriptorCount = 1;
+        descriptorWrite[i].pBufferInfo = &bufferInfo[i];
+    }
+    vkUpdateDescriptorSets(gf3d_indirect.device, 3, descriptorWrite, 0, NULL);
+    return 1;
+}
+
+/**
+ * @brief set up everything the compute path needs
+ * @return 0 if the device cannot run it, so the CPU path is used
+ */
+static Bool gf3d_indirect_gpu_setup()
+{
+    int i;
+    GF3D_Device *gpu;
+    VkDescriptorPoolSize poolSize = {0};
+    VkDescriptorPoolCreateInfo poolInfo = {0};
+
+    gpu = gf3d_device_get_chosen_gpu_info();
+    // one indirect call draws many objects, each finding its instance through firstInstance
+    if ((!gpu)||(!gpu->deviceFeatures.multiDrawIndirect)||(!gpu->deviceFeatures.drawIndirectFirstInstance))
+    {
+        slog("device lacks multi draw indirect with first instance");
+        return 0;
+    }
+    if (!gf3d_indirect_pipeline_create())return 0;
+
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = 3 * GF3D_VGRAPHICS_FRAMES_IN_FLIGHT;
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = GF3D_VGRAPHICS_FRAMES_IN_FLIGHT;
+    if (vkCreateDescriptorPool(gf3d_indirect.device, &poolInfo, NULL, &gf3d_indirect.descriptorPool) != VK_SUCCESS)
+    {
+        slog("failed to create cull descriptor pool");
+        return 0;
+    }
+    for (i = 0; i < GF3D_VGRAPHICS_FRAMES_IN_FLIGHT; i++)
+    {
+        if (!gf3d_indirect_frame_create(&gf3d_indirect.frames[i]))return 0;
+    }
+    // without a GPU side count every object keeps a command, and culled ones draw no instances
+    gf3d_indirect.compact = gf3d_device_draw_indirect_count_enabled();
+    return 1;
+}
+
+/**
+ * @brief record an edit to a slot and grow every frame's dirty range to cover it
+ * @note the scene must be locked
+ */
+static void gf3d_indirect_slot_touch(Uint32 slot)
+{
+    int i;
+    IndirectFrame *frame;
+    gf3d_indirect.version++;
+    gf3d_indirect.slotVersion[slot] = gf3d_indirect.version;
+    for (i = 0; i < GF3D_VGRAPHICS_FRAMES_IN_FLIGHT; i++)
+    {
+        frame = &gf3d_indirect.frames[i];
+        if (frame->dirtyFirst == frame->dirtyEnd)
+        {
+            frame->dirtyFirst = slot;
+            frame->dirtyEnd = slot + 1;
+            continue;
+        }
+        if (slot < frame->dirtyFirst)frame->dirtyFirst = slot;
+        if (slot >= frame->dirtyEnd)frame->dirtyEnd = slot + 1;
+    }
+}
+
+IndirectObject *gf3d_indirect_object_new(Model *model,Matrix4 modelMat,Vector4D colorMod,Vector4D ambientLight)
+{
+    int i;
+    IndirectObject *object = NULL;
+    if ((!model)||(!model->mesh)||(!gf3d_indirect.object_list))return NULL;
+    SDL_LockMutex(gf3d_indirect.lock);
+    for (i = 0; i < gf3d_indirect.object_max; i++)
+    {
+        if (gf3d_indirect.object_list[i]._inuse)continue;
+        object = &gf3d_indirect.object_list[i];
+        object->_inuse = 1;
+        object->model = model;
+        gfc_matrix_copy(object->instance.model,modelMat);
+        vector4d_copy(object->instance.color,colorMod);
+        vector4d_copy(object->ambient,ambientLight);
+        gf3d_indirect_slot_touch(i);
+        gf3d_indirect.layoutVersion = gf3d_indirect.version;
+        if ((Uint32)i >= gf3d_indirect.highWater)gf3d_indirect.highWater = i + 1;
+        break;
+    }
+    SDL_UnlockMutex(gf3d_indirect.lock);
+    if (!object)slog("failed to get a new indirect object, out of space");
+    return object;
+}
+
+void gf3d_indirect_object_set_matrix(IndirectObject *object,Matrix4 modelMat)
+{
+    if ((!object)||(!object->_inuse))return;
+    SDL_LockMutex(gf3d_indirect.lock);
+    gfc_matrix_copy(object->instance.model,modelMat);
+    gf3d_indirect_slot_touch((Uint32)(object - gf3d_indirect.object_list));
+    SDL_UnlockMutex(gf3d_indirect.lock);
+}
+
+void gf3d_indirect_object_free(IndirectObject *object)
+{
+    if ((!object)||(!object->_inuse))return;
+    SDL_LockMutex(gf3d_indirect.lock);
+    memset(object,0,sizeof(IndirectObject));
+    gf3d_indirect_slot_touch((Uint32)(object - gf3d_indirect.object_list));
+    gf3d_indirect.layoutVersion = gf3d_indirect.version;
+    while ((gf3d_indirect.highWater)&&(!gf3d_indirect.object_list[gf3d_indirect.highWater - 1]._inuse))
+    {
+        gf3d_indirect.highWater--;
+    }
+    SDL_UnlockMutex(gf3d_indirect.lock);
+}
+
+/**
+ * @brief find the batch an object is drawn in, adding one if there is room
+ * @param last the batch the previous object landed in, checked first since neighbours tend to share one
+ * @return INDIRECT_BATCH_NONE if the frame is out of batches
+ */
+static Uint32 gf3d_indirect_batch_find(IndirectFrame *frame,IndirectObject *object,Uint32 last)
+{
+    Uint32 i;
+    IndirectBatch *batch;
+    for (i = 0; i <= frame->batchCount; i++)
+    {
+        // the last hit first, then the rest in order
+        if (i == frame->batchCount)
+        {
+            if (frame->batchCount >= GF3D_INDIRECT_BATCH_MAX)return INDIRECT_BATCH_NONE;
+            batch = &frame->batches[frame->batchCount];
+            memset(batch,0,sizeof(IndirectBatch));
+            batch->mesh = object->model->mesh;
+            batch->texture = object->model->texture;
+            vector4d_copy(batch->ambient,object->ambient);
+            return frame->batchCount++;
+        }
+        batch = &frame->batches[(last < frame->batchCount) ? (last + i) % frame->batchCount : i];
+        if ((batch->mesh == object->model->mesh)&&
+            (batch->texture == object->model->texture)&&
+            (memcmp(&batch->ambient,&object->ambient,sizeof(Vector4D)) == 0))
+        {
+            return (Uint32)(batch - frame->batches);
+        }
+    }
+    return INDIRECT_BATCH_NONE;
+}
+
+/**
+ * @brief rewrite the bounds and instance data of the slots moved since the frame's last upload
+ * @note the batches are unchanged, so each slot keeps its command.  The scene must be locked and the frame's fence
+ * waited on
+ */
+static void gf3d_indirect_frame_update_moved(IndirectFrame *frame)
+{
+    Uint32 i,end;
+    float radius;
+    Vector3D center;
+    Mesh *mesh;
+    IndirectObject *object;
+    IndirectCullObject *cull;
+    MeshInstance *instances;
+
+    cull = (IndirectCullObject *)frame->objectAllocation.mapped;
+    instances = (MeshInstance *)frame->instanceAllocation.mapped;
+    end = MIN(frame->dirtyEnd,frame->objectCount);
+    for (i = frame->dirtyFirst; i < end; i++)
+    {
+        if (gf3d_indirect.slotVersion[i] <= frame->version)continue;
+        object = &gf3d_indirect.object_list[i];
+        if (!object->_inuse)continue;
+        mesh = object->model->mesh;
+        radius = gf3d_frustum_transform_sphere(object->instance.model,mesh->center,mesh->radius,&center);
+        cull[i].sphere = vector4d(center.x,center.y,center.z,radius);
+        memcpy(&instances[i],&object->instance,sizeof(MeshInstance));
+    }
+}
+
+/**
+ * @brief write the scene into a frame's buffers: group the objects into batches, give each a command and bound it
+ * @note unless an object was added or freed since the frame's last upload, only the moved ones are written.  The
+ * scene must be locked and the frame's fence waited on
+ */
+static void gf3d_indirect_frame_update(IndirectFrame *frame)
+{
+    Uint32 i,b,first,last = INDIRECT_BATCH_NONE;
+    Bool warned = 0;
+    float radius;
+    Vector3D center;
+    Mesh *mesh;
+    MeshLod *level;
+    IndirectObject *object;
+    IndirectBatch *batch;
+    IndirectCullObject *cull;
+    MeshInstance *instances;
+
+    if (frame->layoutVersion == gf3d_indirect.layoutVersion)
+    {
+        gf3d_indirect_frame_update_moved(frame);
+        frame->version = gf3d_indirect.version;
+        frame->dirtyFirst = frame->dirtyEnd = 0;
+        return;
+    }
+    cull = (IndirectCullObject *)frame->objectAllocation.mapped;
+    instances = (MeshInstance *)frame->instanceAllocation.mapped;
+    frame->batchCount = 0;
+    frame->objectCount = 0;
+    for (i = 0; i < gf3d_indirect.highWater; i++)
+    {
+        object = &gf3d_indirect.object_list[i];
+        gf3d_indirect.objectBatch[i] = INDIRECT_BATCH_NONE;
+        if ((!object->_inuse)||(!object->model->mesh->indexBytes))continue;
+        b = gf3d_indirect_batch_find(frame,object,last);
+        if (b == INDIRECT_BATCH_NONE)
+        {
+            if (!warned)slog("indirect scene is out of batches (%i), some objects are not drawn",GF3D_INDIRECT_BATCH_MAX);
+            warned = 1;
+            continue;
+        }
+        gf3d_indirect.objectBatch[i] = last = b;
+        frame->batches[b].count++;
+        frame->objectCount = i + 1;
+    }
+    // each batch owns a run of commands as long as its object count
+    for (b = 0, first = 0; b < frame->batchCount; b++)
+    {
+        frame->batches[b].first = first;
+        first += frame->batches[b].count;
+        frame->batches[b].count = 0;
+    }
+    for (i = 0; i < frame->objectCount; i++)
+    {
+        b = gf3d_indirect.objectBatch[i];
+        if (b == INDIRECT_BATCH_NONE)
+        {
+            memset(&cull[i],0,sizeof(IndirectCullObject));
+            continue;
+        }
+        object = &gf3d_indirect.object_list[i];
+        batch = &frame->batches[b];
+        mesh = object->model->mesh;
+        level = gf3d_mesh_get_lod(mesh,0);
+        radius = gf3d_frustum_transform_sphere(object->instance.model,mesh->center,mesh->radius,&center);
+        cull[i].sphere = vector4d(center.x,center.y,center.z,radius);
+        cull[i].indexCount = level->indexCount;
+        cull[i].firstIndex = mesh->firstIndex + level->firstIndex;
+        cull[i].vertexOffset = (Sint32)mesh->vertexOffset;
+        cull[i].batch = b;
+        cull[i].batchFirst = batch->first;
+        cull[i].commandSlot = batch->first + batch->count++;
+        memcpy(&instances[i],&object->instance,sizeof(MeshInstance));
+    }
+    frame->version = gf3d_indirect.version;
+    frame->layoutVersion = gf3d_indirect.layoutVersion;
+    frame->dirtyFirst = frame->dirtyEnd = 0;
+}
+
+/**
+ * @brief record one indirect draw per batch into secondaries for the model pipelines and hand them to the pipelines
+ */
+static void gf3d_indirect_record_draws(IndirectFrame *frame,Uint32 bufferFrame)
+{
+    Uint32 b,format;
+    Pipeline *pipes[MVF_MAX];
+    VkCommandBuffer commandBuffers[MVF_MAX] = {0};
+    MeshBindState bound[MVF_MAX];
+    MeshPushConstants constants;
+    MeshIndirectDraws draws;
+    IndirectBatch *batch;
+
+    pipes[MVF_Full] = gf3d_mesh_get_pipeline();
+    pipes[MVF_Compact] = gf3d_mesh_get_compact_pipeline();
+    for (b = 0; b < frame->batchCount; b++)
+    {
+        batch = &frame->batches[b];
+        if (!batch->count)continue;
+        format = batch->mesh->vertexFormat;
+        if ((format >= MVF_MAX)||(!pipes[format]))continue;
+        if (commandBuffers[format] == VK_NULL_HANDLE)
+        {
+            commandBuffers[format] = gf3d_command_bundle_begin(frame->commandPool,pipes[format]);
+            if (commandBuffers[format] == VK_NULL_HANDLE)continue;
+            gf3d_mesh_bind_state_clear(&bound[format]);
+            gf3d_mesh_bind_pipe_state(pipes[format],commandBuffers[format],bufferFrame,frame->instanceBuffer);
+        }
+        memset(&constants,0,sizeof(MeshPushConstants));
+        vector4d_copy(constants.ambient,batch->ambient);
+        constants.textureIndex = batch->texture ? batch->texture->index : 0;
+        draws.buffer = frame->drawBuffer;
+        draws.offset = sizeof(VkDrawIndexedIndirectCommand) * batch->first;
+        draws.countBuffer = gf3d_indirect.compact ? frame->countBuffer : VK_NULL_HANDLE;
+        draws.countOffset = sizeof(Uint32) * b;
+        draws.maxDrawCount = batch->count;
+        gf3d_mesh_render_indirect(batch->mesh,commandBuffers[format],batch->texture,&constants,&draws,&bound[format]);
+        gf3d_upload_require(batch->mesh->uploadValue);
+        if (batch->texture)gf3d_upload_require(batch->texture->uploadValue);
+    }
+    for (format = 0; format < MVF_MAX; format++)
+    {
+        if (commandBuffers[format] == VK_NULL_HANDLE)continue;
+        gf3d_command_rendering_end(commandBuffers[format]);
+        gf3d_pipeline_add_bundle_buffer(pipes[format],commandBuffers[format]);
+    }
+}
+
+/**
+ * @brief record the cull pass: clear the counts, test every object against the frustum and write its draw
+ * @return VK_NULL_HANDLE on error, the primary command buffer otherwise
+ */
+static VkCommandBuffer gf3d_indirect_record_cull(IndirectFrame *frame)
+{
+    VkCommandBuffer commandBuffer;
+    VkCommandBufferBeginInfo beginInfo = {0};
+    VkMemoryBarrier barrier = {0};
+    IndirectCullConstants constants = {0};
+    Frustum *frustum;
+
+    commandBuffer = gf3d_command_get_graphics_buffer(frame->commandPool);
+    if (commandBuffer == VK_NULL_HANDLE)return VK_NULL_HANDLE;
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    if (gf3d_indirect.compact)
+    {
+        vkCmdFillBuffer(commandBuffer, frame->countBuffer, 0, VK_WHOLE_SIZE, 0);
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, NULL, 0, NULL);
+    }
+
+    frustum = gf3d_render_get_frustum();
+    if (frustum)memcpy(constants.planes,frustum->planes,sizeof(constants.planes));
+    constants.objectCount = frame->objectCount;
+    constants.compact = gf3d_indirect.compact;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gf3d_indirect.pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gf3d_indirect.pipelineLayout, 0, 1, &frame->descriptorSet, 0, NULL);
+    vkCmdPushConstants(commandBuffer, gf3d_indirect.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(IndirectCullConstants), &constants);
+    vkCmdDispatch(commandBuffer, (frame->objectCount + INDIRECT_GROUP_SIZE - 1) / INDIRECT_GROUP_SIZE, 1, 1);
+
+    // the frame's render pass reads what was written as draw parameters
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        0, 1, &barrier, 0, NULL, 0, NULL);
+
+    vkEndCommandBuffer(commandBuffer);
+    return commandBuffer;
+}
+
+/**
+ * @brief cull the scene on the CPU and draw what is visible through the draw queue
+ */
+static void gf3d_indirect_flush_cpu()
+{
+    Uint32 i;
+    float radius;
+    Vector3D center;
+    Frustum *frustum;
+    IndirectObject *object;
+    frustum = gf3d_render_get_frustum();
+    SDL_LockMutex(gf3d_indirect.lock);
+    for (i = 0; i < gf3d_indirect.highWater; i++)
+    {
+        object = &gf3d_indirect.object_list[i];
+        if (!object->_inuse)continue;
+        radius = gf3d_frustum_transform_sphere(object->instance.model,object->model->mesh->center,object->model->mesh->radius,&center);
+        if (!gf3d_frustum_sphere_visible(frustum,center,radius))continue;
+        gf3d_model_draw_instanced(object->model,&object->instance,1,object->ambient);
+    }
+    SDL_UnlockMutex(gf3d_indirect.lock);
+}
+
+VkCommandBuffer gf3d_indirect_flush()
+{
+    Uint32 bufferFrame;
+    IndirectFrame *frame;
+    if (!gf3d_indirect.object_list)return VK_NULL_HANDLE;
+    if (!gf3d_indirect.gpu)
+    {
+        gf3d_indirect_flush_cpu();
+        return VK_NULL_HANDLE;
+    }
+    bufferFrame = gf3d_vgraphics_get_current_frame();
+    frame = &gf3d_indirect.frames[bufferFrame];
+    // the frame's fence has been waited on, so nothing in its pool or buffers is in use
+    gf3d_command_pool_reset(frame->commandPool);
+    SDL_LockMutex(gf3d_indirect.lock);
+    if (frame->version != gf3d_indirect.version)
+    {
+        gf3d_indirect_frame_update(frame);
+    }
+    SDL_UnlockMutex(gf3d_indirect.lock);
+    if (!frame->objectCount)return VK_NULL_HANDLE;
+    gf3d_indirect_record_draws(frame,bufferFrame);
+    return gf3d_indirect_record_cull(frame);
+}
+
+/*eol@eof*/
@@ -0,0 +1,668 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "simple_logger.h"
+
+#include "gf3d_memory.h"
+
+#define MM_GRANULARITY  256                 //every range is a multiple of this, so free lists never hold slivers
+#define MM_BLOCK_SIZE   (64 * 1024 * 1024)  //general blocks, smaller on small heaps
+#define MM_LINEAR_SIZE  (16 * 1024 * 1024)  //transient pool per memory type
+#define MM_PAGE_SIZE    (256 * 1024)        //carved from a general block and split into equal slots
+#define MM_CLASS_MIN    256                 //smallest size class
+#define MM_CLASS_COUNT  7                   //size classes double from MM_CLASS_MIN up to 16KiB
+#define MM_CLASS_MAX    (MM_CLASS_MIN << (MM_CLASS_COUNT - 1))
+
+typedef enum
+{
+    MBK_General = 0,
+    MBK_Linear,
+    MBK_Dedicated
+}MemoryBlockKind;
+
+typedef struct
+{
+    VkDeviceSize    offset;
+    VkDeviceSize    size;
+}MemoryRange;
+
+typedef struct MemoryBlock_S
+{
+    VkDeviceMemory          memory;
+    VkDeviceSize            size;
+    Uint8                  *mapped;         /**<the whole block, mapped once if host visible*/
+    MemoryBlockKind         kind;
+    Uint32                  allocationCount;/**<live ranges and pages*/
+    VkDeviceSize            used;
+    MemoryRange            *free;           /**<general blocks: free ranges sorted by offset, neighbours merged*/
+    Uint32                  freeCount;
+    Uint32                  freeMax;
+    VkDeviceSize            head;           /**<linear blocks: next free byte*/
+    struct MemoryBlock_S   *next;
+}MemoryBlock;
+
+typedef struct MemoryPage_S
+{
+    MemoryBlock            *block;          /**<the general block the page was carved from*/
+    VkDeviceSize            offset;         /**<of the page in the block*/
+    VkDeviceSize            slotSize;
+    Uint32                  slotCount;
+    Uint32                  freeCount;
+    Uint16                 *freeSlots;      /**<stack of unused slot indices*/
+    struct MemoryPage_S    *next;
+}MemoryPage;
+
+typedef struct
+{
+    MemoryBlock    *blocks;                 /**<general blocks, the first is kept even when empty*/
+    MemoryBlock    *linear;
+    MemoryPage     *pages[MM_CLASS_COUNT];
+}MemoryPool;
+
+typedef struct
+{
+    VkDevice                            device;
+    VkPhysicalDeviceMemoryProperties    properties;
+    VkDeviceSize                        blockSize[VK_MAX_MEMORY_TYPES];
+    MemoryPool                          pools[VK_MAX_MEMORY_TYPES][2];  /**<buffers, then images, kept apart for bufferImageGranularity*/
+    MemoryBlock                        *dedicated;
+    Uint32                              allocationCount;
+    VkDeviceSize                        bytesUsed;
+    Bool                                deviceLocalHostVisible; /**<the main device local heap can also be mapped*/
+    SDL_mutex                          *lock;                   /**<the render thread can allocate while the simulation reads stats*/
+}MemoryManager;
+
+static MemoryManager gf3d_memory = {0};
+
+static int gf3d_memory_find_type(Uint32 typeFilter,VkMemoryPropertyFlags properties);
+
+static VkDeviceSize gf3d_memory_align(VkDeviceSize value,VkDeviceSize alignment)
+{
+    if (!alignment)return value;
+    return ((value + alignment - 1) / alignment) * alignment;
+}
+
+static void gf3d_memory_block_delete(MemoryBlock *block)
+{
+    if (!block)return;
+    // freeing the memory unmaps it too
+    if (block->memory != VK_NULL_HANDLE)vkFreeMemory(gf3d_memory.device, block->memory, NULL);
+    if (block->free)free(block->free);
+    free(block);
+}
+
+static void gf3d_memory_page_delete(MemoryPage *page)
+{
+    if (!page)return;
+    if (page->freeSlots)free(page->freeSlots);
+    free(page);
+}
+
+void gf3d_memory_close()
+{
+    int i,j,c;
+    MemoryBlock *block,*next;
+    MemoryPage *page,*nextPage;
+    MemoryPool *pool;
+    if (gf3d_memory.allocationCount)
+    {
+        slog("device memory closed with %i allocations still live",gf3d_memory.allocationCount);
+    }
+    for (i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            pool = &gf3d_memory.pools[i][j];
+            for (c = 0; c < MM_CLASS_COUNT; c++)
+            {
+                for (page = pool->pages[c]; page; page = nextPage)
+                {
+                    nextPage = page->next;
+                    gf3d_memory_page_delete(page);
+                }
+            }
+            for (block = pool->blocks; block; block = next)
+            {
+                next = block->next;
+                gf3d_memory_block_delete(block);
+            }
+            gf3d_memory_block_delete(pool->linear);
+        }
+    }
+    for (block = gf3d_memory.dedicated; block; block = next)
+    {
+        next = block->next;
+        gf3d_memory_block_delete(block);
+    }
+    if (gf3d_memory.lock)SDL_DestroyMutex(gf3d_memory.lock);
+    memset(&gf3d_memory,0,sizeof(MemoryManager));
+    slog("device memory closed");
+}
+
+/**
+ * @brief check for memory that is device local and mappable on the same heap as the rest of device local memory.
+ * Software drivers, integrated GPUs and resizable BAR have it.  The small BAR window of other discrete GPUs is its own heap and is left alone
+ */
+static void gf3d_memory_setup_direct_write()
+{
+    int deviceLocal,direct;
+    deviceLocal = gf3d_memory_find_type(~0u,VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    direct = gf3d_memory_find_type(~0u,VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if ((deviceLocal < 0)||(direct < 0))return;
+    if (gf3d_memory.properties.memoryTypes[deviceLocal].heapIndex != gf3d_memory.properties.memoryTypes[direct].heapIndex)return;
+    gf3d_memory.deviceLocalHostVisible = 1;
+    slog("device local memory is host visible, buffers will be written directly");
+}
+
+void gf3d_memory_init(VkPhysicalDevice gpu,VkDevice device)
+{
+    Uint32 i;
+    VkDeviceSize heapSize,blockSize;
+    memset(&gf3d_memory,0,sizeof(MemoryManager));
+    gf3d_memory.device = device;
+    vkGetPhysicalDeviceMemoryProperties(gpu, &gf3d_memory.properties);
+    for (i = 0; i < gf3d_memory.properties.memoryTypeCount; i++)
+    {
+        // small heaps, such as host visible device memory, get smaller blocks so one block cannot claim it all
+        heapSize = gf3d_memory.properties.memoryHeaps[gf3d_memory.properties.memoryTypes[i].heapIndex].size;
+        blockSize = MM_BLOCK_SIZE;
+        if (heapSize / 8 < blockSize)blockSize = (heapSize / 8 / MM_PAGE_SIZE) * MM_PAGE_SIZE;
+        if (blockSize < MM_PAGE_SIZE)blockSize = MM_PAGE_SIZE;
+        gf3d_memory.blockSize[i] = blockSize;
+    }
+    gf3d_memory_setup_direct_write();
+    gf3d_memory.lock = SDL_CreateMutex();
+    if (!gf3d_memory.lock)slog("failed to create device memory lock: %s",SDL_GetError());
+    atexit(gf3d_memory_close);
+    slog("device memory initialized");
+}
+
+static int gf3d_memory_find_type(Uint32 typeFilter,VkMemoryPropertyFlags properties)
+{
+    Uint32 i;
+    for (i = 0; i < gf3d_memory.properties.memoryTypeCount; i++)
+    {
+        if ((typeFilter & (1 << i)) && ((gf3d_memory.properties.memoryTypes[i].propertyFlags & properties) == properties))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static MemoryBlock *gf3d_memory_block_new(Uint32 memoryType,VkDeviceSize size,MemoryBlockKind kind)
+{
+    MemoryBlock *block;
+    VkMemoryAllocateInfo allocInfo = {0};
+    block = (MemoryBlock *)gfc_allocate_array(sizeof(MemoryBlock),1);
+    if (!block)return NULL;
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+    if (vkAllocateMemory(gf3d_memory.device, &allocInfo, NULL, &block->memory) != VK_SUCCESS)
+    {
+        slog("failed to allocate %i bytes of device memory",(int)size);
+        free(block);
+        return NULL;
+    }
+    block->size = size;
+    block->kind = kind;
+    if (gf3d_memory.properties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        if (vkMapMemory(gf3d_memory.device, block->memory, 0, VK_WHOLE_SIZE, 0, (void **)&block->mapped) != VK_SUCCESS)
+        {
+            slog("failed to map device memory block");
+            gf3d_memory_block_delete(block);
+            return NULL;
+        }
+    }
+    if (kind == MBK_General)
+    {
+        block->freeMax = 16;
+        block->free = (MemoryRange *)gfc_allocate_array(sizeof(MemoryRange),block->freeMax);
+        if (!block->free)
+        {
+            gf3d_memory_block_delete(block);
+            return NULL;
+        }
+        block->free[0].offset = 0;
+        block->free[0].size = size;
+        block->freeCount = 1;
+    }
+    return block;
+}
+
+/**
+ * @brief make room for one more free range at index i
+ */
+static Bool gf3d_memory_block_insert_range(MemoryBlock *block,Uint32 i)
+{
+    MemoryRange *grown;
+    if (block->freeCount >= block->freeMax)
+    {
+        grown = (MemoryRange *)realloc(block->free,sizeof(MemoryRange) * block->freeMax * 2);
+        if (!grown)return 0;
+        block->free = grown;
+        block->freeMax *= 2;
+    }
+    memmove(&block->free[i + 1],&block->free[i],sizeof(MemoryRange) * (block->freeCount - i));
+    block->freeCount++;
+    return 1;
+}
+
+static Bool gf3d_memory_block_take(MemoryBlock *block,VkDeviceSize size,VkDeviceSize alignment,VkDeviceSize *offset)
+{
+    Uint32 i;
+    VkDeviceSize start,front,back;
+    MemoryRange *range;
+    for (i = 0; i < block->freeCount; i++)
+    {
+        range = &block->free[i];
+        start = gf3d_memory_align(range->offset,alignment);
+        if (start + size > range->offset + range->size)continue;
+        front = start - range->offset;
+        back = range->offset + range->size - (start + size);
+        if ((front)&&(back))
+        {
+            // the padding before an aligned start stays free on its own
+            if (!gf3d_memory_block_insert_range(block,i + 1))return 0;
+            range = &block->free[i];
+            range->size = front;
+            block->free[i + 1].offset = start + size;
+            block->free[i + 1].size = back;
+        }
+        else if (front)range->size = front;
+        else if (back)
+        {
+            range->offset = start + size;
+            range->size = back;
+        }
+        else
+        {
+            memmove(&block->free[i],&block->free[i + 1],sizeof(MemoryRange) * (block->freeCount - i - 1));
+            block->freeCount--;
+        }
+        block->used += size;
+        block->allocationCount++;
+        *offset = start;
+        return 1;
+    }
+    return 0;
+}
+
+static void gf3d_memory_block_give(MemoryBlock *block,VkDeviceSize offset,VkDeviceSize size)
+{
+    Uint32 i;
+    Bool mergePrev,mergeNext;
+    for (i = 0; i < block->freeCount; i++)
+    {
+        if (block->free[i].offset > offset)break;
+    }
+    block->used -= size;
+    block->allocationCount--;
+    mergePrev = (i > 0)&&(block->free[i - 1].offset + block->free[i - 1].size == offset);
+    mergeNext = (i < block->freeCount)&&(offset + size == block->free[i].offset);
+    if ((mergePrev)&&(mergeNext))
+    {
+        block->free[i - 1].size += size + block->free[i].size;
+        memmove(&block->free[i],&block->free[i + 1],sizeof(MemoryRange) * (block->freeCount - i - 1));
+        block->freeCount--;
+        return;
+    }
+    if (mergePrev)
+    {
+        block->free[i - 1].size += size;
+        return;
+    }
+    if (mergeNext)
+    {
+        block->free[i].offset = offset;
+        block->free[i].size += size;
+        return;
+    }
+    if (!gf3d_memory_block_insert_range(block,i))
+    {
+        slog("failed to grow device memory free list, %i bytes are lost",(int)size);
+        return;
+    }
+    block->free[i].offset = offset;
+    block->free[i].size = size;
+}
+
+/**
+ * @brief take a range from the first general block of a pool with room, adding a block if none has
+ */
+static MemoryBlock *gf3d_memory_general_take(MemoryPool *pool,Uint32 memoryType,VkDeviceSize size,VkDeviceSize alignment,VkDeviceSize *offset)
+{
+    MemoryBlock *block,*last = NULL;
+    for (block = pool->blocks; block; block = block->next)
+    {
+        if (gf3d_memory_block_take(block,size,alignment,offset))return block;
+        last = block;
+    }
+    block = gf3d_memory_block_new(memoryType,gf3d_memory.blockSize[memoryType],MBK_General);
+    if (!block)return NULL;
+    if (last)last->next = block;
+    else pool->blocks = block;
+    if (!gf3d_memory_block_take(block,size,alignment,offset))return NULL;
+    return block;
+}
+
+/**
+ * @brief give a range back to a general block, releasing the block if it empties and is not the pool's first
+ */
+static void gf3d_memory_general_give(MemoryPool *pool,MemoryBlock *block,VkDeviceSize offset,VkDeviceSize size)
+{
+    MemoryBlock *prev;
+    gf3d_memory_block_give(block,offset,size);
+    if ((block->allocationCount)||(block == pool->blocks))return;
+    for (prev = pool->blocks; prev; prev = prev->next)
+    {
+        if (prev->next != block)continue;
+        prev->next = block->next;
+        gf3d_memory_block_delete(block);
+        return;
+    }
+}
+
+static MemoryPage *gf3d_memory_page_new(MemoryPool *pool,Uint32 memoryType,Uint32 sizeClass)
+{
+    Uint32 i;
+    MemoryPage *page;
+    page = (MemoryPage *)gfc_allocate_array(sizeof(MemoryPage),1);
+    if (!page)return NULL;
+    page->slotSize = MM_CLASS_MIN << sizeClass;
+    page->slotCount = MM_PAGE_SIZE / page->slotSize;
+    page->freeSlots = (Uint16 *)gfc_allocate_array(sizeof(Uint16),page->slotCount);
+    if (!page->freeSlots)
+    {
+        gf3d_memory_page_delete(page);
+        return NULL;
+    }
+    // pages start on the largest class size, so every slot is aligned to its own size
+    page->block = gf3d_memory_general_take(pool,memoryType,MM_PAGE_SIZE,MM_CLASS_MAX,&page->offset);
+    if (!page->block)
+    {
+        gf3d_memory_page_delete(page);
+        return NULL;
+    }
+    for (i = 0; i < page->slotCount; i++)
+    {
+        page->freeSlots[i] = (Uint16)(page->slotCount - 1 - i);
+    }
+    page->freeCount = page->slotCount;
+    page->next = pool->pages[sizeClass];
+    pool->pages[sizeClass] = page;
+    return page;
+}
+
+/**
+ * @brief bump allocate from the pool's linear block, 0 if it is full so the request falls back to the general blocks
+ */
+static Bool gf3d_memory_linear_take(MemoryPool *pool,Uint32 memoryType,VkDeviceSize size,VkDeviceSize alignment,VkDeviceSize *offset)
+{
+    VkDeviceSize start;
+    if (size > MM_LINEAR_SIZE / 2)return 0;
+    if (!pool->linear)pool->linear = gf3d_memory_block_new(memoryType,MM_LINEAR_SIZE,MBK_Linear);
+    if (!pool->linear)return 0;
+    start = gf3d_memory_align(pool->linear->head,alignment);
+    if (start + size > pool->linear->size)return 0;
+    pool->linear->head = start + size;
+    pool->linear->used += size;
+    pool->linear->allocationCount++;
+    *offset = start;
+    return 1;
+}
+
+static Bool gf3d_memory_allocate_locked(
+    const VkMemoryRequirements *requirements,
+    VkMemoryPropertyFlags properties,
+    MemoryUsage usage,
+    Bool image,
+    MemoryAllocation *allocation)
+{
+    int memoryType;
+    Uint32 sizeClass;
+    VkDeviceSize size,alignment;
+    MemoryPool *pool;
+    MemoryBlock *block;
+    MemoryPage *page;
+    if ((!requirements)||(!allocation))return 0;
+    memset(allocation,0,sizeof(MemoryAllocation));
+    if (!gf3d_memory.device)
+    {
+        slog("device memory allocator is not initialized");
+        return 0;
+    }
+    memoryType = gf3d_memory_find_type(requirements->memoryTypeBits,properties);
+    if (memoryType < 0)
+    {
+        slog("failed to find suitable memory type!");
+        return 0;
+    }
+    pool = &gf3d_memory.pools[memoryType][image ? 1 : 0];
+    size = gf3d_memory_align(requirements->size,MM_GRANULARITY);
+    alignment = gf3d_memory_align(requirements->alignment,MM_GRANULARITY);
+    allocation->size = requirements->size;
+
+    if ((usage == MU_Dedicated)||(size >= gf3d_memory.blockSize[memoryType] / 2))
+    {
+        block = gf3d_memory_block_new(memoryType,requirements->size,MBK_Dedicated);
+        if (!block)return 0;
+        block->allocationCount = 1;
+        block->used = size;
+        block->next = gf3d_memory.dedicated;
+        gf3d_memory.dedicated = block;
+        allocation->_block = block;
+        allocation->offset = 0;
+    }
+    else if ((usage == MU_Transient)&&(!image)&&(gf3d_memory_linear_take(pool,memoryType,size,alignment,&allocation->offset)))
+    {
+        allocation->_block = pool->linear;
+    }
+    else if ((size <= MM_CLASS_MAX)&&(alignment <= MM_CLASS_MAX))
+    {
+        for (sizeClass = 0; (MM_CLASS_MIN << sizeClass) < size; sizeClass++);
+        while ((MM_CLASS_MIN << sizeClass) < alignment)sizeClass++;
+        for (page = pool->pages[sizeClass]; page; page = page->next)
+        {
+            if (page->freeCount)break;
+        }
+        if (!page)page = gf3d_memory_page_new(pool,memoryType,sizeClass);
+        if (!page)return 0;
+        page->freeCount--;
+        size = page->slotSize;
+        allocation->_block = page->block;
+        allocation->_page = page;
+        allocation->offset = page->offset + page->freeSlots[page->freeCount] * page->slotSize;
+    }
+    else
+    {
+        block = gf3d_memory_general_take(pool,memoryType,size,alignment,&allocation->offset);
+        if (!block)return 0;
+        allocation->_block = block;
+    }
+    block = (MemoryBlock *)allocation->_block;
+    allocation->memory = block->memory;
+    if (block->mapped)allocation->mapped = block->mapped + allocation->offset;
+    gf3d_memory.allocationCount++;
+    gf3d_memory.bytesUsed += size;
+    return 1;
+}
+
+Bool gf3d_memory_allocate(
+    const VkMemoryRequirements *requirements,
+    VkMemoryPropertyFlags properties,
+    MemoryUsage usage,
+    Bool image,
+    MemoryAllocation *allocation)
+{
+    Bool result;
+    if (gf3d_memory.lock)SDL_LockMutex(gf3d_memory.lock);
+    result = gf3d_memory_allocate_locked(requirements,properties,usage,image,allocation);
+    if (gf3d_memory.lock)SDL_UnlockMutex(gf3d_memory.lock);
+    return result;
+}
+
+Bool gf3d_memory_bind_image(VkImage image,VkMemoryPropertyFlags properties,MemoryAllocation *allocation)
+{
+    VkMemoryRequirements memRequirements;
+    if ((image == VK_NULL_HANDLE)||(!allocation))return 0;
+    vkGetImageMemoryRequirements(gf3d_memory.device, image, &memRequirements);
+    if (!gf3d_memory_allocate(&memRequirements,properties,MU_Default,1,allocation))return 0;
+    if (vkBindImageMemory(gf3d_memory.device, image, allocation->memory, allocation->offset) != VK_SUCCESS)
+    {
+        slog("failed to bind image memory");
+        gf3d_memory_free(allocation);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief find the pool a general block or page belongs to
+ */
+static MemoryPool *gf3d_memory_find_pool(MemoryBlock *block)
+{
+    int i,j;
+    MemoryBlock *it;
+    for (i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            for (it = gf3d_memory.pools[i][j].blocks; it; it = it->next)
+            {
+                if (it == block)return &gf3d_memory.pools[i][j];
+            }
+        }
+    }
+    return NULL;
+}
+
+static void gf3d_memory_page_release(MemoryPool *pool,MemoryPage *page)
+{
+    Uint32 c;
+    MemoryPage **link;
+    for (c = 0; (MM_CLASS_MIN << c) < page->slotSize; c++);
+    for (link = &pool->pages[c]; *link; link = &(*link)->next)
+    {
+        if (*link != page)continue;
+        *link = page->next;
+        break;
+    }
+    gf3d_memory_general_give(pool,page->block,page->offset,MM_PAGE_SIZE);
+    gf3d_memory_page_delete(page);
+}
+
+static void gf3d_memory_free_locked(MemoryAllocation *allocation)
+{
+    MemoryBlock *block,**link;
+    MemoryPage *page;
+    MemoryPool *pool;
+    VkDeviceSize size;
+    if ((!allocation)||(!allocation->_block))return;
+    block = (MemoryBlock *)allocation->_block;
+    page = (MemoryPage *)allocation->_page;
+    size = gf3d_memory_align(allocation->size,MM_GRANULARITY);
+    if (page)
+    {
+        size = page->slotSize;
+        page->freeSlots[page->freeCount++] = (Uint16)((allocation->offset - page->offset) / page->slotSize);
+        if (page->freeCount == page->slotCount)
+        {
+            pool = gf3d_memory_find_pool(page->block);
+            if (pool)gf3d_memory_page_release(pool,page);
+        }
+    }
+    else if (block->kind == MBK_Dedicated)
+    {
+        for (link = &gf3d_memory.dedicated; *link; link = &(*link)->next)
+        {
+            if (*link != block)continue;
+            *link = block->next;
+            break;
+        }
+        gf3d_memory_block_delete(block);
+    }
+    else if (block->kind == MBK_Linear)
+    {
+        block->used -= size;
+        block->allocationCount--;
+        // once everything staged has been freed the pool starts over
+        if (!block->allocationCount)block->head = 0;
+    }
+    else
+    {
+        pool = gf3d_memory_find_pool(block);
+        if (pool)gf3d_memory_general_give(pool,block,allocation->offset,size);
+    }
+    gf3d_memory.allocationCount--;
+    gf3d_memory.bytesUsed -= size;
+    memset(allocation,0,sizeof(MemoryAllocation));
+}
+
+void gf3d_memory_free(MemoryAllocation *allocation)
+{
+    if ((!allocation)||(!allocation->_block))return;
+    if (gf3d_memory.lock)SDL_LockMutex(gf3d_memory.lock);
+    gf3d_memory_free_locked(allocation);
+    if (gf3d_memory.lock)SDL_UnlockMutex(gf3d_memory.lock);
+}
+
+Bool gf3d_memory_device_local_is_host_visible()
+{
+    return gf3d_memory.deviceLocalHostVisible;
+}
+
+void gf3d_memory_get_stats(MemoryStats *stats)
+{
+    int i,j,c;
+    Uint32 r;
+    MemoryBlock *block;
+    MemoryPage *page;
+    MemoryPool *pool;
+    VkDeviceSize freeBytes = 0,largest = 0;
+    if (!stats)return;
+    memset(stats,0,sizeof(MemoryStats));
+    if (gf3d_memory.lock)SDL_LockMutex(gf3d_memory.lock);
+    for (i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            pool = &gf3d_memory.pools[i][j];
+            for (block = pool->blocks; block; block = block->next)
+            {
+                stats->blockCount++;
+                stats->bytesReserved += block->size;
+                for (r = 0; r < block->freeCount; r++)
+                {
+                    freeBytes += block->free[r].size;
+                    if (block->free[r].size > largest)largest = block->free[r].size;
+                }
+            }
+            if (pool->linear)
+            {
+                stats->blockCount++;
+                stats->bytesReserved += pool->linear->size;
+            }
+            for (c = 0; c < MM_CLASS_COUNT; c++)
+            {
+                for (page = pool->pages[c]; page; page = page->next)stats->pageCount++;
+            }
+        }
+    }
+    for (block = gf3d_memory.dedicated; block; block = block->next)
+    {
+        stats->blockCount++;
+        stats->dedicatedCount++;
+        stats->bytesReserved += block->size;
+    }
+    stats->allocationCount = gf3d_memory.allocationCount;
+    stats->bytesUsed = gf3d_memory.bytesUsed;
+    if (gf3d_memory.lock)SDL_UnlockMutex(gf3d_memory.lock);
+    if (freeBytes)stats->fragmentation = 1.0f - (float)largest / (float)freeBytes;
+}
+
+/*eol@eof*/
@@ -1,3 +1,6 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stddef.h>
 
 #include "simple_logger.h"
@@ -5,6 +8,13 @@
 #include "gf3d_buffers.h"
 #include "gf3d_vgraphics.h"
 #include "gf3d_obj_load.h"
+#include "gf3d_mesh_cache.h"
+#include "gf3d_mesh_simplify.h"
+#include "gf3d_mesh_cluster.h"
+#include "gf3d_mesh_arena.h"
+#include "gf3d_upload.h"
+#include "gf3d_device.h"
+#include "gf3d_record.h"
 #include "gf3d_swapchain.h"
 #include "gf3d_commands.h"
 #include "gf3d_pipeline.h"
@@ -12,6 +22,38 @@
 
 
 #define ATTRIBUTE_COUNT 3
+#define INSTANCE_ATTRIBUTE_COUNT 5  //4 columns of the model matrix and the color
+#define MESH_INSTANCE_MAX 32768     //per frame, across all instanced draws
+#define MESH_ARENA_VERTEX_BYTES (64 * 1024 * 1024)  //vertex data of every loaded mesh
+#define MESH_ARENA_INDEX_BYTES  (32 * 1024 * 1024)  //index data of every loaded mesh
+
+/**
+ * @purpose per frame ring of instance data, bound as vertex binding 1 of the model pipeline
+ */
+typedef struct
+{
+    VkBuffer        buffer;
+    MemoryAllocation allocation;
+    MeshInstance   *mapped;         /**<persistently mapped*/
+    SDL_atomic_t    used;           /**<instances claimed so far this frame, by any recording thread*/
+}MeshInstanceBuffer;
+
+/**
+ * @purpose what one recording thread last bound on each mesh pipeline this frame, so repeated binds are skipped
+ */
+typedef struct
+{
+    VkDescriptorSet modelMaterial;      /**<texture set last bound to the model pipeline this frame*/
+    VkDescriptorSet compactMaterial;
+    VkDescriptorSet skyMaterial;
+    VkIndexType modelIndexType;         /**<index type the arena was last bound with on the model pipeline this frame*/
+    VkIndexType compactIndexType;
+    VkIndexType highlightIndexType;
+    VkIndexType compactHighlightIndexType;
+    VkIndexType skyIndexType;
+    Uint32 clustersDrawn;               /**<since the frame began*/
+    Uint32 clustersCulled;
+}MeshThreadState;
 
 typedef struct
 {
@@ -19,20 +61,85 @@ typedef struct
     Pipeline *pipe;
     Pipeline *highlight_pipe;
     Pipeline *sky_pipe;
+    Pipeline *compact_pipe;             /**<model pipeline for MVF_Compact meshes*/
+    Pipeline *compact_highlight_pipe;   /**<highlight pipeline for MVF_Compact meshes*/
     Uint32 mesh_max;
-    VkVertexInputAttributeDescription attributeDescriptions[ATTRIBUTE_COUNT];
-    VkVertexInputBindingDescription bindingDescription;
+    VkVertexInputAttributeDescription attributeDescriptions[ATTRIBUTE_COUNT + INSTANCE_ATTRIBUTE_COUNT];
+    VkVertexInputBindingDescription bindingDescription[2];  /**<per vertex data, then per instance data*/
+    VkVertexInputAttributeDescription compactAttributeDescriptions[ATTRIBUTE_COUNT + INSTANCE_ATTRIBUTE_COUNT];
+    VkVertexInputBindingDescription compactBindingDescription[2];
+    MeshInstanceBuffer instanceBuffers[GF3D_VGRAPHICS_FRAMES_IN_FLIGHT];
+    MeshArena vertexArena;          /**<every mesh's vertices, bound once per frame as binding 0*/
+    MeshArena indexArena;           /**<every mesh's indices, 16 and 32 bit side by side*/
+    MeshOptimizeMode optimizeMode;  /**<index and vertex reordering applied when meshes are built from source*/
+    Uint32 clusterMinFaces;         /**<meshes with at least this many faces are split into clusters, 0 for none*/
+    SDL_mutex *lock;                /**<the mesh list is edited by loads on the simulation thread while the render thread runs*/
     Command *stagingCommandBuffer;
+    Uint32 modelUboOffset;      /**<this frame's slice of the model pipeline's uniform ring*/
+    Uint32 highlightUboOffset;
+    Uint32 skyUboOffset;
+    Uint32 compactUboOffset;
+    Uint32 compactHighlightUboOffset;
+    MeshThreadState threads[GF3D_RECORD_THREAD_MAX + 1];   /**<the main thread, then each recording thread*/
+    Uint32 clustersDrawn;               /**<totals of the last frame recorded*/
+    Uint32 clustersCulled;
 }MeshSystem;
 
 static MeshSystem gf3d_mesh = {0};
 
 void gf3d_mesh_close();
 void gf3d_mesh_delete(Mesh *mesh);
-Mesh *gf3d_mesh_get_by_filename(const char *filename);
+Mesh *gf3d_mesh_get_by_filename(const char *filename,MeshVertexFormat format);
+void gf3d_mesh_instance_buffers_create();
+
+/**
+ * @brief create the pipelines for MVF_Compact meshes, both are left NULL if either fails
+ */
+static void gf3d_mesh_compact_pipes_create()
+{
+    Pipeline *pipe,*highlight;
+    pipe = gf3d_pipeline_create_from_config(
+        gf3d_vgraphics_get_default_logical_device(),
+        "config/model_compact_pipeline.cfg",
+        gf3d_vgraphics_get_view_extent(),
+        gf3d_mesh.mesh_max,
+        gf3d_mesh.compactBindingDescription,
+        2,
+        gf3d_mesh.compactAttributeDescriptions,
+        ATTRIBUTE_COUNT + INSTANCE_ATTRIBUTE_COUNT,
+        sizeof(MeshUBO),
+        sizeof(MeshPushConstants)
+    );
+    if (!pipe)
+    {
+        slog("failed to create the compact mesh pipeline");
+        return;
+    }
+    highlight = gf3d_pipeline_create_from_config(
+        gf3d_vgraphics_get_default_logical_device(),
+        "config/highlight_compact_pipeline.cfg",
+        gf3d_vgraphics_get_view_extent(),
+        gf3d_mesh.mesh_max,
+        gf3d_mesh.compactBindingDescription,
+        1,
+        gf3d_mesh.compactAttributeDescriptions,
+        ATTRIBUTE_COUNT,
+        sizeof(HighlightUBO),
+        sizeof(HighlightPushConstants)
+    );
+    if (!highlight)
+    {
+        slog("failed to create the compact highlight pipeline");
+        gf3d_pipeline_free(pipe);
+        return;
+    }
+    gf3d_mesh.compact_pipe = pipe;
+    gf3d_mesh.compact_highlight_pipe = highlight;
+}
 
 void gf3d_mesh_init(Uint32 mesh_max)
 {
+    int i;
     Uint32 count = 0;
     if (!mesh_max)
     {
@@ -41,10 +148,15 @@ void gf3d_mesh_init(Uint32 mesh_max)
     }
     atexit(gf3d_mesh_close);
     gf3d_mesh.mesh_max = mesh_max;
+    gf3d_mesh.optimizeMode = MO_Cache;
     
-    gf3d_mesh.bindingDescription.binding = 0;
-    gf3d_mesh.bindingDescription.stride = sizeof(Vertex);
-    gf3d_mesh.bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    gf3d_mesh.bindingDescription[0].binding = 0;
+    gf3d_mesh.bindingDescription[0].stride = sizeof(Vertex);
+    gf3d_mesh.bindingDescription[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    gf3d_mesh.bindingDescription[1].binding = 1;
+    gf3d_mesh.bindingDescription[1].stride = sizeof(MeshInstance);
+    gf3d_mesh.bindingDescription[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
 
     gf3d_mesh.attributeDescriptions[0].binding = 0;
     gf3d_mesh.attributeDescriptions[0].location = 0;
@@ -61,7 +173,33 @@ void gf3d_mesh_init(Uint32 mesh_max)
     gf3d_mesh.attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
     gf3d_mesh.attributeDescriptions[2].offset = offsetof(Vertex, texel);
 
+    // a mat4 input takes one location per column
+    for (i = 0; i < 4; i++)
+    {
+        gf3d_mesh.attributeDescriptions[ATTRIBUTE_COUNT + i].binding = 1;
+        gf3d_mesh.attributeDescriptions[ATTRIBUTE_COUNT + i].location = ATTRIBUTE_COUNT + i;
+        gf3d_mesh.attributeDescriptions[ATTRIBUTE_COUNT + i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        gf3d_mesh.attributeDescriptions[ATTRIBUTE_COUNT + i].offset = offsetof(MeshInstance, model) + (sizeof(float) * 4 * i);
+    }
+    gf3d_mesh.attributeDescriptions[ATTRIBUTE_COUNT + 4].binding = 1;
+    gf3d_mesh.attributeDescriptions[ATTRIBUTE_COUNT + 4].location = ATTRIBUTE_COUNT + 4;
+    gf3d_mesh.attributeDescriptions[ATTRIBUTE_COUNT + 4].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    gf3d_mesh.attributeDescriptions[ATTRIBUTE_COUNT + 4].offset = offsetof(MeshInstance, color);
+
+    // the compact layout shares the instance data, only the per vertex formats differ
+    memcpy(gf3d_mesh.compactBindingDescription,gf3d_mesh.bindingDescription,sizeof(gf3d_mesh.bindingDescription));
+    memcpy(gf3d_mesh.compactAttributeDescriptions,gf3d_mesh.attributeDescriptions,sizeof(gf3d_mesh.attributeDescriptions));
+    gf3d_mesh.compactBindingDescription[0].stride = sizeof(CompactVertex);
+    gf3d_mesh.compactAttributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+    gf3d_mesh.compactAttributeDescriptions[0].offset = offsetof(CompactVertex, position);
+    gf3d_mesh.compactAttributeDescriptions[1].format = VK_FORMAT_R16G16_SNORM;
+    gf3d_mesh.compactAttributeDescriptions[1].offset = offsetof(CompactVertex, normal);
+    gf3d_mesh.compactAttributeDescriptions[2].format = VK_FORMAT_R16G16_SFLOAT;
+    gf3d_mesh.compactAttributeDescriptions[2].offset = offsetof(CompactVertex, texel);
+
     gf3d_mesh.mesh_list = gfc_allocate_array(sizeof(Mesh),mesh_max);
+    gf3d_mesh.lock = SDL_CreateMutex();
+    if (!gf3d_mesh.lock)slog("failed to create the mesh lock");
     
     gf3d_mesh_get_attribute_descriptions(&count);
     slog("Work1");
@@ -70,10 +208,12 @@ void gf3d_mesh_init(Uint32 mesh_max)
         "config/model_pipeline.cfg",
         gf3d_vgraphics_get_view_extent(),
         mesh_max,
-        gf3d_mesh_get_bind_description(),
-        gf3d_mesh_get_attribute_descriptions(NULL),
-        count,
-        sizeof(MeshUBO)
+        gf3d_mesh.bindingDescription,
+        2,
+        gf3d_mesh.attributeDescriptions,
+        ATTRIBUTE_COUNT + INSTANCE_ATTRIBUTE_COUNT,
+        sizeof(MeshUBO),
+        sizeof(MeshPushConstants)
     );
     slog("Work2");
     gf3d_mesh.sky_pipe = gf3d_pipeline_create_from_config(
@@ -82,9 +222,11 @@ void gf3d_mesh_init(Uint32 mesh_max)
         gf3d_vgraphics_get_view_extent(),
         mesh_max,
         gf3d_mesh_get_bind_description(),
+        1,
         gf3d_mesh_get_attribute_descriptions(NULL),
         count,
-        sizeof(SkyUBO)
+        sizeof(SkyUBO),
+        sizeof(SkyPushConstants)
     );
     slog("Work3");
         gf3d_mesh.highlight_pipe = gf3d_pipeline_create_from_config(
@@ -93,19 +235,76 @@ void gf3d_mesh_init(Uint32 mesh_max)
         gf3d_vgraphics_get_view_extent(),
         mesh_max,
         gf3d_mesh_get_bind_description(),
+        1,
         gf3d_mesh_get_attribute_descriptions(NULL),
         count,
-        sizeof(HighlightUBO)
+        sizeof(HighlightUBO),
+        sizeof(HighlightPushConstants)
     );
+    gf3d_mesh_compact_pipes_create();
+    gf3d_mesh_instance_buffers_create();
+    // the compact stride divides the full one, so full vertex alignment places either format on a whole vertex
+    gf3d_mesh_arena_create(&gf3d_mesh.vertexArena,MESH_ARENA_VERTEX_BYTES,sizeof(Vertex),VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,mesh_max);
+    gf3d_mesh_arena_create(&gf3d_mesh.indexArena,MESH_ARENA_INDEX_BYTES,sizeof(Uint32),VK_BUFFER_USAGE_INDEX_BUFFER_BIT,mesh_max);
 
     slog("mesh system initialized");
 }
 
+void gf3d_mesh_instance_buffers_create()
+{
+    int i;
+    VkDeviceSize bufferSize = sizeof(MeshInstance) * MESH_INSTANCE_MAX;
+    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    // the GPU reads these every draw, so keep them in its own memory when that can be mapped
+    if (gf3d_memory_device_local_is_host_visible())properties |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    for (i = 0; i < GF3D_VGRAPHICS_FRAMES_IN_FLIGHT; i++)
+    {
+        if (!gf3d_buffer_create(
+            bufferSize,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            properties,
+            &gf3d_mesh.instanceBuffers[i].buffer,
+            &gf3d_mesh.instanceBuffers[i].allocation))
+        {
+            slog("failed to create mesh instance buffer");
+            return;
+        }
+        // host visible memory stays mapped for the life of the allocator
+        gf3d_mesh.instanceBuffers[i].mapped = (MeshInstance *)gf3d_mesh.instanceBuffers[i].allocation.mapped;
+    }
+}
+
+void gf3d_mesh_instance_buffers_free()
+{
+    int i;
+    for (i = 0; i < GF3D_VGRAPHICS_FRAMES_IN_FLIGHT; i++)
+    {
+        gf3d_buffer_free(&gf3d_mesh.instanceBuffers[i].buffer,&gf3d_mesh.instanceBuffers[i].allocation);
+    }
+    memset(gf3d_mesh.instanceBuffers,0,sizeof(gf3d_mesh.instanceBuffers));
+}
+
+void gf3d_mesh_set_optimize_mode(Uint32 mode)
+{
+    if (mode >= MO_MAX)mode = MO_Cache;
+    gf3d_mesh.optimizeMode = (MeshOptimizeMode)mode;
+}
+
+void gf3d_mesh_set_cluster_min_faces(Uint32 faces)
+{
+    gf3d_mesh.clusterMinFaces = faces;
+}
+
 Pipeline *gf3d_mesh_get_pipeline()
 {
     return gf3d_mesh.pipe;
 }
 
+Pipeline *gf3d_mesh_get_compact_pipeline()
+{
+    return gf3d_mesh.compact_pipe;
+}
+
 Pipeline *gf3d_mesh_get_highlight_pipeline()
 {
     return gf3d_mesh.highlight_pipe;
@@ -116,13 +315,178 @@ Pipeline *gf3d_mesh_get_sky_pipeline()
     return gf3d_mesh.sky_pipe;
 }
 
+void gf3d_mesh_write_frame_ubo(Pipeline *pipe,Uint32 bufferFrame,void *data,size_t size,Uint32 *offset)
+{
+    UniformBuffer ubo = {0};
+    if (!pipe)return;
+    if (!gf3d_uniform_buffer_list_get_buffer(pipe->uboList, bufferFrame, &ubo))return;
+    memcpy(ubo.data, data, size);
+    *offset = ubo.offset;
+}
+
+void gf3d_mesh_update_frame_ubos(Uint32 bufferFrame)
+{
+    UniformBufferObject graphics_ubo;
+    MeshUBO meshUBO = {0};
+    HighlightUBO highlightUBO = {0};
+    SkyUBO skyUBO = {0};
+
+    graphics_ubo = gf3d_vgraphics_get_uniform_buffer_object();
+
+    gfc_matrix_copy(meshUBO.view,graphics_ubo.view);
+    gfc_matrix_copy(meshUBO.proj,graphics_ubo.proj);
+    meshUBO.LightPosition = vector4d(1000, 1000, 1000, 1);
+    gf3d_mesh_write_frame_ubo(gf3d_mesh.pipe,bufferFrame,&meshUBO,sizeof(MeshUBO),&gf3d_mesh.modelUboOffset);
+    gf3d_mesh_write_frame_ubo(gf3d_mesh.compact_pipe,bufferFrame,&meshUBO,sizeof(MeshUBO),&gf3d_mesh.compactUboOffset);
+
+    gfc_matrix_copy(highlightUBO.view,graphics_ubo.view);
+    gfc_matrix_copy(highlightUBO.proj,graphics_ubo.proj);
+    gf3d_mesh_write_frame_ubo(gf3d_mesh.highlight_pipe,bufferFrame,&highlightUBO,sizeof(HighlightUBO),&gf3d_mesh.highlightUboOffset);
+    gf3d_mesh_write_frame_ubo(gf3d_mesh.compact_highlight_pipe,bufferFrame,&highlightUBO,sizeof(HighlightUBO),&gf3d_mesh.compactHighlightUboOffset);
+
+    gfc_matrix_copy(skyUBO.view,graphics_ubo.view);
+    // the sky follows the camera, so only the rotation is kept
+    skyUBO.view[0][3] = 0;
+    skyUBO.view[1][3] = 0;
+    skyUBO.view[2][3] = 0;
+    skyUBO.view[3][0] = 0;
+    skyUBO.view[3][1] = 0;
+    skyUBO.view[3][2] = 0;
+    gfc_matrix_copy(skyUBO.proj,graphics_ubo.proj);
+    gf3d_mesh_write_frame_ubo(gf3d_mesh.sky_pipe,bufferFrame,&skyUBO,sizeof(SkyUBO),&gf3d_mesh.skyUboOffset);
+}
+
+void gf3d_mesh_bind_frame_set(Pipeline *pipe,VkCommandBuffer commandBuffer,Uint32 bufferFrame,Uint32 uboOffset)
+{
+    VkDescriptorSet *descriptorSet;
+    if ((!pipe)||(commandBuffer == VK_NULL_HANDLE))return;
+    descriptorSet = gf3d_pipeline_get_descriptor_set(pipe, bufferFrame);
+    if (!descriptorSet)return;
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe->pipelineLayout, 0, 1, descriptorSet, 1, &uboOffset);
+}
+
+/**
+ * @brief forget what a thread has bound, so its next draws bind everything again
+ */
+static void gf3d_mesh_thread_state_unbind(MeshThreadState *state)
+{
+    state->modelMaterial = VK_NULL_HANDLE;
+    state->compactMaterial = VK_NULL_HANDLE;
+    state->skyMaterial = VK_NULL_HANDLE;
+    state->modelIndexType = VK_INDEX_TYPE_MAX_ENUM;
+    state->compactIndexType = VK_INDEX_TYPE_MAX_ENUM;
+    state->highlightIndexType = VK_INDEX_TYPE_MAX_ENUM;
+    state->compactHighlightIndexType = VK_INDEX_TYPE_MAX_ENUM;
+    state->skyIndexType = VK_INDEX_TYPE_MAX_ENUM;
+}
+
+/**
+ * @brief get the bind state of the calling recording thread
+ */
+static MeshThreadState *gf3d_mesh_get_thread_state()
+{
+    Uint32 thread = gf3d_record_get_thread();
+    if (thread > GF3D_RECORD_THREAD_MAX)thread = 0;
+    return &gf3d_mesh.threads[thread];
+}
+
+Uint32 gf3d_mesh_get_frame_ubo_offset(Pipeline *pipe)
+{
+    if (pipe == gf3d_mesh.sky_pipe)return gf3d_mesh.skyUboOffset;
+    if (pipe == gf3d_mesh.highlight_pipe)return gf3d_mesh.highlightUboOffset;
+    if (pipe == gf3d_mesh.compact_pipe)return gf3d_mesh.compactUboOffset;
+    if (pipe == gf3d_mesh.compact_highlight_pipe)return gf3d_mesh.compactHighlightUboOffset;
+    return gf3d_mesh.modelUboOffset;
+}
+
+void gf3d_mesh_bind_pipe_state(Pipeline *pipe,VkCommandBuffer commandBuffer,Uint32 bufferFrame,VkBuffer instanceBuffer)
+{
+    VkDeviceSize offsets[] = {0};
+    if ((!pipe)||(commandBuffer == VK_NULL_HANDLE))return;
+    // set 0 holds only per frame data, so it is bound once for every draw this frame
+    gf3d_mesh_bind_frame_set(pipe,commandBuffer,bufferFrame,gf3d_mesh_get_frame_ubo_offset(pipe));
+    // every mesh draws from the vertex arena through its vertexOffset
+    if (gf3d_mesh.vertexArena.buffer != VK_NULL_HANDLE)
+    {
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &gf3d_mesh.vertexArena.buffer, offsets);
+    }
+    // instance data stays on binding 1 while meshes swap binding 0
+    if (instanceBuffer != VK_NULL_HANDLE)
+    {
+        vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffer, offsets);
+    }
+}
+
+/**
+ * @brief bind what every draw on a mesh pipeline shares this frame: set 0, the vertex arena and for model pipelines the instance buffer
+ */
+static void gf3d_mesh_bind_frame_state(Pipeline *pipe,VkCommandBuffer commandBuffer,Uint32 bufferFrame)
+{
+    VkBuffer instanceBuffer = VK_NULL_HANDLE;
+    if ((pipe == gf3d_mesh.pipe)||(pipe == gf3d_mesh.compact_pipe))
+    {
+        instanceBuffer = gf3d_mesh.instanceBuffers[bufferFrame].buffer;
+    }
+    gf3d_mesh_bind_pipe_state(pipe,commandBuffer,bufferFrame,instanceBuffer);
+}
+
+/**
+ * @brief get the calling thread's command buffer for a mesh pipeline, binding the frame state to it if it was just begun
+ */
+static VkCommandBuffer gf3d_mesh_get_pipe_command_buffer(Pipeline *pipe)
+{
+    Bool started = 0;
+    VkCommandBuffer commandBuffer;
+    if (!pipe)return VK_NULL_HANDLE;
+    commandBuffer = gf3d_pipeline_get_command_buffer(pipe,&started);
+    if (started)
+    {
+        // a fresh buffer has nothing bound, whatever the thread bound before was in other buffers
+        gf3d_mesh_thread_state_unbind(gf3d_mesh_get_thread_state());
+        gf3d_mesh_bind_frame_state(pipe,commandBuffer,gf3d_vgraphics_get_current_frame());
+    }
+    return commandBuffer;
+}
+
 void gf3d_mesh_reset_pipes()
 {
-    Uint32 bufferFrame = gf3d_vgraphics_get_current_buffer_frame();
+    int i;
+    Uint32 bufferFrame = gf3d_vgraphics_get_current_frame();
+    Pipeline *pipes[5];
     
+    gf3d_mesh_arena_next_frame(&gf3d_mesh.vertexArena);
+    gf3d_mesh_arena_next_frame(&gf3d_mesh.indexArena);
     gf3d_pipeline_reset_frame(gf3d_mesh.sky_pipe,bufferFrame);
     gf3d_pipeline_reset_frame(gf3d_mesh.pipe,bufferFrame);
     gf3d_pipeline_reset_frame(gf3d_mesh.highlight_pipe,bufferFrame);
+    gf3d_pipeline_reset_frame(gf3d_mesh.compact_pipe,bufferFrame);
+    gf3d_pipeline_reset_frame(gf3d_mesh.compact_highlight_pipe,bufferFrame);
+    gf3d_mesh_update_frame_ubos(bufferFrame);
+    SDL_AtomicSet(&gf3d_mesh.instanceBuffers[bufferFrame].used,0);
+    pipes[0] = gf3d_mesh.sky_pipe;
+    pipes[1] = gf3d_mesh.pipe;
+    pipes[2] = gf3d_mesh.highlight_pipe;
+    pipes[3] = gf3d_mesh.compact_pipe;
+    pipes[4] = gf3d_mesh.compact_highlight_pipe;
+    for (i = 0; i < 5; i++)
+    {
+        if (!pipes[i])continue;
+        gf3d_mesh_bind_frame_state(pipes[i],pipes[i]->commandBuffer,bufferFrame);
+    }
+    // the last frame's queue was recorded in full, so its cluster counts are final
+    gf3d_mesh.clustersDrawn = 0;
+    gf3d_mesh.clustersCulled = 0;
+    for (i = 0; i <= GF3D_RECORD_THREAD_MAX; i++)
+    {
+        gf3d_mesh.clustersDrawn += gf3d_mesh.threads[i].clustersDrawn;
+        gf3d_mesh.clustersCulled += gf3d_mesh.threads[i].clustersCulled;
+    }
+    // recording threads are idle between frames, so their state is reset here too
+    memset(gf3d_mesh.threads,0,sizeof(gf3d_mesh.threads));
+    for (i = 0; i <= GF3D_RECORD_THREAD_MAX; i++)
+    {
+        gf3d_mesh_thread_state_unbind(&gf3d_mesh.threads[i]);
+    }
 }
 
 void gf3d_mesh_submit_pipe_commands()
@@ -130,24 +494,35 @@ void gf3d_mesh_submit_pipe_commands()
     gf3d_pipeline_submit_commands(gf3d_mesh.sky_pipe);
     gf3d_pipeline_submit_commands(gf3d_mesh.pipe);
     gf3d_pipeline_submit_commands(gf3d_mesh.highlight_pipe);
+    gf3d_pipeline_submit_commands(gf3d_mesh.compact_pipe);
+    gf3d_pipeline_submit_commands(gf3d_mesh.compact_highlight_pipe);
+}
+
+Pipeline *gf3d_mesh_get_model_pipe_for_format(MeshVertexFormat format)
+{
+    if (format == MVF_Compact)return gf3d_mesh_get_compact_pipeline();
+    return gf3d_mesh.pipe;
 }
 
-VkCommandBuffer gf3d_mesh_get_model_command_buffer()
+Pipeline *gf3d_mesh_get_highlight_pipe_for_format(MeshVertexFormat format)
 {
-    if (!gf3d_mesh.pipe)return VK_NULL_HANDLE;
-    return gf3d_mesh.pipe->commandBuffer;
+    if (format == MVF_Compact)return gf3d_mesh.compact_highlight_pipe;
+    return gf3d_mesh.highlight_pipe;
 }
 
-VkCommandBuffer gf3d_mesh_get_highlight_command_buffer()
+VkCommandBuffer gf3d_mesh_get_model_command_buffer(MeshVertexFormat format)
 {
-    if (!gf3d_mesh.pipe)return VK_NULL_HANDLE;
-    return gf3d_mesh.highlight_pipe->commandBuffer;
+    return gf3d_mesh_get_pipe_command_buffer(gf3d_mesh_get_model_pipe_for_format(format));
+}
+
+VkCommandBuffer gf3d_mesh_get_highlight_command_buffer(MeshVertexFormat format)
+{
+    return gf3d_mesh_get_pipe_command_buffer(gf3d_mesh_get_highlight_pipe_for_format(format));
 }
 
 VkCommandBuffer gf3d_mesh_get_sky_command_buffer()
 {
-    if (!gf3d_mesh.pipe)return VK_NULL_HANDLE;
-    return gf3d_mesh.sky_pipe->commandBuffer;
+    return gf3d_mesh_get_pipe_command_buffer(gf3d_mesh.sky_pipe);
 }
 
 
@@ -159,61 +534,75 @@ VkVertexInputAttributeDescription * gf3d_mesh_get_attribute_descriptions(Uint32
 
 VkVertexInputBindingDescription * gf3d_mesh_get_bind_description()
 {
-    return &gf3d_mesh.bindingDescription;
+    return &gf3d_mesh.bindingDescription[0];
 }
 
 Mesh *gf3d_mesh_new()
 {
     int i;
+    Mesh *mesh = NULL;
+    SDL_LockMutex(gf3d_mesh.lock);
     for (i = 0; i < gf3d_mesh.mesh_max; i++)
     {
         if (gf3d_mesh.mesh_list[i]._inuse == 0)
         {
-            gf3d_mesh.mesh_list[i]._inuse = 1;
-            gf3d_mesh.mesh_list[i]._refCount = 1;
-            return &gf3d_mesh.mesh_list[i];
+            mesh = &gf3d_mesh.mesh_list[i];
+            break;
         }
     }
-    for (i = 0; i < gf3d_mesh.mesh_max; i++)
+    for (i = 0; (!mesh)&&(i < gf3d_mesh.mesh_max); i++)
     {
         if (gf3d_mesh.mesh_list[i]._refCount == 0)
         {
             gf3d_mesh_delete(&gf3d_mesh.mesh_list[i]);
-            gf3d_mesh.mesh_list[i]._inuse = 1;
-            gf3d_mesh.mesh_list[i]._refCount = 1;
-            return &gf3d_mesh.mesh_list[i];
+            mesh = &gf3d_mesh.mesh_list[i];
         }
     }
-    return NULL;
+    if (mesh)
+    {
+        mesh->_inuse = 1;
+        mesh->_refCount = 1;
+    }
+    SDL_UnlockMutex(gf3d_mesh.lock);
+    return mesh;
 }
 
-Mesh *gf3d_mesh_get_by_filename(const char *filename)
+Mesh *gf3d_mesh_get_by_filename(const char *filename,MeshVertexFormat format)
 {
     int i;
+    Mesh *mesh = NULL;
+    SDL_LockMutex(gf3d_mesh.lock);
     for (i = 0; i < gf3d_mesh.mesh_max; i++)
     {
         if (!gf3d_mesh.mesh_list[i]._inuse)continue;
+        if (gf3d_mesh.mesh_list[i].vertexFormat != format)continue;
         if (gfc_line_cmp(gf3d_mesh.mesh_list[i].filename,filename) == 0)
         {
-            return &gf3d_mesh.mesh_list[i];
+            mesh = &gf3d_mesh.mesh_list[i];
+            break;
         }
     }
-    return NULL;
+    SDL_UnlockMutex(gf3d_mesh.lock);
+    return mesh;
 }
 
 void gf3d_mesh_free(Mesh *mesh)
 {
     if (!mesh)return;
+    SDL_LockMutex(gf3d_mesh.lock);
     mesh->_refCount--;
+    SDL_UnlockMutex(gf3d_mesh.lock);
 }
 
 void gf3d_mesh_free_all()
 {
     int i;
+    SDL_LockMutex(gf3d_mesh.lock);
     for (i = 0; i < gf3d_mesh.mesh_max; i++)
     {
         gf3d_mesh_delete(&gf3d_mesh.mesh_list[i]);
     }
+    SDL_UnlockMutex(gf3d_mesh.lock);
 }
 
 void gf3d_mesh_close()
@@ -226,170 +615,698 @@ void gf3d_mesh_close()
         free(gf3d_mesh.mesh_list);
         gf3d_mesh.mesh_list = NULL;
     }
+    gf3d_mesh_instance_buffers_free();
+    gf3d_mesh_arena_free(&gf3d_mesh.vertexArena);
+    gf3d_mesh_arena_free(&gf3d_mesh.indexArena);
+    if (gf3d_mesh.lock)
+    {
+        SDL_DestroyMutex(gf3d_mesh.lock);
+        gf3d_mesh.lock = NULL;
+    }
     slog("mesh system closed");
 }
 
+static VkDeviceSize gf3d_mesh_get_vertex_stride(MeshVertexFormat format)
+{
+    if (format == MVF_Compact)return sizeof(CompactVertex);
+    return sizeof(Vertex);
+}
+
+static VkDeviceSize gf3d_mesh_get_index_size(VkIndexType indexType)
+{
+    if (indexType == VK_INDEX_TYPE_UINT16)return sizeof(Uint16);
+    return sizeof(Uint32);
+}
+
 void gf3d_mesh_delete(Mesh *mesh)
 {
     if ((!mesh)||(!mesh->_inuse))return;
-    if (mesh->faceBuffer != VK_NULL_HANDLE)
+    SDL_LockMutex(gf3d_mesh.lock);
+    if (mesh->vertexBytes)
     {
-        vkDestroyBuffer(gf3d_vgraphics_get_default_logical_device(), mesh->faceBuffer, NULL);
+        gf3d_mesh_arena_release(&gf3d_mesh.vertexArena,(VkDeviceSize)mesh->vertexOffset * gf3d_mesh_get_vertex_stride(mesh->vertexFormat),mesh->vertexBytes);
     }
-    if (mesh->faceBufferMemory != VK_NULL_HANDLE)
+    if (mesh->indexBytes)
     {
-        vkFreeMemory(gf3d_vgraphics_get_default_logical_device(), mesh->faceBufferMemory, NULL);
+        gf3d_mesh_arena_release(&gf3d_mesh.indexArena,(VkDeviceSize)mesh->firstIndex * gf3d_mesh_get_index_size(mesh->indexType),mesh->indexBytes);
     }
-    if (mesh->buffer != VK_NULL_HANDLE)
+    if (mesh->clusters)free(mesh->clusters);
+    memset(mesh,0,sizeof(Mesh));
+    SDL_UnlockMutex(gf3d_mesh.lock);
+}
+
+void gf3d_mesh_scene_add(Mesh *mesh)
+{
+    if (!mesh)return;
+}
+
+void gf3d_mesh_get_position_decode(Mesh *mesh,Vector4D *scale,Vector4D *offset)
+{
+    if (mesh->vertexFormat != MVF_Compact)
     {
-        vkDestroyBuffer(gf3d_vgraphics_get_default_logical_device(), mesh->buffer, NULL);
+        *scale = vector4d(1,1,1,0);
+        *offset = vector4d(0,0,0,0);
+        return;
     }
-    if (mesh->bufferMemory != VK_NULL_HANDLE)
+    *scale = vector4d(mesh->max.x - mesh->min.x,mesh->max.y - mesh->min.y,mesh->max.z - mesh->min.z,0);
+    *offset = vector4d(mesh->min.x,mesh->min.y,mesh->min.z,0);
+}
+
+MeshLod *gf3d_mesh_get_lod(Mesh *mesh,Uint32 lod)
+{
+    if (!mesh->lodCount)
     {
-        vkFreeMemory(gf3d_vgraphics_get_default_logical_device(), mesh->bufferMemory, NULL);
+        // meshes built outside gf3d_mesh_load draw everything
+        mesh->lods[0].firstIndex = 0;
+        mesh->lods[0].indexCount = mesh->faceCount * 3;
+        mesh->lodCount = 1;
     }
-    memset(mesh,0,sizeof(Mesh));
+    if (lod >= mesh->lodCount)lod = mesh->lodCount - 1;
+    return &mesh->lods[lod];
 }
 
-void gf3d_mesh_scene_add(Mesh *mesh)
+/**
+ * @brief bind the index arena for a mesh's index type, unless the last draw on this pipeline already did
+ */
+static void gf3d_mesh_bind_index_arena(VkCommandBuffer commandBuffer,VkIndexType indexType,VkIndexType *bound)
 {
-    if (!mesh)return;
+    if (*bound == indexType)return;
+    vkCmdBindIndexBuffer(commandBuffer, gf3d_mesh.indexArena.buffer, 0, indexType);
+    *bound = indexType;
 }
 
-void gf3d_mesh_render(Mesh *mesh,VkCommandBuffer commandBuffer, VkDescriptorSet * descriptorSet)
+void gf3d_mesh_bind_material(Pipeline *pipe,VkCommandBuffer commandBuffer,Texture *texture,VkDescriptorSet *bound)
+{
+    VkDescriptorSet material;
+    if ((!texture)||(texture->descriptorSet == VK_NULL_HANDLE))return;
+    gf3d_upload_require(texture->uploadValue);
+    material = gf3d_texture_get_material_set(texture,pipe->bindless);
+    if (*bound == material)return;// consecutive draws sharing a texture keep the set bound
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe->pipelineLayout, 1, 1, &material, 0, NULL);
+    *bound = material;
+}
+
+Bool gf3d_mesh_write_instances(MeshInstance *instances,Uint32 count,Uint32 *firstInstance)
+{
+    MeshInstanceBuffer *instanceBuffer;
+    Uint32 first;
+    instanceBuffer = &gf3d_mesh.instanceBuffers[gf3d_vgraphics_get_current_frame()];
+    if (!instanceBuffer->mapped)return 0;
+    // claimed before writing, so threads recording at once each get their own slice
+    first = (Uint32)SDL_AtomicAdd(&instanceBuffer->used,(int)count);
+    if (first + count > MESH_INSTANCE_MAX)
+    {
+        slog("out of mesh instance space this frame (%i)",MESH_INSTANCE_MAX);
+        return 0;
+    }
+    *firstInstance = first;
+    memcpy(&instanceBuffer->mapped[first],instances,sizeof(MeshInstance) * count);
+    return 1;
+}
+
+/**
+ * @brief bind the index type, material and push constants for drawing a mesh through its model pipeline
+ * @param indexType the index type last bound to the command buffer, updated
+ * @param material the material set last bound to the command buffer, updated
+ * @return 0 if there is no pipeline for the mesh's vertex format
+ */
+static Bool gf3d_mesh_bind_model_draw_state(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, MeshPushConstants *constants,VkIndexType *indexType,VkDescriptorSet *material)
 {
-    VkDeviceSize offsets[] = {0};
     Pipeline *pipe;
-    if (!mesh)
+    pipe = gf3d_mesh_get_model_pipe_for_format(mesh->vertexFormat);
+    if ((!pipe)||(!mesh->indexBytes))return 0;
+    gf3d_upload_require(mesh->uploadValue);
+    gf3d_mesh_get_position_decode(mesh,&constants->positionScale,&constants->positionOffset);
+    gf3d_mesh_bind_index_arena(commandBuffer,mesh->indexType,indexType);
+    
+    gf3d_mesh_bind_material(pipe,commandBuffer,texture,material);
+    
+    vkCmdPushConstants(commandBuffer, pipe->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), constants);
+    return 1;
+}
+
+/**
+ * @brief bind the index type, material and push constants for drawing a mesh through its model pipeline
+ * @return 0 if there is no pipeline for the mesh's vertex format
+ */
+Bool gf3d_mesh_bind_model_draw(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, MeshPushConstants *constants)
+{
+    MeshThreadState *state;
+    state = gf3d_mesh_get_thread_state();
+    if (mesh->vertexFormat == MVF_Compact)
+    {
+        return gf3d_mesh_bind_model_draw_state(mesh,commandBuffer,texture,constants,&state->compactIndexType,&state->compactMaterial);
+    }
+    return gf3d_mesh_bind_model_draw_state(mesh,commandBuffer,texture,constants,&state->modelIndexType,&state->modelMaterial);
+}
+
+void gf3d_mesh_render_instanced(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, MeshPushConstants *constants, MeshInstance *instances, Uint32 count, Uint32 lod)
+{
+    Uint32 firstInstance;
+    if ((!mesh)||(!constants)||(!instances))
     {
         slog("cannot render a NULL mesh");
         return;
     }
-    pipe = gf3d_mesh_get_pipeline();
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh->buffer, offsets);
-    
-    vkCmdBindIndexBuffer(commandBuffer, mesh->faceBuffer, 0, VK_INDEX_TYPE_UINT32);
-    
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe->pipelineLayout, 0, 1, descriptorSet, 0, NULL);
+    if (!count)return;
+    if (!gf3d_mesh_write_instances(instances,count,&firstInstance))return;
+    gf3d_mesh_render_instances(mesh,commandBuffer,texture,constants,firstInstance,count,lod);
+}
+
+void gf3d_mesh_render_instances(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, MeshPushConstants *constants, Uint32 firstInstance, Uint32 count, Uint32 lod)
+{
+    MeshLod *level;
+    if ((!mesh)||(!constants))
+    {
+        slog("cannot render a NULL mesh");
+        return;
+    }
+    if (!count)return;
+    if (!gf3d_mesh_bind_model_draw(mesh,commandBuffer,texture,constants))return;
     
-    vkCmdDrawIndexed(commandBuffer, mesh->faceCount * 3, 1, 0, 0, 0);
+    level = gf3d_mesh_get_lod(mesh,lod);
+    vkCmdDrawIndexed(commandBuffer, level->indexCount, count, mesh->firstIndex + level->firstIndex, mesh->vertexOffset, firstInstance);
 }
 
-void gf3d_mesh_render_highlight(Mesh *mesh,VkCommandBuffer commandBuffer, VkDescriptorSet * descriptorSet)
+void gf3d_mesh_render_clustered(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, MeshPushConstants *constants, MeshInstance *instance, Frustum *frustum, Vector3D eye)
+{
+    Uint32 i,firstInstance = 0,firstIndex = 0,indexCount = 0;
+    Bool bound = 0;
+    MeshThreadState *state;
+    if ((!mesh)||(!constants)||(!instance))
+    {
+        slog("cannot render a NULL mesh");
+        return;
+    }
+    state = gf3d_mesh_get_thread_state();
+    if (!mesh->clusterCount)
+    {
+        gf3d_mesh_render_instanced(mesh,commandBuffer,texture,constants,instance,1,0);
+        return;
+    }
+    for (i = 0; i < mesh->clusterCount; i++)
+    {
+        if (!gf3d_mesh_cluster_visible(&mesh->clusters[i],instance->model,frustum,eye))
+        {
+            state->clustersCulled++;
+            continue;
+        }
+        state->clustersDrawn++;
+        // neighbouring clusters are neighbours in the index buffer, so visible runs draw together
+        if ((indexCount)&&(firstIndex + indexCount == mesh->clusters[i].firstIndex))
+        {
+            indexCount += mesh->clusters[i].indexCount;
+            continue;
+        }
+        if (indexCount)
+        {
+            vkCmdDrawIndexed(commandBuffer, indexCount, 1, mesh->firstIndex + firstIndex, mesh->vertexOffset, firstInstance);
+        }
+        else if (!bound)
+        {
+            if (!gf3d_mesh_write_instances(instance,1,&firstInstance))return;
+            if (!gf3d_mesh_bind_model_draw(mesh,commandBuffer,texture,constants))return;
+            bound = 1;
+        }
+        firstIndex = mesh->clusters[i].firstIndex;
+        indexCount = mesh->clusters[i].indexCount;
+    }
+    if (indexCount)
+    {
+        vkCmdDrawIndexed(commandBuffer, indexCount, 1, mesh->firstIndex + firstIndex, mesh->vertexOffset, firstInstance);
+    }
+}
+
+void gf3d_mesh_get_cluster_stats(Uint32 *drawn, Uint32 *culled)
+{
+    if (drawn)*drawn = gf3d_mesh.clustersDrawn;
+    if (culled)*culled = gf3d_mesh.clustersCulled;
+}
+
+void gf3d_mesh_render_highlight(Mesh *mesh,VkCommandBuffer commandBuffer, HighlightPushConstants *constants, Uint32 lod)
 {
-    VkDeviceSize offsets[] = {0};
     Pipeline *pipe;
-    if (!mesh)
+    MeshLod *level;
+    MeshThreadState *state;
+    if ((!mesh)||(!constants))
     {
         slog("cannot render a NULL mesh");
         return;
     }
-    pipe = gf3d_mesh.highlight_pipe;
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh->buffer, offsets);
+    pipe = gf3d_mesh_get_highlight_pipe_for_format(mesh->vertexFormat);
+    if ((!pipe)||(!mesh->indexBytes))return;
+    state = gf3d_mesh_get_thread_state();
+    gf3d_upload_require(mesh->uploadValue);
+    gf3d_mesh_get_position_decode(mesh,&constants->positionScale,&constants->positionOffset);
+    gf3d_mesh_bind_index_arena(commandBuffer,mesh->indexType,
+        (mesh->vertexFormat == MVF_Compact) ? &state->compactHighlightIndexType : &state->highlightIndexType);
     
-    vkCmdBindIndexBuffer(commandBuffer, mesh->faceBuffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdPushConstants(commandBuffer, pipe->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(HighlightPushConstants), constants);
     
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe->pipelineLayout, 0, 1, descriptorSet, 0, NULL);
-    
-    vkCmdDrawIndexed(commandBuffer, mesh->faceCount * 3, 1, 0, 0, 0);
+    level = gf3d_mesh_get_lod(mesh,lod);
+    vkCmdDrawIndexed(commandBuffer, level->indexCount, 1, mesh->firstIndex + level->firstIndex, mesh->vertexOffset, 0);
 }
 
-void gf3d_mesh_render_sky(Mesh *mesh,VkCommandBuffer commandBuffer, VkDescriptorSet * descriptorSet)
+/**
+ * @brief bind and draw a sky mesh at full detail
+ * @param indexType the index type last bound to the command buffer, updated
+ * @param material the material set last bound to the command buffer, updated
+ */
+static void gf3d_mesh_record_sky(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, SkyPushConstants *constants,VkIndexType *indexType,VkDescriptorSet *material)
 {
-    VkDeviceSize offsets[] = {0};
     Pipeline *pipe;
-    if (!mesh)
+    MeshLod *level;
+    if (!mesh->indexBytes)return;
+    if (mesh->vertexFormat != MVF_Full)
     {
-        slog("cannot render a NULL mesh");
+        slog("sky meshes must use the full vertex format");
         return;
     }
     pipe = gf3d_mesh.sky_pipe;
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh->buffer, offsets);
+    gf3d_upload_require(mesh->uploadValue);
+    gf3d_mesh_bind_index_arena(commandBuffer,mesh->indexType,indexType);
     
-    vkCmdBindIndexBuffer(commandBuffer, mesh->faceBuffer, 0, VK_INDEX_TYPE_UINT32);
+    gf3d_mesh_bind_material(pipe,commandBuffer,texture,material);
     
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe->pipelineLayout, 0, 1, descriptorSet, 0, NULL);
+    vkCmdPushConstants(commandBuffer, pipe->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(SkyPushConstants), constants);
     
-    vkCmdDrawIndexed(commandBuffer, mesh->faceCount * 3, 1, 0, 0, 0);
+    // the sky always fills the view, so it is only ever drawn at full detail
+    level = gf3d_mesh_get_lod(mesh,0);
+    vkCmdDrawIndexed(commandBuffer, level->indexCount, 1, mesh->firstIndex + level->firstIndex, mesh->vertexOffset, 0);
+}
+
+void gf3d_mesh_render_sky(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, SkyPushConstants *constants)
+{
+    MeshThreadState *state;
+    if ((!mesh)||(!constants))
+    {
+        slog("cannot render a NULL mesh");
+        return;
+    }
+    state = gf3d_mesh_get_thread_state();
+    gf3d_mesh_record_sky(mesh,commandBuffer,texture,constants,&state->skyIndexType,&state->skyMaterial);
+}
+
+void gf3d_mesh_bind_state_clear(MeshBindState *bound)
+{
+    if (!bound)return;
+    bound->material = VK_NULL_HANDLE;
+    bound->indexType = VK_INDEX_TYPE_MAX_ENUM;
+}
+
+void gf3d_mesh_render_bundle_instances(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, MeshPushConstants *constants, Uint32 firstInstance, Uint32 count, MeshBindState *bound)
+{
+    MeshLod *level;
+    if ((!mesh)||(!constants)||(!bound))
+    {
+        slog("cannot render a NULL mesh");
+        return;
+    }
+    if (!count)return;
+    if (!gf3d_mesh_bind_model_draw_state(mesh,commandBuffer,texture,constants,&bound->indexType,&bound->material))return;
+    // the buffer is replayed from every view, so it cannot pick a level or cull clusters for one of them
+    level = gf3d_mesh_get_lod(mesh,0);
+    vkCmdDrawIndexed(commandBuffer, level->indexCount, count, mesh->firstIndex + level->firstIndex, mesh->vertexOffset, firstInstance);
 }
 
+void gf3d_mesh_render_indirect(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, MeshPushConstants *constants, MeshIndirectDraws *draws, MeshBindState *bound)
+{
+    if ((!mesh)||(!constants)||(!draws)||(!bound))
+    {
+        slog("cannot render a NULL mesh");
+        return;
+    }
+    if ((!draws->maxDrawCount)||(draws->buffer == VK_NULL_HANDLE))return;
+    if (!gf3d_mesh_bind_model_draw_state(mesh,commandBuffer,texture,constants,&bound->indexType,&bound->material))return;
+    if (draws->countBuffer != VK_NULL_HANDLE)
+    {
+        gf3d_device_cmd_draw_indexed_indirect_count(
+            commandBuffer,
+            draws->buffer,
+            draws->offset,
+            draws->countBuffer,
+            draws->countOffset,
+            draws->maxDrawCount,
+            sizeof(VkDrawIndexedIndirectCommand));
+        return;
+    }
+    // without a count every command runs, the culled ones with no instances
+    vkCmdDrawIndexedIndirect(commandBuffer, draws->buffer, draws->offset, draws->maxDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+}
 
-void gf3d_mesh_setup_face_buffers(Mesh *mesh,Face *faces,Uint32 fcount)
+void gf3d_mesh_render_bundle_sky(Mesh *mesh,VkCommandBuffer commandBuffer, Texture *texture, SkyPushConstants *constants, MeshBindState *bound)
+{
+    if ((!mesh)||(!constants)||(!bound))
+    {
+        slog("cannot render a NULL mesh");
+        return;
+    }
+    gf3d_mesh_record_sky(mesh,commandBuffer,texture,constants,&bound->indexType,&bound->material);
+}
+
+/**
+ * @brief claim an index range in the arena and upload the faces into it, narrowed to 16 bits when they fit
+ * @return 1 on success, 0 if the arena is out of room
+ */
+Bool gf3d_mesh_setup_face_buffers(Mesh *mesh,const Face *faces,Uint32 fcount)
 {
     void* data;
-    VkDevice device = gf3d_vgraphics_get_default_logical_device();
+    Uint32 i;
+    Uint16 *shortIndices;
+    const Uint32 *indices;
+    VkDeviceSize offset;
     VkDeviceSize bufferSize = sizeof(Face) * fcount;
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
     
-    gf3d_buffer_create(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+    // every index fits in 16 bits, so the index buffer is halved
+    mesh->indexType = (mesh->vertexCount <= 0xffff) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    if (mesh->indexType == VK_INDEX_TYPE_UINT16)bufferSize = sizeof(Uint16) * 3 * fcount;
+    
+    if (!gf3d_mesh_arena_alloc(&gf3d_mesh.indexArena,bufferSize,&offset))
+    {
+        slog("mesh index arena is out of room for %i faces",fcount);
+        return 0;
+    }
+    // staged data has to be written before another thread can flush the batch it is in
+    gf3d_upload_lock();
+    data = gf3d_mesh_arena_upload(&gf3d_mesh.indexArena,offset,bufferSize);
+    if (!data)
+    {
+        gf3d_upload_unlock();
+        gf3d_mesh_arena_release(&gf3d_mesh.indexArena,offset,bufferSize);
+        return 0;
+    }
+    if (mesh->indexType == VK_INDEX_TYPE_UINT16)
+    {
+        shortIndices = (Uint16 *)data;
+        indices = (const Uint32 *)faces;
+        for (i = 0; i < fcount * 3; i++)
+        {
+            shortIndices[i] = (Uint16)indices[i];
+        }
+    }
+    else memcpy(data, faces, (size_t) bufferSize);
+    gf3d_upload_unlock();
+
+    // the arena aligns ranges to 4 bytes, so the offset is a whole index of either size
+    mesh->firstIndex = (Uint32)(offset / gf3d_mesh_get_index_size(mesh->indexType));
+    mesh->indexBytes = bufferSize;
+    mesh->faceCount = fcount;
+    return 1;
+}
+
+/**
+ * @brief convert a float to an IEEE half, rounding to nearest.  Texels never need infinities or NaN
+ */
+static Uint16 gf3d_mesh_float_to_half(float value)
+{
+    union {float f; Uint32 u;} bits;
+    Uint32 sign,mantissa;
+    Sint32 exponent;
+    bits.f = value;
+    sign = (bits.u >> 16) & 0x8000;
+    exponent = (Sint32)((bits.u >> 23) & 0xff) - 127 + 15;
+    mantissa = bits.u & 0x7fffff;
+    if (exponent <= 0)
+    {
+        if (exponent < -10)return (Uint16)sign;
+        mantissa |= 0x800000;
+        mantissa = (mantissa >> (1 - exponent)) + 0x1000;
+        return (Uint16)(sign | (mantissa >> 13));
+    }
+    if (exponent >= 31)return (Uint16)(sign | 0x7bff);
+    mantissa += 0x1000;
+    if (mantissa & 0x800000)
+    {
+        mantissa = 0;
+        exponent++;
+        if (exponent >= 31)return (Uint16)(sign | 0x7bff);
+    }
+    return (Uint16)(sign | (exponent << 10) | (mantissa >> 13));
+}
 
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, faces, (size_t) bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+static Sint16 gf3d_mesh_float_to_snorm16(float value)
+{
+    if (value > 1)value = 1;
+    if (value < -1)value = -1;
+    return (Sint16)lroundf(value * 32767.0f);
+}
 
-    gf3d_buffer_create(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh->faceBuffer, &mesh->faceBufferMemory);
+static Uint16 gf3d_mesh_float_to_unorm16(float value)
+{
+    if (value > 1)value = 1;
+    if (value < 0)value = 0;
+    return (Uint16)lroundf(value * 65535.0f);
+}
 
-    gf3d_buffer_copy(stagingBuffer, mesh->faceBuffer, bufferSize);
+/**
+ * @brief fold a normal onto the octahedron and flatten it to two components in [-1,1]
+ */
+static void gf3d_mesh_octahedral_encode(Vector3D normal,Sint16 out[2])
+{
+    float x,y,t,sum;
+    sum = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+    if (sum <= 0)
+    {
+        out[0] = out[1] = 0;
+        return;
+    }
+    x = normal.x / sum;
+    y = normal.y / sum;
+    if (normal.z < 0)
+    {
+        t = x;
+        x = (1 - fabsf(y)) * ((t >= 0) ? 1 : -1);
+        y = (1 - fabsf(t)) * ((y >= 0) ? 1 : -1);
+    }
+    out[0] = gf3d_mesh_float_to_snorm16(x);
+    out[1] = gf3d_mesh_float_to_snorm16(y);
+}
 
-    mesh->faceCount = fcount;
-    vkDestroyBuffer(device, stagingBuffer, NULL);
-    vkFreeMemory(device, stagingBufferMemory, NULL);
+/**
+ * @brief build the compact vertices for a mesh whose bounds are already set
+ */
+static CompactVertex *gf3d_mesh_compact_vertices(Mesh *mesh,const Vertex *vertices,Uint32 vcount)
+{
+    Uint32 i;
+    Vector3D size;
+    CompactVertex *compact;
+    compact = gfc_allocate_array(sizeof(CompactVertex),vcount);
+    if (!compact)return NULL;
+    size.x = mesh->max.x - mesh->min.x;
+    size.y = mesh->max.y - mesh->min.y;
+    size.z = mesh->max.z - mesh->min.z;
+    for (i = 0; i < vcount; i++)
+    {
+        compact[i].position[0] = (size.x > 0) ? gf3d_mesh_float_to_unorm16((vertices[i].vertex.x - mesh->min.x) / size.x) : 0;
+        compact[i].position[1] = (size.y > 0) ? gf3d_mesh_float_to_unorm16((vertices[i].vertex.y - mesh->min.y) / size.y) : 0;
+        compact[i].position[2] = (size.z > 0) ? gf3d_mesh_float_to_unorm16((vertices[i].vertex.z - mesh->min.z) / size.z) : 0;
+        compact[i].position[3] = 0xffff;
+        gf3d_mesh_octahedral_encode(vertices[i].normal,compact[i].normal);
+        compact[i].texel[0] = gf3d_mesh_float_to_half(vertices[i].texel.x);
+        compact[i].texel[1] = gf3d_mesh_float_to_half(vertices[i].texel.y);
+    }
+    return compact;
 }
 
-void gf3d_mesh_create_vertex_buffer_from_vertices(Mesh *mesh,Vertex *vertices,Uint32 vcount,Face *faces,Uint32 fcount)
+Bool gf3d_mesh_create_vertex_buffer_from_vertices(Mesh *mesh,const Vertex *vertices,Uint32 vcount,const Face *faces,Uint32 fcount)
 {
     void *data = NULL;
-    VkDevice device = gf3d_vgraphics_get_default_logical_device();
+    const void *source;
+    CompactVertex *compact = NULL;
+    VkDeviceSize offset;
     size_t bufferSize;    
-    
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
 
-    bufferSize = sizeof(Vertex) * vcount;
-    
-    gf3d_buffer_create(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+    if (mesh->vertexFormat == MVF_Compact)
+    {
+        // the cache stays in the full format, compact data is derived as it is uploaded
+        compact = gf3d_mesh_compact_vertices(mesh,vertices,vcount);
+        if (!compact)
+        {
+            slog("failed to allocate compact vertices");
+            return 0;
+        }
+        source = compact;
+    }
+    else
+    {
+        source = vertices;
+    }
+    bufferSize = gf3d_mesh_get_vertex_stride(mesh->vertexFormat) * vcount;
     
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices, (size_t) bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    gf3d_buffer_create(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT|VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh->buffer, &mesh->bufferMemory);
-
-    gf3d_buffer_copy(stagingBuffer, mesh->buffer, bufferSize);
-
-    vkDestroyBuffer(device, stagingBuffer, NULL);
-    vkFreeMemory(device, stagingBufferMemory, NULL);
+    if (!gf3d_mesh_arena_alloc(&gf3d_mesh.vertexArena,bufferSize,&offset))
+    {
+        slog("mesh vertex arena is out of room for %i vertices",vcount);
+        if (compact)free(compact);
+        return 0;
+    }
+    gf3d_upload_lock();
+    data = gf3d_mesh_arena_upload(&gf3d_mesh.vertexArena,offset,bufferSize);
+    if (!data)
+    {
+        gf3d_upload_unlock();
+        gf3d_mesh_arena_release(&gf3d_mesh.vertexArena,offset,bufferSize);
+        if (compact)free(compact);
+        return 0;
+    }
+    memcpy(data, source, (size_t) bufferSize);
+    gf3d_upload_unlock();
+    if (compact)free(compact);
     
+    mesh->vertexOffset = (Uint32)(offset / gf3d_mesh_get_vertex_stride(mesh->vertexFormat));
+    mesh->vertexBytes = bufferSize;
     mesh->vertexCount = vcount;
-    mesh->bufferMemory = mesh->bufferMemory;
     
-    gf3d_mesh_setup_face_buffers(mesh,faces,fcount);
+    if (!gf3d_mesh_setup_face_buffers(mesh,faces,fcount))return 0;
+    // written in place when the arenas are mapped, so there is nothing to wait on
+    if (!gf3d_mesh.vertexArena.allocation.mapped)mesh->uploadValue = gf3d_upload_get_pending_value();
     
     slog("created a mesh with %i vertices and %i face",vcount,fcount);
+    return 1;
+}
+
+MeshVertexFormat gf3d_mesh_vertex_format_from_string(const char *name)
+{
+    if (!name)return MVF_Full;
+    if (strcmp(name,"compact") == 0)return MVF_Compact;
+    if (strcmp(name,"full") != 0)slog("unknown vertex format %s, using full",name);
+    return MVF_Full;
 }
 
 Mesh *gf3d_mesh_load(const char *filename)
+{
+    return gf3d_mesh_load_format(filename,MVF_Full);
+}
+
+Mesh *gf3d_mesh_load_format(const char *filename,MeshVertexFormat format)
 {
     Mesh *mesh;
     ObjData *obj;
-    mesh = gf3d_mesh_get_by_filename(filename);
+    MeshCache cache;
+    Face *faces;
+    Uint32 faceCount,i;
+    MeshLod lods[GF3D_MESH_LOD_MAX];
+    Uint32 lodCount;
+    MeshCluster *clusters = NULL;
+    Uint32 clusterCount = 0;
+    if (format >= MVF_MAX)format = MVF_Full;
+    mesh = gf3d_mesh_get_by_filename(filename,format);
     if (mesh)return mesh;
     
+    if (gf3d_mesh_cache_open(filename,gf3d_mesh.optimizeMode,gf3d_mesh.clusterMinFaces,&cache))
+    {
+        // the mapped payload goes straight into the staging ring
+        mesh = gf3d_mesh_new();
+        if (!mesh)
+        {
+            gf3d_mesh_cache_close(&cache);
+            return NULL;
+        }
+        mesh->vertexFormat = format;
+        vector3d_set(mesh->min,cache.header->min[0],cache.header->min[1],cache.header->min[2]);
+        vector3d_set(mesh->max,cache.header->max[0],cache.header->max[1],cache.header->max[2]);
+        vector3d_set(mesh->center,cache.header->center[0],cache.header->center[1],cache.header->center[2]);
+        mesh->radius = cache.header->radius;
+        if (!gf3d_mesh_create_vertex_buffer_from_vertices(mesh,cache.vertices,cache.header->vertexCount,cache.faces,cache.header->faceCount))
+        {
+            gf3d_mesh_cache_close(&cache);
+            gf3d_mesh_delete(mesh);
+            return NULL;
+        }
+        mesh->lodCount = cache.header->lodCount;
+        for (i = 0; i < mesh->lodCount; i++)
+        {
+            mesh->lods[i].firstIndex = cache.header->lods[i].firstIndex;
+            mesh->lods[i].indexCount = cache.header->lods[i].indexCount;
+            mesh->lods[i].error = cache.header->lods[i].error;
+        }
+        if (cache.header->clusterCount)
+        {
+            // the mapping goes away with the cache, the clusters are needed every frame
+            mesh->clusters = (MeshCluster *)gfc_allocate_array(sizeof(MeshCluster),cache.header->clusterCount);
+            if (mesh->clusters)
+            {
+                memcpy(mesh->clusters,cache.clusters,sizeof(MeshCluster) * cache.header->clusterCount);
+                mesh->clusterCount = cache.header->clusterCount;
+            }
+        }
+        gf3d_mesh_cache_close(&cache);
+        gfc_line_cpy(mesh->filename,filename);
+        return mesh;
+    }
+
     obj = gf3d_obj_load_from_file(filename);
     
     if (!obj)
     {
         return NULL;
     }
+    obj->face_vert_count = gf3d_mesh_optimize(
+        filename,
+        gf3d_mesh.optimizeMode,
+        obj->faceVertices,
+        obj->face_vert_count,
+        obj->outFace,
+        obj->face_count);
+    if ((gf3d_mesh.clusterMinFaces)&&(obj->face_count >= gf3d_mesh.clusterMinFaces))
+    {
+        clusterCount = gf3d_mesh_cluster_build(
+            obj->outFace,
+            obj->face_count,
+            obj->faceVertices,
+            obj->face_vert_count,
+            gf3d_mesh.optimizeMode,
+            &clusters);
+        if ((clusterCount)&&(gf3d_mesh.optimizeMode != MO_None))
+        {
+            // the faces moved, so the vertices are put back in the order they are now first used
+            gf3d_mesh_optimize_vertex_fetch(obj->faceVertices,obj->face_vert_count,obj->outFace,obj->face_count);
+        }
+    }
+    // every level of detail indexes the same vertices, so the levels share one index buffer back to back
+    faces = gf3d_mesh_simplify_lods(
+        filename,
+        gf3d_mesh.optimizeMode,
+        obj->faceVertices,
+        obj->face_vert_count,
+        obj->outFace,
+        obj->face_count,
+        lods,
+        &lodCount,
+        &faceCount);
+    if (!faces)
+    {
+        free(clusters);
+        gf3d_obj_free(obj);
+        return NULL;
+    }
+    gf3d_mesh_cache_write(filename,obj,faces,faceCount,lods,lodCount,clusters,clusterCount,gf3d_mesh.optimizeMode);
     
     mesh = gf3d_mesh_new();
     if (!mesh)
     {
+        free(clusters);
+        free(faces);
+        gf3d_obj_free(obj);
+        return NULL;
+    }
+    mesh->vertexFormat = format;
+    vector3d_copy(mesh->min,obj->min);
+    vector3d_copy(mesh->max,obj->max);
+    vector3d_copy(mesh->center,obj->center);
+    mesh->radius = obj->radius;
+    if (!gf3d_mesh_create_vertex_buffer_from_vertices(mesh,obj->faceVertices,obj->face_vert_count,faces,faceCount))
+    {
+        gf3d_mesh_delete(mesh);
+        free(clusters);
+        free(faces);
+        gf3d_obj_free(obj);
         return NULL;
     }
-    gf3d_mesh_create_vertex_buffer_from_vertices(mesh,obj->faceVertices,obj->face_vert_count,obj->outFace,obj->face_count);
+    memcpy(mesh->lods,lods,sizeof(lods));
+    mesh->lodCount = lodCount;
+    mesh->clusters = clusters;
+    mesh->clusterCount = clusterCount;
+    free(faces);
     gf3d_obj_free(obj);
     gfc_line_cpy(mesh->filename,filename);
     return mesh;
@@ -0,0 +1,192 @@
+#include <string.h>
+
+#include "simple_logger.h"
+
+#include "gf3d_vgraphics.h"
+#include "gf3d_buffers.h"
+#include "gf3d_upload.h"
+#include "gf3d_mesh_arena.h"
+
+static VkDeviceSize gf3d_mesh_arena_round(MeshArena *arena,VkDeviceSize size)
+{
+    return ((size + arena->alignment - 1) / arena->alignment) * arena->alignment;
+}
+
+Bool gf3d_mesh_arena_create(MeshArena *arena,VkDeviceSize size,VkDeviceSize alignment,VkBufferUsageFlags usage,Uint32 allocationMax)
+{
+    if ((!arena)||(!size)||(!alignment))return 0;
+    memset(arena,0,sizeof(MeshArena));
+    arena->alignment = alignment;
+    arena->size = (size / alignment) * alignment;
+    arena->lock = SDL_CreateMutex();
+    if (!arena->lock)
+    {
+        slog("failed to create mesh arena lock");
+        return 0;
+    }
+    // every held range can leave at most one gap before it, plus the tail
+    arena->freeMax = allocationMax + 1;
+    arena->freeBlocks = (MeshArenaBlock *)gfc_allocate_array(sizeof(MeshArenaBlock),arena->freeMax);
+    if (!arena->freeBlocks)
+    {
+        slog("failed to allocate mesh arena free list");
+        return 0;
+    }
+    // room for every range to be replaced once while frames are in flight
+    arena->retiredMax = allocationMax * 2;
+    arena->retired = (MeshArenaRetired *)gfc_allocate_array(sizeof(MeshArenaRetired),arena->retiredMax);
+    if (!arena->retired)
+    {
+        slog("failed to allocate mesh arena retired list");
+        gf3d_mesh_arena_free(arena);
+        return 0;
+    }
+    if (!gf3d_buffer_create_device_local(
+        arena->size,
+        usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        &arena->buffer,
+        &arena->allocation))
+    {
+        slog("failed to create mesh arena buffer");
+        gf3d_mesh_arena_free(arena);
+        return 0;
+    }
+    arena->freeBlocks[0].offset = 0;
+    arena->freeBlocks[0].size = arena->size;
+    arena->freeCount = 1;
+    return 1;
+}
+
+void gf3d_mesh_arena_free(MeshArena *arena)
+{
+    if (!arena)return;
+    gf3d_buffer_free(&arena->buffer,&arena->allocation);
+    if (arena->freeBlocks)free(arena->freeBlocks);
+    if (arena->retired)free(arena->retired);
+    if (arena->lock)SDL_DestroyMutex(arena->lock);
+    memset(arena,0,sizeof(MeshArena));
+}
+
+Bool gf3d_mesh_arena_alloc(MeshArena *arena,VkDeviceSize size,VkDeviceSize *offset)
+{
+    Uint32 i;
+    if ((!arena)||(!arena->freeBlocks)||(!size)||(!offset))return 0;
+    size = gf3d_mesh_arena_round(arena,size);
+    SDL_LockMutex(arena->lock);
+    for (i = 0; i < arena->freeCount; i++)
+    {
+        if (arena->freeBlocks[i].size < size)continue;
+        *offset = arena->freeBlocks[i].offset;
+        arena->freeBlocks[i].offset += size;
+        arena->freeBlocks[i].size -= size;
+        if (!arena->freeBlocks[i].size)
+        {
+            memmove(&arena->freeBlocks[i],&arena->freeBlocks[i + 1],sizeof(MeshArenaBlock) * (arena->freeCount - i - 1));
+            arena->freeCount--;
+        }
+        arena->used += size;
+        SDL_UnlockMutex(arena->lock);
+        return 1;
+    }
+    SDL_UnlockMutex(arena->lock);
+    return 0;
+}
+
+/**
+ * @brief put a range back on the free list, merging it with its neighbours
+ * @note called with the arena lock held
+ */
+static void gf3d_mesh_arena_reclaim(MeshArena *arena,VkDeviceSize offset,VkDeviceSize size)
+{
+    Uint32 i;
+    Bool mergePrev,mergeNext;
+    for (i = 0; i < arena->freeCount; i++)
+    {
+        if (arena->freeBlocks[i].offset > offset)break;
+    }
+    // i is the first free block after the range
+    mergePrev = (i > 0)&&(arena->freeBlocks[i - 1].offset + arena->freeBlocks[i - 1].size == offset);
+    mergeNext = (i < arena->freeCount)&&(offset + size == arena->freeBlocks[i].offset);
+    arena->used -= size;
+    if ((mergePrev)&&(mergeNext))
+    {
+        arena->freeBlocks[i - 1].size += size + arena->freeBlocks[i].size;
+        memmove(&arena->freeBlocks[i],&arena->freeBlocks[i + 1],sizeof(MeshArenaBlock) * (arena->freeCount - i - 1));
+        arena->freeCount--;
+        return;
+    }
+    if (mergePrev)
+    {
+        arena->freeBlocks[i - 1].size += size;
+        return;
+    }
+    if (mergeNext)
+    {
+        arena->freeBlocks[i].offset = offset;
+        arena->freeBlocks[i].size += size;
+        return;
+    }
+    if (arena->freeCount >= arena->freeMax)
+    {
+        slog("mesh arena free list is full, %i bytes are lost",(int)size);
+        return;
+    }
+    memmove(&arena->freeBlocks[i + 1],&arena->freeBlocks[i],sizeof(MeshArenaBlock) * (arena->freeCount - i));
+    arena->freeBlocks[i].offset = offset;
+    arena->freeBlocks[i].size = size;
+    arena->freeCount++;
+}
+
+void gf3d_mesh_arena_release(MeshArena *arena,VkDeviceSize offset,VkDeviceSize size)
+{
+    if ((!arena)||(!arena->freeBlocks)||(!size))return;
+    size = gf3d_mesh_arena_round(arena,size);
+    SDL_LockMutex(arena->lock);
+    if ((!arena->allocation.mapped)||(!arena->retired))
+    {
+        gf3d_mesh_arena_reclaim(arena,offset,size);
+    }
+    else if (arena->retiredCount >= arena->retiredMax)
+    {
+        slog("mesh arena retired list is full, reusing a range frames in flight may still read");
+        gf3d_mesh_arena_reclaim(arena,offset,size);
+    }
+    else
+    {
+        // a new mesh written in place could otherwise overwrite one a frame in flight is drawing
+        arena->retired[arena->retiredCount].offset = offset;
+        arena->retired[arena->retiredCount].size = size;
+        arena->retired[arena->retiredCount].frame = arena->frame;
+        arena->retiredCount++;
+    }
+    SDL_UnlockMutex(arena->lock);
+}
+
+void gf3d_mesh_arena_next_frame(MeshArena *arena)
+{
+    Uint32 i,kept = 0;
+    if ((!arena)||(!arena->lock))return;
+    SDL_LockMutex(arena->lock);
+    arena->frame++;
+    for (i = 0; i < arena->retiredCount; i++)
+    {
+        // the fence just waited on covers every frame submitted from this slot and before
+        if (arena->frame - arena->retired[i].frame >= GF3D_VGRAPHICS_FRAMES_IN_FLIGHT)
+        {
+            gf3d_mesh_arena_reclaim(arena,arena->retired[i].offset,arena->retired[i].size);
+            continue;
+        }
+        arena->retired[kept++] = arena->retired[i];
+    }
+    arena->retiredCount = kept;
+    SDL_UnlockMutex(arena->lock);
+}
+
+void *gf3d_mesh_arena_upload(MeshArena *arena,VkDeviceSize offset,VkDeviceSize size)
+{
+    if ((!arena)||(arena->buffer == VK_NULL_HANDLE)||(offset + size > arena->size))return NULL;
+    if (arena->allocation.mapped)return (Uint8 *)arena->allocation.mapped + offset;
+    return gf3d_upload_buffer_reserve(arena->buffer,offset,size);
+}
+
+/*eol@eof*/
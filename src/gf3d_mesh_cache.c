@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "simple_logger.h"
+
+#include "gf3d_mesh_cache.h"
+
+static Bool gf3d_mesh_cache_get_source_info(const char *filename, Uint64 *sourceTime, Uint64 *sourceSize)
+{
+    struct stat info;
+    if (stat(filename,&info) != 0)return 0;
+    *sourceTime = (Uint64)info.st_mtime;
+    *sourceSize = (Uint64)info.st_size;
+    return 1;
+}
+
+void gf3d_mesh_cache_get_filename(const char *filename, TextLine cachename)
+{
+    char *dot,*slash;
+    if ((!filename)||(!cachename))return;
+    gfc_line_cpy(cachename,filename);
+    dot = strrchr(cachename,'.');
+    slash = strrchr(cachename,'/');
+    if ((dot)&&((!slash)||(dot > slash)))*dot = '\0';
+    gfc_line_cat(cachename,".gf3dmesh");
+}
+
+/**
+ * @brief find the largest vertex index any face uses, so a corrupt cache cannot read past the vertex data on the GPU
+ */
+static Uint32 gf3d_mesh_cache_get_max_index(const Face *faces, Uint32 faceCount)
+{
+    Uint32 i,j,maxIndex = 0;
+    for (i = 0; i < faceCount; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            if (faces[i].verts[j] > maxIndex)maxIndex = faces[i].verts[j];
+        }
+    }
+    return maxIndex;
+}
+
+/**
+ * @brief check every cluster is whole triangles inside the full detail level, so clustered draws stay in the mesh
+ */
+static Bool gf3d_mesh_cache_clusters_valid(const MeshCluster *clusters, Uint32 clusterCount, Uint32 indexCount)
+{
+    Uint32 i;
+    for (i = 0; i < clusterCount; i++)
+    {
+        if (clusters[i].indexCount % 3)return 0;
+        if ((Uint64)clusters[i].firstIndex + clusters[i].indexCount > indexCount)return 0;
+    }
+    return 1;
+}
+
+Bool gf3d_mesh_cache_open(const char *filename, MeshOptimizeMode optimizeMode, Uint32 clusterMinFaces, MeshCache *cache)
+{
+    TextLine cachename;
+    Uint64 sourceTime,sourceSize;
+    const MeshCacheHeader *header;
+    Bool split;
+    if ((!filename)||(!cache))return 0;
+    memset(cache,0,sizeof(MeshCache));
+    if (!gf3d_mesh_cache_get_source_info(filename,&sourceTime,&sourceSize))return 0;
+    gf3d_mesh_cache_get_filename(filename,cachename);
+    if (!gf3d_mmap_open(cachename,&cache->file))return 0;
+    if (cache->file.size < sizeof(MeshCacheHeader))
+    {
+        gf3d_mesh_cache_close(cache);
+        return 0;
+    }
+    header = (const MeshCacheHeader *)cache->file.data;
+    if ((header->magic != GF3D_MESH_CACHE_MAGIC)||
+        (header->version != GF3D_MESH_CACHE_VERSION)||
+        (header->vertexSize != sizeof(Vertex)))
+    {
+        slog("mesh cache %s is from an older format, rebuilding",cachename);
+        gf3d_mesh_cache_close(cache);
+        return 0;
+    }
+    if (header->optimizeMode != optimizeMode)
+    {
+        slog("mesh cache %s was optimized differently, rebuilding",cachename);
+        gf3d_mesh_cache_close(cache);
+        return 0;
+    }
+    if ((header->sourceTime != sourceTime)||(header->sourceSize != sourceSize))
+    {
+        slog("mesh cache %s is out of date, rebuilding",cachename);
+        gf3d_mesh_cache_close(cache);
+        return 0;
+    }
+    if ((!header->lodCount)||(header->lodCount > GF3D_MESH_LOD_MAX)||
+        (header->lods[header->lodCount - 1].firstIndex + header->lods[header->lodCount - 1].indexCount > header->faceCount * 3))
+    {
+        slog("mesh cache %s has a bad level of detail table, rebuilding",cachename);
+        gf3d_mesh_cache_close(cache);
+        return 0;
+    }
+    split = (clusterMinFaces)&&(header->lods[0].indexCount / 3 >= clusterMinFaces);
+    if (split != (header->clusterCount > 0))
+    {
+        slog("mesh cache %s was split into clusters differently, rebuilding",cachename);
+        gf3d_mesh_cache_close(cache);
+        return 0;
+    }
+    if ((header->vertexOffset + (Uint64)header->vertexCount * sizeof(Vertex) > cache->file.size)||
+        (header->faceOffset + (Uint64)header->faceCount * sizeof(Face) > cache->file.size)||
+        (header->clusterOffset + (Uint64)header->clusterCount * sizeof(MeshCluster) > cache->file.size))
+    {
+        slog("mesh cache %s is truncated, rebuilding",cachename);
+        gf3d_mesh_cache_close(cache);
+        return 0;
+    }
+    if ((header->faceCount)&&(gf3d_mesh_cache_get_max_index(
+        (const Face *)((const Uint8 *)cache->file.data + header->faceOffset),
+        header->faceCount) >= header->vertexCount))
+    {
+        slog("mesh cache %s has faces indexing past its vertices, rebuilding",cachename);
+        gf3d_mesh_cache_close(cache);
+        return 0;
+    }
+    if ((header->clusterCount)&&(!gf3d_mesh_cache_clusters_valid(
+        (const MeshCluster *)((const Uint8 *)cache->file.data + header->clusterOffset),
+        header->clusterCount,
+        header->lods[0].indexCount)))
+    {
+        slog("mesh cache %s has clusters outside its full detail level, rebuilding",cachename);
+        gf3d_mesh_cache_close(cache);
+        return 0;
+    }
+    cache->header = header;
+    cache->vertices = (const Vertex *)((const Uint8 *)cache->file.data + header->vertexOffset);
+    cache->faces = (const Face *)((const Uint8 *)cache->file.data + header->faceOffset);
+    if (header->clusterCount)
+    {
+        cache->clusters = (const MeshCluster *)((const Uint8 *)cache->file.data + header->clusterOffset);
+    }
+    return 1;
+}
+
+void gf3d_mesh_cache_close(MeshCache *cache)
+{
+    if (!cache)return;
+    gf3d_mmap_close(&cache->file);
+    memset(cache,0,sizeof(MeshCache));
+}
+
+Bool gf3d_mesh_cache_write(
+    const char *filename,
+    ObjData *obj,
+    const Face *faces,
+    Uint32 faceCount,
+    const MeshLod *lods,
+    Uint32 lodCount,
+    const MeshCluster *clusters,
+    Uint32 clusterCount,
+    MeshOptimizeMode optimizeMode)
+{
+    FILE *file;
+    TextLine cachename;
+    MeshCacheHeader header = {0};
+    size_t written = 0;
+    Uint32 i;
+    if ((!filename)||(!obj)||(!faces)||(!lods))return 0;
+    if ((!obj->faceVertices)||(!lodCount)||(lodCount > GF3D_MESH_LOD_MAX))return 0;
+    if (!gf3d_mesh_cache_get_source_info(filename,&header.sourceTime,&header.sourceSize))return 0;
+    gf3d_mesh_cache_get_filename(filename,cachename);
+    file = fopen(cachename,"wb");
+    if (!file)
+    {
+        slog("failed to open mesh cache %s for writing",cachename);
+        return 0;
+    }
+    header.version = GF3D_MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.optimizeMode = optimizeMode;
+    header.vertexCount = obj->face_vert_count;
+    header.faceCount = faceCount;
+    header.lodCount = lodCount;
+    header.clusterCount = clusters ? clusterCount : 0;
+    for (i = 0; i < lodCount; i++)
+    {
+        header.lods[i].firstIndex = lods[i].firstIndex;
+        header.lods[i].indexCount = lods[i].indexCount;
+        header.lods[i].error = lods[i].error;
+    }
+    header.min[0] = obj->min.x;
+    header.min[1] = obj->min.y;
+    header.min[2] = obj->min.z;
+    header.max[0] = obj->max.x;
+    header.max[1] = obj->max.y;
+    header.max[2] = obj->max.z;
+    header.center[0] = obj->center.x;
+    header.center[1] = obj->center.y;
+    header.center[2] = obj->center.z;
+    header.radius = obj->radius;
+    header.vertexOffset = sizeof(MeshCacheHeader);
+    header.faceOffset = header.vertexOffset + (Uint64)header.vertexCount * sizeof(Vertex);
+    header.clusterOffset = header.faceOffset + (Uint64)header.faceCount * sizeof(Face);
+    // the magic is left zero until the payload is down, so a partial write never validates
+    written += fwrite(&header,sizeof(MeshCacheHeader),1,file);
+    written += fwrite(obj->faceVertices,sizeof(Vertex),header.vertexCount,file);
+    written += fwrite(faces,sizeof(Face),header.faceCount,file);
+    if (header.clusterCount)written += fwrite(clusters,sizeof(MeshCluster),header.clusterCount,file);
+    if (written != 1 + header.vertexCount + header.faceCount + header.clusterCount)
+    {
+        slog("failed to write mesh cache %s",cachename);
+        fclose(file);
+        remove(cachename);
+        return 0;
+    }
+    header.magic = GF3D_MESH_CACHE_MAGIC;
+    fseek(file,0,SEEK_SET);
+    fwrite(&header,sizeof(MeshCacheHeader),1,file);
+    fclose(file);
+    return 1;
+}
+
+/*eol@eof*/
@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "simple_logger.h"
+
+#include "gf3d_mesh_cluster.h"
+
+#define MC_NORMAL_DOT       0.5f    //triangles turned more than 60 degrees from the first of a cluster are left for another
+#define MC_MIN_CONE_DOT     0.1f    //cones wider than this cannot usefully cull, so they never do
+#define MC_MAX_SCALE_SKEW   0.01f   //non uniform scale bends the normals, so the cone test is skipped
+
+static void gf3d_mesh_cluster_face_normal(const Vertex *vertices,const Face *face,Vector3D *normal)
+{
+    Vector3D e1,e2;
+    float length;
+    const Vector3D *p0 = &vertices[face->verts[0]].vertex;
+    const Vector3D *p1 = &vertices[face->verts[1]].vertex;
+    const Vector3D *p2 = &vertices[face->verts[2]].vertex;
+    e1.x = p1->x - p0->x;
+    e1.y = p1->y - p0->y;
+    e1.z = p1->z - p0->z;
+    e2.x = p2->x - p0->x;
+    e2.y = p2->y - p0->y;
+    e2.z = p2->z - p0->z;
+    normal->x = e1.y * e2.z - e1.z * e2.y;
+    normal->y = e1.z * e2.x - e1.x * e2.z;
+    normal->z = e1.x * e2.y - e1.y * e2.x;
+    length = sqrtf(normal->x * normal->x + normal->y * normal->y + normal->z * normal->z);
+    if (length <= 0)return;
+    normal->x /= length;
+    normal->y /= length;
+    normal->z /= length;
+}
+
+/**
+ * @brief fill in the bounding sphere and normal cone of a cluster from its run of faces
+ */
+static void gf3d_mesh_cluster_bounds(MeshCluster *cluster,const Face *faces,const Vector3D *normals,const Vertex *vertices)
+{
+    Uint32 i,k,count;
+    Vector3D min,max,axis = {0};
+    const Vector3D *p;
+    float d,length,minDot = 1;
+    count = cluster->indexCount / 3;
+    min = max = vertices[faces[0].verts[0]].vertex;
+    for (i = 0; i < count; i++)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            p = &vertices[faces[i].verts[k]].vertex;
+            if (p->x < min.x)min.x = p->x;
+            if (p->y < min.y)min.y = p->y;
+            if (p->z < min.z)min.z = p->z;
+            if (p->x > max.x)max.x = p->x;
+            if (p->y > max.y)max.y = p->y;
+            if (p->z > max.z)max.z = p->z;
+        }
+        axis.x += normals[i].x;
+        axis.y += normals[i].y;
+        axis.z += normals[i].z;
+    }
+    cluster->center.x = (min.x + max.x) * 0.5f;
+    cluster->center.y = (min.y + max.y) * 0.5f;
+    cluster->center.z = (min.z + max.z) * 0.5f;
+    cluster->radius = 0;
+    for (i = 0; i < count; i++)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            p = &vertices[faces[i].verts[k]].vertex;
+            d = (p->x - cluster->center.x) * (p->x - cluster->center.x) +
+                (p->y - cluster->center.y) * (p->y - cluster->center.y) +
+                (p->z - cluster->center.z) * (p->z - cluster->center.z);
+            if (d > cluster->radius)cluster->radius = d;
+        }
+    }
+    cluster->radius = sqrtf(cluster->radius);
+
+    length = sqrtf(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+    cluster->coneCutoff = 1;
+    if (length <= 0)return;
+    axis.x /= length;
+    axis.y /= length;
+    axis.z /= length;
+    cluster->coneAxis = axis;
+    for (i = 0; i < count; i++)
+    {
+        d = axis.x * normals[i].x + axis.y * normals[i].y + axis.z * normals[i].z;
+        if (d < minDot)minDot = d;
+    }
+    if (minDot < MC_MIN_CONE_DOT)return;
+    // sine of the cone half angle: the eye must be at least this far behind every triangle
+    cluster->coneCutoff = sqrtf(1 - minDot * minDot);
+}
+
+Uint32 gf3d_mesh_cluster_build(
+    Face *faces,
+    Uint32 faceCount,
+    const Vertex *vertices,
+    Uint32 vertexCount,
+    MeshOptimizeMode mode,
+    MeshCluster **clusters)
+{
+    Uint32 i,k,f,t,v,seed,cursor = 0,head,tail,count,clusterCount = 0;
+    Uint32 *offsets = NULL,*adjacency = NULL,*queue = NULL,*queued = NULL;
+    Uint8 *assigned = NULL;
+    Vector3D *normals = NULL,*sortedNormals = NULL,reference;
+    Face *out = NULL;
+    MeshCluster *list = NULL;
+    float d;
+
+    if (clusters)*clusters = NULL;
+    if ((!faces)||(!vertices)||(!faceCount)||(!clusters))return 0;
+    offsets = (Uint32 *)gfc_allocate_array(sizeof(Uint32),vertexCount + 1);
+    adjacency = (Uint32 *)gfc_allocate_array(sizeof(Uint32),faceCount * 3);
+    queue = (Uint32 *)gfc_allocate_array(sizeof(Uint32),faceCount);
+    queued = (Uint32 *)gfc_allocate_array(sizeof(Uint32),faceCount);
+    assigned = (Uint8 *)gfc_allocate_array(sizeof(Uint8),faceCount);
+    normals = (Vector3D *)gfc_allocate_array(sizeof(Vector3D),faceCount);
+    sortedNormals = (Vector3D *)gfc_allocate_array(sizeof(Vector3D),faceCount);
+    out = (Face *)gfc_allocate_array(sizeof(Face),faceCount);
+    // at worst every cluster holds a single face
+    list = (MeshCluster *)gfc_allocate_array(sizeof(MeshCluster),faceCount);
+    if ((!offsets)||(!adjacency)||(!queue)||(!queued)||(!assigned)||(!normals)||(!sortedNormals)||(!out)||(!list))
+    {
+        slog("failed to allocate mesh cluster data");
+        goto done;
+    }
+
+    for (f = 0; f < faceCount; f++)
+    {
+        gf3d_mesh_cluster_face_normal(vertices,&faces[f],&normals[f]);
+        for (k = 0; k < 3; k++)offsets[faces[f].verts[k] + 1]++;
+    }
+    for (v = 0; v < vertexCount; v++)offsets[v + 1] += offsets[v];
+    for (f = 0; f < faceCount; f++)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            v = faces[f].verts[k];
+            adjacency[offsets[v]++] = f;
+        }
+    }
+    for (v = vertexCount; v > 0; v--)offsets[v] = offsets[v - 1];
+    offsets[0] = 0;
+
+    // grow each cluster breadth first from the next unclaimed face, which keeps it round and compact.
+    // seeds follow the cache optimized order, so neighbouring clusters stay neighbours in the buffer
+    for (seed = 0; seed < faceCount; seed++)
+    {
+        if (assigned[seed])continue;
+        list[clusterCount].firstIndex = cursor * 3;
+        head = tail = count = 0;
+        reference = normals[seed];
+        queue[tail++] = seed;
+        queued[seed] = clusterCount + 1;
+        while ((head < tail)&&(count < GF3D_MESH_CLUSTER_FACES))
+        {
+            t = queue[head++];
+            d = normals[t].x * reference.x + normals[t].y * reference.y + normals[t].z * reference.z;
+            if ((reference.x == 0)&&(reference.y == 0)&&(reference.z == 0))
+            {
+                reference = normals[t];// a degenerate seed takes its direction from the first real face
+            }
+            else if ((count)&&(d < MC_NORMAL_DOT))continue;// left for a cluster facing its way
+            assigned[t] = 1;
+            out[cursor] = faces[t];
+            sortedNormals[cursor] = normals[t];
+            cursor++;
+            count++;
+            for (k = 0; k < 3; k++)
+            {
+                v = faces[t].verts[k];
+                for (i = offsets[v]; i < offsets[v + 1]; i++)
+                {
+                    f = adjacency[i];
+                    if ((assigned[f])||(queued[f] == clusterCount + 1))continue;
+                    queued[f] = clusterCount + 1;
+                    queue[tail++] = f;
+                }
+            }
+        }
+        list[clusterCount].indexCount = count * 3;
+        clusterCount++;
+    }
+    memcpy(faces,out,sizeof(Face) * faceCount);
+
+    for (i = 0; i < clusterCount; i++)
+    {
+        f = list[i].firstIndex / 3;
+        if (mode != MO_None)
+        {
+            // normals of a cluster are only summed and compared, so they need not follow the reorder
+            gf3d_mesh_optimize_vertex_cache(&faces[f],list[i].indexCount / 3,vertexCount);
+        }
+        gf3d_mesh_cluster_bounds(&list[i],&faces[f],&sortedNormals[f],vertices);
+    }
+    *clusters = (MeshCluster *)realloc(list,sizeof(MeshCluster) * clusterCount);
+    if (!*clusters)*clusters = list;
+    list = NULL;
+    slog("split mesh into %i clusters averaging %.1f faces",clusterCount,(float)faceCount / (float)clusterCount);
+done:
+    free(offsets);
+    free(adjacency);
+    free(queue);
+    free(queued);
+    free(assigned);
+    free(normals);
+    free(sortedNormals);
+    free(out);
+    free(list);
+    return clusterCount;
+}
+
+Bool gf3d_mesh_cluster_visible(const MeshCluster *cluster, Matrix4 modelMat, Frustum *frustum, Vector3D eye)
+{
+    Vector3D center,axis,toCenter;
+    float radius,scale[3],length,distance;
+    int c;
+    if (!cluster)return 0;
+    radius = gf3d_frustum_transform_sphere(modelMat,cluster->center,cluster->radius,&center);
+    if ((frustum)&&(!gf3d_frustum_sphere_visible(frustum,center,radius)))return 0;
+    if (cluster->coneCutoff >= 1)return 1;
+    for (c = 0; c < 3; c++)
+    {
+        scale[c] = sqrtf(modelMat[c][0] * modelMat[c][0] + modelMat[c][1] * modelMat[c][1] + modelMat[c][2] * modelMat[c][2]);
+    }
+    if ((fabsf(scale[0] - scale[1]) > scale[0] * MC_MAX_SCALE_SKEW)||
+        (fabsf(scale[0] - scale[2]) > scale[0] * MC_MAX_SCALE_SKEW))return 1;
+    axis.x = modelMat[0][0] * cluster->coneAxis.x + modelMat[1][0] * cluster->coneAxis.y + modelMat[2][0] * cluster->coneAxis.z;
+    axis.y = modelMat[0][1] * cluster->coneAxis.x + modelMat[1][1] * cluster->coneAxis.y + modelMat[2][1] * cluster->coneAxis.z;
+    axis.z = modelMat[0][2] * cluster->coneAxis.x + modelMat[1][2] * cluster->coneAxis.y + modelMat[2][2] * cluster->coneAxis.z;
+    length = sqrtf(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+    if (length <= 0)return 1;
+    toCenter.x = center.x - eye.x;
+    toCenter.y = center.y - eye.y;
+    toCenter.z = center.z - eye.z;
+    distance = sqrtf(toCenter.x * toCenter.x + toCenter.y * toCenter.y + toCenter.z * toCenter.z);
+    // every triangle faces away if the eye sits inside the cone behind the cluster
+    if ((toCenter.x * axis.x + toCenter.y * axis.y + toCenter.z * axis.z) / length >= cluster->coneCutoff * distance + radius)return 0;
+    return 1;
+}
+
+/*eol@eof*/
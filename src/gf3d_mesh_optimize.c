@@ -0,0 +1,394 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "simple_logger.h"
+
+#include "gf3d_mesh_optimize.h"
+
+#define MO_INDEX_NONE       0xFFFFFFFF
+#define MO_LRU_SIZE         (GF3D_MESH_OPTIMIZE_CACHE_SIZE + 3)
+#define MO_LAST_TRI_SCORE   0.75f
+#define MO_CACHE_DECAY      1.5f
+#define MO_VALENCE_SCALE    2.0f
+#define MO_VALENCE_POWER    0.5f
+
+MeshOptimizeMode gf3d_mesh_optimize_mode_from_string(const char *name)
+{
+    if (!name)return MO_Cache;
+    if (strcmp(name,"none") == 0)return MO_None;
+    if (strcmp(name,"cache") == 0)return MO_Cache;
+    if (strcmp(name,"overdraw") == 0)return MO_Overdraw;
+    slog("unknown mesh optimize mode %s, using cache",name);
+    return MO_Cache;
+}
+
+static float gf3d_mesh_optimize_vertex_score(Sint32 cachePosition,Uint32 liveTriangles)
+{
+    float score = 0;
+    if (!liveTriangles)return -1;// no triangles left to use it
+    if (cachePosition >= 0)
+    {
+        // the triangle just drawn gets a fixed score so it is not favoured over its neighbours
+        if (cachePosition < 3)score = MO_LAST_TRI_SCORE;
+        else
+        {
+            score = 1.0f - (float)(cachePosition - 3) / (float)(GF3D_MESH_OPTIMIZE_CACHE_SIZE - 3);
+            score = powf(score,MO_CACHE_DECAY);
+        }
+    }
+    // vertices with few triangles left should be finished off so they can leave the cache
+    score += MO_VALENCE_SCALE * powf((float)liveTriangles,-MO_VALENCE_POWER);
+    return score;
+}
+
+void gf3d_mesh_optimize_vertex_cache(Face *faces,Uint32 faceCount,Uint32 vertexCount)
+{
+    Uint32 i,j,k,v,t,f;
+    Uint32 best,cursor = 0;
+    float bestScore,score;
+    Uint32 *offsets = NULL,*live = NULL,*adjacency = NULL;
+    Sint32 *cachePosition = NULL;
+    float *vertexScore = NULL,*triangleScore = NULL;
+    Uint8 *emitted = NULL;
+    Face *out = NULL;
+    Uint32 cache[MO_LRU_SIZE + 3],newCache[MO_LRU_SIZE + 3];
+    Uint32 cacheCount = 0,newCount;
+
+    if ((!faces)||(!faceCount)||(!vertexCount))return;
+    offsets = (Uint32 *)gfc_allocate_array(sizeof(Uint32),vertexCount + 1);
+    live = (Uint32 *)gfc_allocate_array(sizeof(Uint32),vertexCount);
+    adjacency = (Uint32 *)gfc_allocate_array(sizeof(Uint32),faceCount * 3);
+    cachePosition = (Sint32 *)gfc_allocate_array(sizeof(Sint32),vertexCount);
+    vertexScore = (float *)gfc_allocate_array(sizeof(float),vertexCount);
+    triangleScore = (float *)gfc_allocate_array(sizeof(float),faceCount);
+    emitted = (Uint8 *)gfc_allocate_array(sizeof(Uint8),faceCount);
+    out = (Face *)gfc_allocate_array(sizeof(Face),faceCount);
+    if ((!offsets)||(!live)||(!adjacency)||(!cachePosition)||(!vertexScore)||(!triangleScore)||(!emitted)||(!out))
+    {
+        slog("failed to allocate vertex cache optimization data");
+        goto done;
+    }
+
+    // triangles using each vertex, as one flat list
+    for (f = 0; f < faceCount; f++)
+    {
+        for (k = 0; k < 3; k++)live[faces[f].verts[k]]++;
+    }
+    for (v = 0; v < vertexCount; v++)
+    {
+        offsets[v + 1] = offsets[v] + live[v];
+        live[v] = 0;
+    }
+    for (f = 0; f < faceCount; f++)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            v = faces[f].verts[k];
+            adjacency[offsets[v] + live[v]++] = f;
+        }
+    }
+    for (v = 0; v < vertexCount; v++)
+    {
+        cachePosition[v] = -1;
+        vertexScore[v] = gf3d_mesh_optimize_vertex_score(-1,live[v]);
+    }
+    best = 0;
+    bestScore = -1;
+    for (f = 0; f < faceCount; f++)
+    {
+        triangleScore[f] = vertexScore[faces[f].verts[0]] + vertexScore[faces[f].verts[1]] + vertexScore[faces[f].verts[2]];
+        if (triangleScore[f] > bestScore)
+        {
+            bestScore = triangleScore[f];
+            best = f;
+        }
+    }
+
+    for (i = 0; i < faceCount; i++)
+    {
+        if (best == MO_INDEX_NONE)
+        {
+            // nothing in the cache has triangles left, start over at the next unused triangle
+            while ((cursor < faceCount)&&(emitted[cursor]))cursor++;
+            if (cursor >= faceCount)break;
+            best = cursor;
+        }
+        out[i] = faces[best];
+        emitted[best] = 1;
+
+        // retire the triangle from its vertices' live lists
+        newCount = 0;
+        for (k = 0; k < 3; k++)
+        {
+            v = faces[best].verts[k];
+            for (j = offsets[v]; j < offsets[v] + live[v]; j++)
+            {
+                if (adjacency[j] == best)
+                {
+                    adjacency[j] = adjacency[offsets[v] + live[v] - 1];
+                    live[v]--;
+                    break;
+                }
+            }
+            newCache[newCount++] = v;
+        }
+        // the triangle's vertices move to the front, everything else shifts back
+        for (j = 0; j < cacheCount; j++)
+        {
+            v = cache[j];
+            if ((v == faces[best].verts[0])||(v == faces[best].verts[1])||(v == faces[best].verts[2]))continue;
+            newCache[newCount++] = v;
+        }
+        for (j = 0; j < newCount; j++)
+        {
+            v = newCache[j];
+            cachePosition[v] = (j < GF3D_MESH_OPTIMIZE_CACHE_SIZE) ? (Sint32)j : -1;
+            vertexScore[v] = gf3d_mesh_optimize_vertex_score(cachePosition[v],live[v]);
+        }
+        // rescore the triangles touching anything that moved and pick the best of them
+        best = MO_INDEX_NONE;
+        bestScore = -1;
+        for (j = 0; j < newCount; j++)
+        {
+            v = newCache[j];
+            for (k = offsets[v]; k < offsets[v] + live[v]; k++)
+            {
+                t = adjacency[k];
+                score = vertexScore[faces[t].verts[0]] + vertexScore[faces[t].verts[1]] + vertexScore[faces[t].verts[2]];
+                triangleScore[t] = score;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best = t;
+                }
+            }
+        }
+        cacheCount = (newCount < GF3D_MESH_OPTIMIZE_CACHE_SIZE) ? newCount : GF3D_MESH_OPTIMIZE_CACHE_SIZE;
+        memcpy(cache,newCache,sizeof(Uint32) * cacheCount);
+    }
+    memcpy(faces,out,sizeof(Face) * faceCount);
+done:
+    free(offsets);
+    free(live);
+    free(adjacency);
+    free(cachePosition);
+    free(vertexScore);
+    free(triangleScore);
+    free(emitted);
+    free(out);
+}
+
+typedef struct
+{
+    Uint32  start;      /**<first face of the cluster*/
+    Uint32  count;
+    float   sortKey;    /**<how far the cluster faces out from the mesh centroid*/
+}OverdrawCluster;
+
+static int gf3d_mesh_overdraw_cluster_compare(const void *a,const void *b)
+{
+    const OverdrawCluster *ca = (const OverdrawCluster *)a;
+    const OverdrawCluster *cb = (const OverdrawCluster *)b;
+    if (ca->sortKey > cb->sortKey)return -1;
+    if (ca->sortKey < cb->sortKey)return 1;
+    return (ca->start < cb->start) ? -1 : 1;
+}
+
+void gf3d_mesh_optimize_overdraw(Face *faces,Uint32 faceCount,const Vertex *vertices,Uint32 vertexCount)
+{
+    Uint32 i,k,f,v,misses,clusterCount = 0,out = 0;
+    Uint32 *timestamps = NULL;
+    Uint32 time = GF3D_MESH_OPTIMIZE_CACHE_SIZE + 1;
+    OverdrawCluster *clusters = NULL;
+    Face *sorted = NULL;
+    Vector3D meshCenter = {0},center,normal,e1,e2,n;
+    const Vector3D *p[3];
+    float area,totalArea = 0,clusterArea,length;
+
+    if ((!faces)||(!faceCount)||(!vertices)||(!vertexCount))return;
+    timestamps = (Uint32 *)gfc_allocate_array(sizeof(Uint32),vertexCount);
+    clusters = (OverdrawCluster *)gfc_allocate_array(sizeof(OverdrawCluster),faceCount);
+    sorted = (Face *)gfc_allocate_array(sizeof(Face),faceCount);
+    if ((!timestamps)||(!clusters)||(!sorted))
+    {
+        slog("failed to allocate overdraw optimization data");
+        goto done;
+    }
+
+    // a triangle missing on all three corners means the cache went cold, so the order can break there for free
+    for (f = 0; f < faceCount; f++)
+    {
+        misses = 0;
+        for (k = 0; k < 3; k++)
+        {
+            v = faces[f].verts[k];
+            if (time - timestamps[v] > GF3D_MESH_OPTIMIZE_CACHE_SIZE)
+            {
+                timestamps[v] = time++;
+                misses++;
+            }
+        }
+        if ((f == 0)||(misses == 3))
+        {
+            clusters[clusterCount].start = f;
+            clusterCount++;
+        }
+        clusters[clusterCount - 1].count++;
+    }
+
+    for (f = 0; f < faceCount; f++)
+    {
+        for (k = 0; k < 3; k++)p[k] = &vertices[faces[f].verts[k]].vertex;
+        vector3d_sub(e1,(*p[1]),(*p[0]));
+        vector3d_sub(e2,(*p[2]),(*p[0]));
+        vector3d_cross_product(&n,e1,e2);
+        area = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+        meshCenter.x += area * (p[0]->x + p[1]->x + p[2]->x) / 3.0f;
+        meshCenter.y += area * (p[0]->y + p[1]->y + p[2]->y) / 3.0f;
+        meshCenter.z += area * (p[0]->z + p[1]->z + p[2]->z) / 3.0f;
+        totalArea += area;
+    }
+    if (totalArea > 0)
+    {
+        meshCenter.x /= totalArea;
+        meshCenter.y /= totalArea;
+        meshCenter.z /= totalArea;
+    }
+
+    for (i = 0; i < clusterCount; i++)
+    {
+        memset(&center,0,sizeof(Vector3D));
+        memset(&normal,0,sizeof(Vector3D));
+        clusterArea = 0;
+        for (f = clusters[i].start; f < clusters[i].start + clusters[i].count; f++)
+        {
+            for (k = 0; k < 3; k++)p[k] = &vertices[faces[f].verts[k]].vertex;
+            vector3d_sub(e1,(*p[1]),(*p[0]));
+            vector3d_sub(e2,(*p[2]),(*p[0]));
+            vector3d_cross_product(&n,e1,e2);
+            area = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+            center.x += area * (p[0]->x + p[1]->x + p[2]->x) / 3.0f;
+            center.y += area * (p[0]->y + p[1]->y + p[2]->y) / 3.0f;
+            center.z += area * (p[0]->z + p[1]->z + p[2]->z) / 3.0f;
+            vector3d_add(normal,normal,n);  //unnormalized cross products weight by area already
+            clusterArea += area;
+        }
+        if (clusterArea > 0)
+        {
+            center.x /= clusterArea;
+            center.y /= clusterArea;
+            center.z /= clusterArea;
+        }
+        length = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+        if (length > 0)
+        {
+            normal.x /= length;
+            normal.y /= length;
+            normal.z /= length;
+        }
+        clusters[i].sortKey =
+            (center.x - meshCenter.x) * normal.x +
+            (center.y - meshCenter.y) * normal.y +
+            (center.z - meshCenter.z) * normal.z;
+    }
+    qsort(clusters,clusterCount,sizeof(OverdrawCluster),gf3d_mesh_overdraw_cluster_compare);
+    for (i = 0; i < clusterCount; i++)
+    {
+        memcpy(&sorted[out],&faces[clusters[i].start],sizeof(Face) * clusters[i].count);
+        out += clusters[i].count;
+    }
+    memcpy(faces,sorted,sizeof(Face) * faceCount);
+done:
+    free(timestamps);
+    free(clusters);
+    free(sorted);
+}
+
+Uint32 gf3d_mesh_optimize_vertex_fetch(Vertex *vertices,Uint32 vertexCount,Face *faces,Uint32 faceCount)
+{
+    Uint32 f,k,v,next = 0;
+    Uint32 *remap;
+    Vertex *reordered;
+    if ((!vertices)||(!vertexCount)||(!faces))return vertexCount;
+    remap = (Uint32 *)malloc(sizeof(Uint32) * vertexCount);
+    reordered = (Vertex *)gfc_allocate_array(sizeof(Vertex),vertexCount);
+    if ((!remap)||(!reordered))
+    {
+        slog("failed to allocate vertex fetch optimization data");
+        free(remap);
+        free(reordered);
+        return vertexCount;
+    }
+    memset(remap,0xFF,sizeof(Uint32) * vertexCount);
+    for (f = 0; f < faceCount; f++)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            v = faces[f].verts[k];
+            if (remap[v] == MO_INDEX_NONE)
+            {
+                remap[v] = next;
+                reordered[next++] = vertices[v];
+            }
+            faces[f].verts[k] = remap[v];
+        }
+    }
+    memcpy(vertices,reordered,sizeof(Vertex) * next);
+    free(remap);
+    free(reordered);
+    return next;
+}
+
+float gf3d_mesh_optimize_acmr(const Face *faces,Uint32 faceCount,Uint32 vertexCount,float *atvr)
+{
+    Uint32 f,k,v,misses = 0,unique = 0;
+    Uint32 *timestamps;
+    Uint32 time = GF3D_MESH_OPTIMIZE_CACHE_SIZE + 1;
+    if (atvr)*atvr = 0;
+    if ((!faces)||(!faceCount)||(!vertexCount))return 0;
+    timestamps = (Uint32 *)gfc_allocate_array(sizeof(Uint32),vertexCount);
+    if (!timestamps)return 0;
+    for (f = 0; f < faceCount; f++)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            v = faces[f].verts[k];
+            if (!timestamps[v])unique++;
+            // FIFO: an entry stays for CACHE_SIZE misses after it was loaded, hits do not refresh it
+            if (time - timestamps[v] > GF3D_MESH_OPTIMIZE_CACHE_SIZE)
+            {
+                timestamps[v] = time++;
+                misses++;
+            }
+        }
+    }
+    free(timestamps);
+    if ((atvr)&&(unique))*atvr = (float)misses / (float)unique;
+    return (float)misses / (float)faceCount;
+}
+
+Uint32 gf3d_mesh_optimize(
+    const char *filename,
+    MeshOptimizeMode mode,
+    Vertex *vertices,
+    Uint32 vertexCount,
+    Face *faces,
+    Uint32 faceCount)
+{
+    float acmrBefore,atvrBefore,acmr,atvr;
+    if ((mode == MO_None)||(!vertices)||(!faces))return vertexCount;
+    acmrBefore = gf3d_mesh_optimize_acmr(faces,faceCount,vertexCount,&atvrBefore);
+    gf3d_mesh_optimize_vertex_cache(faces,faceCount,vertexCount);
+    if (mode == MO_Overdraw)
+    {
+        gf3d_mesh_optimize_overdraw(faces,faceCount,vertices,vertexCount);
+    }
+    vertexCount = gf3d_mesh_optimize_vertex_fetch(vertices,vertexCount,faces,faceCount);
+    acmr = gf3d_mesh_optimize_acmr(faces,faceCount,vertexCount,&atvr);
+    slog("optimized mesh %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+         filename ? filename : "",acmrBefore,acmr,atvrBefore,atvr);
+    return vertexCount;
+}
+
+/*eol@eof*/
@@ -0,0 +1,518 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "simple_logger.h"
+
+#include "gf3d_mesh_simplify.h"
+
+#define MS_INDEX_NONE       0xFFFFFFFF
+#define MS_EDGE_NONE        0xFFFFFFFFFFFFFFFFULL
+#define MS_BORDER_WEIGHT    10.0    //how strongly open edges resist being pulled in
+#define MS_MIN_NORMAL_DOT   0.25    //collapses may not turn a triangle further than about 75 degrees
+#define MS_LOD_RATIO        0.5f    //each level aims for this fraction of the triangles of the level before
+#define MS_LOD_MIN_FACES    32      //levels are not built below this many triangles
+#define MS_LOD_MIN_SAVING   0.8f    //a level keeping more than this fraction of the level before is dropped
+
+typedef enum
+{
+    MSK_Manifold,   /**<interior vertex, free to collapse onto any neighbour*/
+    MSK_Border,     /**<on an open edge, may only slide along it*/
+    MSK_Locked      /**<seam or complex vertex, never moves*/
+}MeshSimplifyKind;
+
+/**
+ * @purpose sum of squared distances to a set of planes, area weighted
+ */
+typedef struct
+{
+    double a2,b2,c2,d2;
+    double ab,ac,ad;
+    double bc,bd;
+    double cd;
+    double w;
+}Quadric;
+
+typedef struct
+{
+    Uint32 from;
+    Uint32 to;
+    double cost;
+}Collapse;
+
+typedef struct
+{
+    Uint64 *keys;
+    Uint32  mask;
+}EdgeSet;
+
+static void gf3d_mesh_quadric_add_plane(Quadric *q,double a,double b,double c,double d,double w)
+{
+    q->a2 += a * a * w;
+    q->b2 += b * b * w;
+    q->c2 += c * c * w;
+    q->d2 += d * d * w;
+    q->ab += a * b * w;
+    q->ac += a * c * w;
+    q->ad += a * d * w;
+    q->bc += b * c * w;
+    q->bd += b * d * w;
+    q->cd += c * d * w;
+    q->w += w;
+}
+
+static void gf3d_mesh_quadric_add(Quadric *q,const Quadric *r)
+{
+    q->a2 += r->a2;
+    q->b2 += r->b2;
+    q->c2 += r->c2;
+    q->d2 += r->d2;
+    q->ab += r->ab;
+    q->ac += r->ac;
+    q->ad += r->ad;
+    q->bc += r->bc;
+    q->bd += r->bd;
+    q->cd += r->cd;
+    q->w += r->w;
+}
+
+/**
+ * @brief the mean squared distance from a point to the planes of the quadric
+ */
+static double gf3d_mesh_quadric_error(const Quadric *q,const double *p)
+{
+    double r;
+    if (q->w <= 0)return 0;
+    r = q->a2 * p[0] * p[0] + q->b2 * p[1] * p[1] + q->c2 * p[2] * p[2] + q->d2;
+    r += 2 * (q->ab * p[0] * p[1] + q->ac * p[0] * p[2] + q->bc * p[1] * p[2]);
+    r += 2 * (q->ad * p[0] + q->bd * p[1] + q->cd * p[2]);
+    return fabs(r) / q->w;
+}
+
+static void gf3d_mesh_simplify_normal(const double *p0,const double *p1,const double *p2,double *n)
+{
+    double e1[3],e2[3];
+    e1[0] = p1[0] - p0[0];
+    e1[1] = p1[1] - p0[1];
+    e1[2] = p1[2] - p0[2];
+    e2[0] = p2[0] - p0[0];
+    e2[1] = p2[1] - p0[1];
+    e2[2] = p2[2] - p0[2];
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static Uint32 gf3d_mesh_simplify_hash(Uint64 key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (Uint32)key;
+}
+
+static Bool gf3d_mesh_edge_set_create(EdgeSet *set,Uint32 edgeCount)
+{
+    Uint32 size = 16;
+    while (size < edgeCount * 2)size <<= 1;
+    set->keys = (Uint64 *)malloc(sizeof(Uint64) * size);
+    if (!set->keys)return 0;
+    memset(set->keys,0xff,sizeof(Uint64) * size);
+    set->mask = size - 1;
+    return 1;
+}
+
+static void gf3d_mesh_edge_set_insert(EdgeSet *set,Uint32 a,Uint32 b)
+{
+    Uint64 key = ((Uint64)a << 32) | b;
+    Uint32 slot = gf3d_mesh_simplify_hash(key) & set->mask;
+    while (set->keys[slot] != MS_EDGE_NONE)
+    {
+        if (set->keys[slot] == key)return;
+        slot = (slot + 1) & set->mask;
+    }
+    set->keys[slot] = key;
+}
+
+static Bool gf3d_mesh_edge_set_has(EdgeSet *set,Uint32 a,Uint32 b)
+{
+    Uint64 key = ((Uint64)a << 32) | b;
+    Uint32 slot = gf3d_mesh_simplify_hash(key) & set->mask;
+    while (set->keys[slot] != MS_EDGE_NONE)
+    {
+        if (set->keys[slot] == key)return 1;
+        slot = (slot + 1) & set->mask;
+    }
+    return 0;
+}
+
+/**
+ * @brief map every vertex to the first vertex sharing its position, so seams count as one point of the surface
+ */
+static void gf3d_mesh_simplify_weld_positions(const double *positions,Uint32 vertexCount,Uint32 *weld)
+{
+    Uint32 i,size = 16,slot,*table;
+    Uint64 bits[3];
+    while (size < vertexCount * 2)size <<= 1;
+    table = (Uint32 *)malloc(sizeof(Uint32) * size);
+    if (!table)
+    {
+        for (i = 0; i < vertexCount; i++)weld[i] = i;
+        return;
+    }
+    memset(table,0xff,sizeof(Uint32) * size);
+    for (i = 0; i < vertexCount; i++)
+    {
+        memcpy(bits,&positions[i * 3],sizeof(bits));
+        slot = gf3d_mesh_simplify_hash(bits[0] ^ (bits[1] * 31) ^ (bits[2] * 131)) & (size - 1);
+        while (table[slot] != MS_INDEX_NONE)
+        {
+            if (memcmp(&positions[table[slot] * 3],&positions[i * 3],sizeof(double) * 3) == 0)break;
+            slot = (slot + 1) & (size - 1);
+        }
+        if (table[slot] == MS_INDEX_NONE)table[slot] = i;
+        weld[i] = table[slot];
+    }
+    free(table);
+}
+
+static int gf3d_mesh_collapse_compare(const void *a,const void *b)
+{
+    const Collapse *ca = (const Collapse *)a;
+    const Collapse *cb = (const Collapse *)b;
+    if (ca->cost < cb->cost)return -1;
+    if (ca->cost > cb->cost)return 1;
+    return 0;
+}
+
+/**
+ * @brief check that moving from onto to turns none of the remaining triangles around from over
+ */
+static Bool gf3d_mesh_simplify_collapse_flips(
+    Uint32 from,
+    Uint32 to,
+    const Face *faces,
+    const Uint32 *offsets,
+    const Uint32 *adjacency,
+    const double *positions)
+{
+    Uint32 i,k,f;
+    double before[3],after[3],p[3][3];
+    double dot,lengths;
+    for (i = offsets[from]; i < offsets[from + 1]; i++)
+    {
+        f = adjacency[i];
+        if ((faces[f].verts[0] == to)||(faces[f].verts[1] == to)||(faces[f].verts[2] == to))continue;// goes away
+        for (k = 0; k < 3; k++)
+        {
+            memcpy(p[k],&positions[faces[f].verts[k] * 3],sizeof(double) * 3);
+        }
+        gf3d_mesh_simplify_normal(p[0],p[1],p[2],before);
+        for (k = 0; k < 3; k++)
+        {
+            if (faces[f].verts[k] == from)memcpy(p[k],&positions[to * 3],sizeof(double) * 3);
+        }
+        gf3d_mesh_simplify_normal(p[0],p[1],p[2],after);
+        dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+        lengths = sqrt(before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+                  sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+        if (dot <= MS_MIN_NORMAL_DOT * lengths)return 1;
+    }
+    return 0;
+}
+
+Uint32 gf3d_mesh_simplify(
+    Face *faces,
+    Uint32 faceCount,
+    const Vertex *vertices,
+    Uint32 vertexCount,
+    Uint32 targetFaceCount,
+    float *error)
+{
+    Uint32 i,k,f,v,a,b,wa,wb,o;
+    Uint32 wanted,done,kept;
+    double extent,scale,n[3],area,d,maxCost = 0;
+    Face face;
+    double *positions = NULL;
+    Uint32 *weld = NULL,*wedges = NULL,*remap = NULL,*offsets = NULL,*adjacency = NULL;
+    Uint8 *kind = NULL,*touched = NULL;
+    Quadric *quadrics = NULL,q;
+    Collapse *collapses = NULL;
+    Uint32 collapseCount;
+    EdgeSet edges = {0};
+
+    if (error)*error = 0;
+    if ((!faces)||(!vertices)||(!faceCount)||(!vertexCount))return faceCount;
+    if (faceCount <= targetFaceCount)return faceCount;
+
+    positions = (double *)gfc_allocate_array(sizeof(double),vertexCount * 3);
+    weld = (Uint32 *)gfc_allocate_array(sizeof(Uint32),vertexCount);
+    wedges = (Uint32 *)gfc_allocate_array(sizeof(Uint32),vertexCount);
+    remap = (Uint32 *)gfc_allocate_array(sizeof(Uint32),vertexCount);
+    offsets = (Uint32 *)gfc_allocate_array(sizeof(Uint32),vertexCount + 1);
+    adjacency = (Uint32 *)gfc_allocate_array(sizeof(Uint32),faceCount * 3);
+    kind = (Uint8 *)gfc_allocate_array(sizeof(Uint8),vertexCount);
+    touched = (Uint8 *)gfc_allocate_array(sizeof(Uint8),vertexCount);
+    quadrics = (Quadric *)gfc_allocate_array(sizeof(Quadric),vertexCount);
+    collapses = (Collapse *)gfc_allocate_array(sizeof(Collapse),faceCount * 6);
+    if ((!positions)||(!weld)||(!wedges)||(!remap)||(!offsets)||(!adjacency)||
+        (!kind)||(!touched)||(!quadrics)||(!collapses)||
+        (!gf3d_mesh_edge_set_create(&edges,faceCount * 3)))
+    {
+        slog("failed to allocate mesh simplification data");
+        goto done;
+    }
+
+    // work in a unit box so the error thresholds do not depend on the model scale
+    extent = 0;
+    for (k = 0; k < 3; k++)
+    {
+        double lo = 0,hi = 0;
+        for (v = 0; v < vertexCount; v++)
+        {
+            d = (k == 0) ? vertices[v].vertex.x : (k == 1) ? vertices[v].vertex.y : vertices[v].vertex.z;
+            if ((v == 0)||(d < lo))lo = d;
+            if ((v == 0)||(d > hi))hi = d;
+        }
+        if (hi - lo > extent)extent = hi - lo;
+    }
+    scale = (extent > 0) ? 1.0 / extent : 1.0;
+    for (v = 0; v < vertexCount; v++)
+    {
+        positions[v * 3 + 0] = vertices[v].vertex.x * scale;
+        positions[v * 3 + 1] = vertices[v].vertex.y * scale;
+        positions[v * 3 + 2] = vertices[v].vertex.z * scale;
+    }
+    gf3d_mesh_simplify_weld_positions(positions,vertexCount,weld);
+    for (v = 0; v < vertexCount; v++)wedges[weld[v]]++;
+
+    // open edges are found on the welded surface, so texture seams are not mistaken for holes
+    for (f = 0; f < faceCount; f++)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            gf3d_mesh_edge_set_insert(&edges,weld[faces[f].verts[k]],weld[faces[f].verts[(k + 1) % 3]]);
+        }
+    }
+    for (f = 0; f < faceCount; f++)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            a = faces[f].verts[k];
+            b = faces[f].verts[(k + 1) % 3];
+            wa = weld[a];
+            wb = weld[b];
+            if (gf3d_mesh_edge_set_has(&edges,wb,wa))continue;
+            // a second open edge leaving the same point makes it a pinch, which cannot slide safely
+            kind[a] = (kind[a] == MSK_Manifold) ? MSK_Border : MSK_Locked;
+            if (kind[b] == MSK_Manifold)kind[b] = MSK_Border;
+        }
+    }
+    for (v = 0; v < vertexCount; v++)
+    {
+        if (wedges[weld[v]] > 1)kind[v] = MSK_Locked;
+    }
+
+    // every triangle plane, plus a plane standing up from every open edge to hold the outline in place
+    for (f = 0; f < faceCount; f++)
+    {
+        const double *p0 = &positions[faces[f].verts[0] * 3];
+        const double *p1 = &positions[faces[f].verts[1] * 3];
+        const double *p2 = &positions[faces[f].verts[2] * 3];
+        gf3d_mesh_simplify_normal(p0,p1,p2,n);
+        area = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (area <= 0)continue;
+        n[0] /= area;
+        n[1] /= area;
+        n[2] /= area;
+        d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+        for (k = 0; k < 3; k++)
+        {
+            gf3d_mesh_quadric_add_plane(&quadrics[weld[faces[f].verts[k]]],n[0],n[1],n[2],d,area * 0.5);
+        }
+        for (k = 0; k < 3; k++)
+        {
+            double e[3],en[3],length;
+            const double *pa,*pb;
+            a = faces[f].verts[k];
+            b = faces[f].verts[(k + 1) % 3];
+            if (gf3d_mesh_edge_set_has(&edges,weld[b],weld[a]))continue;
+            pa = &positions[a * 3];
+            pb = &positions[b * 3];
+            e[0] = pb[0] - pa[0];
+            e[1] = pb[1] - pa[1];
+            e[2] = pb[2] - pa[2];
+            length = sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+            if (length <= 0)continue;
+            en[0] = (e[1] * n[2] - e[2] * n[1]) / length;
+            en[1] = (e[2] * n[0] - e[0] * n[2]) / length;
+            en[2] = (e[0] * n[1] - e[1] * n[0]) / length;
+            d = -(en[0] * pa[0] + en[1] * pa[1] + en[2] * pa[2]);
+            gf3d_mesh_quadric_add_plane(&quadrics[weld[a]],en[0],en[1],en[2],d,length * length * MS_BORDER_WEIGHT);
+            gf3d_mesh_quadric_add_plane(&quadrics[weld[b]],en[0],en[1],en[2],d,length * length * MS_BORDER_WEIGHT);
+        }
+    }
+
+    while (faceCount > targetFaceCount)
+    {
+        // triangles using each vertex, rebuilt every pass as the faces change
+        memset(offsets,0,sizeof(Uint32) * (vertexCount + 1));
+        for (f = 0; f < faceCount; f++)
+        {
+            for (k = 0; k < 3; k++)offsets[faces[f].verts[k] + 1]++;
+        }
+        for (v = 0; v < vertexCount; v++)offsets[v + 1] += offsets[v];
+        for (f = 0; f < faceCount; f++)
+        {
+            for (k = 0; k < 3; k++)
+            {
+                v = faces[f].verts[k];
+                adjacency[offsets[v]++] = f;
+            }
+        }
+        for (v = vertexCount; v > 0; v--)offsets[v] = offsets[v - 1];
+        offsets[0] = 0;
+
+        memset(edges.keys,0xff,sizeof(Uint64) * (edges.mask + 1));
+        for (f = 0; f < faceCount; f++)
+        {
+            for (k = 0; k < 3; k++)
+            {
+                gf3d_mesh_edge_set_insert(&edges,weld[faces[f].verts[k]],weld[faces[f].verts[(k + 1) % 3]]);
+            }
+        }
+
+        collapseCount = 0;
+        for (f = 0; f < faceCount; f++)
+        {
+            // both directions of every edge are candidates
+            for (k = 0; k < 6; k++)
+            {
+                a = faces[f].verts[k % 3];
+                b = faces[f].verts[(k < 3) ? (k + 1) % 3 : (k + 2) % 3];
+                if (a == b)continue;
+                if (kind[a] == MSK_Locked)continue;
+                if (kind[a] == MSK_Border)
+                {
+                    // border vertices only slide along an open edge onto another border point
+                    if (kind[b] == MSK_Manifold)continue;
+                    if ((gf3d_mesh_edge_set_has(&edges,weld[a],weld[b]))&&
+                        (gf3d_mesh_edge_set_has(&edges,weld[b],weld[a])))continue;
+                }
+                q = quadrics[weld[a]];
+                gf3d_mesh_quadric_add(&q,&quadrics[weld[b]]);
+                collapses[collapseCount].from = a;
+                collapses[collapseCount].to = b;
+                collapses[collapseCount].cost = gf3d_mesh_quadric_error(&q,&positions[b * 3]);
+                collapseCount++;
+            }
+        }
+        if (!collapseCount)break;
+        qsort(collapses,collapseCount,sizeof(Collapse),gf3d_mesh_collapse_compare);
+
+        // each collapse removes about two triangles
+        wanted = (faceCount - targetFaceCount) / 2 + 1;
+        done = 0;
+        memset(touched,0,sizeof(Uint8) * vertexCount);
+        for (v = 0; v < vertexCount; v++)remap[v] = v;
+        for (i = 0; (i < collapseCount)&&(done < wanted); i++)
+        {
+            a = collapses[i].from;
+            b = collapses[i].to;
+            if ((touched[a])||(touched[b]))continue;
+            if (gf3d_mesh_simplify_collapse_flips(a,b,faces,offsets,adjacency,positions))continue;
+            remap[a] = b;
+            gf3d_mesh_quadric_add(&quadrics[weld[b]],&quadrics[weld[a]]);
+            // the whole neighbourhood is frozen for the pass so the flip checks above stay valid
+            touched[b] = 1;
+            for (o = offsets[a]; o < offsets[a + 1]; o++)
+            {
+                f = adjacency[o];
+                for (k = 0; k < 3; k++)touched[faces[f].verts[k]] = 1;
+            }
+            if (collapses[i].cost > maxCost)maxCost = collapses[i].cost;
+            done++;
+        }
+        if (!done)break;
+
+        kept = 0;
+        for (f = 0; f < faceCount; f++)
+        {
+            for (k = 0; k < 3; k++)face.verts[k] = remap[faces[f].verts[k]];
+            if ((face.verts[0] == face.verts[1])||(face.verts[1] == face.verts[2])||(face.verts[0] == face.verts[2]))continue;
+            faces[kept++] = face;
+        }
+        faceCount = kept;
+    }
+    if (error)*error = (float)(sqrt(maxCost) * extent);
+done:
+    free(positions);
+    free(weld);
+    free(wedges);
+    free(remap);
+    free(offsets);
+    free(adjacency);
+    free(kind);
+    free(touched);
+    free(quadrics);
+    free(collapses);
+    free(edges.keys);
+    return faceCount;
+}
+
+Face *gf3d_mesh_simplify_lods(
+    const char *filename,
+    MeshOptimizeMode mode,
+    const Vertex *vertices,
+    Uint32 vertexCount,
+    const Face *faces,
+    Uint32 faceCount,
+    MeshLod *lods,
+    Uint32 *lodCount,
+    Uint32 *totalFaces)
+{
+    Uint32 level,count,previous,target;
+    float error,totalError = 0;
+    Face *out,*next;
+    if ((!faces)||(!lods)||(!lodCount)||(!totalFaces))return NULL;
+    // worst case every level is as large as the first, the tail is trimmed when done
+    out = (Face *)gfc_allocate_array(sizeof(Face),faceCount * GF3D_MESH_LOD_MAX);
+    if (!out)
+    {
+        slog("failed to allocate mesh lod faces");
+        return NULL;
+    }
+    memcpy(out,faces,sizeof(Face) * faceCount);
+    memset(lods,0,sizeof(MeshLod) * GF3D_MESH_LOD_MAX);
+    lods[0].indexCount = faceCount * 3;
+    *lodCount = 1;
+    *totalFaces = faceCount;
+    previous = faceCount;
+    for (level = 1; level < GF3D_MESH_LOD_MAX; level++)
+    {
+        target = (Uint32)(previous * MS_LOD_RATIO);
+        if (target < MS_LOD_MIN_FACES)break;
+        next = &out[*totalFaces];
+        memcpy(next,&out[*totalFaces - previous],sizeof(Face) * previous);
+        count = gf3d_mesh_simplify(next,previous,vertices,vertexCount,target,&error);
+        if (count > previous * MS_LOD_MIN_SAVING)break;
+        if (mode != MO_None)gf3d_mesh_optimize_vertex_cache(next,count,vertexCount);
+        // each level is simplified from the one before, so the errors stack
+        totalError += error;
+        lods[level].firstIndex = *totalFaces * 3;
+        lods[level].indexCount = count * 3;
+        lods[level].error = totalError;
+        *totalFaces += count;
+        *lodCount = level + 1;
+        previous = count;
+    }
+    next = (Face *)realloc(out,sizeof(Face) * *totalFaces);
+    if (next)out = next;
+    for (level = 0; level < *lodCount; level++)
+    {
+        slog("mesh %s lod %i: %i faces, error %f",filename ? filename : "",level,lods[level].indexCount / 3,lods[level].error);
+    }
+    return out;
+}
+
+/*eol@eof*/
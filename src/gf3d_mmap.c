@@ -0,0 +1,98 @@
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "simple_logger.h"
+
+#include "gf3d_mmap.h"
+
+#ifdef _WIN32
+
+Bool gf3d_mmap_open(const char *filename, MappedFile *mapped)
+{
+    LARGE_INTEGER size;
+    if ((!filename)||(!mapped))return 0;
+    memset(mapped,0,sizeof(MappedFile));
+    mapped->file = CreateFileA(filename,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+    if (mapped->file == INVALID_HANDLE_VALUE)
+    {
+        mapped->file = NULL;
+        return 0;
+    }
+    if ((!GetFileSizeEx(mapped->file,&size))||(!size.QuadPart))
+    {
+        gf3d_mmap_close(mapped);
+        return 0;
+    }
+    mapped->size = (size_t)size.QuadPart;
+    mapped->mapping = CreateFileMappingA(mapped->file,NULL,PAGE_READONLY,0,0,NULL);
+    if (!mapped->mapping)
+    {
+        slog("failed to create file mapping for %s",filename);
+        gf3d_mmap_close(mapped);
+        return 0;
+    }
+    mapped->data = MapViewOfFile(mapped->mapping,FILE_MAP_READ,0,0,0);
+    if (!mapped->data)
+    {
+        slog("failed to map view of %s",filename);
+        gf3d_mmap_close(mapped);
+        return 0;
+    }
+    return 1;
+}
+
+void gf3d_mmap_close(MappedFile *mapped)
+{
+    if (!mapped)return;
+    if (mapped->data)UnmapViewOfFile(mapped->data);
+    if (mapped->mapping)CloseHandle(mapped->mapping);
+    if (mapped->file)CloseHandle(mapped->file);
+    memset(mapped,0,sizeof(MappedFile));
+}
+
+#else
+
+Bool gf3d_mmap_open(const char *filename, MappedFile *mapped)
+{
+    struct stat info;
+    void *data;
+    if ((!filename)||(!mapped))return 0;
+    memset(mapped,0,sizeof(MappedFile));
+    mapped->fd = open(filename,O_RDONLY);
+    if (mapped->fd < 0)return 0;
+    if ((fstat(mapped->fd,&info) != 0)||(info.st_size <= 0))
+    {
+        gf3d_mmap_close(mapped);
+        return 0;
+    }
+    mapped->size = (size_t)info.st_size;
+    data = mmap(NULL,mapped->size,PROT_READ,MAP_PRIVATE,mapped->fd,0);
+    if (data == MAP_FAILED)
+    {
+        slog("failed to mmap %s",filename);
+        gf3d_mmap_close(mapped);
+        return 0;
+    }
+    mapped->data = data;
+    // the payload is read front to back exactly once, into a staging buffer
+    madvise(data,mapped->size,MADV_SEQUENTIAL);
+    return 1;
+}
+
+void gf3d_mmap_close(MappedFile *mapped)
+{
+    if (!mapped)return;
+    if (mapped->data)munmap((void *)mapped->data,mapped->size);
+    if (mapped->fd > 0)close(mapped->fd);
+    memset(mapped,0,sizeof(MappedFile));
+}
+
+#endif
+
+/*eol@eof*/
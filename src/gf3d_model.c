@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <math.h>
 
 #include "simple_logger.h"
 
@@ -8,9 +9,23 @@
 #include "gf3d_vgraphics.h"
 #include "gf3d_obj_load.h"
 #include "gf3d_uniform_buffers.h"
+#include "gf3d_frustum.h"
+#include "gf3d_render.h"
+#include "gf3d_draw_queue.h"
+#include "gf3d_record.h"
 
 #include "gf3d_model.h"
 
+/**
+ * @purpose per recording thread scratch for splitting instances by level of detail
+ */
+typedef struct
+{
+    MeshInstance        *   sorted;         /**<the instances grouped by level*/
+    Uint8               *   lods;           /**<the level picked for each instance*/
+    Uint32                  size;           /**<how many instances both arrays hold*/
+}ModelLodScratch;
+
 typedef struct
 {
     Model               *   model_list;
@@ -18,6 +33,8 @@ typedef struct
     Uint32                  chain_length;   /**<length of swap chain*/
     VkDevice                device;
     Pipeline            *   pipe;           /**<the pipeline associated with model rendering*/
+    float                   lodBias;        /**<screen space error in pixels allowed before a coarser level of detail is drawn*/
+    ModelLodScratch         scratch[GF3D_RECORD_THREAD_MAX + 1];
 }ModelManager;
 
 static ModelManager gf3d_model = {0};
@@ -27,34 +44,6 @@ void gf3d_model_delete(Model *model);
 void gf3d_model_create_descriptor_pool(Model *model);
 void gf3d_model_create_descriptor_sets(Model *model);
 void gf3d_model_create_descriptor_set_layout();
-void gf3d_model_update_uniform_buffer(
-    Model *model,
-    UniformBuffer *ubo,
-    Matrix4 modelMat,
-    Vector4D colorMod,
-    Vector4D ambientLight
-);
-void gf3d_model_update_highlight_uniform_buffer(
-    Model *model,
-    UniformBuffer *ubo,
-    Matrix4 modelMat,
-    Vector4D highlightColor);
-
-void gf3d_model_update_highlight_model_descriptor_set(
-    Model *model,
-    VkDescriptorSet descriptorSet,
-    Uint32 chainIndex,
-    Matrix4 modelMat,
-    Vector4D highlightColor);
-void gf3d_model_update_basic_model_descriptor_set(
-    Model *model,
-    VkDescriptorSet descriptorSet,
-    Uint32 chainIndex,
-    Matrix4 modelMat,
-    Vector4D colorMod,
-    Vector4D ambientLight);
-
-
 VkDescriptorSetLayout * gf3d_model_get_descriptor_set_layout();
 
 void gf3d_model_manager_close()
@@ -68,6 +57,11 @@ void gf3d_model_manager_close()
     {
         free(gf3d_model.model_list);
     }
+    for (i = 0; i <= GF3D_RECORD_THREAD_MAX; i++)
+    {
+        if (gf3d_model.scratch[i].sorted)free(gf3d_model.scratch[i].sorted);
+        if (gf3d_model.scratch[i].lods)free(gf3d_model.scratch[i].lods);
+    }
     memset(&gf3d_model,0,sizeof(ModelManager));
     slog("model manager closed");
 }
@@ -84,6 +78,7 @@ void gf3d_model_manager_init(Uint32 max_models)
     gf3d_model.max_models = max_models;
     gf3d_model.device = gf3d_vgraphics_get_default_logical_device();
     gf3d_model.pipe = gf3d_mesh_get_pipeline();
+    gf3d_model.lodBias = 1;
     
     slog("model manager initiliazed");
     atexit(gf3d_model_manager_close);
@@ -125,6 +120,11 @@ Model * gf3d_model_load(const char * filename)
 }
 
 Model * gf3d_model_load_full(const char * modelFile,const char *textureFile)
+{
+    return gf3d_model_load_full_format(modelFile,textureFile,MVF_Full);
+}
+
+Model * gf3d_model_load_full_format(const char * modelFile,const char *textureFile,MeshVertexFormat format)
 {
     Model *model;
     model = gf3d_model_new();
@@ -132,7 +132,7 @@ Model * gf3d_model_load_full(const char * modelFile,const char *textureFile)
     
     gfc_line_cpy(model->filename,modelFile);
 
-    model->mesh = gf3d_mesh_load(modelFile);
+    model->mesh = gf3d_mesh_load_format(modelFile,format);
     if (!model->mesh)
     {
         gf3d_model_free(model);
@@ -152,15 +152,25 @@ Model * gf3d_model_load_from_config(SJson *json)
 {
     const char *model;
     const char *texture;
+    MeshVertexFormat format;
     if (!json)return NULL;
     model = sj_get_string_value(sj_object_get_value(json,"model"));
     texture = sj_get_string_value(sj_object_get_value(json,"texture"));
-    return gf3d_model_load_full(model,texture);
+    format = gf3d_mesh_vertex_format_from_string(sj_get_string_value(sj_object_get_value(json,"vertexFormat")));
+    return gf3d_model_load_full_format(model,texture,format);
 }
 
 
+static void gf3d_model_delete_deferred(void *data)
+{
+    gf3d_model_delete((Model *)data);
+}
+
 void gf3d_model_free(Model *model)
 {
+    if (!model)return;
+    // a frame captured for the render thread may still draw with it
+    if (gf3d_render_defer_free(gf3d_model_delete_deferred,model))return;
     gf3d_model_delete(model);
 }
 
@@ -176,328 +186,178 @@ void gf3d_model_delete(Model *model)
 
 void gf3d_model_draw(Model *model,Matrix4 modelMat,Vector4D colorMod,Vector4D ambientLight)
 {
-    VkDescriptorSet *descriptorSet = NULL;
-    VkCommandBuffer commandBuffer;
-    Uint32 bufferFrame;
+    MeshInstance instance;
     if (!model)
     {
         return;
     }
-    commandBuffer = gf3d_mesh_get_model_command_buffer();
-    bufferFrame = gf3d_vgraphics_get_current_buffer_frame();
-    descriptorSet = gf3d_pipeline_get_descriptor_set(gf3d_model.pipe, bufferFrame);
-    if (descriptorSet == NULL)
-    {
-        slog("failed to get a free descriptor Set for model rendering");
-        return;
-    }
-    gf3d_model_update_basic_model_descriptor_set(model,*descriptorSet,bufferFrame,modelMat,colorMod,ambientLight);
-    gf3d_mesh_render(model->mesh,commandBuffer,descriptorSet);
+    gfc_matrix_copy(instance.model,modelMat);
+    vector4d_copy(instance.color,colorMod);
+    gf3d_model_draw_instanced(model,&instance,1,ambientLight);
 }
 
-void gf3d_model_draw_highlight(Model *model,Matrix4 modelMat,Vector4D highlight)
+void gf3d_model_set_lod_bias(float bias)
 {
-    VkDescriptorSet *descriptorSet = NULL;
-    VkCommandBuffer commandBuffer;
-    Uint32 bufferFrame;
-    if (!model)
-    {
-        return;
-    }
-    commandBuffer = gf3d_mesh_get_highlight_command_buffer();
-    bufferFrame = gf3d_vgraphics_get_current_buffer_frame();
-    descriptorSet = gf3d_pipeline_get_descriptor_set(gf3d_mesh_get_highlight_pipeline(), bufferFrame);
-    if (descriptorSet == NULL)
-    {
-        slog("failed to get a free descriptor Set for model rendering");
-        return;
-    }
-    gf3d_model_update_highlight_model_descriptor_set(model,*descriptorSet,bufferFrame,modelMat,highlight);
-    gf3d_mesh_render_highlight(model->mesh,commandBuffer,descriptorSet);
+    if (bias < 0)bias = 0;
+    gf3d_model.lodBias = bias;
 }
 
-void gf3d_model_update_sky_uniform_buffer(
-    Model *model,
-    UniformBuffer *ubo,
-    Matrix4 modelMat,
-    Vector4D colorMod)
+/**
+ * @brief how many pixels one unit of object space error covers one unit in front of the camera
+ */
+static float gf3d_model_get_lod_pixel_scale(UniformBufferObject *ubo)
 {
-    void* data;
-    UniformBufferObject graphics_ubo;
-    SkyUBO modelUBO;
-    graphics_ubo = gf3d_vgraphics_get_uniform_buffer_object();
-    
-    gfc_matrix_copy(modelUBO.model,modelMat);
-    gfc_matrix_copy(modelUBO.view,graphics_ubo.view);
-     modelUBO.view[0][3] = 0;
-     modelUBO.view[1][3] = 0;
-     modelUBO.view[2][3] = 0;
-     modelUBO.view[3][0] = 0;
-     modelUBO.view[3][1] = 0;
-     modelUBO.view[3][2] = 0;
-    gfc_matrix_copy(modelUBO.proj,graphics_ubo.proj);
-    
-    vector4d_copy(modelUBO.color,colorMod);
-        
-    vkMapMemory(gf3d_model.device, ubo->uniformBufferMemory, 0, sizeof(MeshUBO), 0, &data);
-    
-        memcpy(data, &modelUBO, sizeof(SkyUBO));
-
-    vkUnmapMemory(gf3d_model.device, ubo->uniformBufferMemory);
+    return fabsf(ubo->proj[1][1]) * gf3d_vgraphics_get_view_extent().height * 0.5f;
 }
 
-void gf3d_model_update_sky_model_descriptor_set(
-    Model *model,
-    VkDescriptorSet descriptorSet,
-    Uint32 chainIndex,
-    Matrix4 modelMat,
-    Vector4D colorMod)
+static Uint32 gf3d_model_select_lod(Mesh *mesh,Matrix4 modelMat,UniformBufferObject *ubo,float pixelScale)
 {
-    VkDescriptorImageInfo imageInfo = {0};
-    VkWriteDescriptorSet descriptorWrite[2] = {0};
-    VkDescriptorBufferInfo bufferInfo = {0};
-    Pipeline *pipe;
-    UniformBuffer *ubo = NULL;
-    
-    if (!model)
+    Vector3D center,viewCenter;
+    float radius,scale,distance;
+    Uint32 lod;
+    radius = gf3d_frustum_transform_sphere(modelMat,mesh->center,mesh->radius,&center);
+    scale = (mesh->radius > 0) ? radius / mesh->radius : 1;
+    viewCenter.x = ubo->view[0][0] * center.x + ubo->view[1][0] * center.y + ubo->view[2][0] * center.z + ubo->view[3][0];
+    viewCenter.y = ubo->view[0][1] * center.x + ubo->view[1][1] * center.y + ubo->view[2][1] * center.z + ubo->view[3][1];
+    viewCenter.z = ubo->view[0][2] * center.x + ubo->view[1][2] * center.y + ubo->view[2][2] * center.z + ubo->view[3][2];
+    // measured to the near side of the bounds, so nothing inside them ever coarsens
+    distance = sqrtf(viewCenter.x * viewCenter.x + viewCenter.y * viewCenter.y + viewCenter.z * viewCenter.z) - radius;
+    if (distance <= 0)return 0;
+    for (lod = mesh->lodCount - 1; lod > 0; lod--)
     {
-        slog("no model provided for descriptor set update");
-        return;
+        if (mesh->lods[lod].error * scale * pixelScale / distance <= gf3d_model.lodBias)return lod;
     }
-    if (descriptorSet == VK_NULL_HANDLE)
-    {
-        slog("null handle provided for descriptorSet");
-        return;
-    }
-    pipe = gf3d_mesh_get_sky_pipeline();
-    ubo = gf3d_uniform_buffer_list_get_buffer(pipe->uboList, chainIndex);
-    if (!ubo)
-    {
-        slog("failed to get a free uniform buffer for draw call");
-        return;
-    }
-    
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = model->texture->textureImageView;
-    imageInfo.sampler = model->texture->textureSampler;
-
-    gf3d_model_update_sky_uniform_buffer(model,ubo,modelMat,colorMod);
-    bufferInfo.buffer = ubo->uniformBuffer;
-    bufferInfo.offset = 0;
-    bufferInfo.range = sizeof(SkyUBO);        
-    
-    descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite[0].dstSet = descriptorSet;
-    descriptorWrite[0].dstBinding = 0;
-    descriptorWrite[0].dstArrayElement = 0;
-    descriptorWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrite[0].descriptorCount = 1;
-    descriptorWrite[0].pBufferInfo = &bufferInfo;
-
-    descriptorWrite[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite[1].dstSet = descriptorSet;
-    descriptorWrite[1].dstBinding = 1;
-    descriptorWrite[1].dstArrayElement = 0;
-    descriptorWrite[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrite[1].descriptorCount = 1;                        
-    descriptorWrite[1].pImageInfo = &imageInfo;
-    descriptorWrite[1].pTexelBufferView = NULL; // Optional
-
-    vkUpdateDescriptorSets(gf3d_model.device, 2, descriptorWrite, 0, NULL);
+    return 0;
 }
 
-void gf3d_model_draw_sky(Model *model,Matrix4 modelMat,Color color)
+/**
+ * @brief get the calling recording thread's level of detail scratch, grown to hold count instances
+ * @return NULL if it could not be grown
+ */
+static ModelLodScratch *gf3d_model_get_lod_scratch(Uint32 count)
 {
-    VkDescriptorSet *descriptorSet = NULL;
-    VkCommandBuffer commandBuffer;
-    Uint32 bufferFrame;
-    if (!model)
+    Uint32 thread;
+    ModelLodScratch *scratch;
+    thread = gf3d_record_get_thread();
+    if (thread > GF3D_RECORD_THREAD_MAX)thread = 0;
+    scratch = &gf3d_model.scratch[thread];
+    if (scratch->size >= count)return scratch;
+    if (scratch->sorted)free(scratch->sorted);
+    if (scratch->lods)free(scratch->lods);
+    scratch->sorted = (MeshInstance *)gfc_allocate_array(sizeof(MeshInstance),count);
+    scratch->lods = (Uint8 *)gfc_allocate_array(sizeof(Uint8),count);
+    if ((!scratch->sorted)||(!scratch->lods))
     {
-        return;
+        slog("failed to allocate level of detail scratch for %i instances",count);
+        if (scratch->sorted)free(scratch->sorted);
+        if (scratch->lods)free(scratch->lods);
+        memset(scratch,0,sizeof(ModelLodScratch));
+        return NULL;
     }
-    commandBuffer = gf3d_mesh_get_sky_command_buffer();
-    bufferFrame = gf3d_vgraphics_get_current_buffer_frame();
-    descriptorSet = gf3d_pipeline_get_descriptor_set(gf3d_mesh_get_sky_pipeline(), bufferFrame);
-    if (descriptorSet == NULL)
+    scratch->size = count;
+    return scratch;
+}
+
+/**
+ * @brief a lone full detail instance of a clustered mesh culls its clusters, anything else is drawn instanced
+ */
+static void gf3d_model_render_batch(
+    Model *model,
+    MeshPushConstants *constants,
+    MeshInstance *instances,
+    Uint32 count,
+    Uint32 lod)
+{
+    if ((model->mesh->clusterCount)&&(count == 1)&&(lod == 0))
     {
-        slog("failed to get a free descriptor Set for model rendering");
+        gf3d_draw_queue_add_clustered(model->mesh,model->texture,constants,instances);
         return;
     }
-    gf3d_model_update_sky_model_descriptor_set(model,*descriptorSet,bufferFrame,modelMat,gfc_color_to_vector4f(color));
-    gf3d_mesh_render_sky(model->mesh,commandBuffer,descriptorSet);
+    gf3d_draw_queue_add_instanced(model->mesh,model->texture,constants,instances,count,lod);
 }
 
-
-void gf3d_model_update_basic_model_descriptor_set(
-    Model *model,
-    VkDescriptorSet descriptorSet,
-    Uint32 chainIndex,
-    Matrix4 modelMat,
-    Vector4D colorMod,
-    Vector4D ambientLight)
+void gf3d_model_draw_instanced(Model *model,MeshInstance *instances,Uint32 count,Vector4D ambientLight)
 {
-    VkDescriptorImageInfo imageInfo = {0};
-    VkWriteDescriptorSet descriptorWrite[2] = {0};
-    VkDescriptorBufferInfo bufferInfo = {0};
-    UniformBuffer *ubo = NULL;
-    
-    if (!model)
+    MeshPushConstants constants;
+    UniformBufferObject ubo;
+    ModelLodScratch *scratch;
+    float pixelScale;
+    Uint32 i,lod;
+    Uint32 lodStart[GF3D_MESH_LOD_MAX + 1] = {0};
+    Uint32 lodEnd[GF3D_MESH_LOD_MAX];
+    if (gf3d_render_capture_instanced(model,instances,count,ambientLight))return;
+    if ((!model)||(!model->mesh)||(!instances)||(!count))
     {
-        slog("no model provided for descriptor set update");
         return;
     }
-    if (descriptorSet == VK_NULL_HANDLE)
+    vector4d_copy(constants.ambient,ambientLight);
+    constants.textureIndex = model->texture ? model->texture->index : 0;
+    scratch = NULL;
+    if ((model->mesh->lodCount > 1)&&(gf3d_model.lodBias > 0))
     {
-        slog("null handle provided for descriptorSet");
-        return;
+        scratch = gf3d_model_get_lod_scratch(count);
     }
-    ubo = gf3d_uniform_buffer_list_get_buffer(gf3d_model.pipe->uboList, chainIndex);
-    if (!ubo)
+    if (!scratch)
     {
-        slog("failed to get a free uniform buffer for draw call");
+        gf3d_model_render_batch(model,&constants,instances,count,0);
         return;
     }
-    
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = model->texture->textureImageView;
-    imageInfo.sampler = model->texture->textureSampler;
-
-    gf3d_model_update_uniform_buffer(model,ubo,modelMat,colorMod,ambientLight);
-    bufferInfo.buffer = ubo->uniformBuffer;
-    bufferInfo.offset = 0;
-    bufferInfo.range = sizeof(MeshUBO);        
-    
-    descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite[0].dstSet = descriptorSet;
-    descriptorWrite[0].dstBinding = 0;
-    descriptorWrite[0].dstArrayElement = 0;
-    descriptorWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrite[0].descriptorCount = 1;
-    descriptorWrite[0].pBufferInfo = &bufferInfo;
-
-    descriptorWrite[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite[1].dstSet = descriptorSet;
-    descriptorWrite[1].dstBinding = 1;
-    descriptorWrite[1].dstArrayElement = 0;
-    descriptorWrite[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrite[1].descriptorCount = 1;                        
-    descriptorWrite[1].pImageInfo = &imageInfo;
-    descriptorWrite[1].pTexelBufferView = NULL; // Optional
-
-    vkUpdateDescriptorSets(gf3d_model.device, 2, descriptorWrite, 0, NULL);
-}
-
-void gf3d_model_update_highlight_model_descriptor_set(
-    Model *model,
-    VkDescriptorSet descriptorSet,
-    Uint32 chainIndex,
-    Matrix4 modelMat,
-    Vector4D highlightColor)
-{
-    VkDescriptorImageInfo imageInfo = {0};
-    VkWriteDescriptorSet descriptorWrite[2] = {0};
-    VkDescriptorBufferInfo bufferInfo = {0};
-    Pipeline *pipe;
-    UniformBuffer *ubo = NULL;
-    
-    if (!model)
+    ubo = gf3d_vgraphics_get_uniform_buffer_object();
+    pixelScale = gf3d_model_get_lod_pixel_scale(&ubo);
+    // pick each instance's level once, then counting sort them into the scratch so each level is one instanced draw
+    for (i = 0; i < count; i++)
     {
-        slog("no model provided for descriptor set update");
-        return;
+        scratch->lods[i] = (Uint8)gf3d_model_select_lod(model->mesh,instances[i].model,&ubo,pixelScale);
+        lodStart[scratch->lods[i] + 1]++;
     }
-    if (descriptorSet == VK_NULL_HANDLE)
+    for (lod = 0; lod < model->mesh->lodCount; lod++)
     {
-        slog("null handle provided for descriptorSet");
-        return;
+        lodStart[lod + 1] += lodStart[lod];
+        lodEnd[lod] = lodStart[lod];
     }
-    pipe = gf3d_mesh_get_highlight_pipeline();
-    ubo = gf3d_uniform_buffer_list_get_buffer(pipe->uboList, chainIndex);
-    if (!ubo)
+    for (i = 0; i < count; i++)
     {
-        slog("failed to get a free uniform buffer for draw call");
-        return;
+        memcpy(&scratch->sorted[lodEnd[scratch->lods[i]]++],&instances[i],sizeof(MeshInstance));
+    }
+    for (lod = 0; lod < model->mesh->lodCount; lod++)
+    {
+        if (lodEnd[lod] == lodStart[lod])continue;
+        gf3d_model_render_batch(model,&constants,&scratch->sorted[lodStart[lod]],lodEnd[lod] - lodStart[lod],lod);
     }
-    
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = model->texture->textureImageView;
-    imageInfo.sampler = model->texture->textureSampler;
-
-    gf3d_model_update_highlight_uniform_buffer(model,ubo,modelMat,highlightColor);
-    bufferInfo.buffer = ubo->uniformBuffer;
-    bufferInfo.offset = 0;
-    bufferInfo.range = sizeof(HighlightUBO);        
-    
-    descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite[0].dstSet = descriptorSet;
-    descriptorWrite[0].dstBinding = 0;
-    descriptorWrite[0].dstArrayElement = 0;
-    descriptorWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrite[0].descriptorCount = 1;
-    descriptorWrite[0].pBufferInfo = &bufferInfo;
-
-    descriptorWrite[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite[1].dstSet = descriptorSet;
-    descriptorWrite[1].dstBinding = 1;
-    descriptorWrite[1].dstArrayElement = 0;
-    descriptorWrite[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrite[1].descriptorCount = 1;                        
-    descriptorWrite[1].pImageInfo = &imageInfo;
-    descriptorWrite[1].pTexelBufferView = NULL; // Optional
-
-    vkUpdateDescriptorSets(gf3d_model.device, 2, descriptorWrite, 0, NULL);
 }
 
-
-
-void gf3d_model_update_uniform_buffer(
-    Model *model,
-    UniformBuffer *ubo,
-    Matrix4 modelMat,
-    Vector4D colorMod,
-    Vector4D ambient)
+void gf3d_model_draw_highlight(Model *model,Matrix4 modelMat,Vector4D highlight)
 {
-    void* data;
-    UniformBufferObject graphics_ubo;
-    MeshUBO modelUBO;
-    graphics_ubo = gf3d_vgraphics_get_uniform_buffer_object();
-    
-    gfc_matrix_copy(modelUBO.model,modelMat);
-    gfc_matrix_copy(modelUBO.view,graphics_ubo.view);
-    gfc_matrix_copy(modelUBO.proj,graphics_ubo.proj);
-    
-    vector4d_copy(modelUBO.color,colorMod);
-    vector4d_copy(modelUBO.ambient,ambient);
-    modelUBO.LightPosition = vector4d(1000, 1000, 1000, 1);
-
-    vkMapMemory(gf3d_model.device, ubo->uniformBufferMemory, 0, sizeof(MeshUBO), 0, &data);
-    
-        memcpy(data, &modelUBO, sizeof(MeshUBO));
-
-    vkUnmapMemory(gf3d_model.device, ubo->uniformBufferMemory);
+    HighlightPushConstants constants;
+    UniformBufferObject ubo;
+    Uint32 lod = 0;
+    if (gf3d_render_capture_highlight(model,modelMat,highlight))return;
+    if ((!model)||(!model->mesh))
+    {
+        return;
+    }
+    if ((model->mesh->lodCount > 1)&&(gf3d_model.lodBias > 0))
+    {
+        ubo = gf3d_vgraphics_get_uniform_buffer_object();
+        lod = gf3d_model_select_lod(model->mesh,modelMat,&ubo,gf3d_model_get_lod_pixel_scale(&ubo));
+    }
+    gfc_matrix_copy(constants.model,modelMat);
+    vector4d_copy(constants.color,highlight);
+    gf3d_draw_queue_add_highlight(model->mesh,&constants,lod);
 }
 
-void gf3d_model_update_highlight_uniform_buffer(
-    Model *model,
-    UniformBuffer *ubo,
-    Matrix4 modelMat,
-    Vector4D highlightColor)
+void gf3d_model_draw_sky(Model *model,Matrix4 modelMat,Color color)
 {
-    void* data;
-    UniformBufferObject graphics_ubo;
-    HighlightUBO modelUBO;
-    graphics_ubo = gf3d_vgraphics_get_uniform_buffer_object();
-    
-    gfc_matrix_copy(modelUBO.model,modelMat);
-    gfc_matrix_copy(modelUBO.view,graphics_ubo.view);
-    gfc_matrix_copy(modelUBO.proj,graphics_ubo.proj);
-    
-    vector4d_copy(modelUBO.color,highlightColor);
-        
-    vkMapMemory(gf3d_model.device, ubo->uniformBufferMemory, 0, sizeof(MeshUBO), 0, &data);
-    
-        memcpy(data, &modelUBO, sizeof(HighlightUBO));
-
-    vkUnmapMemory(gf3d_model.device, ubo->uniformBufferMemory);
+    SkyPushConstants constants;
+    if (gf3d_render_capture_sky(model,modelMat,color))return;
+    if (!model)
+    {
+        return;
+    }
+    gfc_matrix_copy(constants.model,modelMat);
+    constants.color = gfc_color_to_vector4f(color);
+    constants.textureIndex = model->texture ? model->texture->index : 0;
+    gf3d_draw_queue_add_sky(model->mesh,model->texture,&constants);
 }
 
 /*eol@eof*/
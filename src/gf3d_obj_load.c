@@ -1,10 +1,47 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <SDL.h>
+
 #include "simple_logger.h"
 
+#include "gf3d_mmap.h"
 #include "gf3d_obj_load.h"
 
-void gf3d_obj_get_counts_from_file(ObjData *obj, FILE* file);
-void gf3d_obj_load_get_data_from_file(ObjData *obj, FILE* file);
+#define OBJ_CHUNK_MIN_SIZE  65536   //files smaller than this are not worth a thread
+#define OBJ_CHUNK_MAX       16
+#define OBJ_INDEX_NONE      0xFFFFFFFF
+
+/**
+ * @purpose one corner of a face as written in the file.  Indices are resolved to 0 based,
+ * negative (relative) indices are resolved against the chunk's own counts and flagged so the
+ * merge can add the counts of the chunks before it
+ */
+typedef struct
+{
+    Sint32  index[3];       /**<vertex, texel, normal*/
+    Uint8   relative;       /**<bit per index that still needs the chunk base added*/
+    Uint8   present;        /**<bit per index that was given at all*/
+}ObjCorner;
+
+/**
+ * @purpose everything parsed out of one line aligned slice of the file
+ */
+typedef struct
+{
+    const char *start;
+    const char *end;
+    Vector3D   *vertices;
+    Uint32      vertex_count,vertex_max;
+    Vector3D   *normals;
+    Uint32      normal_count,normal_max;
+    Vector2D   *texels;
+    Uint32      texel_count,texel_max;
+    ObjCorner  *corners;    /**<three per triangle, polygons are fanned*/
+    Uint32      corner_count,corner_max;
+    Bool        failed;
+}ObjChunk;
 
 void gf3d_obj_free(ObjData *obj)
 {
@@ -49,211 +86,548 @@ void gf3d_obj_free(ObjData *obj)
     free(obj);
 }
 
+static Uint32 gf3d_obj_vertex_hash(const Vertex *vertex)
+{
+    Uint32 i,bits,hash = 2166136261u;
+    const float *values = (const float *)vertex;
+    for (i = 0; i < sizeof(Vertex) / sizeof(float); i++)
+    {
+        memcpy(&bits,&values[i],sizeof(Uint32));
+        hash = (hash ^ bits) * 16777619u;
+        hash ^= hash >> 15;
+    }
+    return hash;
+}
+
+/**
+ * @brief add a vertex to the welded array unless an identical one is already there
+ * @param table open addressed hash table of indices into vertices, OBJ_INDEX_NONE when empty
+ * @param mask table size - 1, the size being a power of two
+ * @return the index of the vertex in the welded array
+ */
+static Uint32 gf3d_obj_weld_vertex(Vertex *vertices,Uint32 *count,Uint32 *table,Uint32 mask,const Vertex *vertex)
+{
+    Uint32 slot;
+    slot = gf3d_obj_vertex_hash(vertex) & mask;
+    while (table[slot] != OBJ_INDEX_NONE)
+    {
+        if (memcmp(&vertices[table[slot]],vertex,sizeof(Vertex)) == 0)return table[slot];
+        slot = (slot + 1) & mask;
+    }
+    table[slot] = *count;
+    memcpy(&vertices[*count],vertex,sizeof(Vertex));
+    return (*count)++;
+}
+
 void gf3d_obj_load_reorg(ObjData *obj)
 {
     int i,f;
-    int vert = 0;
-    int vertexIndex,normalIndex,texelIndex;
+    Uint32 vertexIndex,normalIndex,texelIndex;
+    Uint32 tableSize,*table;
+    Vertex vertex,*welded;
     
     if (!obj)return;
     
-    obj->face_vert_count = obj->face_count*3;
-    obj->faceVertices = (Vertex *)gfc_allocate_array(sizeof(Vertex),obj->face_vert_count);
+    obj->face_vert_count = 0;
+    obj->faceVertices = (Vertex *)gfc_allocate_array(sizeof(Vertex),obj->face_count*3);
     obj->outFace = (Face *)gfc_allocate_array(sizeof(Face),obj->face_count);
+    if ((!obj->faceVertices)||(!obj->outFace))return;
+
+    // load factor of at most one half keeps the probes short
+    for (tableSize = 16; tableSize < obj->face_count * 6; tableSize *= 2);
+    table = (Uint32 *)malloc(sizeof(Uint32) * tableSize);
+    if (!table)return;
+    memset(table,0xFF,sizeof(Uint32) * tableSize);
     
     for (i = 0; i < obj->face_count;i++)
     {
-        for (f = 0; f < 3;f++,vert++)
+        for (f = 0; f < 3;f++)
         {
             vertexIndex = obj->faceVerts[i].verts[f];
             normalIndex = obj->faceNormals[i].verts[f];
             texelIndex = obj->faceTexels[i].verts[f];
             
-            vector3d_copy(obj->faceVertices[vert].vertex,obj->vertices[vertexIndex]);
-            vector3d_copy(obj->faceVertices[vert].normal,obj->normals[normalIndex]);
-            vector2d_copy(obj->faceVertices[vert].texel,obj->texels[texelIndex]);
+            // corners written without a texel or normal keep the zeroed defaults
+            memset(&vertex,0,sizeof(Vertex));
+            if (vertexIndex != OBJ_INDEX_NONE)vector3d_copy(vertex.vertex,obj->vertices[vertexIndex]);
+            if (normalIndex != OBJ_INDEX_NONE)vector3d_copy(vertex.normal,obj->normals[normalIndex]);
+            if (texelIndex != OBJ_INDEX_NONE)vector2d_copy(vertex.texel,obj->texels[texelIndex]);
             
-            obj->outFace[i].verts[f] = vert;
+            obj->outFace[i].verts[f] = gf3d_obj_weld_vertex(obj->faceVertices,&obj->face_vert_count,table,tableSize - 1,&vertex);
         }
     }
+    free(table);
+    // give back the space the duplicates would have used
+    if (obj->face_vert_count)
+    {
+        welded = (Vertex *)realloc(obj->faceVertices,sizeof(Vertex) * obj->face_vert_count);
+        if (welded)obj->faceVertices = welded;
+    }
 }
 
-ObjData *gf3d_obj_load_from_file(const char *filename)
+static void *gf3d_obj_chunk_grow(ObjChunk *chunk,void *array,Uint32 *max,Uint32 needed,size_t size)
 {
-    FILE *file;
-    ObjData *obj;
-    file = fopen(filename,"r");
-    if (!file)
+    void *grown;
+    Uint32 newMax;
+    if (needed <= *max)return array;
+    newMax = *max ? *max * 2 : 1024;
+    while (newMax < needed)newMax *= 2;
+    grown = realloc(array,newMax * size);
+    if (!grown)
     {
-        slog("failed to open obj file %s",filename);
-        return NULL;
+        chunk->failed = 1;
+        return array;
+    }
+    *max = newMax;
+    return grown;
+}
+
+static const char *gf3d_obj_skip_space(const char *c,const char *end)
+{
+    while ((c < end)&&((*c == ' ')||(*c == '\t')))c++;
+    return c;
+}
+
+static const char *gf3d_obj_next_line(const char *c,const char *end)
+{
+    while ((c < end)&&(*c != '\n'))c++;
+    if (c < end)c++;
+    return c;
+}
+
+static const double gf3d_obj_pow10[] =
+{
+    1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,1e12,1e13,1e14,1e15,1e16,1e17,1e18
+};
+
+/**
+ * @brief parse a decimal float without going through the C locale
+ * @note digits past the 18th significant one are dropped, far beyond float precision
+ * @return the character after the number, or c if there was no number
+ */
+static const char *gf3d_obj_parse_float(const char *c,const char *end,float *out)
+{
+    const char *start;
+    Uint64 mantissa = 0;
+    double value;
+    int sign = 1,exponent = 0,exponentSign = 1,scale = 0,significant = 0;
+    Bool digits = 0;
+    c = gf3d_obj_skip_space(c,end);
+    start = c;
+    if ((c < end)&&((*c == '-')||(*c == '+')))
+    {
+        if (*c == '-')sign = -1;
+        c++;
+    }
+    while ((c < end)&&(*c >= '0')&&(*c <= '9'))
+    {
+        if (significant < 18)
+        {
+            mantissa = mantissa * 10 + (*c - '0');
+            if (mantissa)significant++;
+        }
+        else scale++;
+        digits = 1;
+        c++;
+    }
+    if ((c < end)&&(*c == '.'))
+    {
+        c++;
+        while ((c < end)&&(*c >= '0')&&(*c <= '9'))
+        {
+            if (significant < 18)
+            {
+                mantissa = mantissa * 10 + (*c - '0');
+                if (mantissa)significant++;
+                scale--;
+            }
+            digits = 1;
+            c++;
+        }
+    }
+    if (!digits)return start;
+    if ((c < end)&&((*c == 'e')||(*c == 'E')))
+    {
+        c++;
+        if ((c < end)&&((*c == '-')||(*c == '+')))
+        {
+            if (*c == '-')exponentSign = -1;
+            c++;
+        }
+        while ((c < end)&&(*c >= '0')&&(*c <= '9'))
+        {
+            if (exponent < 1000)exponent = exponent * 10 + (*c - '0');
+            c++;
+        }
+    }
+    scale += exponentSign * exponent;
+    value = (double)mantissa;
+    if ((scale >= 0)&&(scale <= 18))value *= gf3d_obj_pow10[scale];
+    else if ((scale < 0)&&(scale >= -18))value /= gf3d_obj_pow10[-scale];
+    else value *= pow(10,scale);
+    *out = (float)(sign * value);
+    return c;
+}
+
+static const char *gf3d_obj_parse_int(const char *c,const char *end,Sint32 *out,Bool *found)
+{
+    int sign = 1;
+    Sint32 value = 0;
+    *found = 0;
+    if ((c < end)&&(*c == '-'))
+    {
+        sign = -1;
+        c++;
+    }
+    while ((c < end)&&(*c >= '0')&&(*c <= '9'))
+    {
+        value = value * 10 + (*c - '0');
+        *found = 1;
+        c++;
+    }
+    *out = sign * value;
+    return c;
+}
+
+/**
+ * @brief parse one face corner in any of the v, v/vt, v//vn or v/vt/vn forms
+ * @return the character after the corner, or c if there was no corner
+ */
+static const char *gf3d_obj_parse_corner(ObjChunk *chunk,const char *c,const char *end,ObjCorner *corner)
+{
+    int i;
+    Sint32 value;
+    Bool found;
+    Uint32 counts[3];
+    const char *start;
+    counts[0] = chunk->vertex_count;
+    counts[1] = chunk->texel_count;
+    counts[2] = chunk->normal_count;
+    memset(corner,0,sizeof(ObjCorner));
+    c = gf3d_obj_skip_space(c,end);
+    start = c;
+    for (i = 0; i < 3; i++)
+    {
+        if (i)
+        {
+            if ((c >= end)||(*c != '/'))break;
+            c++;
+        }
+        c = gf3d_obj_parse_int(c,end,&value,&found);
+        if ((!found)||(!value))continue;
+        corner->present |= 1 << i;
+        if (value > 0)
+        {
+            corner->index[i] = value - 1;
+        }
+        else
+        {
+            corner->index[i] = (Sint32)counts[i] + value;
+            corner->relative |= 1 << i;
+        }
+    }
+    if (!(corner->present & 1))return start;
+    return c;
+}
+
+static void gf3d_obj_parse_face(ObjChunk *chunk,const char *c,const char *end)
+{
+    ObjCorner first,previous,current;
+    Uint32 count = 0;
+    const char *next;
+    while (c < end)
+    {
+        next = gf3d_obj_parse_corner(chunk,c,end,&current);
+        if (next == gf3d_obj_skip_space(c,end))break;
+        c = next;
+        if (count == 0)first = current;
+        else if (count >= 2)
+        {
+            // fan any polygon into triangles around its first corner
+            chunk->corners = gf3d_obj_chunk_grow(chunk,chunk->corners,&chunk->corner_max,chunk->corner_count + 3,sizeof(ObjCorner));
+            if (chunk->failed)return;
+            chunk->corners[chunk->corner_count++] = first;
+            chunk->corners[chunk->corner_count++] = previous;
+            chunk->corners[chunk->corner_count++] = current;
+        }
+        previous = current;
+        count++;
+    }
+}
+
+static void gf3d_obj_parse_chunk(ObjChunk *chunk)
+{
+    const char *c = chunk->start;
+    const char *end = chunk->end;
+    const char *lineEnd;
+    float x,y,z;
+    while ((c < end)&&(!chunk->failed))
+    {
+        c = gf3d_obj_skip_space(c,end);
+        lineEnd = c;
+        while ((lineEnd < end)&&(*lineEnd != '\n')&&(*lineEnd != '\r'))lineEnd++;
+        if ((c + 1 < lineEnd)&&(c[0] == 'v')&&((c[1] == ' ')||(c[1] == '\t')))
+        {
+            x = y = z = 0;
+            c = gf3d_obj_parse_float(c + 2,lineEnd,&x);
+            c = gf3d_obj_parse_float(c,lineEnd,&y);
+            gf3d_obj_parse_float(c,lineEnd,&z);
+            chunk->vertices = gf3d_obj_chunk_grow(chunk,chunk->vertices,&chunk->vertex_max,chunk->vertex_count + 1,sizeof(Vector3D));
+            if (chunk->failed)break;
+            vector3d_set(chunk->vertices[chunk->vertex_count],x,y,z);
+            chunk->vertex_count++;
+        }
+        else if ((c + 2 < lineEnd)&&(c[0] == 'v')&&(c[1] == 'n')&&((c[2] == ' ')||(c[2] == '\t')))
+        {
+            x = y = z = 0;
+            c = gf3d_obj_parse_float(c + 3,lineEnd,&x);
+            c = gf3d_obj_parse_float(c,lineEnd,&y);
+            gf3d_obj_parse_float(c,lineEnd,&z);
+            chunk->normals = gf3d_obj_chunk_grow(chunk,chunk->normals,&chunk->normal_max,chunk->normal_count + 1,sizeof(Vector3D));
+            if (chunk->failed)break;
+            vector3d_set(chunk->normals[chunk->normal_count],x,y,z);
+            chunk->normal_count++;
+        }
+        else if ((c + 2 < lineEnd)&&(c[0] == 'v')&&(c[1] == 't')&&((c[2] == ' ')||(c[2] == '\t')))
+        {
+            x = y = 0;
+            c = gf3d_obj_parse_float(c + 3,lineEnd,&x);
+            gf3d_obj_parse_float(c,lineEnd,&y);
+            chunk->texels = gf3d_obj_chunk_grow(chunk,chunk->texels,&chunk->texel_max,chunk->texel_count + 1,sizeof(Vector2D));
+            if (chunk->failed)break;
+            chunk->texels[chunk->texel_count].x = x;
+            chunk->texels[chunk->texel_count].y = 1 - y;
+            chunk->texel_count++;
+        }
+        else if ((c + 1 < lineEnd)&&(c[0] == 'f')&&((c[1] == ' ')||(c[1] == '\t')))
+        {
+            gf3d_obj_parse_face(chunk,c + 2,lineEnd);
+        }
+        c = gf3d_obj_next_line(lineEnd,end);
+    }
+}
+
+static int gf3d_obj_parse_chunk_thread(void *data)
+{
+    gf3d_obj_parse_chunk((ObjChunk *)data);
+    return 0;
+}
+
+static void gf3d_obj_chunk_free(ObjChunk *chunk)
+{
+    if (!chunk)return;
+    free(chunk->vertices);
+    free(chunk->normals);
+    free(chunk->texels);
+    free(chunk->corners);
+}
+
+/**
+ * @brief concatenate the chunk arrays into obj, resolving relative indices against the chunks before each one
+ */
+static Bool gf3d_obj_merge_chunks(ObjData *obj,ObjChunk *chunks,Uint32 chunkCount)
+{
+    Uint32 i,j,k,face = 0;
+    Uint32 base[3] = {0};
+    Uint32 counts[3];
+    Sint32 index;
+    ObjCorner *corner;
+    Face *faces[3];
+    for (i = 0; i < chunkCount; i++)
+    {
+        if (chunks[i].failed)return 0;
+        obj->vertex_count += chunks[i].vertex_count;
+        obj->normal_count += chunks[i].normal_count;
+        obj->texel_count += chunks[i].texel_count;
+        obj->face_count += chunks[i].corner_count / 3;
     }
-    obj = (ObjData*)gfc_allocate_array(sizeof(ObjData),1);
-    if (!obj)return NULL;
-    
-    gf3d_obj_get_counts_from_file(obj, file);
-    
     obj->vertices = (Vector3D *)gfc_allocate_array(sizeof(Vector3D),obj->vertex_count);
     obj->normals = (Vector3D *)gfc_allocate_array(sizeof(Vector3D),obj->normal_count);
     obj->texels = (Vector2D *)gfc_allocate_array(sizeof(Vector2D),obj->texel_count);
-    
     obj->faceVerts = (Face *)gfc_allocate_array(sizeof(Face),obj->face_count);
-    obj->faceNormals = (Face *)gfc_allocate_array(sizeof(Face),obj->face_count);
     obj->faceTexels = (Face *)gfc_allocate_array(sizeof(Face),obj->face_count);
-    
-    gf3d_obj_load_get_data_from_file(obj, file);
-    fclose(file);
-    gf3d_obj_load_reorg(obj);
-    return obj;
+    obj->faceNormals = (Face *)gfc_allocate_array(sizeof(Face),obj->face_count);
+    if ((obj->vertex_count && !obj->vertices)||(obj->normal_count && !obj->normals)||
+        (obj->texel_count && !obj->texels)||(obj->face_count && ((!obj->faceVerts)||(!obj->faceTexels)||(!obj->faceNormals))))
+    {
+        return 0;
+    }
+    faces[0] = obj->faceVerts;
+    faces[1] = obj->faceTexels;
+    faces[2] = obj->faceNormals;
+    counts[0] = obj->vertex_count;
+    counts[1] = obj->texel_count;
+    counts[2] = obj->normal_count;
+    for (i = 0; i < chunkCount; i++)
+    {
+        if (chunks[i].vertex_count)memcpy(&obj->vertices[base[0]],chunks[i].vertices,sizeof(Vector3D) * chunks[i].vertex_count);
+        if (chunks[i].texel_count)memcpy(&obj->texels[base[1]],chunks[i].texels,sizeof(Vector2D) * chunks[i].texel_count);
+        if (chunks[i].normal_count)memcpy(&obj->normals[base[2]],chunks[i].normals,sizeof(Vector3D) * chunks[i].normal_count);
+        for (j = 0; j < chunks[i].corner_count; j++)
+        {
+            corner = &chunks[i].corners[j];
+            for (k = 0; k < 3; k++)
+            {
+                index = corner->index[k];
+                if (corner->relative & (1 << k))index += base[k];
+                if ((!(corner->present & (1 << k)))||(index < 0)||((Uint32)index >= counts[k]))
+                {
+                    faces[k][face].verts[j % 3] = OBJ_INDEX_NONE;
+                }
+                else faces[k][face].verts[j % 3] = index;
+            }
+            if (j % 3 == 2)face++;
+        }
+        base[0] += chunks[i].vertex_count;
+        base[1] += chunks[i].texel_count;
+        base[2] += chunks[i].normal_count;
+    }
+    return 1;
 }
 
-void gf3d_obj_get_counts_from_file(ObjData *obj, FILE* file)
+ObjData *gf3d_obj_load_from_file(const char *filename)
 {
-  char buf[256];
-  int  numvertices = 0;
-  int  numtexels = 0;
-  int  numnormals = 0;
-  int  numfaces = 0;
+    int i;
+    MappedFile file;
+    ObjData *obj;
+    ObjChunk chunks[OBJ_CHUNK_MAX];
+    SDL_Thread *threads[OBJ_CHUNK_MAX] = {0};
+    Uint32 chunkCount;
+    const char *data,*end,*split;
+    Bool merged;
+    if (!gf3d_mmap_open(filename,&file))
+    {
+        slog("failed to open obj file %s",filename);
+        return NULL;
+    }
+    obj = (ObjData*)gfc_allocate_array(sizeof(ObjData),1);
+    if (!obj)
+    {
+        gf3d_mmap_close(&file);
+        return NULL;
+    }
+    data = (const char *)file.data;
+    end = data + file.size;
 
-  if ((file == NULL) ||
-     (obj == NULL))
-  {
-    return;
-  }
-  while(fscanf(file, "%s", buf) != EOF)
-  {
-    switch(buf[0])
-    {
-      case 'v':
-        switch(buf[1])
+    // line aligned slices, one per core, but none smaller than OBJ_CHUNK_MIN_SIZE
+    chunkCount = SDL_GetCPUCount();
+    if (chunkCount > file.size / OBJ_CHUNK_MIN_SIZE)chunkCount = file.size / OBJ_CHUNK_MIN_SIZE;
+    if (chunkCount > OBJ_CHUNK_MAX)chunkCount = OBJ_CHUNK_MAX;
+    if (chunkCount < 1)chunkCount = 1;
+    memset(chunks,0,sizeof(chunks));
+    for (i = 0; i < chunkCount; i++)
+    {
+        chunks[i].start = i ? chunks[i - 1].end : data;
+        if (i == chunkCount - 1)split = end;
+        else
         {
-          case '\0':
-            fgets(buf, sizeof(buf), file);
-            numvertices++;
-            break;
-          case 'n':
-            fgets(buf, sizeof(buf), file);
-            numnormals++;
-            break;
-          case 't':
-            fgets(buf, sizeof(buf), file);
-            numtexels++;
-            break;
-          default:
-            break;
+            split = data + (file.size / chunkCount) * (i + 1);
+            if (split < chunks[i].start)split = chunks[i].start;
+            split = gf3d_obj_next_line(split,end);
         }
-        break;
-      case 'f':
-        fgets(buf, sizeof(buf), file);
-        numfaces++;
-        break;
-      default:
-        fgets(buf, sizeof(buf), file);
-        break;
-    }
-  }
-  obj->vertex_count  = numvertices;
-  obj->texel_count  = numtexels;
-  obj->normal_count  = numnormals;
-  obj->face_count = numfaces;
+        chunks[i].end = split;
+    }
+    for (i = 1; i < chunkCount; i++)
+    {
+        threads[i] = SDL_CreateThread(gf3d_obj_parse_chunk_thread,"obj_parse",&chunks[i]);
+        if (!threads[i])gf3d_obj_parse_chunk(&chunks[i]);// no thread, do it here
+    }
+    gf3d_obj_parse_chunk(&chunks[0]);
+    for (i = 1; i < chunkCount; i++)
+    {
+        if (threads[i])SDL_WaitThread(threads[i],NULL);
+    }
+
+    merged = gf3d_obj_merge_chunks(obj,chunks,chunkCount);
+    for (i = 0; i < chunkCount; i++)
+    {
+        gf3d_obj_chunk_free(&chunks[i]);
+    }
+    gf3d_mmap_close(&file);
+    if (!merged)
+    {
+        slog("failed to parse obj file %s",filename);
+        gf3d_obj_free(obj);
+        return NULL;
+    }
+    gf3d_obj_load_reorg(obj);
+    if ((!obj->faceVertices)||(!obj->outFace))
+    {
+        slog("failed to build vertices for obj file %s",filename);
+        gf3d_obj_free(obj);
+        return NULL;
+    }
+    slog("obj file %s welded from %u to %u vertices",filename,obj->face_count * 3,obj->face_vert_count);
+    gf3d_obj_get_bounds(obj);
+    return obj;
 }
 
-void gf3d_obj_load_get_data_from_file(ObjData *obj, FILE* file)
+void gf3d_obj_benchmark(const char *filename,Uint32 iterations)
 {
-  int  numvertices = 0;
-  int  numnormals = 0;
-  int  numtexcoords = 0;
-  int  numfaces = 0;
-  char buf[128];
-  float x,y,z;
-  int f[3][3];
-
-  if (file == NULL)
-    return;
-  
-  rewind(file);
-  while(fscanf(file, "%s", buf) != EOF)
-  {
-    switch(buf[0])
-    {
-      case 'v':
-        switch(buf[1])
+    Uint32 i;
+    Uint64 start,elapsed;
+    size_t size;
+    double seconds;
+    MappedFile file;
+    ObjData *obj;
+    if ((!filename)||(!iterations))return;
+    if (!gf3d_mmap_open(filename,&file))
+    {
+        slog("obj benchmark: failed to open %s",filename);
+        return;
+    }
+    size = file.size;
+    gf3d_mmap_close(&file);
+    start = SDL_GetPerformanceCounter();
+    for (i = 0; i < iterations; i++)
+    {
+        obj = gf3d_obj_load_from_file(filename);
+        if (!obj)return;
+        if (i + 1 == iterations)
         {
-          case '\0':
-            fscanf(
-                file,
-                "%f %f %f",
-                &x,
-                &y,
-                &z
-              );
-            obj->vertices[numvertices].x = x;
-            obj->vertices[numvertices].y = y;
-            obj->vertices[numvertices].z = z;
-            numvertices++;
-            break;
-          case 'n':
-            fscanf(
-                file,
-                "%f %f %f",
-                &x,
-                &y,
-                &z
-            );
-            obj->normals[numnormals].x = x;
-            obj->normals[numnormals].y = y;
-            obj->normals[numnormals].z = z;
-            numnormals++;
-            break;
-          case 't':
-            fscanf(
-                file,
-                "%f %f",
-                &x,
-                &y
-              );
-            obj->texels[numtexcoords].x = x;
-            obj->texels[numtexcoords].y = 1 - y;
-            numtexcoords++;
-            break;
-          default:
-            break;
+            slog("obj benchmark: %s has %u vertices, %u normals, %u texels, %u triangles",
+                 filename,obj->vertex_count,obj->normal_count,obj->texel_count,obj->face_count);
         }
-        break;
-      case 'f':
-        fscanf(
-            file,
-            "%d/%d/%d %d/%d/%d %d/%d/%d",
-            &f[0][0],
-            &f[0][1],
-            &f[0][2],
-            
-            &f[1][0],
-            &f[1][1],
-            &f[1][2],
-            
-            &f[2][0],
-            &f[2][1],
-            &f[2][2]);
-        
-        obj->faceVerts[numfaces].verts[0]   = f[0][0] - 1;
-        obj->faceTexels[numfaces].verts[0]  = f[0][1] - 1;
-        obj->faceNormals[numfaces].verts[0] = f[0][2] - 1;
-        
-        obj->faceVerts[numfaces].verts[1]   = f[1][0] - 1;
-        obj->faceTexels[numfaces].verts[1]  = f[1][1] - 1;
-        obj->faceNormals[numfaces].verts[1] = f[1][2] - 1;
-        
-        obj->faceVerts[numfaces].verts[2]   = f[2][0] - 1;
-        obj->faceTexels[numfaces].verts[2]  = f[2][1] - 1;
-        obj->faceNormals[numfaces].verts[2] = f[2][2] - 1;
-        numfaces++;
-        break;
-      default:
-        fgets(buf, sizeof(buf), file);
-        break;
-    }
-  }
+        gf3d_obj_free(obj);
+    }
+    elapsed = SDL_GetPerformanceCounter() - start;
+    seconds = (double)elapsed / (double)SDL_GetPerformanceFrequency();
+    slog("obj benchmark: %s %.2f ms per load, %.1f MB/s",
+         filename,
+         (seconds * 1000.0) / iterations,
+         ((double)size * iterations) / (seconds * 1024.0 * 1024.0));
+}
+
+void gf3d_obj_get_bounds(ObjData *obj)
+{
+    int i;
+    float distance;
+    Vector3D delta;
+    if (!obj)return;
+    if (!obj->vertex_count)return;
+    vector3d_copy(obj->min,obj->vertices[0]);
+    vector3d_copy(obj->max,obj->vertices[0]);
+    for (i = 1; i < obj->vertex_count; i++)
+    {
+        if (obj->vertices[i].x < obj->min.x)obj->min.x = obj->vertices[i].x;
+        if (obj->vertices[i].y < obj->min.y)obj->min.y = obj->vertices[i].y;
+        if (obj->vertices[i].z < obj->min.z)obj->min.z = obj->vertices[i].z;
+        if (obj->vertices[i].x > obj->max.x)obj->max.x = obj->vertices[i].x;
+        if (obj->vertices[i].y > obj->max.y)obj->max.y = obj->vertices[i].y;
+        if (obj->vertices[i].z > obj->max.z)obj->max.z = obj->vertices[i].z;
+    }
+    // sphere around the box center, sized to the farthest vertex rather than the box corner
+    obj->center.x = (obj->min.x + obj->max.x) * 0.5;
+    obj->center.y = (obj->min.y + obj->max.y) * 0.5;
+    obj->center.z = (obj->min.z + obj->max.z) * 0.5;
+    obj->radius = 0;
+    for (i = 0; i < obj->vertex_count; i++)
+    {
+        vector3d_sub(delta,obj->vertices[i],obj->center);
+        distance = delta.x * delta.x + delta.y * delta.y + delta.z * delta.z;
+        if (distance > obj->radius)obj->radius = distance;
+    }
+    obj->radius = sqrt(obj->radius);
 }
 
 /*eol@eof*/
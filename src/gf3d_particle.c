@@ -4,6 +4,10 @@
 
 #include "gf3d_vgraphics.h"
 #include "gf3d_buffers.h"
+#include "gf3d_upload.h"
+#include "gf3d_render.h"
+#include "gf3d_record.h"
+#include "gf3d_draw_queue.h"
 
 #include "gf3d_particle.h"
 
@@ -24,7 +28,9 @@ typedef struct
     VkVertexInputAttributeDescription   attributeDescriptions[PARTICLE_ATTRIBUTE_COUNT];
     VkVertexInputBindingDescription     bindingDescription;
     VkBuffer                    buffer;                 /**<vertex buffer for particles (just one vertex)*/
-    VkDeviceMemory              bufferMemory;           /**<memory handle for the vertex buffer*/
+    MemoryAllocation            bufferMemory;           /**<memory for the vertex buffer*/
+    Uint64                      uploadValue;            /**<upload timeline value the vertex buffer is ready at*/
+    Bool                        vertexBound[GF3D_RECORD_THREAD_MAX + 1];   /**<per recording thread, this frame*/
     Pipeline *pipe;
 }ParticleManager;
 
@@ -35,14 +41,7 @@ void gf3d_particle_create_vertex_buffer();
 
 void gf3d_particles_manager_close()
 {
-    if (gf3d_particle.buffer != VK_NULL_HANDLE)
-    {
-        vkDestroyBuffer(gf3d_vgraphics_get_default_logical_device(), gf3d_particle.buffer, NULL);
-    }
-    if (gf3d_particle.bufferMemory != VK_NULL_HANDLE)
-    {
-        vkFreeMemory(gf3d_vgraphics_get_default_logical_device(), gf3d_particle.bufferMemory, NULL);
-    }
+    gf3d_buffer_free(&gf3d_particle.buffer, &gf3d_particle.bufferMemory);
     memset(&gf3d_particle,0,sizeof(ParticleManager));
 }
 
@@ -64,9 +63,11 @@ void gf3d_particle_manager_init(Uint32 max_particles)
         gf3d_vgraphics_get_view_extent(),
         max_particles,
         &gf3d_particle.bindingDescription,
+        1,
         gf3d_particle.attributeDescriptions,
         PARTICLE_ATTRIBUTE_COUNT,
-        sizeof(ParticleUBO)
+        sizeof(ParticleUBO),
+        0
     );
     slog("particle manager initiliazed");
     atexit(gf3d_particles_manager_close);
@@ -74,9 +75,10 @@ void gf3d_particle_manager_init(Uint32 max_particles)
 
 void gf3d_particle_reset_pipes()
 {
-    Uint32 bufferFrame = gf3d_vgraphics_get_current_buffer_frame();
+    Uint32 bufferFrame = gf3d_vgraphics_get_current_frame();
     
     gf3d_pipeline_reset_frame(gf3d_particle.pipe,bufferFrame);
+    memset(gf3d_particle.vertexBound,0,sizeof(gf3d_particle.vertexBound));
 }
 
 void gf3d_particle_submit_pipe_commands()
@@ -92,27 +94,19 @@ Pipeline *gf3d_particle_get_pipeline()
 
 void gf3d_particle_create_vertex_buffer()
 {
-    void *data = NULL;
     size_t bufferSize;
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    VkDevice device = gf3d_vgraphics_get_default_logical_device();
     Vector3D particle = {0};
 
     bufferSize = sizeof(Vector3D);
     
-    gf3d_buffer_create(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
-    
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-            memcpy(data, &particle, (size_t) bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
+    gf3d_buffer_create_device_local(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT|VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &gf3d_particle.buffer, &gf3d_particle.bufferMemory);
 
-    gf3d_buffer_create(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT|VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &gf3d_particle.buffer, &gf3d_particle.bufferMemory);
-
-    gf3d_buffer_copy(stagingBuffer, gf3d_particle.buffer, bufferSize);
-
-    vkDestroyBuffer(device, stagingBuffer, NULL);
-    vkFreeMemory(device, stagingBufferMemory, NULL);    
+    if (gf3d_particle.bufferMemory.mapped)memcpy(gf3d_particle.bufferMemory.mapped, &particle, bufferSize);
+    else
+    {
+        gf3d_upload_buffer(gf3d_particle.buffer, 0, &particle, bufferSize);
+        gf3d_particle.uploadValue = gf3d_upload_get_pending_value();
+    }
 }
 
 
@@ -129,7 +123,6 @@ VkVertexInputAttributeDescription * gf3d_particle_get_attribute_descriptions(Uin
 
 void gf3d_particle_update_uniform_buffer(Particle *particle,UniformBuffer *ubo)
 {
-    void* data;
     ParticleUBO particleUBO = {0};
     UniformBufferObject graphics_ubo;
     
@@ -144,101 +137,62 @@ void gf3d_particle_update_uniform_buffer(Particle *particle,UniformBuffer *ubo)
     vector4d_copy(particleUBO.color,gfc_color_to_vector4f(particle->color));
     particleUBO.size = particle->size;
     particleUBO.viewportSize = gf3d_vgraphics_get_view_extent_as_vector2d();
-    
-    vkMapMemory(gf3d_vgraphics_get_default_logical_device(), ubo->uniformBufferMemory, 0, sizeof(ParticleUBO), 0, &data);
-    
-        memcpy(data, &particleUBO, sizeof(ParticleUBO));
 
-    vkUnmapMemory(gf3d_vgraphics_get_default_logical_device(), ubo->uniformBufferMemory);
+    memcpy(ubo->data, &particleUBO, sizeof(ParticleUBO));
 }
 
-void gf3d_particle_update_basic_descriptor_set(
-    Particle *particle,
-    VkDescriptorSet descriptorSet,
-    Uint32 chainIndex)
+void gf3d_particle_render_queued(Uint32 uboOffset)
 {
-    VkWriteDescriptorSet descriptorWrite[2] = {0};
-    VkDescriptorBufferInfo bufferInfo = {0};
-    UniformBuffer *ubo;
+    VkDeviceSize offsets[] = {0};
+    VkDescriptorSet *descriptorSet;
+    VkCommandBuffer commandBuffer;
+    Bool started = 0;
+    Uint32 thread;
 
-    if (!particle)
-    {
-        slog("no particle provided for descriptor set update");
-        return;
-    }
-    if (descriptorSet == VK_NULL_HANDLE)
+    commandBuffer = gf3d_pipeline_get_command_buffer(gf3d_particle.pipe,&started);
+    if (commandBuffer == VK_NULL_HANDLE)return;
+    descriptorSet = gf3d_pipeline_get_descriptor_set(gf3d_particle.pipe, gf3d_vgraphics_get_current_frame());
+    if (descriptorSet == NULL)
     {
-        slog("null handle provided for descriptorSet");
+        slog("failed to get the frame descriptor Set for particle rendering");
         return;
     }
-
-    ubo = gf3d_uniform_buffer_list_get_buffer(gf3d_particle.pipe->uboList, chainIndex);
-    if (!ubo)
+    thread = gf3d_record_get_thread();
+    if (thread > GF3D_RECORD_THREAD_MAX)thread = 0;
+    // every particle shares the one vertex, so it is bound once per command buffer
+    if ((started)||(!gf3d_particle.vertexBound[thread]))
     {
-        slog("failed to get a uniform buffer for particle descriptor");
-        return;
+        gf3d_upload_require(gf3d_particle.uploadValue);
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &gf3d_particle.buffer, offsets);
+        gf3d_particle.vertexBound[thread] = 1;
     }
-    gf3d_particle_update_uniform_buffer(particle,ubo);
-
-    bufferInfo.buffer = ubo->uniformBuffer;
-    bufferInfo.offset = 0;
-    bufferInfo.range = sizeof(ParticleUBO);        
     
-    descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrite[0].dstSet = descriptorSet;
-    descriptorWrite[0].dstBinding = 0;
-    descriptorWrite[0].dstArrayElement = 0;
-    descriptorWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrite[0].descriptorCount = 1;
-    descriptorWrite[0].pBufferInfo = &bufferInfo;
-
-    vkUpdateDescriptorSets(gf3d_vgraphics_get_default_logical_device(), 1, descriptorWrite, 0, NULL);
-}
-
-void gf3d_particle_render(Particle *particle,VkCommandBuffer commandBuffer, VkDescriptorSet * descriptorSet)
-{
-    VkDeviceSize offsets[] = {0};
-    if (!particle)
-    {
-        slog("cannot render a NULL particle");
-        return;
-    }
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &gf3d_particle.buffer, offsets);
-        
     vkCmdBindDescriptorSets(
         commandBuffer,
         VK_PIPELINE_BIND_POINT_GRAPHICS,
-        gf3d_particle.pipe->pipelineLayout, 0, 1, descriptorSet, 0, NULL);
+        gf3d_particle.pipe->pipelineLayout, 0, 1, descriptorSet, 1, &uboOffset);
     
     vkCmdDrawIndexed(commandBuffer, 1, 1, 0, 0, 0);
 }
 
 void gf3d_particle_draw(Particle *particle)
 {
-    VkDescriptorSet *descriptorSet = NULL;
-    Uint32 buffer_frame;
-    VkCommandBuffer commandBuffer;
+    UniformBuffer ubo = {0};
 
+    if (gf3d_render_capture_particle(particle))return;
     if (!particle)
     {
         slog("cannot render a NULL particle");
         return;
     }
-    commandBuffer = gf3d_particle.pipe->commandBuffer;
-    buffer_frame = gf3d_vgraphics_get_current_buffer_frame();
-
-    descriptorSet = gf3d_pipeline_get_descriptor_set(gf3d_particle.pipe, buffer_frame);
-    if (descriptorSet == NULL)
+    if (!gf3d_uniform_buffer_list_get_buffer(gf3d_particle.pipe->uboList, gf3d_vgraphics_get_current_frame(), &ubo))
     {
-        slog("failed to get a free descriptor Set for sprite rendering");
+        slog("failed to get a uniform buffer for particle rendering");
         return;
     }
-
-    gf3d_particle_update_basic_descriptor_set(
-        particle,
-        *descriptorSet,
-        buffer_frame);
-    gf3d_particle_render(particle,commandBuffer,descriptorSet);
+    gf3d_particle_update_uniform_buffer(particle,&ubo);
+    // particles blend, so they are recorded back to front once the frame's draws are sorted
+    gf3d_draw_queue_add_particle(particle->position,ubo.offset);
 }
 
 /**
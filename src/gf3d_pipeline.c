@@ -8,6 +8,8 @@
 #include "gf3d_swapchain.h"
 #include "gf3d_vgraphics.h"
 #include "gf3d_shaders.h"
+#include "gf3d_texture.h"
+#include "gf3d_record.h"
 #include "gf3d_pipeline.h"
 
 extern int __DEBUG;
@@ -16,7 +18,7 @@ typedef struct
 {
     Uint32              maxPipelines;
     Pipeline           *pipelineList;
-    Uint32              chainLength;
+    Uint32              chainLength;        /**<how many frames in flight each pipeline keeps resources for*/
 }PipelineManager;
 
 static PipelineManager gf3d_pipeline = {0};
@@ -25,6 +27,7 @@ void gf3d_pipeline_close();
 void gf3d_pipeline_create_basic_model_descriptor_pool(Pipeline *pipe);
 void gf3d_pipeline_create_basic_model_descriptor_set_layout(Pipeline *pipe);
 void gf3d_pipeline_create_descriptor_sets(Pipeline *pipe);
+void gf3d_pipeline_update_descriptor_sets(Pipeline *pipe);
 VkFormat gf3d_pipeline_find_depth_format();
 
 void gf3d_pipeline_init(Uint32 max_pipelines)
@@ -41,7 +44,7 @@ void gf3d_pipeline_init(Uint32 max_pipelines)
         return;
     }
     gf3d_pipeline.maxPipelines = max_pipelines;
-    gf3d_pipeline.chainLength = gf3d_swapchain_get_chain_length();
+    gf3d_pipeline.chainLength = GF3D_VGRAPHICS_FRAMES_IN_FLIGHT;
     slog("pipeline manager created with chain length %i",gf3d_pipeline.chainLength);
     atexit(gf3d_pipeline_close);
     slog("pipeline system initialized");
@@ -171,7 +174,7 @@ int gf3d_pipeline_render_pass_create(VkDevice device,SJson *config,VkRenderPass
         slog("failed to create render pass!");
         return 0;
     }
-    if (__DEBUG)slog("created renderpass for pipeline");
+    if (__DEBUG)slog("created renderpass");
     return 1;
 }
 
@@ -214,20 +217,24 @@ Pipeline *gf3d_pipeline_create_from_config(
     VkExtent2D extent,
     Uint32 descriptorCount,
     const VkVertexInputBindingDescription* vertexInputDescription,
+    Uint32 vertexBindingCount,
     const VkVertexInputAttributeDescription * vertextInputAttributeDescriptions,
     Uint32 vertexAttributeCount,
-    VkDeviceSize bufferSize)
+    VkDeviceSize bufferSize,
+    Uint32 pushConstantSize)
 {
-    SJson *config,*file, *item;
+    SJson *config,*file;
     const char *str;
     Pipeline *pipe;
     const char *vertFile = NULL;
     const char *fragFile = NULL;
-    Uint32 draw_calls = 1024;
     VkRect2D scissor = {0};
     VkViewport viewport = {0};
     VkGraphicsPipelineCreateInfo pipelineInfo = {0};
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
+    VkPushConstantRange pushConstantRange = {0};
+    VkPhysicalDeviceProperties properties = {0};
+    VkDescriptorSetLayout setLayouts[2];
     VkPipelineViewportStateCreateInfo viewportState = {0};
     VkPipelineRasterizationStateCreateInfo rasterizer = {0};
     VkPipelineShaderStageCreateInfo shaderStages[2];
@@ -286,11 +293,36 @@ Pipeline *gf3d_pipeline_create_from_config(
         gf3d_pipeline_free(pipe);
         return NULL;
     }
-    fragFile = sj_object_get_value_as_string(config,"fragment_shader");
+    fragFile = NULL;
+    if (gf3d_texture_bindless_enabled())
+    {
+        // pipelines that sample textures provide a variant indexing the bindless table
+        fragFile = sj_object_get_value_as_string(config,"fragment_shader_bindless");
+    }
     if (fragFile)
     {
         pipe->fragShader = (char *)gf3d_shaders_load_data(fragFile,&pipe->fragSize);
-        pipe->fragModule = gf3d_shaders_create_module(pipe->fragShader,pipe->fragSize,device);
+        if (pipe->fragShader)pipe->fragModule = gf3d_shaders_create_module(pipe->fragShader,pipe->fragSize,device);
+        if (pipe->fragModule != VK_NULL_HANDLE)pipe->bindless = true;
+        else
+        {
+            slog("pipeline %s falling back to a material set per texture",configFile);
+            if (pipe->fragShader)free(pipe->fragShader);
+            pipe->fragShader = NULL;
+            pipe->fragSize = 0;
+        }
+    }
+    if (!pipe->bindless)
+    {
+        fragFile = sj_object_get_value_as_string(config,"fragment_shader");
+        if (fragFile)
+        {
+            pipe->fragShader = (char *)gf3d_shaders_load_data(fragFile,&pipe->fragSize);
+            pipe->fragModule = gf3d_shaders_create_module(pipe->fragShader,pipe->fragSize,device);
+        }
+    }
+    if (fragFile)
+    {
         fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
         fragShaderStageInfo.module = pipe->fragModule;
@@ -306,7 +338,15 @@ Pipeline *gf3d_pipeline_create_from_config(
     }
 
     pipe->device = device;
-    pipe->descriptorSetCount = descriptorCount;
+    pipe->descriptorSetCount = gf3d_pipeline.chainLength;
+    vkGetPhysicalDeviceProperties(gf3d_vgraphics_get_default_physical_device(),&properties);
+    if (pushConstantSize > properties.limits.maxPushConstantsSize)
+    {
+        slog("pipeline %s push constants (%i bytes) exceed the device limit of %i",configFile,pushConstantSize,properties.limits.maxPushConstantsSize);
+        sj_free(file);
+        gf3d_pipeline_free(pipe);
+        return NULL;
+    }
     
     gf3d_pipelin_depth_stencil_create_info_from_json(sj_object_get_value(config,"depthStencil"),&depthStencil);
     inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -315,7 +355,7 @@ Pipeline *gf3d_pipeline_create_from_config(
     inputAssembly.primitiveRestartEnable = VK_FALSE;
     
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.vertexBindingDescriptionCount = vertexBindingCount;
     vertexInputInfo.pVertexBindingDescriptions = vertexInputDescription;
     vertexInputInfo.vertexAttributeDescriptionCount = vertexAttributeCount;
     vertexInputInfo.pVertexAttributeDescriptions = vertextInputAttributeDescriptions;
@@ -362,27 +402,20 @@ Pipeline *gf3d_pipeline_create_from_config(
     gf3d_pipeline_create_descriptor_sets(pipe);
     
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1; // Optional
-    pipelineLayoutInfo.pSetLayouts = &pipe->descriptorSetLayout; // Optional 
-    pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-    pipelineLayoutInfo.pPushConstantRanges = NULL; // Optional
-
-    item = sj_object_get_value(config,"renderPass");
-    if (!item)
+    setLayouts[0] = pipe->descriptorSetLayout;
+    setLayouts[1] = *gf3d_texture_get_descriptor_set_layout(pipe->bindless);
+    pipelineLayoutInfo.setLayoutCount = 2;
+    pipelineLayoutInfo.pSetLayouts = setLayouts;
+    if (pushConstantSize)
     {
-        slog("failed to create pipeline layout!");
-        sj_free(file);
-        gf3d_pipeline_free(pipe);
-        return NULL;
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = pushConstantSize;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
     }
-    if (!gf3d_pipeline_render_pass_create(device,item,&pipe->renderPass))
-    {
-        slog("failed to create pipeline layout!");
-        sj_free(file);
-        gf3d_pipeline_free(pipe);
-        return NULL;
-    }
-    
+    pipe->pushConstantSize = pushConstantSize;
+
     if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipe->pipelineLayout) != VK_SUCCESS)
     {
         slog("failed to create pipeline layout!");
@@ -403,7 +436,7 @@ Pipeline *gf3d_pipeline_create_from_config(
     pipelineInfo.pColorBlendState = &colorBlending;
     pipelineInfo.pDynamicState = NULL; // Optional
     pipelineInfo.layout = pipe->pipelineLayout;
-    pipelineInfo.renderPass = pipe->renderPass;
+    pipelineInfo.renderPass = gf3d_vgraphics_get_render_pass();// all pipelines share the frame render pass
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
@@ -420,7 +453,8 @@ Pipeline *gf3d_pipeline_create_from_config(
 
     slog("Testing123");
     
-    pipe->uboList = gf3d_uniform_buffer_list_new(device,bufferSize,draw_calls,gf3d_swapchain_get_swap_image_count());
+    pipe->uboList = gf3d_uniform_buffer_list_new(device,bufferSize,descriptorCount,gf3d_pipeline.chainLength);
+    gf3d_pipeline_update_descriptor_sets(pipe);
     
     if (__DEBUG)slog("pipeline created from file '%s'",configFile);
     slog("Testing456");
@@ -429,7 +463,6 @@ Pipeline *gf3d_pipeline_create_from_config(
 
 void gf3d_pipeline_free(Pipeline *pipe)
 {
-    int i;
     if (!pipe)return;
     if (!pipe->inUse)return;
     if (pipe->uboList)
@@ -437,21 +470,13 @@ void gf3d_pipeline_free(Pipeline *pipe)
         gf3d_uniform_buffer_list_free(pipe->uboList);
     }
 
-    if (pipe->descriptorCursor)
+    if (pipe->descriptorSets)
     {
-        free(pipe->descriptorCursor);
-        pipe->descriptorCursor = NULL;
+        free(pipe->descriptorSets);
     }
-    if (pipe->descriptorPool != NULL)
+    if (pipe->descriptorPool != VK_NULL_HANDLE)
     {
-        for (i = 0;i < gf3d_pipeline.chainLength;i++)
-        {
-            if (pipe->descriptorPool[i] != VK_NULL_HANDLE)
-            {
-                vkDestroyDescriptorPool(pipe->device, pipe->descriptorPool[i], NULL);
-            }
-        }
-        free(pipe->descriptorPool);
+        vkDestroyDescriptorPool(pipe->device, pipe->descriptorPool, NULL);
     }
     if (pipe->descriptorSetLayout != VK_NULL_HANDLE)
     {
@@ -465,10 +490,6 @@ void gf3d_pipeline_free(Pipeline *pipe)
     {
         vkDestroyPipelineLayout(pipe->device, pipe->pipelineLayout, NULL);
     }
-    if (pipe->renderPass)
-    {
-        vkDestroyRenderPass(pipe->device, pipe->renderPass, NULL);
-    }
     if (pipe->fragModule != VK_NULL_HANDLE)
     {
         vkDestroyShaderModule(pipe->device, pipe->fragModule, NULL);
@@ -492,8 +513,7 @@ void gf3d_pipeline_free(Pipeline *pipe)
 
 void gf3d_pipeline_create_basic_model_descriptor_pool(Pipeline *pipe)
 {
-    int i;
-    VkDescriptorPoolSize poolSize[2] = {0};
+    VkDescriptorPoolSize poolSize = {0};
     VkDescriptorPoolCreateInfo poolInfo = {0};
     
     if (!pipe)
@@ -501,45 +521,76 @@ void gf3d_pipeline_create_basic_model_descriptor_pool(Pipeline *pipe)
         slog("no pipeline provided");
         return;
     }
-    poolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSize[0].descriptorCount = pipe->descriptorSetCount;
-    poolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSize[1].descriptorCount = pipe->descriptorSetCount;
+    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSize.descriptorCount = pipe->descriptorSetCount;
     
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = 2;
-    poolInfo.pPoolSizes = poolSize;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
     poolInfo.maxSets = pipe->descriptorSetCount;
-    pipe->descriptorPool = (VkDescriptorPool *)gfc_allocate_array(sizeof(VkDescriptorPool),gf3d_pipeline.chainLength);
 
-    for (i =0; i < gf3d_pipeline.chainLength;i++)
+    if (vkCreateDescriptorPool(pipe->device, &poolInfo, NULL, &pipe->descriptorPool) != VK_SUCCESS)
     {
-        if (vkCreateDescriptorPool(pipe->device, &poolInfo, NULL, &pipe->descriptorPool[i]) != VK_SUCCESS)
-        {
-            slog("failed to create descriptor pool!");
-            return;
-        }
+        slog("failed to create descriptor pool!");
+        return;
     }
-    pipe->descriptorPoolCount = gf3d_pipeline.chainLength;
 }
 
 void gf3d_pipeline_reset_frame(Pipeline *pipe,Uint32 frame)
 {
     if (!pipe)return;
-    gf3d_uniform_buffer_list_clear(pipe->uboList,frame);
     if (frame >= gf3d_pipeline.chainLength)
     {
-        slog("frame %i outside the range of supported descriptor Pools (%i)",frame,gf3d_pipeline.chainLength);
+        slog("frame %i outside the range of supported frames in flight (%i)",frame,gf3d_pipeline.chainLength);
         return;
     }
-    pipe->descriptorCursor[frame] = 0;
-    pipe->commandBuffer = gf3d_command_rendering_begin(frame,pipe);
+    gf3d_uniform_buffer_list_clear(pipe->uboList,frame);
+    memset(pipe->threadBuffers,0,sizeof(pipe->threadBuffers));
+    pipe->bundleCount = 0;
+    pipe->commandBuffer = gf3d_command_rendering_begin(gf3d_vgraphics_get_current_buffer_frame(),pipe);
 }
 
 void gf3d_pipeline_submit_commands(Pipeline *pipe)
 {
+    int i;
     if (!pipe)return;
     gf3d_command_rendering_end(pipe->commandBuffer);
+    for (i = 0; i < GF3D_PIPELINE_THREAD_MAX; i++)
+    {
+        gf3d_command_rendering_end(pipe->threadBuffers[i]);
+    }
+}
+
+VkCommandBuffer gf3d_pipeline_get_command_buffer(Pipeline *pipe,Bool *started)
+{
+    Uint32 thread;
+    if (started)*started = 0;
+    if (!pipe)return VK_NULL_HANDLE;
+    thread = gf3d_record_get_thread();
+    if ((!thread)||(thread > GF3D_PIPELINE_THREAD_MAX))return pipe->commandBuffer;
+    // each recording thread only ever touches its own slot, so no locking is needed
+    if (pipe->threadBuffers[thread - 1] == VK_NULL_HANDLE)
+    {
+        pipe->threadBuffers[thread - 1] = gf3d_command_rendering_begin_from_pool(
+            gf3d_record_get_command_pool(),
+            gf3d_vgraphics_get_current_buffer_frame(),
+            pipe);
+        if (pipe->threadBuffers[thread - 1] == VK_NULL_HANDLE)return VK_NULL_HANDLE;
+        if (started)*started = 1;
+    }
+    return pipe->threadBuffers[thread - 1];
+}
+
+Bool gf3d_pipeline_add_bundle_buffer(Pipeline *pipe,VkCommandBuffer commandBuffer)
+{
+    if ((!pipe)||(commandBuffer == VK_NULL_HANDLE))return 0;
+    if (pipe->bundleCount >= GF3D_PIPELINE_BUNDLE_MAX)
+    {
+        slog("pipeline cannot execute more than %i bundles a frame",GF3D_PIPELINE_BUNDLE_MAX);
+        return 0;
+    }
+    pipe->bundleBuffers[pipe->bundleCount++] = commandBuffer;
+    return 1;
 }
 
 void gf3d_pipeline_create_descriptor_sets(Pipeline *pipe)
@@ -549,7 +600,6 @@ void gf3d_pipeline_create_descriptor_sets(Pipeline *pipe)
     VkDescriptorSetLayout *layouts = NULL;
     VkDescriptorSetAllocateInfo allocInfo = {0};
 
-    slog("making descriptor");
     layouts = (VkDescriptorSetLayout *)gfc_allocate_array(sizeof(VkDescriptorSetLayout),pipe->descriptorSetCount);
     for (i = 0; i < pipe->descriptorSetCount; i++)
     {
@@ -557,60 +607,63 @@ void gf3d_pipeline_create_descriptor_sets(Pipeline *pipe)
     }
     
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = pipe->descriptorPool;
     allocInfo.descriptorSetCount = pipe->descriptorSetCount;
     allocInfo.pSetLayouts = layouts;
     
-    pipe->descriptorCursor = (Uint32 *)gfc_allocate_array(sizeof(Uint32),gf3d_pipeline.chainLength);
-    pipe->descriptorSets = (VkDescriptorSet **)gfc_allocate_array(sizeof(VkDescriptorSet*),gf3d_pipeline.chainLength);
-
-    for (i = 0; i < gf3d_pipeline.chainLength; i++)
-    {    
-        pipe->descriptorSets[i] = (VkDescriptorSet *)gfc_allocate_array(sizeof(VkDescriptorSet),pipe->descriptorSetCount);
-        allocInfo.descriptorPool = pipe->descriptorPool[i];
-        slog("allocating descriptor sets");
-        slog("Number in loop");
-        if ((r = vkAllocateDescriptorSets(pipe->device, &allocInfo, pipe->descriptorSets[i])) != VK_SUCCESS)
-        {
-            slog("failed to allocate descriptor sets!");
-            if (r == VK_ERROR_OUT_OF_POOL_MEMORY)slog("out of pool memory");
-            else if (r == VK_ERROR_FRAGMENTED_POOL)slog("fragmented pool");
-            else if (r == VK_ERROR_OUT_OF_DEVICE_MEMORY)slog("out of device memory");
-            else if (r == VK_ERROR_OUT_OF_HOST_MEMORY)slog("out of host memory");
-            free(layouts);
-            return;
-        }
-        slog("Number in loop 1");
+    pipe->descriptorSets = (VkDescriptorSet *)gfc_allocate_array(sizeof(VkDescriptorSet),pipe->descriptorSetCount);
+
+    if ((r = vkAllocateDescriptorSets(pipe->device, &allocInfo, pipe->descriptorSets)) != VK_SUCCESS)
+    {
+        slog("failed to allocate descriptor sets!");
+        if (r == VK_ERROR_OUT_OF_POOL_MEMORY)slog("out of pool memory");
+        else if (r == VK_ERROR_FRAGMENTED_POOL)slog("fragmented pool");
+        else if (r == VK_ERROR_OUT_OF_DEVICE_MEMORY)slog("out of device memory");
+        else if (r == VK_ERROR_OUT_OF_HOST_MEMORY)slog("out of host memory");
+    }
+    free(layouts);
+}
+
+void gf3d_pipeline_update_descriptor_sets(Pipeline *pipe)
+{
+    int i;
+    VkDescriptorBufferInfo bufferInfo = {0};
+    VkWriteDescriptorSet descriptorWrite = {0};
+
+    if ((!pipe)||(!pipe->uboList)||(!pipe->descriptorSets))return;
+    // each frame's ring buffer never changes, so its set is written once and every draw just supplies an offset
+    for (i = 0; i < pipe->descriptorSetCount; i++)
+    {
+        bufferInfo.buffer = gf3d_uniform_buffer_list_get_frame_buffer(pipe->uboList, i);
+        bufferInfo.offset = 0;
+        bufferInfo.range = pipe->uboList->bufferSize;
+
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = pipe->descriptorSets[i];
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(pipe->device, 1, &descriptorWrite, 0, NULL);
     }
-    slog("Number in loop 2");
 }
 
 void gf3d_pipeline_create_basic_model_descriptor_set_layout(Pipeline *pipe)
 {
     VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
     VkDescriptorSetLayoutBinding uboLayoutBinding = {0};
-    VkDescriptorSetLayoutBinding samplerLayoutBinding = {0};
-    
-    VkDescriptorSetLayoutBinding bindings[2];
-    
-    samplerLayoutBinding.binding = 1;
-    samplerLayoutBinding.descriptorCount = 1;
-    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    samplerLayoutBinding.pImmutableSamplers = NULL;
-    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    
-    memcpy(&bindings[1],&samplerLayoutBinding,sizeof(VkDescriptorSetLayoutBinding));
 
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;// offset into the frame's ring is given at bind time
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = NULL; // Optional
 
-    memcpy(&bindings[0],&uboLayoutBinding,sizeof(VkDescriptorSetLayoutBinding));
-
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 2;
-    layoutInfo.pBindings = bindings;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &uboLayoutBinding;
 
     if (vkCreateDescriptorSetLayout(pipe->device, &layoutInfo, NULL, &pipe->descriptorSetLayout) != VK_SUCCESS)
     {
@@ -630,12 +683,8 @@ VkDescriptorSet * gf3d_pipeline_get_descriptor_set(Pipeline *pipe, Uint32 frame)
         slog("frame %i us out of the range of descriptor pools, limited to %i",frame,gf3d_pipeline.chainLength);
         return NULL;
     }
-    if (pipe->descriptorCursor[frame] > pipe->descriptorSetCount)
-    {
-        slog("cannot allocate any more descriptor sets this frame!");
-        return NULL;
-    }
-    return &pipe->descriptorSets[frame][pipe->descriptorCursor[frame]++];
+    if (!pipe->descriptorSets)return NULL;
+    return &pipe->descriptorSets[frame];
 }
 
 /*eol@eof*/
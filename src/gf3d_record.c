@@ -0,0 +1,205 @@
+#include <string.h>
+
+#include "simple_logger.h"
+
+#include "gf3d_vgraphics.h"
+#include "gf3d_record.h"
+
+#define RECORD_SECONDARY_MAX        16  //pipelines one thread can draw with in a frame
+#define RECORD_DISPATCH_MIN         4   //fewer items than this are not worth waking the threads for
+#define RECORD_CHUNKS_PER_THREAD    4   //smaller chunks even out threads that get the expensive items
+
+typedef struct
+{
+    Uint32          index;                                      /**<1 based, 0 is the main thread*/
+    SDL_Thread     *thread;
+    SDL_sem        *start;                                      /**<posted when there is work to pick up*/
+    Command        *commandPools[GF3D_VGRAPHICS_FRAMES_IN_FLIGHT];
+}RecordThread;
+
+typedef struct
+{
+    RecordThread    threads[GF3D_RECORD_THREAD_MAX];
+    Uint32          threadCount;
+    SDL_TLSID       threadKey;                                  /**<holds the calling thread's index*/
+    SDL_TLSID       ownerKey;                                   /**<set on the thread that begins frames*/
+    SDL_sem        *done;                                       /**<posted by each thread once the work runs out*/
+    Uint32          frame;                                      /**<the frame in flight being recorded*/
+    Bool            dispatching;
+    Bool            quit;
+    RecordJob       job;
+    void           *data;
+    Uint32          count;
+    Uint32          chunk;
+    SDL_atomic_t    next;                                       /**<the first item not yet claimed*/
+}RecordManager;
+
+static RecordManager gf3d_record = {0};
+
+/**
+ * @brief claim chunks of the current job until there are none left
+ */
+static void gf3d_record_run_chunks()
+{
+    Uint32 start,end;
+    for (;;)
+    {
+        start = (Uint32)SDL_AtomicAdd(&gf3d_record.next,gf3d_record.chunk);
+        if (start >= gf3d_record.count)return;
+        end = MIN(start + gf3d_record.chunk,gf3d_record.count);
+        gf3d_record.job(gf3d_record.data,start,end);
+    }
+}
+
+static int gf3d_record_thread(void *data)
+{
+    RecordThread *thread = (RecordThread *)data;
+    SDL_TLSSet(gf3d_record.threadKey,(void *)(size_t)thread->index,NULL);
+    for (;;)
+    {
+        SDL_SemWait(thread->start);
+        if (gf3d_record.quit)break;
+        gf3d_record_run_chunks();
+        SDL_SemPost(gf3d_record.done);
+    }
+    return 0;
+}
+
+void gf3d_record_close()
+{
+    int i;
+    gf3d_record.quit = 1;
+    for (i = 0; i < gf3d_record.threadCount; i++)
+    {
+        SDL_SemPost(gf3d_record.threads[i].start);
+        SDL_WaitThread(gf3d_record.threads[i].thread,NULL);
+        SDL_DestroySemaphore(gf3d_record.threads[i].start);
+    }
+    if (gf3d_record.done)SDL_DestroySemaphore(gf3d_record.done);
+    // the command pools belong to the command system and are freed with it
+    memset(&gf3d_record,0,sizeof(RecordManager));
+    slog("recording threads closed");
+}
+
+/**
+ * @brief set up the command pools for one recording thread and start it
+ * @return 0 on error, 1 otherwise
+ */
+static Bool gf3d_record_thread_start(RecordThread *thread,Uint32 index)
+{
+    int i;
+    thread->index = index;
+    for (i = 0; i < GF3D_VGRAPHICS_FRAMES_IN_FLIGHT; i++)
+    {
+        // secondaries only, they are executed from the frame's primary
+        thread->commandPools[i] = gf3d_command_graphics_pool_setup(0);
+        if (!thread->commandPools[i])return 0;
+        if (!gf3d_command_pool_add_secondary_buffers(thread->commandPools[i],RECORD_SECONDARY_MAX))return 0;
+    }
+    thread->start = SDL_CreateSemaphore(0);
+    if (!thread->start)return 0;
+    thread->thread = SDL_CreateThread(gf3d_record_thread,"gf3d_record",thread);
+    if (!thread->thread)
+    {
+        SDL_DestroySemaphore(thread->start);
+        thread->start = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+void gf3d_record_init(Uint32 threadCount)
+{
+    int i;
+    if (!threadCount)
+    {
+        threadCount = SDL_GetCPUCount();
+        if (threadCount)threadCount--;// the main thread records too
+    }
+    if (threadCount > GF3D_RECORD_THREAD_MAX)threadCount = GF3D_RECORD_THREAD_MAX;
+    gf3d_record.threadKey = SDL_TLSCreate();
+    gf3d_record.ownerKey = SDL_TLSCreate();
+    gf3d_record.done = SDL_CreateSemaphore(0);
+    if (!gf3d_record.done)
+    {
+        slog("failed to create recording semaphore: %s",SDL_GetError());
+        threadCount = 0;
+    }
+    for (i = 0; i < threadCount; i++)
+    {
+        if (!gf3d_record_thread_start(&gf3d_record.threads[i],i + 1))
+        {
+            slog("failed to start recording thread %i, recording with %i",i + 1,i);
+            break;
+        }
+        gf3d_record.threadCount++;
+    }
+    slog("recording draws on %i threads",gf3d_record.threadCount + 1);
+    atexit(gf3d_record_close);
+}
+
+Uint32 gf3d_record_get_thread_count()
+{
+    return gf3d_record.threadCount;
+}
+
+Uint32 gf3d_record_get_thread()
+{
+    if (!gf3d_record.threadCount)return 0;
+    return (Uint32)(size_t)SDL_TLSGet(gf3d_record.threadKey);
+}
+
+Command *gf3d_record_get_command_pool()
+{
+    Uint32 thread = gf3d_record_get_thread();
+    if ((!thread)||(thread > gf3d_record.threadCount))return NULL;
+    return gf3d_record.threads[thread - 1].commandPools[gf3d_record.frame];
+}
+
+void gf3d_record_frame_begin(Uint32 frame)
+{
+    int i;
+    if (frame >= GF3D_VGRAPHICS_FRAMES_IN_FLIGHT)return;
+    SDL_TLSSet(gf3d_record.ownerKey,(void *)1,NULL);
+    gf3d_record.frame = frame;
+    for (i = 0; i < gf3d_record.threadCount; i++)
+    {
+        gf3d_command_pool_reset(gf3d_record.threads[i].commandPools[frame]);
+    }
+}
+
+void gf3d_record_dispatch(RecordJob job,void *data,Uint32 count)
+{
+    int i;
+    if ((!job)||(!count))return;
+    if ((!gf3d_record.threadCount)||(count < RECORD_DISPATCH_MIN)||(gf3d_record.dispatching)||(gf3d_record_get_thread()))
+    {
+        job(data,0,count);
+        return;
+    }
+    if (!SDL_TLSGet(gf3d_record.ownerKey))
+    {
+        // not the thread recording frames, so whatever job draws is captured rather than recorded
+        job(data,0,count);
+        return;
+    }
+    gf3d_record.dispatching = 1;
+    gf3d_record.job = job;
+    gf3d_record.data = data;
+    gf3d_record.count = count;
+    gf3d_record.chunk = count / ((gf3d_record.threadCount + 1) * RECORD_CHUNKS_PER_THREAD);
+    if (!gf3d_record.chunk)gf3d_record.chunk = 1;
+    SDL_AtomicSet(&gf3d_record.next,0);
+    for (i = 0; i < gf3d_record.threadCount; i++)
+    {
+        SDL_SemPost(gf3d_record.threads[i].start);
+    }
+    gf3d_record_run_chunks();
+    for (i = 0; i < gf3d_record.threadCount; i++)
+    {
+        SDL_SemWait(gf3d_record.done);
+    }
+    gf3d_record.dispatching = 0;
+}
+
+/*eol@eof*/
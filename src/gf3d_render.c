@@ -0,0 +1,732 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "simple_logger.h"
+
+#include "gf3d_vgraphics.h"
+#include "gf3d_camera.h"
+#include "gf3d_record.h"
+#include "gf2d_draw.h"
+#include "gf3d_render.h"
+
+#define RENDER_FRAME_COUNT      2       //one frame being written while the one before it is drawn
+#define RENDER_QUEUE_SIZE       4       //power of two, room for every frame and the quit sentinel
+#define RENDER_DATA_START       (64 * 1024)
+#define RENDER_PACKETS_START    256
+#define RENDER_FREES_START      16
+#define RENDER_ALIGN(n)         (((n) + 15) & ~((size_t)15))
+
+typedef enum
+{
+    RPT_Instanced = 0,
+    RPT_Highlight,
+    RPT_Sky,
+    RPT_Particle,
+    RPT_Bundle,
+    RPT_Sprite,                 //2D from here on, replayed in order on the render thread
+    RPT_Rect,
+    RPT_Text,
+    RPT_TextWrap
+}RenderPacketType;
+
+typedef struct
+{
+    Uint32          type;
+    Uint32          size;       /**<bytes to the next packet, this header included*/
+}RenderPacketHeader;
+
+typedef struct
+{
+    RenderPacketHeader header;
+    Model          *model;
+    Vector4D        ambient;
+    Uint32          count;      /**<the instances follow the packet*/
+}RenderPacketInstanced;
+
+typedef struct
+{
+    RenderPacketHeader header;
+    Model          *model;
+    Matrix4         modelMat;
+    Vector4D        highlight;
+}RenderPacketHighlight;
+
+typedef struct
+{
+    RenderPacketHeader header;
+    Model          *model;
+    Matrix4         modelMat;
+    Color           color;
+}RenderPacketSky;
+
+typedef struct
+{
+    RenderPacketHeader header;
+    Particle        particle;
+}RenderPacketParticle;
+
+typedef struct
+{
+    RenderPacketHeader header;
+    Bundle         *bundle;
+}RenderPacketBundle;
+
+typedef struct
+{
+    RenderPacketHeader header;
+    Sprite         *sprite;
+    Vector2D        position;
+    Vector2D        scale;
+    Vector3D        rotation;
+    Color           color;
+    Uint32          frame;
+}RenderPacketSprite;
+
+typedef struct
+{
+    RenderPacketHeader header;
+    Rect            rect;
+    Color           color;
+    Bool            filled;
+}RenderPacketRect;
+
+typedef struct
+{
+    RenderPacketHeader header;
+    Font           *font;
+    Color           color;
+    Vector2D        position;   /**<the text follows the packet*/
+}RenderPacketText;
+
+typedef struct
+{
+    RenderPacketHeader header;
+    Font           *font;
+    Color           color;
+    Rect            block;      /**<the text follows the packet*/
+}RenderPacketTextWrap;
+
+/**
+ * @purpose a resource released by the simulation that a captured frame may still draw with
+ */
+typedef struct
+{
+    RenderFreeFunc  freeFunc;
+    void           *data;
+}RenderFree;
+
+/**
+ * @purpose a list of releases waiting on frames to be drawn
+ */
+typedef struct
+{
+    RenderFree     *items;
+    Uint32          count;
+    Uint32          max;
+}RenderFreeList;
+
+/**
+ * @purpose every draw the simulation made in one frame, and the view it made them with
+ */
+typedef struct
+{
+    Uint8          *data;
+    size_t          used;
+    size_t          size;
+    Uint32         *packets;    /**<offset of each packet in data, in the order written*/
+    Uint32          packetCount;
+    Uint32          packetMax;
+    Matrix4         view;
+    Frustum         frustum;
+    Vector3D        eye;
+    RenderFreeList  frees;      /**<released while this frame was written, run once it has been drawn*/
+}RenderFrame;
+
+/**
+ * @purpose a single producer single consumer ring of frames
+ */
+typedef struct
+{
+    RenderFrame    *items[RENDER_QUEUE_SIZE];
+    SDL_atomic_t    head;       /**<only written by the producer*/
+    SDL_atomic_t    tail;       /**<only written by the consumer*/
+    SDL_sem        *ready;      /**<counts items pushed, only used to sleep on while the ring is empty*/
+}RenderQueue;
+
+/**
+ * @purpose a run of 3D packets handed to the recording threads
+ */
+typedef struct
+{
+    RenderFrame    *frame;
+    Uint32          first;
+}RenderRun;
+
+typedef struct
+{
+    SDL_Thread     *thread;     /**<NULL when frames are rendered directly*/
+    SDL_threadID    simThread;  /**<draws from this thread are captured*/
+    RenderFrame     frames[RENDER_FRAME_COUNT];
+    RenderQueue     filled;     /**<written frames waiting to be drawn*/
+    RenderQueue     free;       /**<drawn frames waiting to be written*/
+    RenderFrame    *writing;    /**<the frame the simulation thread is writing, if any*/
+    RenderFrame    *drawing;    /**<the frame the render thread is drawing, if any*/
+    RenderFreeList  pending;    /**<released between frames, handed to the next frame written*/
+}RenderManager;
+
+static RenderManager gf3d_render = {0};
+
+static Bool gf3d_render_queue_create(RenderQueue *queue)
+{
+    memset(queue,0,sizeof(RenderQueue));
+    queue->ready = SDL_CreateSemaphore(0);
+    return queue->ready != NULL;
+}
+
+static void gf3d_render_queue_destroy(RenderQueue *queue)
+{
+    if (queue->ready)SDL_DestroySemaphore(queue->ready);
+    memset(queue,0,sizeof(RenderQueue));
+}
+
+static void gf3d_render_queue_push(RenderQueue *queue,RenderFrame *frame)
+{
+    int head = SDL_AtomicGet(&queue->head);
+    queue->items[head & (RENDER_QUEUE_SIZE - 1)] = frame;
+    // the item has to be in its slot before the consumer can see the new head
+    SDL_AtomicSet(&queue->head,head + 1);
+    SDL_SemPost(queue->ready);
+}
+
+static RenderFrame *gf3d_render_queue_pop(RenderQueue *queue)
+{
+    RenderFrame *frame;
+    int tail;
+    SDL_SemWait(queue->ready);
+    tail = SDL_AtomicGet(&queue->tail);
+    frame = queue->items[tail & (RENDER_QUEUE_SIZE - 1)];
+    SDL_AtomicSet(&queue->tail,tail + 1);
+    return frame;
+}
+
+static Bool gf3d_render_free_list_add(RenderFreeList *list,RenderFreeFunc freeFunc,void *data)
+{
+    RenderFree *items;
+    Uint32 max;
+    if (list->count >= list->max)
+    {
+        max = list->max ? list->max * 2 : RENDER_FREES_START;
+        items = (RenderFree *)realloc(list->items,sizeof(RenderFree) * max);
+        if (!items)return 0;
+        list->items = items;
+        list->max = max;
+    }
+    list->items[list->count].freeFunc = freeFunc;
+    list->items[list->count].data = data;
+    list->count++;
+    return 1;
+}
+
+/**
+ * @brief run every release in a list, on the simulation thread, once nothing still queued can draw with them
+ */
+static void gf3d_render_free_list_run(RenderFreeList *list)
+{
+    Uint32 i;
+    for (i = 0; i < list->count; i++)
+    {
+        list->items[i].freeFunc(list->items[i].data);
+    }
+    list->count = 0;
+}
+
+static void gf3d_render_free_list_destroy(RenderFreeList *list)
+{
+    if (list->items)free(list->items);
+    memset(list,0,sizeof(RenderFreeList));
+}
+
+static Bool gf3d_render_packet_is_3d(Uint32 type)
+{
+    return type < RPT_Sprite;
+}
+
+/**
+ * @brief draw one packet with the regular draw calls, they record directly off the simulation thread
+ */
+static void gf3d_render_packet_replay(RenderPacketHeader *header)
+{
+    RenderPacketInstanced *instanced;
+    RenderPacketHighlight *highlight;
+    RenderPacketSky *sky;
+    RenderPacketSprite *sprite;
+    RenderPacketRect *rect;
+    RenderPacketText *text;
+    RenderPacketTextWrap *wrap;
+    switch (header->type)
+    {
+        case RPT_Instanced:
+            instanced = (RenderPacketInstanced *)header;
+            gf3d_model_draw_instanced(
+                instanced->model,
+                (MeshInstance *)((Uint8 *)header + RENDER_ALIGN(sizeof(RenderPacketInstanced))),
+                instanced->count,
+                instanced->ambient);
+            break;
+        case RPT_Highlight:
+            highlight = (RenderPacketHighlight *)header;
+            gf3d_model_draw_highlight(highlight->model,highlight->modelMat,highlight->highlight);
+            break;
+        case RPT_Sky:
+            sky = (RenderPacketSky *)header;
+            gf3d_model_draw_sky(sky->model,sky->modelMat,sky->color);
+            break;
+        case RPT_Particle:
+            gf3d_particle_draw(&((RenderPacketParticle *)header)->particle);
+            break;
+        case RPT_Bundle:
+            gf3d_bundle_draw(((RenderPacketBundle *)header)->bundle);
+            break;
+        case RPT_Sprite:
+            sprite = (RenderPacketSprite *)header;
+            gf2d_sprite_draw(sprite->sprite,sprite->position,sprite->scale,sprite->rotation,sprite->color,sprite->frame);
+            break;
+        case RPT_Rect:
+            rect = (RenderPacketRect *)header;
+            if (rect->filled)gf2d_draw_rect_filled(rect->rect,rect->color);
+            else gf2d_draw_rect(rect->rect,rect->color);
+            break;
+        case RPT_Text:
+            text = (RenderPacketText *)header;
+            gf2d_font_draw_line(
+                (char *)header + RENDER_ALIGN(sizeof(RenderPacketText)),
+                text->font,
+                text->color,
+                text->position);
+            break;
+        case RPT_TextWrap:
+            wrap = (RenderPacketTextWrap *)header;
+            gf2d_font_draw_text_wrap(
+                (char *)header + RENDER_ALIGN(sizeof(RenderPacketTextWrap)),
+                wrap->block,
+                wrap->color,
+                wrap->font);
+            break;
+        default:
+            slog("unknown render packet type %i",header->type);
+            break;
+    }
+}
+
+static void gf3d_render_replay_job(void *data,Uint32 start,Uint32 end)
+{
+    RenderRun *run = (RenderRun *)data;
+    Uint32 i;
+    for (i = run->first + start; i < run->first + end; i++)
+    {
+        gf3d_render_packet_replay((RenderPacketHeader *)(run->frame->data + run->frame->packets[i]));
+    }
+}
+
+/**
+ * @brief record every packet of a frame and submit it
+ */
+static void gf3d_render_frame_draw(RenderFrame *frame)
+{
+    RenderPacketHeader *header;
+    RenderRun run;
+    Uint32 i,end;
+    gf3d_render.drawing = frame;
+    gfc_matrix_copy(*gf3d_vgraphics_get_view_matrix(),frame->view);
+    gf2d_font_update();
+    gf3d_vgraphics_render_start();
+    run.frame = frame;
+    for (i = 0; i < frame->packetCount; i = end)
+    {
+        header = (RenderPacketHeader *)(frame->data + frame->packets[i]);
+        if (!gf3d_render_packet_is_3d(header->type))
+        {
+            gf3d_render_packet_replay(header);
+            end = i + 1;
+            continue;
+        }
+        // the 3D draws between two 2D draws can land in any order, each pipeline depth tests its own
+        for (end = i + 1; end < frame->packetCount; end++)
+        {
+            header = (RenderPacketHeader *)(frame->data + frame->packets[end]);
+            if (!gf3d_render_packet_is_3d(header->type))break;
+        }
+        run.first = i;
+        gf3d_record_dispatch(gf3d_render_replay_job,&run,end - i);
+    }
+    gf3d_vgraphics_render_end();
+    // the frame goes back to the free queue, the frustum and eye come from the camera again
+    gf3d_render.drawing = NULL;
+}
+
+static int gf3d_render_thread(void *data)
+{
+    RenderFrame *frame;
+    for (;;)
+    {
+        frame = gf3d_render_queue_pop(&gf3d_render.filled);
+        if (!frame)break;// asked to quit
+        gf3d_render_frame_draw(frame);
+        gf3d_render_queue_push(&gf3d_render.free,frame);
+    }
+    return 0;
+}
+
+void gf3d_render_close()
+{
+    int i;
+    if (gf3d_render.thread)
+    {
+        if (gf3d_render.writing)gf3d_render_frame_end();
+        // frames already handed off are drawn before the thread sees the sentinel
+        gf3d_render_queue_push(&gf3d_render.filled,NULL);
+        SDL_WaitThread(gf3d_render.thread,NULL);
+    }
+    gf3d_render_queue_destroy(&gf3d_render.filled);
+    gf3d_render_queue_destroy(&gf3d_render.free);
+    // every frame has been drawn, so whatever was released can go before the systems that own it close
+    for (i = 0; i < RENDER_FRAME_COUNT; i++)
+    {
+        gf3d_render_free_list_run(&gf3d_render.frames[i].frees);
+        gf3d_render_free_list_destroy(&gf3d_render.frames[i].frees);
+        if (gf3d_render.frames[i].data)free(gf3d_render.frames[i].data);
+        if (gf3d_render.frames[i].packets)free(gf3d_render.frames[i].packets);
+    }
+    gf3d_render_free_list_run(&gf3d_render.pending);
+    gf3d_render_free_list_destroy(&gf3d_render.pending);
+    memset(&gf3d_render,0,sizeof(RenderManager));
+    slog("render thread closed");
+}
+
+/**
+ * @brief allocate the packet buffers and queues and start the render thread
+ * @return 0 on error, 1 otherwise
+ */
+static Bool gf3d_render_thread_start()
+{
+    int i;
+    if ((!gf3d_render_queue_create(&gf3d_render.filled))||(!gf3d_render_queue_create(&gf3d_render.free)))
+    {
+        slog("failed to create render queue: %s",SDL_GetError());
+        return 0;
+    }
+    for (i = 0; i < RENDER_FRAME_COUNT; i++)
+    {
+        gf3d_render.frames[i].data = (Uint8 *)malloc(RENDER_DATA_START);
+        gf3d_render.frames[i].packets = (Uint32 *)gfc_allocate_array(sizeof(Uint32),RENDER_PACKETS_START);
+        if ((!gf3d_render.frames[i].data)||(!gf3d_render.frames[i].packets))
+        {
+            slog("failed to allocate render packet buffers");
+            return 0;
+        }
+        gf3d_render.frames[i].size = RENDER_DATA_START;
+        gf3d_render.frames[i].packetMax = RENDER_PACKETS_START;
+        gf3d_render_queue_push(&gf3d_render.free,&gf3d_render.frames[i]);
+    }
+    gf3d_render.thread = SDL_CreateThread(gf3d_render_thread,"gf3d_render",NULL);
+    if (!gf3d_render.thread)
+    {
+        slog("failed to start render thread: %s",SDL_GetError());
+        return 0;
+    }
+    return 1;
+}
+
+void gf3d_render_init(Bool threaded)
+{
+    gf3d_render.simThread = SDL_ThreadID();
+    if ((threaded)&&(!gf3d_render_thread_start()))
+    {
+        slog("rendering frames directly");
+    }
+    if (gf3d_render.thread)slog("rendering frames on their own thread");
+    atexit(gf3d_render_close);
+}
+
+Bool gf3d_render_is_threaded()
+{
+    return gf3d_render.thread != NULL;
+}
+
+void gf3d_render_frame_begin()
+{
+    Uint32 i;
+    RenderFrame *frame;
+    if (!gf3d_render.thread)
+    {
+        gf3d_camera_get_view_mat4(gf3d_vgraphics_get_view_matrix());
+        gf2d_font_update();
+        gf3d_vgraphics_render_start();
+        return;
+    }
+    if (gf3d_render.writing)
+    {
+        slog("render frame already begun");
+        return;
+    }
+    frame = gf3d_render_queue_pop(&gf3d_render.free);
+    // the frame has been drawn, and every frame before it, so nothing queued can still reference these
+    gf3d_render_free_list_run(&frame->frees);
+    frame->used = 0;
+    frame->packetCount = 0;
+    gf3d_camera_get_view_mat4(&frame->view);
+    memcpy(&frame->frustum,gf3d_camera_get_frustum(),sizeof(Frustum));
+    frame->eye = gf3d_camera_get_eye_position();
+    gf3d_render.writing = frame;
+    // released while no frame was open, the frame last handed off may still draw with them
+    for (i = 0; i < gf3d_render.pending.count; i++)
+    {
+        if (!gf3d_render_free_list_add(&frame->frees,gf3d_render.pending.items[i].freeFunc,gf3d_render.pending.items[i].data))
+        {
+            slog("failed to defer a render resource release, it is leaked");
+        }
+    }
+    gf3d_render.pending.count = 0;
+}
+
+void gf3d_render_frame_end()
+{
+    RenderFrame *frame;
+    if (!gf3d_render.thread)
+    {
+        gf3d_vgraphics_render_end();
+        return;
+    }
+    frame = gf3d_render.writing;
+    if (!frame)return;
+    gf3d_render.writing = NULL;
+    gf3d_render_queue_push(&gf3d_render.filled,frame);
+}
+
+void gf3d_render_wait_idle()
+{
+    RenderFrame *frames[RENDER_FRAME_COUNT];
+    int i,count;
+    if (!gf3d_render.thread)return;
+    // every frame not being written comes back to the free queue once it is drawn
+    count = RENDER_FRAME_COUNT - (gf3d_render.writing ? 1 : 0);
+    for (i = 0; i < count; i++)
+    {
+        frames[i] = gf3d_render_queue_pop(&gf3d_render.free);
+    }
+    for (i = 0; i < count; i++)
+    {
+        gf3d_render_queue_push(&gf3d_render.free,frames[i]);
+    }
+}
+
+Frustum *gf3d_render_get_frustum()
+{
+    if (gf3d_render.drawing)return &gf3d_render.drawing->frustum;
+    return gf3d_camera_get_frustum();
+}
+
+Vector3D gf3d_render_get_eye_position()
+{
+    if (gf3d_render.drawing)return gf3d_render.drawing->eye;
+    return gf3d_camera_get_eye_position();
+}
+
+/**
+ * @brief check if a draw call should be written to the frame instead of recorded
+ */
+static Bool gf3d_render_capturing()
+{
+    if (!gf3d_render.thread)return 0;
+    return SDL_ThreadID() == gf3d_render.simThread;
+}
+
+Bool gf3d_render_defer_free(RenderFreeFunc freeFunc,void *data)
+{
+    RenderFreeList *list;
+    if ((!freeFunc)||(!data))return 0;
+    if (!gf3d_render_capturing())return 0;
+    // the frame being written may already hold draws of it, so it waits on that frame, otherwise on the next one
+    list = gf3d_render.writing ? &gf3d_render.writing->frees : &gf3d_render.pending;
+    if (!gf3d_render_free_list_add(list,freeFunc,data))
+    {
+        slog("failed to defer a render resource release, it is leaked");
+    }
+    return 1;
+}
+
+/**
+ * @brief reserve space for a packet at the end of the frame being written
+ * @param type the RenderPacketType
+ * @param size bytes needed, the packet struct and anything after it
+ * @return NULL on error, the packet with its header filled in otherwise
+ */
+static void *gf3d_render_packet_new(Uint32 type,size_t size)
+{
+    RenderFrame *frame = gf3d_render.writing;
+    RenderPacketHeader *header;
+    Uint8 *data;
+    Uint32 *packets;
+    size_t newSize;
+    if (!frame)
+    {
+        slog("cannot draw outside of gf3d_render_frame_begin and gf3d_render_frame_end");
+        return NULL;
+    }
+    size = RENDER_ALIGN(size);
+    if (frame->used + size > frame->size)
+    {
+        for (newSize = frame->size * 2; newSize < frame->used + size; newSize *= 2);
+        data = (Uint8 *)realloc(frame->data,newSize);
+        if (!data)
+        {
+            slog("failed to grow render packet buffer to %i bytes",(int)newSize);
+            return NULL;
+        }
+        frame->data = data;
+        frame->size = newSize;
+    }
+    if (frame->packetCount >= frame->packetMax)
+    {
+        packets = (Uint32 *)realloc(frame->packets,sizeof(Uint32) * frame->packetMax * 2);
+        if (!packets)
+        {
+            slog("failed to grow render packet list");
+            return NULL;
+        }
+        frame->packets = packets;
+        frame->packetMax *= 2;
+    }
+    header = (RenderPacketHeader *)(frame->data + frame->used);
+    header->type = type;
+    header->size = (Uint32)size;
+    frame->packets[frame->packetCount++] = (Uint32)frame->used;
+    frame->used += size;
+    return header;
+}
+
+Bool gf3d_render_capture_instanced(Model *model,MeshInstance *instances,Uint32 count,Vector4D ambient)
+{
+    RenderPacketInstanced *packet;
+    if (!gf3d_render_capturing())return 0;
+    if ((!model)||(!instances)||(!count))return 0;
+    packet = gf3d_render_packet_new(RPT_Instanced,RENDER_ALIGN(sizeof(RenderPacketInstanced)) + sizeof(MeshInstance) * count);
+    if (!packet)return 1;
+    packet->model = model;
+    vector4d_copy(packet->ambient,ambient);
+    packet->count = count;
+    memcpy((Uint8 *)packet + RENDER_ALIGN(sizeof(RenderPacketInstanced)),instances,sizeof(MeshInstance) * count);
+    return 1;
+}
+
+Bool gf3d_render_capture_highlight(Model *model,Matrix4 modelMat,Vector4D highlight)
+{
+    RenderPacketHighlight *packet;
+    if (!gf3d_render_capturing())return 0;
+    if (!model)return 0;
+    packet = gf3d_render_packet_new(RPT_Highlight,sizeof(RenderPacketHighlight));
+    if (!packet)return 1;
+    packet->model = model;
+    gfc_matrix_copy(packet->modelMat,modelMat);
+    vector4d_copy(packet->highlight,highlight);
+    return 1;
+}
+
+Bool gf3d_render_capture_sky(Model *model,Matrix4 modelMat,Color color)
+{
+    RenderPacketSky *packet;
+    if (!gf3d_render_capturing())return 0;
+    if (!model)return 0;
+    packet = gf3d_render_packet_new(RPT_Sky,sizeof(RenderPacketSky));
+    if (!packet)return 1;
+    packet->model = model;
+    gfc_matrix_copy(packet->modelMat,modelMat);
+    packet->color = color;
+    return 1;
+}
+
+Bool gf3d_render_capture_particle(Particle *particle)
+{
+    RenderPacketParticle *packet;
+    if (!gf3d_render_capturing())return 0;
+    if (!particle)return 0;
+    packet = gf3d_render_packet_new(RPT_Particle,sizeof(RenderPacketParticle));
+    if (!packet)return 1;
+    packet->particle = *particle;
+    return 1;
+}
+
+Bool gf3d_render_capture_bundle(Bundle *bundle)
+{
+    RenderPacketBundle *packet;
+    if (!gf3d_render_capturing())return 0;
+    if (!bundle)return 0;
+    packet = gf3d_render_packet_new(RPT_Bundle,sizeof(RenderPacketBundle));
+    if (!packet)return 1;
+    packet->bundle = bundle;
+    return 1;
+}
+
+Bool gf3d_render_capture_sprite(Sprite *sprite,Vector2D position,Vector2D scale,Vector3D rotation,Color color,Uint32 frame)
+{
+    RenderPacketSprite *packet;
+    if (!gf3d_render_capturing())return 0;
+    if (!sprite)return 0;
+    packet = gf3d_render_packet_new(RPT_Sprite,sizeof(RenderPacketSprite));
+    if (!packet)return 1;
+    packet->sprite = sprite;
+    packet->position = position;
+    packet->scale = scale;
+    packet->rotation = rotation;
+    packet->color = color;
+    packet->frame = frame;
+    return 1;
+}
+
+Bool gf3d_render_capture_rect(Rect rect,Color color,Bool filled)
+{
+    RenderPacketRect *packet;
+    if (!gf3d_render_capturing())return 0;
+    packet = gf3d_render_packet_new(RPT_Rect,sizeof(RenderPacketRect));
+    if (!packet)return 1;
+    packet->rect = rect;
+    packet->color = color;
+    packet->filled = filled;
+    return 1;
+}
+
+Bool gf3d_render_capture_text(char *text,Font *font,Color color,Vector2D position)
+{
+    RenderPacketText *packet;
+    size_t length;
+    if (!gf3d_render_capturing())return 0;
+    if ((!text)||(!font))return 0;
+    length = strlen(text) + 1;
+    packet = gf3d_render_packet_new(RPT_Text,RENDER_ALIGN(sizeof(RenderPacketText)) + length);
+    if (!packet)return 1;
+    packet->font = font;
+    packet->color = color;
+    packet->position = position;
+    memcpy((char *)packet + RENDER_ALIGN(sizeof(RenderPacketText)),text,length);
+    return 1;
+}
+
+Bool gf3d_render_capture_text_wrap(char *text,Rect block,Color color,Font *font)
+{
+    RenderPacketTextWrap *packet;
+    size_t length;
+    if (!gf3d_render_capturing())return 0;
+    if ((!text)||(!font))return 0;
+    length = strlen(text) + 1;
+    packet = gf3d_render_packet_new(RPT_TextWrap,RENDER_ALIGN(sizeof(RenderPacketTextWrap)) + length);
+    if (!packet)return 1;
+    packet->font = font;
+    packet->color = color;
+    packet->block = block;
+    memcpy((char *)packet + RENDER_ALIGN(sizeof(RenderPacketTextWrap)),text,length);
+    return 1;
+}
+
+/*eol@eof*/
@@ -11,6 +11,10 @@
 typedef struct
 {
     VkDevice                    device;
+    VkPhysicalDevice            physicalDevice;
+    VkSurfaceKHR                surface;
+    Uint32                      requestedWidth;         /**<the resolution asked for at init, clamped again on every rebuild*/
+    Uint32                      requestedHeight;
     VkSurfaceCapabilitiesKHR    capabilities;
     Uint32                      formatCount;
     VkSurfaceFormatKHR         *formats;
@@ -27,19 +31,18 @@ typedef struct
     VkFramebuffer              *frameBuffers;
     Uint32                      framebufferCount;
     VkImage                     depthImage;
-    VkDeviceMemory              depthImageMemory;
+    MemoryAllocation            depthImageMemory;
     VkImageView                 depthImageView;
 }vSwapChain;
 
 static vSwapChain gf3d_swapchain = {0};
 
-void gf3d_swapchain_create(VkDevice device,VkSurfaceKHR surface);
+Bool gf3d_swapchain_create(VkDevice device,VkSurfaceKHR surface);
 void gf3d_swapchain_close();
 int gf3d_swapchain_choose_format();
 void gf3d_swapchain_create_depth_image();
 int gf3d_swapchain_get_presentation_mode();
 VkExtent2D gf3d_swapchain_configure_extent(Uint32 width,Uint32 height);
-uint32_t gf3d_swapchain_find_Memory_type(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
 void gf3d_swapchain_init(VkPhysicalDevice device,VkDevice logicalDevice,VkSurfaceKHR surface,Uint32 width,Uint32 height)
 {
@@ -84,13 +87,17 @@ void gf3d_swapchain_init(VkPhysicalDevice device,VkDevice logicalDevice,VkSurfac
     gf3d_swapchain.extent = gf3d_swapchain_configure_extent(width,height);
     slog("chosing swap chain extent of (%i,%i)",gf3d_swapchain.extent.width,gf3d_swapchain.extent.height);
     
-    gf3d_swapchain_create(logicalDevice,surface);
     gf3d_swapchain.device = logicalDevice;
+    gf3d_swapchain.physicalDevice = device;
+    gf3d_swapchain.surface = surface;
+    gf3d_swapchain.requestedWidth = width;
+    gf3d_swapchain.requestedHeight = height;
+    gf3d_swapchain_create(logicalDevice,surface);
     
     atexit(gf3d_swapchain_close);
 }
 
-void gf3d_swapchain_create_frame_buffer(VkFramebuffer *buffer,VkImageView *imageView,Pipeline *pipe)
+void gf3d_swapchain_create_frame_buffer(VkFramebuffer *buffer,VkImageView *imageView,VkRenderPass renderPass)
 {
     VkFramebufferCreateInfo framebufferInfo = {0};
     VkImageView imageViews[2];
@@ -99,7 +106,7 @@ void gf3d_swapchain_create_frame_buffer(VkFramebuffer *buffer,VkImageView *image
     imageViews[1] = gf3d_swapchain.depthImageView;
 
     framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    framebufferInfo.renderPass = pipe->renderPass;
+    framebufferInfo.renderPass = renderPass;
     framebufferInfo.attachmentCount = 2;
     framebufferInfo.pAttachments = imageViews;
     framebufferInfo.width = gf3d_swapchain.extent.width;
@@ -116,13 +123,13 @@ void gf3d_swapchain_create_frame_buffer(VkFramebuffer *buffer,VkImageView *image
     }
 }
 
-void gf3d_swapchain_setup_frame_buffers(Pipeline *pipe)
+void gf3d_swapchain_setup_frame_buffers(VkRenderPass renderPass)
 {
     int i;
     gf3d_swapchain.frameBuffers = (VkFramebuffer *)gfc_allocate_array(sizeof(VkFramebuffer),gf3d_swapchain.swapImageCount);
     for (i = 0; i < gf3d_swapchain.swapImageCount;i++)
     {
-        gf3d_swapchain_create_frame_buffer(&gf3d_swapchain.frameBuffers[i],&gf3d_swapchain.imageViews[i],pipe);
+        gf3d_swapchain_create_frame_buffer(&gf3d_swapchain.frameBuffers[i],&gf3d_swapchain.imageViews[i],renderPass);
     }
     gf3d_swapchain.framebufferCount = gf3d_swapchain.swapImageCount;
 }
@@ -132,9 +139,10 @@ VkFormat gf3d_swapchain_get_format()
     return gf3d_swapchain.formats[gf3d_swapchain.chosenFormat].format;
 }
 
-void gf3d_swapchain_create(VkDevice device,VkSurfaceKHR surface)
+Bool gf3d_swapchain_create(VkDevice device,VkSurfaceKHR surface)
 {
     int i;
+    VkSwapchainKHR oldSwapChain;
     Sint32 graphicsFamily;
     Sint32 presentFamily;
     Sint32 transferFamily;
@@ -179,14 +187,23 @@ void gf3d_swapchain_create(VkDevice device,VkSurfaceKHR surface)
     createInfo.presentMode = gf3d_swapchain.presentModes[gf3d_swapchain.chosenPresentMode];
     createInfo.clipped = VK_TRUE;
     
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    // when rebuilding, the old chain is retired by this call whether or not it succeeds
+    oldSwapChain = gf3d_swapchain.swapChain;
+    createInfo.oldSwapchain = oldSwapChain;
     
     if (vkCreateSwapchainKHR(device, &createInfo, NULL, &gf3d_swapchain.swapChain) != VK_SUCCESS)
     {
         slog("failed to create swap chain!");
+        if (oldSwapChain != VK_NULL_HANDLE)
+        {
+            vkDestroySwapchainKHR(device, oldSwapChain, NULL);
+            gf3d_swapchain.swapChain = VK_NULL_HANDLE;
+            return false;
+        }
         gf3d_swapchain_close();
-        return;
+        return false;
     }
+    if (oldSwapChain != VK_NULL_HANDLE)vkDestroySwapchainKHR(device, oldSwapChain, NULL);
     slog("created a swap chain with length %i",gf3d_swapchain.swapChainCount);
     
     vkGetSwapchainImagesKHR(device, gf3d_swapchain.swapChain, &gf3d_swapchain.swapImageCount, NULL);
@@ -194,7 +211,7 @@ void gf3d_swapchain_create(VkDevice device,VkSurfaceKHR surface)
     {
         slog("failed to create any swap images!");
         gf3d_swapchain_close();
-        return;
+        return false;
     }
     gf3d_swapchain.swapImages = (VkImage *)gfc_allocate_array(sizeof(VkImage),gf3d_swapchain.swapImageCount);
     vkGetSwapchainImagesKHR(device, gf3d_swapchain.swapChain, &gf3d_swapchain.swapImageCount,gf3d_swapchain.swapImages );
@@ -206,6 +223,7 @@ void gf3d_swapchain_create(VkDevice device,VkSurfaceKHR surface)
         gf3d_swapchain.imageViews[i] = gf3d_vgraphics_create_image_view(gf3d_swapchain.swapImages[i],gf3d_swapchain.formats[gf3d_swapchain.chosenFormat].format);
     }
     slog("create image views");
+    return true;
 }
 
 VkExtent2D gf3d_swapchain_configure_extent(Uint32 width,Uint32 height)
@@ -253,11 +271,12 @@ int gf3d_swapchain_choose_format()
     return chosen;
 }
 
-void gf3d_swapchain_close()
+/**
+ * @brief destroy everything made from the swap chain's images, leaving the chain itself and the surface queries
+ */
+static void gf3d_swapchain_images_close()
 {
     int i;
-    slog("cleaning up swapchain");
-    
     if (gf3d_swapchain.depthImageView != VK_NULL_HANDLE)
     {
         vkDestroyImageView(gf3d_swapchain.device, gf3d_swapchain.depthImageView, NULL);
@@ -266,10 +285,7 @@ void gf3d_swapchain_close()
     {
         vkDestroyImage(gf3d_swapchain.device, gf3d_swapchain.depthImage, NULL);
     }
-    if (gf3d_swapchain.depthImageMemory != VK_NULL_HANDLE)
-    {
-        vkFreeMemory(gf3d_swapchain.device, gf3d_swapchain.depthImageMemory, NULL);
-    }
+    gf3d_memory_free(&gf3d_swapchain.depthImageMemory);
     if (gf3d_swapchain.frameBuffers)
     {
         for (i = 0;i < gf3d_swapchain.framebufferCount; i++)
@@ -278,8 +294,9 @@ void gf3d_swapchain_close()
             slog("framebuffer destroyed");
         }
         free (gf3d_swapchain.frameBuffers);
+        gf3d_swapchain.frameBuffers = NULL;
     }
-    vkDestroySwapchainKHR(gf3d_swapchain.device, gf3d_swapchain.swapChain, NULL);
+    gf3d_swapchain.framebufferCount = 0;
     if (gf3d_swapchain.imageViews)
     {
         for (i = 0;i < gf3d_swapchain.swapImageCount;i++)
@@ -288,10 +305,43 @@ void gf3d_swapchain_close()
             slog("imageview destroyed");
         }
         free(gf3d_swapchain.imageViews);
+        gf3d_swapchain.imageViews = NULL;
     }
     if (gf3d_swapchain.swapImages)
     {
         free(gf3d_swapchain.swapImages);
+        gf3d_swapchain.swapImages = NULL;
+    }
+    gf3d_swapchain.swapImageCount = 0;
+    gf3d_swapchain.depthImage = VK_NULL_HANDLE;
+    gf3d_swapchain.depthImageView = VK_NULL_HANDLE;
+}
+
+Bool gf3d_swapchain_recreate(VkRenderPass renderPass)
+{
+    VkExtent2D extent;
+    if (!gf3d_swapchain.device)return false;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(gf3d_swapchain.physicalDevice, gf3d_swapchain.surface, &gf3d_swapchain.capabilities);
+    // a minimized window has no area to present to, keep the old chain until it comes back
+    extent = gf3d_swapchain.capabilities.currentExtent;
+    if ((extent.width == 0)||(extent.height == 0))return false;
+    gf3d_swapchain_images_close();
+    gf3d_swapchain.extent = gf3d_swapchain_configure_extent(gf3d_swapchain.requestedWidth,gf3d_swapchain.requestedHeight);
+    if (!gf3d_swapchain_create(gf3d_swapchain.device,gf3d_swapchain.surface))return false;
+    gf3d_swapchain_create_depth_image();
+    gf3d_swapchain_setup_frame_buffers(renderPass);
+    slog("rebuilt swap chain at (%i,%i)",gf3d_swapchain.extent.width,gf3d_swapchain.extent.height);
+    return true;
+}
+
+void gf3d_swapchain_close()
+{
+    slog("cleaning up swapchain");
+    
+    gf3d_swapchain_images_close();
+    if (gf3d_swapchain.swapChain != VK_NULL_HANDLE)
+    {
+        vkDestroySwapchainKHR(gf3d_swapchain.device, gf3d_swapchain.swapChain, NULL);
     }
     if (gf3d_swapchain.formats)
     {
@@ -464,30 +514,9 @@ void gf3d_swapchain_create_depth_image()
     gf3d_swapchain_transition_image_layout(gf3d_swapchain.depthImage, gf3d_pipeline_find_depth_format(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 }
 
-uint32_t gf3d_swapchain_find_Memory_type(uint32_t typeFilter, VkMemoryPropertyFlags properties)
-{
-    uint32_t i;
-    VkPhysicalDeviceMemoryProperties memProperties;
-    
-    vkGetPhysicalDeviceMemoryProperties(gf3d_vgraphics_get_default_physical_device(), &memProperties);
-
-    for (i= 0; i < memProperties.memoryTypeCount; i++)
-    {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-        {
-            return i;
-        }
-    }
-
-    slog("failed to find suitable memory type!");
-    return 0;
-}
-
-void gf3d_swapchain_create_image(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage* image, VkDeviceMemory* imageMemory)
+void gf3d_swapchain_create_image(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage* image, MemoryAllocation* imageMemory)
 {
     VkImageCreateInfo imageInfo = {0};
-    VkMemoryAllocateInfo allocInfo = {0};
-    VkMemoryRequirements memRequirements;
 
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -508,18 +537,10 @@ void gf3d_swapchain_create_image(uint32_t width, uint32_t height, VkFormat forma
         slog("failed to create image!");
     }
 
-    vkGetImageMemoryRequirements(gf3d_swapchain.device, *image, &memRequirements);
-
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = gf3d_swapchain_find_Memory_type(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(gf3d_swapchain.device, &allocInfo, NULL, imageMemory) != VK_SUCCESS)
+    if (!gf3d_memory_bind_image(*image, properties, imageMemory))
     {
         slog("failed to allocate image memory!");
     }
-
-    vkBindImageMemory(gf3d_swapchain.device, *image, *imageMemory, 0);
 }
 
 /*eol@eof*/
@@ -2,15 +2,23 @@
 #include "simple_logger.h"
 
 #include "gf3d_vgraphics.h"
+#include "gf3d_device.h"
 #include "gf3d_buffers.h"
-#include "gf3d_swapchain.h"
+#include "gf3d_upload.h"
 #include "gf3d_texture.h"
 
 typedef struct
 {
-    Uint32          max_textures;
-    Texture       * texture_list;
-    VkDevice        device;
+    Uint32                  max_textures;
+    Texture               * texture_list;
+    VkDevice                device;
+    VkDescriptorSetLayout   descriptorSetLayout;    /**<layout of the per texture material set*/
+    VkDescriptorPool        descriptorPool;
+    VkDescriptorSet       * descriptorSets;         /**<one per texture slot, reused with the slot*/
+    Bool                    bindless;               /**<if true bindlessSet holds an array of every texture as well*/
+    VkDescriptorSetLayout   bindlessLayout;
+    VkDescriptorPool        bindlessPool;
+    VkDescriptorSet         bindlessSet;            /**<the table bindless fragment shaders index per draw*/
 }TextureManager;
 
 static TextureManager gf3d_texture = {0};
@@ -18,6 +26,8 @@ static TextureManager gf3d_texture = {0};
 void gf3d_texture_close();
 void gf3d_texture_delete(Texture *tex);
 void gf3d_texture_delete_all();
+int gf3d_texture_create_descriptor_sets();
+int gf3d_texture_create_bindless_descriptor_set();
 
 void gf3d_texture_init(Uint32 max_textures)
 {
@@ -36,9 +46,211 @@ void gf3d_texture_init(Uint32 max_textures)
     gf3d_texture.max_textures = max_textures;
     gf3d_texture.device = gf3d_vgraphics_get_default_logical_device();
     atexit(gf3d_texture_close);
+    // per texture sets always exist, pipelines whose bindless shaders are missing still draw with them
+    if (!gf3d_texture_create_descriptor_sets())
+    {
+        slog("failed to create texture descriptor sets");
+        return;
+    }
+    if ((gf3d_device_bindless_enabled())&&(gf3d_texture_create_bindless_descriptor_set()))
+    {
+        gf3d_texture.bindless = true;
+        slog("texture system using a bindless table of %i textures",max_textures);
+    }
     slog("texture system initialized");
 }
 
+int gf3d_texture_create_descriptor_sets()
+{
+    int i;
+    VkDescriptorSetLayoutBinding samplerLayoutBinding = {0};
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
+    VkDescriptorPoolSize poolSize = {0};
+    VkDescriptorPoolCreateInfo poolInfo = {0};
+    VkDescriptorSetLayout *layouts;
+    VkDescriptorSetAllocateInfo allocInfo = {0};
+
+    samplerLayoutBinding.binding = 0;
+    samplerLayoutBinding.descriptorCount = 1;
+    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    samplerLayoutBinding.pImmutableSamplers = NULL;
+    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &samplerLayoutBinding;
+    if (vkCreateDescriptorSetLayout(gf3d_texture.device, &layoutInfo, NULL, &gf3d_texture.descriptorSetLayout) != VK_SUCCESS)
+    {
+        slog("failed to create texture descriptor set layout!");
+        return 0;
+    }
+
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = gf3d_texture.max_textures;
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = gf3d_texture.max_textures;
+    if (vkCreateDescriptorPool(gf3d_texture.device, &poolInfo, NULL, &gf3d_texture.descriptorPool) != VK_SUCCESS)
+    {
+        slog("failed to create texture descriptor pool!");
+        return 0;
+    }
+
+    layouts = (VkDescriptorSetLayout *)gfc_allocate_array(sizeof(VkDescriptorSetLayout),gf3d_texture.max_textures);
+    gf3d_texture.descriptorSets = (VkDescriptorSet *)gfc_allocate_array(sizeof(VkDescriptorSet),gf3d_texture.max_textures);
+    if ((!layouts)||(!gf3d_texture.descriptorSets))
+    {
+        slog("failed to allocate texture descriptor sets");
+        if (layouts)free(layouts);
+        return 0;
+    }
+    for (i = 0; i < gf3d_texture.max_textures; i++)
+    {
+        layouts[i] = gf3d_texture.descriptorSetLayout;
+    }
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = gf3d_texture.descriptorPool;
+    allocInfo.descriptorSetCount = gf3d_texture.max_textures;
+    allocInfo.pSetLayouts = layouts;
+    if (vkAllocateDescriptorSets(gf3d_texture.device, &allocInfo, gf3d_texture.descriptorSets) != VK_SUCCESS)
+    {
+        slog("failed to allocate texture descriptor sets!");
+        free(layouts);
+        return 0;
+    }
+    free(layouts);
+    return 1;
+}
+
+int gf3d_texture_create_bindless_descriptor_set()
+{
+    VkPhysicalDeviceDescriptorIndexingProperties indexingProperties = {0};
+    VkPhysicalDeviceProperties2 properties = {0};
+    VkDescriptorSetLayoutBinding samplerLayoutBinding = {0};
+    VkDescriptorBindingFlags bindingFlags;
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {0};
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
+    VkDescriptorPoolSize poolSize = {0};
+    VkDescriptorPoolCreateInfo poolInfo = {0};
+    VkDescriptorSetAllocateInfo allocInfo = {0};
+
+    indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &indexingProperties;
+    vkGetPhysicalDeviceProperties2(gf3d_vgraphics_get_default_physical_device(), &properties);
+    if ((indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers < gf3d_texture.max_textures)||
+        (indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages < gf3d_texture.max_textures))
+    {
+        slog("device cannot hold %i textures in a bindless table, falling back to a set per texture",gf3d_texture.max_textures);
+        return 0;
+    }
+
+    samplerLayoutBinding.binding = 0;
+    samplerLayoutBinding.descriptorCount = gf3d_texture.max_textures;
+    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    samplerLayoutBinding.pImmutableSamplers = NULL;
+    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    // free slots are never sampled, and textures load while earlier frames still have the table bound
+    bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = 1;
+    bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &samplerLayoutBinding;
+    if (vkCreateDescriptorSetLayout(gf3d_texture.device, &layoutInfo, NULL, &gf3d_texture.bindlessLayout) != VK_SUCCESS)
+    {
+        slog("failed to create bindless texture descriptor set layout!");
+        return 0;
+    }
+
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = gf3d_texture.max_textures;
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+    if (vkCreateDescriptorPool(gf3d_texture.device, &poolInfo, NULL, &gf3d_texture.bindlessPool) != VK_SUCCESS)
+    {
+        slog("failed to create bindless texture descriptor pool!");
+        vkDestroyDescriptorSetLayout(gf3d_texture.device, gf3d_texture.bindlessLayout, NULL);
+        gf3d_texture.bindlessLayout = VK_NULL_HANDLE;
+        return 0;
+    }
+
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = gf3d_texture.bindlessPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &gf3d_texture.bindlessLayout;
+    if (vkAllocateDescriptorSets(gf3d_texture.device, &allocInfo, &gf3d_texture.bindlessSet) != VK_SUCCESS)
+    {
+        slog("failed to allocate bindless texture descriptor set!");
+        gf3d_texture.bindlessSet = VK_NULL_HANDLE;
+        vkDestroyDescriptorPool(gf3d_texture.device, gf3d_texture.bindlessPool, NULL);
+        gf3d_texture.bindlessPool = VK_NULL_HANDLE;
+        vkDestroyDescriptorSetLayout(gf3d_texture.device, gf3d_texture.bindlessLayout, NULL);
+        gf3d_texture.bindlessLayout = VK_NULL_HANDLE;
+        return 0;
+    }
+    return 1;
+}
+
+Bool gf3d_texture_bindless_enabled()
+{
+    return gf3d_texture.bindless;
+}
+
+VkDescriptorSetLayout *gf3d_texture_get_descriptor_set_layout(Bool bindless)
+{
+    if ((bindless)&&(gf3d_texture.bindless))return &gf3d_texture.bindlessLayout;
+    return &gf3d_texture.descriptorSetLayout;
+}
+
+VkDescriptorSet gf3d_texture_get_material_set(Texture *tex,Bool bindless)
+{
+    if ((bindless)&&(gf3d_texture.bindless))return gf3d_texture.bindlessSet;
+    if (!tex)return VK_NULL_HANDLE;
+    return tex->descriptorSet;
+}
+
+void gf3d_texture_update_descriptor_set(Texture *tex)
+{
+    VkDescriptorImageInfo imageInfo = {0};
+    VkWriteDescriptorSet descriptorWrite[2] = {0};
+    Uint32 writeCount = 1;
+
+    if (!tex)return;
+    tex->index = tex - gf3d_texture.texture_list;
+    tex->descriptorSet = gf3d_texture.descriptorSets[tex->index];
+
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = tex->textureImageView;
+    imageInfo.sampler = tex->textureSampler;
+
+    descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite[0].dstSet = tex->descriptorSet;
+    descriptorWrite[0].dstBinding = 0;
+    descriptorWrite[0].dstArrayElement = 0;
+    descriptorWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite[0].descriptorCount = 1;
+    descriptorWrite[0].pImageInfo = &imageInfo;
+    if (gf3d_texture.bindless)
+    {
+        descriptorWrite[1] = descriptorWrite[0];
+        descriptorWrite[1].dstSet = gf3d_texture.bindlessSet;
+        descriptorWrite[1].dstArrayElement = tex->index;
+        writeCount = 2;
+    }
+
+    vkUpdateDescriptorSets(gf3d_texture.device, writeCount, descriptorWrite, 0, NULL);
+}
+
 void gf3d_texture_close()
 {
     slog("cleaning up textures");
@@ -47,6 +259,27 @@ void gf3d_texture_close()
     {
         free(gf3d_texture.texture_list);
     }
+    if (gf3d_texture.descriptorSets != NULL)
+    {
+        free(gf3d_texture.descriptorSets);
+    }
+    if (gf3d_texture.descriptorPool != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorPool(gf3d_texture.device, gf3d_texture.descriptorPool, NULL);
+    }
+    if (gf3d_texture.descriptorSetLayout != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorSetLayout(gf3d_texture.device, gf3d_texture.descriptorSetLayout, NULL);
+    }
+    if (gf3d_texture.bindlessPool != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorPool(gf3d_texture.device, gf3d_texture.bindlessPool, NULL);
+    }
+    if (gf3d_texture.bindlessLayout != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorSetLayout(gf3d_texture.device, gf3d_texture.bindlessLayout, NULL);
+    }
+    memset(&gf3d_texture,0,sizeof(TextureManager));
 }
 
 Texture *gf3d_texture_new()
@@ -91,10 +324,7 @@ void gf3d_texture_delete(Texture *tex)
     {
         vkDestroyImage(gf3d_texture.device, tex->textureImage, NULL);
     }
-    if (tex->textureImageMemory != VK_NULL_HANDLE)
-    {
-        vkFreeMemory(gf3d_texture.device, tex->textureImageMemory, NULL);
-    }
+    gf3d_memory_free(&tex->textureImageMemory);
     memset(tex,0,sizeof(Texture));
 }
 
@@ -128,45 +358,6 @@ Texture *gf3d_texture_get_by_filename(const char * filename)
     return NULL;
 }
 
-void gf3d_texture_copy_buffer_to_image(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
-{
-    VkCommandBuffer commandBuffer;
-    Command * commandPool;
-    VkBufferImageCopy region = {0};
-
-    commandPool = gf3d_vgraphics_get_graphics_command_pool();
-    commandBuffer = gf3d_command_begin_single_time(commandPool);
-    
-    
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-
-    region.imageOffset.x = 0;
-    region.imageOffset.y = 0;
-    region.imageOffset.z = 0;
-    
-    region.imageExtent.width = width;
-    region.imageExtent.height = height;
-    region.imageExtent.depth = 1;
-    
-    vkCmdCopyBufferToImage(
-        commandBuffer,
-        buffer,
-        image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        1,
-        &region
-    );
-
-    gf3d_command_end_single_time(commandPool, commandBuffer);
-}
-
 void gf3d_texture_create_sampler(Texture *tex)
 {
     VkSamplerCreateInfo samplerInfo = {0};
@@ -199,14 +390,9 @@ void gf3d_texture_create_sampler(Texture *tex)
 
 Texture *gf3d_texture_convert_surface(SDL_Surface * surface)
 {
-    void* data;
     Texture *tex;
     VkDeviceSize imageSize;
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
     VkImageCreateInfo imageInfo = {0};
-    VkMemoryRequirements memRequirements;
-    VkMemoryAllocateInfo allocInfo = {0};
 
     if (!surface)
     {
@@ -225,14 +411,6 @@ Texture *gf3d_texture_convert_surface(SDL_Surface * surface)
     tex->height = surface->h;
     imageSize = surface->w * surface->h * 4;
     
-    gf3d_buffer_create(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
-    
-    SDL_LockSurface(surface);
-        vkMapMemory(gf3d_texture.device, stagingBufferMemory, 0, imageSize, 0, &data);
-            memcpy(data, surface->pixels, imageSize);
-        vkUnmapMemory(gf3d_texture.device, stagingBufferMemory);
-    SDL_UnlockSurface(surface);    
-    
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
     imageInfo.extent.width = surface->w;
@@ -255,34 +433,32 @@ Texture *gf3d_texture_convert_surface(SDL_Surface * surface)
         SDL_FreeSurface(surface);
         return NULL;
     }
-    vkGetImageMemoryRequirements(gf3d_texture.device, tex->textureImage, &memRequirements);
-
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = gf3d_vgraphics_find_memory_type(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-    if (vkAllocateMemory(gf3d_texture.device, &allocInfo, NULL, &tex->textureImageMemory) != VK_SUCCESS)
+    if (!gf3d_memory_bind_image(tex->textureImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &tex->textureImageMemory))
     {
         slog("failed to allocate image memory!");
         gf3d_texture_delete(tex);
         SDL_FreeSurface(surface);
         return NULL;
     }
-
-    vkBindImageMemory(gf3d_texture.device, tex->textureImage, tex->textureImageMemory, 0);    
     
-    gf3d_swapchain_transition_image_layout(tex->textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-    gf3d_texture_copy_buffer_to_image(stagingBuffer, tex->textureImage, surface->w, surface->h);
-    
-    gf3d_swapchain_transition_image_layout(tex->textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // the transitions and copy ride along with the rest of the frame's uploads
+    SDL_LockSurface(surface);
+        if (!gf3d_upload_image(tex->textureImage, surface->w, surface->h, surface->pixels, imageSize))
+        {
+            SDL_UnlockSurface(surface);
+            gf3d_texture_delete(tex);
+            SDL_FreeSurface(surface);
+            return NULL;
+        }
+    SDL_UnlockSurface(surface);
+    tex->uploadValue = gf3d_upload_get_pending_value();
 
     tex->textureImageView = gf3d_vgraphics_create_image_view(tex->textureImage, VK_FORMAT_R8G8B8A8_UNORM);
     
     gf3d_texture_create_sampler(tex);
+    gf3d_texture_update_descriptor_set(tex);
     
-    vkDestroyBuffer(gf3d_texture.device, stagingBuffer, NULL);
-    vkFreeMemory(gf3d_texture.device, stagingBufferMemory, NULL);
     return tex;
 }
 
@@ -1,13 +1,17 @@
 #include "simple_logger.h"
 
+#include "gf3d_vgraphics.h"
 #include "gf3d_buffers.h"
 #include "gf3d_uniform_buffers.h"
 
 UniformBufferList *gf3d_uniform_buffer_list_new(VkDevice device,VkDeviceSize bufferSize, Uint32 bufferCount,Uint32 bufferFrames)
 {
-    int i,j;
+    int j;
+    VkDeviceSize alignment;
+    VkPhysicalDeviceProperties properties = {0};
+    VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
     UniformBufferList *bufferList;
-    if ((!bufferCount)||(!bufferFrames))
+    if ((!bufferCount)||(!bufferFrames)||(!bufferSize))
     {
         slog("cannot allocate zero buffers!");
         return NULL;
@@ -18,96 +22,107 @@ UniformBufferList *gf3d_uniform_buffer_list_new(VkDevice device,VkDeviceSize buf
         slog("failed to allocate unform buffers list");
         return NULL;
     }
-    
+
     bufferList->device = device;
-    
-    bufferList->buffers = gfc_allocate_array(sizeof(UniformBuffer  *),bufferFrames);
-    
-    if (!bufferList->buffers)
+
+    // every dynamic offset has to be a multiple of the device alignment
+    vkGetPhysicalDeviceProperties(gf3d_vgraphics_get_default_physical_device(),&properties);
+    alignment = properties.limits.minUniformBufferOffsetAlignment;
+    if (!alignment)alignment = 1;
+    bufferList->bufferSize = bufferSize;
+    bufferList->stride = (bufferSize + alignment - 1) & ~(alignment - 1);
+
+    bufferList->frames = gfc_allocate_array(sizeof(UniformBufferFrame),bufferFrames);
+
+    if (!bufferList->frames)
     {
         gf3d_uniform_buffer_list_free(bufferList);
         slog("failed to allocate unform buffers list");
         return NULL;
     }
-    
+    bufferList->buffer_count = bufferCount;
+    bufferList->buffer_frames = bufferFrames;
+
+    // read by every draw, so keep them in device memory when the host can write it
+    if (gf3d_memory_device_local_is_host_visible())memoryProperties |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     for (j = 0; j < bufferFrames; j ++)
     {
-        bufferList->buffers[j] = gfc_allocate_array(sizeof(UniformBuffer),bufferCount);
-        if (!bufferList->buffers[j])
+        if (!gf3d_buffer_create(
+            bufferList->stride * bufferCount,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            memoryProperties,
+            &bufferList->frames[j].buffer,
+            &bufferList->frames[j].allocation))
         {
             gf3d_uniform_buffer_list_free(bufferList);
-            slog("failed to allocate unform buffers");
+            slog("failed to create uniform ring buffer");
             return NULL;
         }
-        for (i = 0; i < bufferCount; i++)
-        {
-            gf3d_buffer_create(
-                bufferSize,
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                &bufferList->buffers[j][i].uniformBuffer,
-                &bufferList->buffers[j][i].uniformBufferMemory);
-        }
+        // host visible memory stays mapped for the life of the allocator
+        bufferList->frames[j].mapped = (Uint8 *)bufferList->frames[j].allocation.mapped;
     }
-    bufferList->buffer_count = bufferCount;
-    bufferList->buffer_frames = bufferFrames;
-    
-    
+
     return bufferList;
 }
 
 void gf3d_uniform_buffer_list_free(UniformBufferList *list)
 {
-    int i,j;
+    int j;
     if (!list)return;
-    for (j = 0; j < list->buffer_frames;j++)
+    if (list->frames)
     {
-        for (i = 0; i < list->buffer_count; i++)
+        for (j = 0; j < list->buffer_frames;j++)
         {
-            if (list->buffers[j][i].uniformBuffer)
-            {
-                vkDestroyBuffer(list->device, list->buffers[j][i].uniformBuffer, NULL);
-            }
-            if (list->buffers[j][i].uniformBufferMemory)
-            {
-                vkFreeMemory(list->device, list->buffers[j][i].uniformBufferMemory, NULL);
-            }
+            gf3d_buffer_free(&list->frames[j].buffer,&list->frames[j].allocation);
         }
+        free(list->frames);
     }
+    free(list);
 }
 
-UniformBuffer *gf3d_uniform_buffer_list_get_buffer(UniformBufferList *list, Uint32 bufferFrame)
+int gf3d_uniform_buffer_list_get_buffer(UniformBufferList *list, Uint32 bufferFrame, UniformBuffer *ubo)
 {
-    int i;
-    if (!list)return NULL;
+    UniformBufferFrame *frame;
+    VkDeviceSize cursor;
+    if ((!list)||(!ubo))return 0;
     if (bufferFrame >= list->buffer_frames)
     {
         slog("buffer frame out of range");
-        return NULL;
+        return 0;
     }
-    for (i = 0;i < list->buffer_count;i++)
+    frame = &list->frames[bufferFrame];
+    cursor = (VkDeviceSize)(Uint32)SDL_AtomicAdd(&frame->next,1) * list->stride;
+    if (cursor + list->stride > list->stride * list->buffer_count)
     {
-        if (list->buffers[bufferFrame][i]._inuse)continue;// skip whats in use.
-        list->buffers[bufferFrame][i]._inuse = 1;
-        return &list->buffers[bufferFrame][i];
+        slog("out of uniform buffers");
+        return 0;
     }
-    slog("out of uniform buffers");
-    return NULL;
+    ubo->uniformBuffer = frame->buffer;
+    ubo->offset = (Uint32)cursor;
+    ubo->data = frame->mapped + cursor;
+    return 1;
+}
+
+VkBuffer gf3d_uniform_buffer_list_get_frame_buffer(UniformBufferList *list, Uint32 bufferFrame)
+{
+    if (!list)return VK_NULL_HANDLE;
+    if (bufferFrame >= list->buffer_frames)
+    {
+        slog("buffer frame out of range");
+        return VK_NULL_HANDLE;
+    }
+    return list->frames[bufferFrame].buffer;
 }
 
 void gf3d_uniform_buffer_list_clear(UniformBufferList *list, Uint32 bufferFrame)
 {
-    int i;
     if (!list)return;
     if (bufferFrame >= list->buffer_frames)
     {
         slog("buffer frame out of range");
         return;
     }
-    for (i = 0;i < list->buffer_count;i++)
-    {
-        list->buffers[bufferFrame][i]._inuse = 0;// just marked free here, cleaned up on assignment
-    }
+    SDL_AtomicSet(&list->frames[bufferFrame].next,0);// the frame's fence has been waited on, so the whole ring is free again
 }
 
 /*eol@eof*/
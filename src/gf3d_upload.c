@@ -0,0 +1,723 @@
+#include <string.h>
+
+#include <SDL.h>
+
+#include "simple_logger.h"
+
+#include "gf3d_vgraphics.h"
+#include "gf3d_vqueues.h"
+#include "gf3d_device.h"
+#include "gf3d_commands.h"
+#include "gf3d_buffers.h"
+#include "gf3d_upload.h"
+
+#define UPLOAD_BATCH_MAX        4   //batches in flight before the oldest has to be waited on
+#define UPLOAD_OVERFLOW_MAX     8   //uploads too large for the ring, per batch
+#define UPLOAD_ALIGNMENT        16  //ring ranges start on this, enough for any texel size
+
+#define UPLOAD_READ_STAGES (VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+#define UPLOAD_READ_ACCESS (VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT)
+
+typedef struct
+{
+    Command            *commandPool;
+    VkCommandBuffer     commandBuffer;      /**<being recorded or in flight, VK_NULL_HANDLE when idle*/
+    VkFence             fence;
+    VkDeviceSize        ringBytes;          /**<ring space the batch holds, wrap padding included*/
+    VkBuffer            overflowBuffers[UPLOAD_OVERFLOW_MAX];
+    MemoryAllocation    overflowAllocations[UPLOAD_OVERFLOW_MAX];
+    Uint32              overflowCount;
+}UploadBatch;
+
+/**
+ * @purpose the graphics queue half of a queue family ownership transfer, recorded by the first frame that needs it
+ */
+typedef struct
+{
+    Uint64                  value;          /**<upload timeline value of the batch that released it*/
+    Bool                    isImage;
+    VkBufferMemoryBarrier   buffer;
+    VkImageMemoryBarrier    image;
+}UploadAcquire;
+
+typedef struct
+{
+    VkDevice            device;
+    VkBuffer            ringBuffer;
+    MemoryAllocation    ringAllocation;     /**<mapped for the life of the program*/
+    VkDeviceSize        ringSize;
+    VkDeviceSize        ringHead;           /**<next byte to hand out*/
+    VkDeviceSize        ringUsed;           /**<bytes held by batches, the oldest held byte is ringUsed behind ringHead*/
+    UploadBatch         batches[UPLOAD_BATCH_MAX];
+    Uint32              batchOldest;        /**<first batch in flight, the one being recorded follows the last in flight*/
+    Uint32              batchesInFlight;
+    VkDeviceSize        frameBudget;
+    VkDeviceSize        frameBytes;         /**<uploaded since the frame began*/
+    Bool                async;              /**<batches go to a separate transfer queue and are ordered with timeline semaphores*/
+    Bool                ownershipTransfer;  /**<the transfer queue is in another family, so everything copied is released and acquired*/
+    Uint32              transferFamily;
+    Uint32              graphicsFamily;
+    VkQueue             queue;              /**<where batches are submitted*/
+    VkSemaphore         uploadTimeline;     /**<signaled by each batch, value n means the nth batch is done*/
+    Uint64              uploadValue;        /**<value signaled by the last batch submitted*/
+    Uint64              frameRequired;      /**<highest upload value a draw in this frame needs*/
+    SDL_SpinLock        requireLock;        /**<draws recorded on worker threads raise frameRequired too*/
+    SDL_mutex          *lock;               /**<the simulation thread uploads while the render thread ends frames*/
+    VkSemaphore         frameTimeline;      /**<signaled by each frame, batches wait on it before reusing memory the frame read*/
+    Uint64              frameValue;         /**<value signaled by the last frame submitted*/
+    UploadAcquire      *acquires;           /**<in upload value order*/
+    Uint32              acquireCount;
+    Uint32              acquireMax;
+    Uint32              copyCount;
+    Uint32              submitCount;
+    Uint32              stallCount;         /**<times the host had to wait on a batch*/
+}UploadManager;
+
+static UploadManager gf3d_upload = {0};
+
+static void gf3d_upload_retire(Bool wait);
+
+static void gf3d_upload_close()
+{
+    Uint32 i;
+    gf3d_upload_wait();
+    for (i = 0; i < UPLOAD_BATCH_MAX; i++)
+    {
+        if (gf3d_upload.batches[i].fence != VK_NULL_HANDLE)
+        {
+            vkDestroyFence(gf3d_upload.device, gf3d_upload.batches[i].fence, NULL);
+        }
+    }
+    if (gf3d_upload.uploadTimeline != VK_NULL_HANDLE)
+    {
+        vkDestroySemaphore(gf3d_upload.device, gf3d_upload.uploadTimeline, NULL);
+    }
+    if (gf3d_upload.frameTimeline != VK_NULL_HANDLE)
+    {
+        vkDestroySemaphore(gf3d_upload.device, gf3d_upload.frameTimeline, NULL);
+    }
+    if (gf3d_upload.acquires)free(gf3d_upload.acquires);
+    gf3d_buffer_free(&gf3d_upload.ringBuffer,&gf3d_upload.ringAllocation);
+    if (gf3d_upload.lock)SDL_DestroyMutex(gf3d_upload.lock);
+    slog("upload system closed: %u copies in %u submits, %u stalls",gf3d_upload.copyCount,gf3d_upload.submitCount,gf3d_upload.stallCount);
+    memset(&gf3d_upload,0,sizeof(UploadManager));
+}
+
+/**
+ * @brief create the two timeline semaphores the transfer queue and the frames order each other with
+ */
+static Bool gf3d_upload_setup_timelines()
+{
+    VkSemaphoreTypeCreateInfo typeInfo = {0};
+    VkSemaphoreCreateInfo semaphoreInfo = {0};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+    if ((vkCreateSemaphore(gf3d_upload.device, &semaphoreInfo, NULL, &gf3d_upload.uploadTimeline) != VK_SUCCESS)||
+        (vkCreateSemaphore(gf3d_upload.device, &semaphoreInfo, NULL, &gf3d_upload.frameTimeline) != VK_SUCCESS))
+    {
+        slog("failed to create upload timeline semaphores!");
+        return 0;
+    }
+    return 1;
+}
+
+void gf3d_upload_init(VkDeviceSize ringSize,VkDeviceSize frameBudget)
+{
+    Uint32 i;
+    VkFenceCreateInfo fenceInfo = {0};
+    memset(&gf3d_upload,0,sizeof(UploadManager));
+    gf3d_upload.device = gf3d_vgraphics_get_default_logical_device();
+    gf3d_upload.frameBudget = frameBudget;
+    gf3d_upload.lock = SDL_CreateMutex();
+    if (!gf3d_upload.lock)
+    {
+        slog("failed to create the upload lock");
+        return;
+    }
+    ringSize = (ringSize / UPLOAD_ALIGNMENT) * UPLOAD_ALIGNMENT;
+    if (!ringSize)
+    {
+        slog("cannot initialize uploads with an empty staging ring");
+        return;
+    }
+    if (!gf3d_buffer_create(
+        ringSize,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &gf3d_upload.ringBuffer,
+        &gf3d_upload.ringAllocation))
+    {
+        slog("failed to create the upload staging ring");
+        return;
+    }
+    gf3d_upload.ringSize = ringSize;
+    gf3d_upload.queue = gf3d_vqueues_get_graphics_queue();
+    gf3d_upload.graphicsFamily = gf3d_vqueues_get_graphics_queue_family();
+    gf3d_upload.transferFamily = gf3d_vqueues_get_transfer_queue_family();
+    if ((gf3d_vqueues_get_transfer_queue() != gf3d_upload.queue)&&(gf3d_device_timeline_semaphores_enabled()))
+    {
+        gf3d_upload.async = gf3d_upload_setup_timelines();
+    }
+    if (gf3d_upload.async)
+    {
+        gf3d_upload.queue = gf3d_vqueues_get_transfer_queue();
+        gf3d_upload.ownershipTransfer = (gf3d_upload.transferFamily != gf3d_upload.graphicsFamily);
+    }
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    for (i = 0; i < UPLOAD_BATCH_MAX; i++)
+    {
+        if (vkCreateFence(gf3d_upload.device, &fenceInfo, NULL, &gf3d_upload.batches[i].fence) != VK_SUCCESS)
+        {
+            slog("failed to create upload fence!");
+        }
+        if (gf3d_upload.async)gf3d_upload.batches[i].commandPool = gf3d_command_transfer_pool_setup(1);
+        else gf3d_upload.batches[i].commandPool = gf3d_command_graphics_pool_setup(1);
+        if (!gf3d_upload.batches[i].commandPool)
+        {
+            slog("failed to create command pool for upload batch %i",i);
+        }
+    }
+    atexit(gf3d_upload_close);
+    slog("upload system initialized with a %i byte staging ring, %s",
+         (int)ringSize,
+         gf3d_upload.async ? "submitting on the transfer queue" : "submitting on the graphics queue");
+}
+
+static UploadBatch *gf3d_upload_get_recording()
+{
+    return &gf3d_upload.batches[(gf3d_upload.batchOldest + gf3d_upload.batchesInFlight) % UPLOAD_BATCH_MAX];
+}
+
+/**
+ * @brief get the batch being recorded, starting one if needed
+ */
+static UploadBatch *gf3d_upload_get_batch()
+{
+    UploadBatch *batch;
+    VkCommandBufferBeginInfo beginInfo = {0};
+    VkMemoryBarrier barrier = {0};
+    if (gf3d_upload.batchesInFlight >= UPLOAD_BATCH_MAX)gf3d_upload_retire(1);
+    batch = gf3d_upload_get_recording();
+    if (batch->commandBuffer != VK_NULL_HANDLE)return batch;
+    gf3d_command_pool_reset(batch->commandPool);
+    batch->commandBuffer = gf3d_command_get_graphics_buffer(batch->commandPool);
+    if (batch->commandBuffer == VK_NULL_HANDLE)return NULL;
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(batch->commandBuffer, &beginInfo);
+    // on the transfer queue the wait on the frame timeline covers this instead
+    if (gf3d_upload.async)return batch;
+    // frames already submitted may still be reading a range that is about to be written
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    vkCmdPipelineBarrier(
+        batch->commandBuffer,
+        UPLOAD_READ_STAGES,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1, &barrier,
+        0, NULL,
+        0, NULL);
+    return batch;
+}
+
+/**
+ * @brief hand back the ring space and overflow buffers of finished batches, oldest first
+ * @param wait if true block until the oldest batch is done and retire just that one, otherwise retire every batch that is already done
+ */
+static void gf3d_upload_retire(Bool wait)
+{
+    Uint32 i;
+    UploadBatch *batch;
+    while (gf3d_upload.batchesInFlight)
+    {
+        batch = &gf3d_upload.batches[gf3d_upload.batchOldest];
+        if (wait)
+        {
+            vkWaitForFences(gf3d_upload.device, 1, &batch->fence, VK_TRUE, UINT64_MAX);
+            gf3d_upload.stallCount++;
+        }
+        else if (vkGetFenceStatus(gf3d_upload.device, batch->fence) != VK_SUCCESS)break;
+        vkResetFences(gf3d_upload.device, 1, &batch->fence);
+        for (i = 0; i < batch->overflowCount; i++)
+        {
+            gf3d_buffer_free(&batch->overflowBuffers[i],&batch->overflowAllocations[i]);
+        }
+        batch->overflowCount = 0;
+        gf3d_upload.ringUsed -= batch->ringBytes;
+        batch->ringBytes = 0;
+        batch->commandBuffer = VK_NULL_HANDLE;
+        gf3d_upload.batchOldest = (gf3d_upload.batchOldest + 1) % UPLOAD_BATCH_MAX;
+        gf3d_upload.batchesInFlight--;
+        if (wait)break;
+    }
+}
+
+/**
+ * @brief claim ring space, flushing and waiting on older batches if it is full
+ * @param size aligned size to claim
+ * @param offset (output) where the space starts in the ring
+ * @param claimed (output) bytes taken from the ring, including any padding skipped at the end
+ */
+static Bool gf3d_upload_ring_alloc(VkDeviceSize size,VkDeviceSize *offset,VkDeviceSize *claimed)
+{
+    VkDeviceSize tail;
+    if (size > gf3d_upload.ringSize)return 0;
+    for (;;)
+    {
+        if (!gf3d_upload.ringUsed)gf3d_upload.ringHead = 0;
+        if (gf3d_upload.ringUsed < gf3d_upload.ringSize)
+        {
+            tail = (gf3d_upload.ringHead + gf3d_upload.ringSize - gf3d_upload.ringUsed) % gf3d_upload.ringSize;
+            if (gf3d_upload.ringHead >= tail)
+            {
+                // free space runs from the head to the end, then from the start to the tail
+                if (gf3d_upload.ringHead + size <= gf3d_upload.ringSize)
+                {
+                    *offset = gf3d_upload.ringHead;
+                    *claimed = size;
+                    break;
+                }
+                if (size <= tail)
+                {
+                    *offset = 0;
+                    *claimed = gf3d_upload.ringSize - gf3d_upload.ringHead + size;
+                    break;
+                }
+            }
+            else if (gf3d_upload.ringHead + size <= tail)
+            {
+                *offset = gf3d_upload.ringHead;
+                *claimed = size;
+                break;
+            }
+        }
+        // full: get what is recorded on its way, then wait for the oldest batch to give space back
+        if (gf3d_upload_get_recording()->commandBuffer != VK_NULL_HANDLE)gf3d_upload_flush();
+        if (!gf3d_upload.batchesInFlight)return 0;
+        gf3d_upload_retire(1);
+    }
+    gf3d_upload.ringHead = *offset + size;
+    gf3d_upload.ringUsed += *claimed;
+    return 1;
+}
+
+/**
+ * @brief get staging memory for an upload and the batch to record its copy into
+ * @param size how many bytes to stage
+ * @param srcBuffer (output) the buffer the staging memory belongs to
+ * @param srcOffset (output) where in srcBuffer the staging memory starts
+ * @param batchOut (output) the batch that owns the staging memory
+ * @return the mapped staging memory, NULL on failure
+ */
+static void *gf3d_upload_stage(VkDeviceSize size,VkBuffer *srcBuffer,VkDeviceSize *srcOffset,UploadBatch **batchOut)
+{
+    UploadBatch *batch;
+    VkDeviceSize claimed;
+    if (gf3d_upload.ringBuffer == VK_NULL_HANDLE)
+    {
+        slog("upload system not initialized");
+        return NULL;
+    }
+    gf3d_upload.frameBytes += size;
+    gf3d_upload.copyCount++;
+    if (size > gf3d_upload.ringSize)
+    {
+        // too big for the ring, it gets a buffer of its own that lives as long as the batch
+        batch = gf3d_upload_get_batch();
+        if ((batch)&&(batch->overflowCount >= UPLOAD_OVERFLOW_MAX))
+        {
+            gf3d_upload_flush();
+            batch = gf3d_upload_get_batch();
+        }
+        if (!batch)return NULL;
+        if (!gf3d_buffer_create_staging(size,&batch->overflowBuffers[batch->overflowCount],&batch->overflowAllocations[batch->overflowCount]))
+        {
+            slog("failed to create overflow staging buffer for %i bytes",(int)size);
+            return NULL;
+        }
+        *srcBuffer = batch->overflowBuffers[batch->overflowCount];
+        *srcOffset = 0;
+        *batchOut = batch;
+        return batch->overflowAllocations[batch->overflowCount++].mapped;
+    }
+    if (!gf3d_upload_ring_alloc(((size + UPLOAD_ALIGNMENT - 1) / UPLOAD_ALIGNMENT) * UPLOAD_ALIGNMENT,srcOffset,&claimed))
+    {
+        slog("failed to get staging ring space for %i bytes",(int)size);
+        return NULL;
+    }
+    batch = gf3d_upload_get_batch();
+    if (!batch)
+    {
+        gf3d_upload.ringUsed -= claimed;
+        return NULL;
+    }
+    batch->ringBytes += claimed;
+    *srcBuffer = gf3d_upload.ringBuffer;
+    *batchOut = batch;
+    return (Uint8 *)gf3d_upload.ringAllocation.mapped + *srcOffset;
+}
+
+/**
+ * @brief make room for one more acquire and tag it with the value of the batch being recorded
+ * @return the new acquire, zeroed, or NULL on failure
+ */
+static UploadAcquire *gf3d_upload_acquire_new()
+{
+    UploadAcquire *acquires;
+    UploadAcquire *acquire;
+    Uint32 acquireMax;
+    if (gf3d_upload.acquireCount >= gf3d_upload.acquireMax)
+    {
+        acquireMax = gf3d_upload.acquireMax ? gf3d_upload.acquireMax * 2 : 64;
+        acquires = (UploadAcquire *)realloc(gf3d_upload.acquires,sizeof(UploadAcquire) * acquireMax);
+        if (!acquires)
+        {
+            slog("failed to grow the upload acquire list");
+            return NULL;
+        }
+        gf3d_upload.acquires = acquires;
+        gf3d_upload.acquireMax = acquireMax;
+    }
+    acquire = &gf3d_upload.acquires[gf3d_upload.acquireCount++];
+    memset(acquire,0,sizeof(UploadAcquire));
+    acquire->value = gf3d_upload.uploadValue + 1;
+    return acquire;
+}
+
+/**
+ * @brief hand a copied buffer range from the transfer queue family over to the graphics queue family
+ */
+static void gf3d_upload_release_buffer(UploadBatch *batch,VkBuffer dst,VkDeviceSize dstOffset,VkDeviceSize size)
+{
+    UploadAcquire *acquire;
+    VkBufferMemoryBarrier barrier = {0};
+    if (!gf3d_upload.ownershipTransfer)return;
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.srcQueueFamilyIndex = gf3d_upload.transferFamily;
+    barrier.dstQueueFamilyIndex = gf3d_upload.graphicsFamily;
+    barrier.buffer = dst;
+    barrier.offset = dstOffset;
+    barrier.size = size;
+    vkCmdPipelineBarrier(
+        batch->commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0,
+        0, NULL,
+        1, &barrier,
+        0, NULL);
+    acquire = gf3d_upload_acquire_new();
+    if (!acquire)return;
+    acquire->buffer = barrier;
+    acquire->buffer.srcAccessMask = 0;
+    acquire->buffer.dstAccessMask = UPLOAD_READ_ACCESS;
+}
+
+void *gf3d_upload_buffer_reserve(VkBuffer dst,VkDeviceSize dstOffset,VkDeviceSize size)
+{
+    void *data;
+    UploadBatch *batch;
+    VkBuffer srcBuffer;
+    VkBufferCopy region = {0};
+    if ((dst == VK_NULL_HANDLE)||(!size))return NULL;
+    gf3d_upload_lock();
+    data = gf3d_upload_stage(size,&srcBuffer,&region.srcOffset,&batch);
+    if (data)
+    {
+        region.dstOffset = dstOffset;
+        region.size = size;
+        vkCmdCopyBuffer(batch->commandBuffer, srcBuffer, dst, 1, &region);
+        gf3d_upload_release_buffer(batch,dst,dstOffset,size);
+    }
+    gf3d_upload_unlock();
+    return data;
+}
+
+Bool gf3d_upload_buffer(VkBuffer dst,VkDeviceSize dstOffset,const void *data,VkDeviceSize size)
+{
+    void *staging;
+    if (!data)return 0;
+    // held until the data is written, so another thread cannot submit the batch first
+    gf3d_upload_lock();
+    staging = gf3d_upload_buffer_reserve(dst,dstOffset,size);
+    if (staging)memcpy(staging,data,(size_t)size);
+    gf3d_upload_unlock();
+    return (staging != NULL);
+}
+
+/**
+ * @brief stage an image and record its copy and layout transitions, called with the upload lock held
+ */
+static Bool gf3d_upload_image_record(VkImage image,Uint32 width,Uint32 height,const void *pixels,VkDeviceSize size)
+{
+    void *staging;
+    UploadBatch *batch;
+    UploadAcquire *acquire;
+    VkBuffer srcBuffer;
+    VkBufferImageCopy region = {0};
+    VkImageMemoryBarrier barrier = {0};
+    VkPipelineStageFlags dstStage;
+    if ((image == VK_NULL_HANDLE)||(!pixels)||(!size))return 0;
+    staging = gf3d_upload_stage(size,&srcBuffer,&region.bufferOffset,&batch);
+    if (!staging)return 0;
+    memcpy(staging,pixels,(size_t)size);
+
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+        batch->commandBuffer,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, NULL,
+        0, NULL,
+        1, &barrier);
+
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width = width;
+    region.imageExtent.height = height;
+    region.imageExtent.depth = 1;
+    vkCmdCopyBufferToImage(batch->commandBuffer, srcBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    if (gf3d_upload.async)
+    {
+        // the transfer queue cannot name shader stages, the frame's semaphore wait makes the writes visible
+        barrier.dstAccessMask = 0;
+        dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        if (gf3d_upload.ownershipTransfer)
+        {
+            barrier.srcQueueFamilyIndex = gf3d_upload.transferFamily;
+            barrier.dstQueueFamilyIndex = gf3d_upload.graphicsFamily;
+        }
+    }
+    vkCmdPipelineBarrier(
+        batch->commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage,
+        0,
+        0, NULL,
+        0, NULL,
+        1, &barrier);
+    if (!gf3d_upload.ownershipTransfer)return 1;
+    acquire = gf3d_upload_acquire_new();
+    if (!acquire)return 1;
+    acquire->isImage = 1;
+    acquire->image = barrier;
+    acquire->image.srcAccessMask = 0;
+    acquire->image.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    return 1;
+}
+
+Bool gf3d_upload_image(VkImage image,Uint32 width,Uint32 height,const void *pixels,VkDeviceSize size)
+{
+    Bool result;
+    gf3d_upload_lock();
+    result = gf3d_upload_image_record(image,width,height,pixels,size);
+    gf3d_upload_unlock();
+    return result;
+}
+
+Uint64 gf3d_upload_get_pending_value()
+{
+    Uint64 value;
+    if (!gf3d_upload.async)return 0;
+    gf3d_upload_lock();
+    value = gf3d_upload.uploadValue;
+    if (gf3d_upload_get_recording()->commandBuffer != VK_NULL_HANDLE)value++;
+    gf3d_upload_unlock();
+    return value;
+}
+
+void gf3d_upload_require(Uint64 value)
+{
+    if (!value)return;
+    SDL_AtomicLock(&gf3d_upload.requireLock);
+    if (value > gf3d_upload.frameRequired)gf3d_upload.frameRequired = value;
+    SDL_AtomicUnlock(&gf3d_upload.requireLock);
+}
+
+void gf3d_upload_flush()
+{
+    UploadBatch *batch;
+    VkSubmitInfo submitInfo = {0};
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {0};
+    VkMemoryBarrier barrier = {0};
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    gf3d_upload_lock();
+    batch = gf3d_upload_get_recording();
+    if (batch->commandBuffer == VK_NULL_HANDLE)
+    {
+        gf3d_upload_unlock();
+        return;
+    }
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    if (gf3d_upload.async)
+    {
+        // wait for the frames that might still read what this batch overwrites, then mark it done on the upload timeline
+        gf3d_upload.uploadValue++;
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &gf3d_upload.uploadValue;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &gf3d_upload.uploadTimeline;
+        if (gf3d_upload.frameValue)
+        {
+            timelineInfo.waitSemaphoreValueCount = 1;
+            timelineInfo.pWaitSemaphoreValues = &gf3d_upload.frameValue;
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &gf3d_upload.frameTimeline;
+            submitInfo.pWaitDstStageMask = &waitStage;
+        }
+    }
+    else
+    {
+        // everything copied is visible to any draw submitted after this batch
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = UPLOAD_READ_ACCESS;
+        vkCmdPipelineBarrier(
+            batch->commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            UPLOAD_READ_STAGES,
+            0,
+            1, &barrier,
+            0, NULL,
+            0, NULL);
+    }
+    vkEndCommandBuffer(batch->commandBuffer);
+
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch->commandBuffer;
+    gf3d_vqueues_lock();
+    if (vkQueueSubmit(gf3d_upload.queue, 1, &submitInfo, batch->fence) != VK_SUCCESS)
+    {
+        slog("failed to submit upload batch!");
+    }
+    gf3d_vqueues_unlock();
+    gf3d_upload.batchesInFlight++;
+    gf3d_upload.submitCount++;
+    gf3d_upload_unlock();
+}
+
+void gf3d_upload_wait()
+{
+    gf3d_upload_lock();
+    gf3d_upload_flush();
+    while (gf3d_upload.batchesInFlight)
+    {
+        gf3d_upload_retire(1);
+    }
+    gf3d_upload_unlock();
+}
+
+/**
+ * @brief record the acquires of every transfer up to a value into a frame command buffer and drop them from the list
+ * @return the command buffer, VK_NULL_HANDLE if there was nothing to acquire
+ */
+static VkCommandBuffer gf3d_upload_record_acquires(Command *com,Uint64 value)
+{
+    Uint32 i,count;
+    VkCommandBuffer commandBuffer;
+    VkCommandBufferBeginInfo beginInfo = {0};
+    for (count = 0; count < gf3d_upload.acquireCount; count++)
+    {
+        if (gf3d_upload.acquires[count].value > value)break;
+    }
+    if (!count)return VK_NULL_HANDLE;
+    commandBuffer = gf3d_command_get_graphics_buffer(com);
+    if (commandBuffer == VK_NULL_HANDLE)
+    {
+        slog("failed to get a command buffer for upload acquires");
+        return VK_NULL_HANDLE;
+    }
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    for (i = 0; i < count; i++)
+    {
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            UPLOAD_READ_STAGES, UPLOAD_READ_STAGES,
+            0,
+            0, NULL,
+            gf3d_upload.acquires[i].isImage ? 0 : 1, &gf3d_upload.acquires[i].buffer,
+            gf3d_upload.acquires[i].isImage ? 1 : 0, &gf3d_upload.acquires[i].image);
+    }
+    vkEndCommandBuffer(commandBuffer);
+    gf3d_upload.acquireCount -= count;
+    memmove(gf3d_upload.acquires,&gf3d_upload.acquires[count],sizeof(UploadAcquire) * gf3d_upload.acquireCount);
+    return commandBuffer;
+}
+
+void gf3d_upload_frame_end(Command *com,UploadFrameSync *sync)
+{
+    Uint64 required;
+    Uint64 completed = 0;
+    if (sync)memset(sync,0,sizeof(UploadFrameSync));
+    gf3d_upload_lock();
+    gf3d_upload_flush();
+    gf3d_upload_retire(0);
+    gf3d_upload.frameBytes = 0;
+    SDL_AtomicLock(&gf3d_upload.requireLock);
+    required = MIN(gf3d_upload.frameRequired,gf3d_upload.uploadValue);
+    gf3d_upload.frameRequired = 0;
+    SDL_AtomicUnlock(&gf3d_upload.requireLock);
+    if ((!gf3d_upload.async)||(!sync))
+    {
+        gf3d_upload_unlock();
+        return;
+    }
+    // transfers that already finished are acquired too, waiting on them costs nothing
+    vkGetSemaphoreCounterValue(gf3d_upload.device, gf3d_upload.uploadTimeline, &completed);
+    required = MAX(required,completed);
+    if (required)
+    {
+        if (gf3d_upload.ownershipTransfer)sync->acquireBuffer = gf3d_upload_record_acquires(com,required);
+        sync->waitSemaphore = gf3d_upload.uploadTimeline;
+        sync->waitValue = required;
+        sync->waitStage = UPLOAD_READ_STAGES;
+    }
+    sync->signalSemaphore = gf3d_upload.frameTimeline;
+    sync->signalValue = ++gf3d_upload.frameValue;
+    gf3d_upload_unlock();
+}
+
+Bool gf3d_upload_budget_check(VkDeviceSize size)
+{
+    Bool result;
+    if (!gf3d_upload.frameBudget)return 1;
+    gf3d_upload_lock();
+    result = (!gf3d_upload.frameBytes)||(gf3d_upload.frameBytes + size <= gf3d_upload.frameBudget);
+    gf3d_upload_unlock();
+    return result;
+}
+
+void gf3d_upload_lock()
+{
+    if (gf3d_upload.lock)SDL_LockMutex(gf3d_upload.lock);
+}
+
+void gf3d_upload_unlock()
+{
+    if (gf3d_upload.lock)SDL_UnlockMutex(gf3d_upload.lock);
+}
+
+/*eol@eof*/
@@ -27,12 +27,28 @@
 #include "gf3d_pipeline.h"
 #include "gf3d_commands.h"
 #include "gf3d_texture.h"
+#include "gf3d_camera.h"
+#include "gf3d_memory.h"
+#include "gf3d_upload.h"
+#include "gf3d_record.h"
+#include "gf3d_render.h"
+#include "gf3d_draw_queue.h"
+#include "gf3d_bundle.h"
+#include "gf3d_indirect.h"
+#include "gf3d_mesh_optimize.h"
 #include "gf2d_sprite.h"
 #include "gf3d_particle.h"
 
 #include "gf3d_vgraphics.h"
 
 
+typedef struct
+{
+    Command                    *commandPool;                /**<command buffers recorded for this frame*/
+    VkFence                     inFlightFence;              /**<signaled once the GPU has finished with this frame*/
+    VkSemaphore                 imageAvailableSemaphore;    /**<signaled when the swap chain image is ready to be drawn to*/
+}FrameInFlight;
+
 typedef struct
 {
     SDL_Window                 *main_window;
@@ -60,14 +76,20 @@ typedef struct
     VkFormat                    color_format;
     VkColorSpaceKHR             color_space;
     
-    VkSemaphore                 imageAvailableSemaphore;
-    VkSemaphore                 renderFinishedSemaphore;
+    VkRenderPass                renderPass;                 /**<the single render pass every pipeline draws within*/
+    FrameInFlight               frames[GF3D_VGRAPHICS_FRAMES_IN_FLIGHT];
+    Uint32                      currentFrame;               /**<which of the frames in flight is being recorded*/
 
-    Command                 *   graphicsCommandPool; 
+    Command                 *   graphicsCommandPool;        /**<used for one off commands like uploads and layout transitions*/
     UniformBufferObject         ubo;
     
-    //render frame and command buffer for the current render pass
+    //swap chain image for the current render pass
     Uint32                      bufferFrame;
+    Bool                        imageAcquired;              /**<false when this frame could not get a swap chain image and will not be presented*/
+    Bool                        swapchainStale;             /**<acquire or present reported the surface changed, rebuilt before the next acquire*/
+    Uint32                      swapImageCount;
+    VkSemaphore                *renderFinishedSemaphores;   /**<per swap chain image, signaled when the image is ready to be presented*/
+    VkFence                    *imagesInFlight;             /**<per swap chain image, the fence of the frame last rendered into it*/
     
     SDL_Surface                *screen;
     Sint32                      bitdepth;
@@ -85,7 +107,10 @@ extern Mesh *testMesh;
 void gf3d_vgraphics_close();
 void gf3d_vgraphics_logical_device_close();
 void gf3d_vgraphics_extension_init();
-void gf3d_vgraphics_semaphores_create();
+void gf3d_vgraphics_frames_create();
+static void gf3d_vgraphics_image_sync_create();
+static void gf3d_vgraphics_image_sync_close();
+void gf3d_vgraphics_render_pass_create(SJson *config);
 
 VkDeviceCreateInfo gf3d_vgraphics_get_device_info(Bool enableValidationLayers);
 
@@ -110,6 +135,13 @@ void gf3d_vgraphics_init(const char *config)
     short int fullscreen = 0;
     short int enableValidation = 0;
     short int enableDebug = 0;
+    float lodBias = 1;
+    int clusterFaces = 1024;
+    int uploadRingMB = 32;
+    int uploadFrameBudgetMB = 8;
+    int recordThreads = 0;
+    int indirectObjects = 0;
+    short int renderThread = 0;
     
     json = sj_load(config);
     if (!json)
@@ -156,6 +188,7 @@ void gf3d_vgraphics_init(const char *config)
     );
     
     gf3d_vgraphics.ubo.proj[1][1] *= -1;
+    gf3d_camera_set_projection(gf3d_vgraphics.ubo.proj);
 
     gf3d_vgraphics_setup(
         windowName,
@@ -168,12 +201,18 @@ void gf3d_vgraphics_init(const char *config)
         );
     
     gf3d_vgraphics.device = gf3d_vgraphics_get_default_logical_device();
+    gf3d_memory_init(gf3d_vgraphics.gpu, gf3d_vgraphics.device);
 
     gf3d_vqueues_setup_device_queues(gf3d_vgraphics.device);
     // swap chain!!!
     gf3d_swapchain_init(gf3d_vgraphics.gpu,gf3d_vgraphics.device,gf3d_vgraphics.surface,resolution.x,resolution.y);
+    gf3d_vgraphics_render_pass_create(sj_object_get_value(json,"renderPass"));
+    gf3d_texture_init(1024);// pipelines share the texture material set layout
     gf3d_pipeline_init(16);// how many different rendering pipelines we need
     gf3d_mesh_init(1024);//TODO: pull this from a parameter
+    gf3d_mesh_set_optimize_mode(gf3d_mesh_optimize_mode_from_string(sj_object_get_value_as_string(json,"mesh_optimize")));
+    sj_get_integer_value(sj_object_get_value(json,"mesh_cluster_faces"),&clusterFaces);
+    gf3d_mesh_set_cluster_min_faces(clusterFaces > 0 ? (Uint32)clusterFaces : 0);
     
     // 2D stuff
     SDL_PixelFormatEnumToMasks(SDL_PIXELFORMAT_RGBA32,
@@ -193,18 +232,67 @@ void gf3d_vgraphics_init(const char *config)
         gf3d_vgraphics.bmask,
         gf3d_vgraphics.amask);
 
-    gf3d_texture_init(1024);
-
-    gf3d_command_system_init(16 * gf3d_swapchain_get_swap_image_count(), gf3d_vgraphics.device);
+    // room for the recording threads', bundles' and indirect scene's pools on top of the frame and upload pools
+    gf3d_command_system_init(
+        16 * gf3d_swapchain_get_swap_image_count() + (GF3D_RECORD_THREAD_MAX + GF3D_VGRAPHICS_BUNDLE_MAX + 1) * GF3D_VGRAPHICS_FRAMES_IN_FLIGHT,
+        gf3d_vgraphics.device);
     gf3d_vgraphics.graphicsCommandPool = gf3d_command_graphics_pool_setup(gf3d_swapchain_get_swap_image_count());
+    sj_get_integer_value(sj_object_get_value(json,"record_threads"),&recordThreads);
+    gf3d_record_init(recordThreads > 0 ? (Uint32)recordThreads : 0);
+    sj_get_integer_value(sj_object_get_value(json,"upload_ring_mb"),&uploadRingMB);
+    sj_get_integer_value(sj_object_get_value(json,"upload_frame_budget_mb"),&uploadFrameBudgetMB);
+    gf3d_upload_init(
+        (VkDeviceSize)(uploadRingMB > 1 ? uploadRingMB : 1) * 1024 * 1024,
+        (VkDeviceSize)(uploadFrameBudgetMB > 0 ? uploadFrameBudgetMB : 0) * 1024 * 1024);
 
     gf3d_model_manager_init(1024);
+    sj_get_float_value(sj_object_get_value(json,"lod_bias"),&lodBias);
+    gf3d_model_set_lod_bias(lodBias);
     gf2d_sprite_manager_init(1024);
     gf3d_particle_manager_init(4096);
+    gf3d_draw_queue_init(8192);
+    gf3d_bundle_init(GF3D_VGRAPHICS_BUNDLE_MAX);
+    sj_get_integer_value(sj_object_get_value(json,"indirect_objects"),&indirectObjects);
+    if (indirectObjects > 0)gf3d_indirect_init((Uint32)indirectObjects);
 
     gf3d_swapchain_create_depth_image();
-    gf3d_swapchain_setup_frame_buffers(gf3d_mesh_get_pipeline());
-    gf3d_vgraphics_semaphores_create();
+    gf3d_swapchain_setup_frame_buffers(gf3d_vgraphics.renderPass);
+    gf3d_vgraphics_frames_create();
+    // last, so the render thread is stopped before anything it draws with is closed
+    sj_get_bool_value(sj_object_get_value(json,"render_thread"),&renderThread);
+    gf3d_render_init(renderThread);
+    sj_free(json);
+}
+
+void gf3d_vgraphics_render_pass_close()
+{
+    if (gf3d_vgraphics.renderPass != VK_NULL_HANDLE)
+    {
+        vkDestroyRenderPass(gf3d_vgraphics.device, gf3d_vgraphics.renderPass, NULL);
+        gf3d_vgraphics.renderPass = VK_NULL_HANDLE;
+    }
+}
+
+void gf3d_vgraphics_render_pass_create(SJson *config)
+{
+    if (!config)
+    {
+        slog("graphics config missing renderPass description, exiting");
+        exit(0);
+        return;
+    }
+    if (!gf3d_pipeline_render_pass_create(gf3d_vgraphics.device,config,&gf3d_vgraphics.renderPass))
+    {
+        slog("failed to create the frame render pass, exiting");
+        exit(0);
+        return;
+    }
+    atexit(gf3d_vgraphics_render_pass_close);
+}
+
+VkRenderPass gf3d_vgraphics_get_render_pass()
+{
+    return gf3d_vgraphics.renderPass;
 }
 
 
@@ -449,9 +537,31 @@ SDL_Surface *gf3d_vgraphics_screen_convert(SDL_Surface **surface)
 }
 
 
-Uint32 gf3d_vgraphics_render_begin()
+/**
+ * @brief rebuild the swap chain and everything sized by its images once the surface has changed
+ * @return 0 if it could not be rebuilt yet (minimized window), 1 once the swap chain is usable again
+ */
+static Bool gf3d_vgraphics_swapchain_rebuild()
 {
-    Uint32 imageIndex;
+    // the old images, frame buffers and present semaphores may still be in use by frames in flight
+    gf3d_vqueues_lock();
+    vkDeviceWaitIdle(gf3d_vgraphics.device);
+    gf3d_vqueues_unlock();
+    gf3d_vgraphics_image_sync_close();
+    gf3d_vgraphics.swapchainStale = !gf3d_swapchain_recreate(gf3d_vgraphics.renderPass);
+    if (gf3d_vgraphics.swapchainStale)return 0;
+    gf3d_vgraphics_image_sync_create();
+    return 1;
+}
+
+/**
+ * @brief acquire the next swap chain image for the current frame in flight
+ * @param imageIndex output: the index of the acquired image
+ * @return 0 if no image could be acquired and the frame should not be presented, 1 otherwise
+ */
+static Bool gf3d_vgraphics_render_begin(Uint32 *imageIndex)
+{
+    VkResult result;
     VkSwapchainKHR swapChains[1] = {0};
 
     /*
@@ -459,17 +569,35 @@ Uint32 gf3d_vgraphics_render_begin()
     Execute the command buffer with that image as attachment in the framebuffer
     Return the image to the swap chain for presentation
     */
+    if ((gf3d_vgraphics.swapchainStale)&&(!gf3d_vgraphics_swapchain_rebuild()))return 0;
     swapChains[0] = gf3d_swapchain_get();
     
-    vkAcquireNextImageKHR(
+    result = vkAcquireNextImageKHR(
         gf3d_vgraphics.device,
         swapChains[0],
-        UINT_MAX,
-        gf3d_vgraphics.imageAvailableSemaphore,
+        UINT64_MAX,
+        gf3d_vgraphics.frames[gf3d_vgraphics.currentFrame].imageAvailableSemaphore,
         VK_NULL_HANDLE,
-        &imageIndex);
-    
-    return imageIndex;
+        imageIndex);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        // nothing was acquired and the semaphore is untouched, so try again on the rebuilt chain
+        if (!gf3d_vgraphics_swapchain_rebuild())return 0;
+        swapChains[0] = gf3d_swapchain_get();
+        result = vkAcquireNextImageKHR(
+            gf3d_vgraphics.device,
+            swapChains[0],
+            UINT64_MAX,
+            gf3d_vgraphics.frames[gf3d_vgraphics.currentFrame].imageAvailableSemaphore,
+            VK_NULL_HANDLE,
+            imageIndex);
+    }
+    // suboptimal still hands back an image and signals the semaphore, so it is drawn and presented, then rebuilt
+    if (result == VK_SUBOPTIMAL_KHR)gf3d_vgraphics.swapchainStale = 1;
+    if ((result == VK_SUCCESS)||(result == VK_SUBOPTIMAL_KHR))return 1;
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)gf3d_vgraphics.swapchainStale = 1;
+    else slog("failed to acquire swap chain image: %i",result);
+    return 0;
 }
 
 /**
@@ -479,12 +607,33 @@ Uint32 gf3d_vgraphics_render_begin()
 
 void gf3d_vgraphics_render_start()
 {
-    gf3d_vgraphics.bufferFrame = gf3d_vgraphics_render_begin();
+    FrameInFlight *frame;
+    
+    frame = &gf3d_vgraphics.frames[gf3d_vgraphics.currentFrame];
     
+    // wait for the GPU to finish the last time this frame was submitted, then its resources are ours again
+    vkWaitForFences(gf3d_vgraphics.device, 1, &frame->inFlightFence, VK_TRUE, UINT64_MAX);
+    
+    // the fence is only reset by render_end right before the submit that signals it again, so a skipped frame can never leave it unsignaled
+    gf3d_vgraphics.imageAcquired = gf3d_vgraphics_render_begin(&gf3d_vgraphics.bufferFrame);
+    if (gf3d_vgraphics.imageAcquired)
+    {
+        // the swap chain can hand back an image an older frame in flight is still rendering into
+        if ((gf3d_vgraphics.imagesInFlight[gf3d_vgraphics.bufferFrame] != VK_NULL_HANDLE)&&
+            (gf3d_vgraphics.imagesInFlight[gf3d_vgraphics.bufferFrame] != frame->inFlightFence))
+        {
+            vkWaitForFences(gf3d_vgraphics.device, 1, &gf3d_vgraphics.imagesInFlight[gf3d_vgraphics.bufferFrame], VK_TRUE, UINT64_MAX);
+        }
+        gf3d_vgraphics.imagesInFlight[gf3d_vgraphics.bufferFrame] = frame->inFlightFence;
+    }
+    
+    gf3d_command_pool_reset(frame->commandPool);
+    gf3d_record_frame_begin(gf3d_vgraphics.currentFrame);
     
     gf3d_mesh_reset_pipes();
     gf3d_particle_reset_pipes();
     gf3d_sprite_reset_pipes();
+    gf3d_draw_queue_reset();
 }
 
 Uint32  gf3d_vgraphics_get_current_buffer_frame()
@@ -492,73 +641,252 @@ Uint32  gf3d_vgraphics_get_current_buffer_frame()
     return gf3d_vgraphics.bufferFrame;
 }
 
+Uint32  gf3d_vgraphics_get_current_frame()
+{
+    return gf3d_vgraphics.currentFrame;
+}
+
+Command *gf3d_vgraphics_get_current_command_pool()
+{
+    return gf3d_vgraphics.frames[gf3d_vgraphics.currentFrame].commandPool;
+}
+
 void gf3d_vgraphics_render_end()
 {
+    FrameInFlight *frame;
+    VkCommandBuffer commandBuffer;
+    VkCommandBuffer cullBuffer;
+    VkCommandBuffer commandBuffers[3];
+    Uint32 commandBufferCount = 0;
+    UploadFrameSync uploadSync;
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {0};
     VkPresentInfoKHR presentInfo = {0};
     VkSubmitInfo submitInfo = {0};
     VkSwapchainKHR swapChains[1] = {0};
-    VkSemaphore waitSemaphores[] = {gf3d_vgraphics.imageAvailableSemaphore};
-    VkSemaphore signalSemaphores[] = {gf3d_vgraphics.renderFinishedSemaphore};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    
+    VkSemaphore waitSemaphores[2];
+    VkSemaphore signalSemaphores[2];
+    Uint64 waitValues[2] = {0};
+    Uint64 signalValues[2] = {0};
+    VkPipelineStageFlags waitStages[2] = {0};
+    Uint32 waitCount = 0,signalCount = 0;
+    VkResult result;
+    
+    frame = &gf3d_vgraphics.frames[gf3d_vgraphics.currentFrame];
+    if (gf3d_vgraphics.imageAcquired)
+    {
+        waitSemaphores[waitCount] = frame->imageAvailableSemaphore;
+        waitStages[waitCount++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        // indexed by image, the presentation engine may still hold the semaphore of an earlier present of another image
+        signalSemaphores[signalCount++] = gf3d_vgraphics.renderFinishedSemaphores[gf3d_vgraphics.bufferFrame];
+    }
+
+    // queued draws go into the pipelines' command buffers before those are ended
+    cullBuffer = gf3d_indirect_flush();
+    gf3d_bundle_flush();
+    gf3d_draw_queue_flush();
     gf3d_mesh_submit_pipe_commands();
     gf3d_particle_submit_pipe_commands();
     gf3d_sprite_submit_pipe_commands();
     
+    // anything loaded this frame has to be on the queue before the draws that use it
+    gf3d_upload_frame_end(frame->commandPool,&uploadSync);
+    if (uploadSync.acquireBuffer != VK_NULL_HANDLE)commandBuffers[commandBufferCount++] = uploadSync.acquireBuffer;
+    // the cull pass writes the indirect draws the render pass reads
+    if (cullBuffer != VK_NULL_HANDLE)commandBuffers[commandBufferCount++] = cullBuffer;
+    
+    // without an image the draws are dropped, but uploads and culling still go out so their semaphores keep counting
+    if (gf3d_vgraphics.imageAcquired)
+    {
+        commandBuffer = gf3d_command_execute_render_pass(
+            frame->commandPool,
+            gf3d_vgraphics.renderPass,
+            gf3d_swapchain_get_frame_buffer_by_index(gf3d_vgraphics.bufferFrame));
+        if (commandBuffer != VK_NULL_HANDLE)commandBuffers[commandBufferCount++] = commandBuffer;
+    }
+    
     swapChains[0] = gf3d_swapchain_get();
 
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    submitInfo.waitSemaphoreCount = 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
-    //get count of configured command buffers
-    //get the list of command buffers
+    //every pipeline is executed from the one primary command buffer, so it all goes in one submit
+    submitInfo.commandBufferCount = commandBufferCount;
+    submitInfo.pCommandBuffers = commandBuffers;
     
-    submitInfo.commandBufferCount = gf3d_command_pool_get_used_buffer_count(gf3d_vgraphics.graphicsCommandPool);
-    submitInfo.pCommandBuffers = gf3d_command_pool_get_used_buffers(gf3d_vgraphics.graphicsCommandPool);
-    
-    submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
     
-    if (vkQueueSubmit(gf3d_vqueues_get_graphics_queue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+    // uploads on the transfer queue are ordered against frames with timeline semaphores
+    if (uploadSync.waitSemaphore != VK_NULL_HANDLE)
+    {
+        waitSemaphores[waitCount] = uploadSync.waitSemaphore;
+        waitValues[waitCount] = uploadSync.waitValue;
+        waitStages[waitCount++] = uploadSync.waitStage;
+    }
+    submitInfo.waitSemaphoreCount = waitCount;
+    if (uploadSync.signalSemaphore != VK_NULL_HANDLE)
+    {
+        signalSemaphores[signalCount] = uploadSync.signalSemaphore;
+        signalValues[signalCount++] = uploadSync.signalValue;
+    }
+    submitInfo.signalSemaphoreCount = signalCount;
+    if (uploadSync.signalSemaphore != VK_NULL_HANDLE)
+    {
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
+        timelineInfo.pWaitSemaphoreValues = waitValues;
+        timelineInfo.signalSemaphoreValueCount = submitInfo.signalSemaphoreCount;
+        timelineInfo.pSignalSemaphoreValues = signalValues;
+        submitInfo.pNext = &timelineInfo;
+    }
+    
+    vkResetFences(gf3d_vgraphics.device, 1, &frame->inFlightFence);
+    gf3d_vqueues_lock();
+    if (vkQueueSubmit(gf3d_vqueues_get_graphics_queue(), 1, &submitInfo, frame->inFlightFence) != VK_SUCCESS)
     {
         slog("failed to submit draw command buffer!");
+        // an empty submit still signals the fence, otherwise the next wait on this frame never returns
+        vkQueueSubmit(gf3d_vqueues_get_graphics_queue(), 0, NULL, frame->inFlightFence);
+        gf3d_vgraphics.imageAcquired = 0;// nothing will signal the present semaphore
+    }
+    gf3d_vqueues_unlock();
+    
+    if (!gf3d_vgraphics.imageAcquired)
+    {
+        gf3d_vgraphics.currentFrame = (gf3d_vgraphics.currentFrame + 1) % GF3D_VGRAPHICS_FRAMES_IN_FLIGHT;
+        return;
     }
     
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    presentInfo.pWaitSemaphores = &gf3d_vgraphics.renderFinishedSemaphores[gf3d_vgraphics.bufferFrame];
     
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = swapChains;
     presentInfo.pImageIndices = &gf3d_vgraphics.bufferFrame;
     presentInfo.pResults = NULL; // Optional
     
-    vkQueuePresentKHR(gf3d_vqueues_get_present_queue(), &presentInfo);
+    gf3d_vqueues_lock();
+    result = vkQueuePresentKHR(gf3d_vqueues_get_present_queue(), &presentInfo);
+    gf3d_vqueues_unlock();
+    if ((result == VK_ERROR_OUT_OF_DATE_KHR)||(result == VK_SUBOPTIMAL_KHR))
+    {
+        gf3d_vgraphics.swapchainStale = 1;
+    }
+    else if (result != VK_SUCCESS)
+    {
+        slog("failed to present swap chain image: %i",result);
+    }
+    
+    gf3d_vgraphics.currentFrame = (gf3d_vgraphics.currentFrame + 1) % GF3D_VGRAPHICS_FRAMES_IN_FLIGHT;
+    if (gf3d_vgraphics.swapchainStale)gf3d_vgraphics_swapchain_rebuild();
 }
 
-void gf3d_vgraphics_semaphores_close()
+/**
+ * @brief free the sync objects kept per swap chain image
+ */
+static void gf3d_vgraphics_image_sync_close()
 {
-    vkDestroySemaphore(gf3d_vgraphics.device, gf3d_vgraphics.renderFinishedSemaphore, NULL);
-    vkDestroySemaphore(gf3d_vgraphics.device, gf3d_vgraphics.imageAvailableSemaphore, NULL);
+    int i;
+    if (gf3d_vgraphics.renderFinishedSemaphores)
+    {
+        for (i = 0; i < gf3d_vgraphics.swapImageCount; i++)
+        {
+            if (gf3d_vgraphics.renderFinishedSemaphores[i] == VK_NULL_HANDLE)continue;
+            vkDestroySemaphore(gf3d_vgraphics.device, gf3d_vgraphics.renderFinishedSemaphores[i], NULL);
+        }
+        free(gf3d_vgraphics.renderFinishedSemaphores);
+        gf3d_vgraphics.renderFinishedSemaphores = NULL;
+    }
+    if (gf3d_vgraphics.imagesInFlight)
+    {
+        free(gf3d_vgraphics.imagesInFlight);
+        gf3d_vgraphics.imagesInFlight = NULL;
+    }
+    gf3d_vgraphics.swapImageCount = 0;
+}
+
+/**
+ * @brief make a present semaphore and an in flight fence slot for each image of the current swap chain
+ */
+static void gf3d_vgraphics_image_sync_create()
+{
+    int i;
+    VkSemaphoreCreateInfo semaphoreInfo = {0};
     
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    gf3d_vgraphics.swapImageCount = gf3d_swapchain_get_swap_image_count();
+    gf3d_vgraphics.renderFinishedSemaphores = (VkSemaphore *)gfc_allocate_array(sizeof(VkSemaphore),gf3d_vgraphics.swapImageCount);
+    gf3d_vgraphics.imagesInFlight = (VkFence *)gfc_allocate_array(sizeof(VkFence),gf3d_vgraphics.swapImageCount);
+    if ((!gf3d_vgraphics.renderFinishedSemaphores)||(!gf3d_vgraphics.imagesInFlight))
+    {
+        slog("failed to allocate per swap chain image sync objects");
+        return;
+    }
+    for (i = 0; i < gf3d_vgraphics.swapImageCount; i++)
+    {
+        if (vkCreateSemaphore(gf3d_vgraphics.device, &semaphoreInfo, NULL, &gf3d_vgraphics.renderFinishedSemaphores[i]) != VK_SUCCESS)
+        {
+            slog("failed to create semaphores!");
+        }
+    }
 }
 
-void gf3d_vgraphics_semaphores_create()
+void gf3d_vgraphics_frames_close()
 {
+    int i;
+    // nothing else can be torn down while the GPU is still working on a frame
+    vkDeviceWaitIdle(gf3d_vgraphics.device);
+    for (i = 0; i < GF3D_VGRAPHICS_FRAMES_IN_FLIGHT; i++)
+    {
+        if (gf3d_vgraphics.frames[i].inFlightFence != VK_NULL_HANDLE)
+        {
+            vkDestroyFence(gf3d_vgraphics.device, gf3d_vgraphics.frames[i].inFlightFence, NULL);
+        }
+        if (gf3d_vgraphics.frames[i].imageAvailableSemaphore != VK_NULL_HANDLE)
+        {
+            vkDestroySemaphore(gf3d_vgraphics.device, gf3d_vgraphics.frames[i].imageAvailableSemaphore, NULL);
+        }
+        memset(&gf3d_vgraphics.frames[i],0,sizeof(FrameInFlight));
+    }
+    gf3d_vgraphics_image_sync_close();
+}
+
+void gf3d_vgraphics_frames_create()
+{
+    int i;
     VkSemaphoreCreateInfo semaphoreInfo = {0};
+    VkFenceCreateInfo fenceInfo = {0};
     
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
     
-    if ((vkCreateSemaphore(gf3d_vgraphics.device, &semaphoreInfo, NULL, &gf3d_vgraphics.imageAvailableSemaphore) != VK_SUCCESS) ||
-        (vkCreateSemaphore(gf3d_vgraphics.device, &semaphoreInfo, NULL, &gf3d_vgraphics.renderFinishedSemaphore) != VK_SUCCESS))
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;// so the first wait on each frame returns immediately
+    
+    for (i = 0; i < GF3D_VGRAPHICS_FRAMES_IN_FLIGHT; i++)
     {
-        slog("failed to create semaphores!");
+        if (vkCreateSemaphore(gf3d_vgraphics.device, &semaphoreInfo, NULL, &gf3d_vgraphics.frames[i].imageAvailableSemaphore) != VK_SUCCESS)
+        {
+            slog("failed to create semaphores!");
+        }
+        if (vkCreateFence(gf3d_vgraphics.device, &fenceInfo, NULL, &gf3d_vgraphics.frames[i].inFlightFence) != VK_SUCCESS)
+        {
+            slog("failed to create frame fence!");
+        }
+        // one for the frame, one for taking ownership of what the transfer queue uploaded
+        gf3d_vgraphics.frames[i].commandPool = gf3d_command_graphics_pool_setup(2);
+        if (!gf3d_vgraphics.frames[i].commandPool)
+        {
+            slog("failed to create command pool for frame %i",i);
+            continue;
+        }
+        gf3d_command_pool_add_secondary_buffers(gf3d_vgraphics.frames[i].commandPool,GF3D_VGRAPHICS_FRAME_COMMAND_BUFFERS);
     }
-	else slog("created semaphores");
-    atexit(gf3d_vgraphics_semaphores_close);
+    gf3d_vgraphics_image_sync_create();
+    gf3d_vgraphics.currentFrame = 0;
+    slog("created %i frames in flight",GF3D_VGRAPHICS_FRAMES_IN_FLIGHT);
+    atexit(gf3d_vgraphics_frames_close);
 }
 
 uint32_t gf3d_vgraphics_find_memory_type(uint32_t typeFilter, VkMemoryPropertyFlags properties)
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <SDL.h>
+
 #include "simple_logger.h"
 
 #include "gfc_vector.h"
@@ -13,6 +15,7 @@ typedef struct
 {
     VkQueue                     queue;
     Sint32                      queue_family;
+    Uint32                      queue_index;                /**<which queue of the family, queues sharing a family and index are the same queue*/
     float                       queue_priority;
 }VQueue;
 
@@ -24,15 +27,14 @@ typedef struct
     VkQueueFamilyProperties    *queue_family_properties;
     Uint32                      work_queue_count;
     VkDeviceQueueCreateInfo    *queue_create_info;          /**<used when the logical device is created*/
+    float                       queue_priorities[VQ_MAX][VQ_MAX];   /**<per create info, one for each queue asked of the family*/
     VQueue                      queue_list[VQ_MAX];
+    SDL_mutex                  *lock;                       /**<the render thread submits frames while the simulation thread submits uploads*/
 }vQueues;
 
 static vQueues gf3d_vqueues = {0};
 
 void gf3d_vqueues_close();
-VkDeviceQueueCreateInfo gf3d_vqueues_get_graphics_queue_info();
-VkDeviceQueueCreateInfo gf3d_vqueues_get_present_queue_info();
-VkDeviceQueueCreateInfo gf3d_vqueues_get_transfer_queue_info();
 
 void gf3d_vqueues_choose_graphics_family()
 {
@@ -61,17 +63,22 @@ void gf3d_vqueues_choose_graphics_family()
 void gf3d_vqueues_choose_transfer_family()
 {
     int i;
-    Uint32 bestScore = 0;
+    Uint32 score,bestScore = 0;
     int bestFamily = -1;
+    VkQueueFlags flags;
     for (i = 0; i < gf3d_vqueues.queue_family_count; i++)
     {
-        if (gf3d_vqueues.queue_family_properties[i].queueFlags & VK_QUEUE_TRANSFER_BIT)
+        flags = gf3d_vqueues.queue_family_properties[i].queueFlags;
+        // graphics and compute families can always transfer, even when they do not say so
+        if (!(flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))continue;
+        // a family that does nothing but transfer is a copy engine that runs beside rendering
+        if (!(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))score = 3;
+        else if (!(flags & VK_QUEUE_GRAPHICS_BIT))score = 2;
+        else score = 1;
+        if (score > bestScore)
         {
-            if (gf3d_vqueues.queue_family_properties[i].queueCount > bestScore)
-            {
-                bestScore = gf3d_vqueues.queue_family_properties[i].queueCount;
-                bestFamily = i;
-            }
+            bestScore = score;
+            bestFamily = i;
         }
     }
     if (bestFamily == -1)
@@ -115,6 +122,58 @@ void gf3d_vqueues_choose_present_family()
 }
 
 
+/**
+ * @brief make one create info per queue family in use.  Present shares the graphics queue when it can,
+ * transfer gets a queue of its own when its family has one to spare
+ */
+void gf3d_vqueues_build_create_info()
+{
+    Uint32 i,q,family,queueCount;
+    Sint32 families[VQ_MAX];
+    Uint32 familyQueues[VQ_MAX] = {0};
+    Uint32 familyCount = 0;
+    
+    for (q = 0; q < VQ_MAX; q++)
+    {
+        if (gf3d_vqueues.queue_list[q].queue_family == -1)continue;
+        for (family = 0; family < familyCount; family++)
+        {
+            if (families[family] == gf3d_vqueues.queue_list[q].queue_family)break;
+        }
+        if (family == familyCount)
+        {
+            families[familyCount++] = gf3d_vqueues.queue_list[q].queue_family;
+        }
+        queueCount = gf3d_vqueues.queue_family_properties[families[family]].queueCount;
+        if ((q == VQ_Transfer)&&(familyQueues[family])&&(familyQueues[family] < queueCount))
+        {
+            gf3d_vqueues.queue_list[q].queue_index = familyQueues[family];
+        }
+        else if (familyQueues[family])
+        {
+            gf3d_vqueues.queue_list[q].queue_index = 0;
+            continue;
+        }
+        gf3d_vqueues.queue_priorities[family][familyQueues[family]++] = gf3d_vqueues.queue_list[q].queue_priority;
+    }
+    gf3d_vqueues.work_queue_count = familyCount;
+    if (!familyCount)
+    {
+        slog("No suitable queues for graphics calls or presentation");
+        return;
+    }
+    gf3d_vqueues.queue_create_info = (VkDeviceQueueCreateInfo*)gfc_allocate_array(
+        sizeof(VkDeviceQueueCreateInfo),
+        familyCount);
+    for (i = 0; i < familyCount; i++)
+    {
+        gf3d_vqueues.queue_create_info[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        gf3d_vqueues.queue_create_info[i].queueFamilyIndex = families[i];
+        gf3d_vqueues.queue_create_info[i].queueCount = familyQueues[i];
+        gf3d_vqueues.queue_create_info[i].pQueuePriorities = gf3d_vqueues.queue_priorities[i];
+    }
+}
+
 void gf3d_vqueues_init(VkPhysicalDevice device,VkSurfaceKHR surface)
 {
     Uint32 i;
@@ -196,34 +255,9 @@ void gf3d_vqueues_init(VkPhysicalDevice device,VkSurfaceKHR surface)
         slog("using queue family %i for transfer pipeline",gf3d_vqueues.queue_list[VQ_Transfer].queue_family);
     }
     
-    if (gf3d_vqueues.queue_list[VQ_Graphics].queue_family != -1)
-    {
-        gf3d_vqueues.work_queue_count++;
-    }
-    if ((gf3d_vqueues.queue_list[VQ_Present].queue_family != -1) && (gf3d_vqueues.queue_list[VQ_Present].queue_family != gf3d_vqueues.queue_list[VQ_Graphics].queue_family))
-    {
-        gf3d_vqueues.work_queue_count++;
-    }
-    
-    if (!gf3d_vqueues.work_queue_count)
-    {
-        slog("No suitable queues for graphics calls or presentation");
-    }
-    else
-    {
-        gf3d_vqueues.queue_create_info = (VkDeviceQueueCreateInfo*)gfc_allocate_array(
-            sizeof(VkDeviceQueueCreateInfo),
-            gf3d_vqueues.work_queue_count);
-        i = 0;
-        if (gf3d_vqueues.queue_list[VQ_Graphics].queue_family != -1)
-        {
-            gf3d_vqueues.queue_create_info[i++] = gf3d_vqueues_get_graphics_queue_info();
-        }
-        if ((gf3d_vqueues.queue_list[VQ_Present].queue_family != -1) && (gf3d_vqueues.queue_list[VQ_Present].queue_family != gf3d_vqueues.queue_list[VQ_Graphics].queue_family))
-        {
-            gf3d_vqueues.queue_create_info[i++] = gf3d_vqueues_get_present_queue_info();
-        }
-    }
+    gf3d_vqueues_build_create_info();
+    gf3d_vqueues.lock = SDL_CreateMutex();
+    if (!gf3d_vqueues.lock)slog("failed to create the queue lock");
     
     atexit(gf3d_vqueues_close);
     slog("vqueues initialized");
@@ -235,49 +269,19 @@ const VkDeviceQueueCreateInfo *gf3d_vqueues_get_queue_create_info(Uint32 *count)
     return gf3d_vqueues.queue_create_info;
 }
 
-VkDeviceQueueCreateInfo gf3d_vqueues_get_graphics_queue_info()
-{
-    VkDeviceQueueCreateInfo queueCreateInfo = {0};
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.queueFamilyIndex = gf3d_vqueues.queue_list[VQ_Graphics].queue_family;
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.pQueuePriorities = &gf3d_vqueues.queue_list[VQ_Graphics].queue_priority;
-    return queueCreateInfo;
-}
-
-VkDeviceQueueCreateInfo gf3d_vqueues_get_present_queue_info()
-{
-    VkDeviceQueueCreateInfo queueCreateInfo = {0};
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.queueFamilyIndex = gf3d_vqueues.queue_list[VQ_Present].queue_family;
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.pQueuePriorities = &gf3d_vqueues.queue_list[VQ_Present].queue_priority;
-    return queueCreateInfo;
-}
-
-VkDeviceQueueCreateInfo gf3d_vqueues_get_transfer_queue_info()
-{
-    VkDeviceQueueCreateInfo queueCreateInfo = {0};
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.queueFamilyIndex = gf3d_vqueues.queue_list[VQ_Transfer].queue_family;
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.pQueuePriorities = &gf3d_vqueues.queue_list[VQ_Transfer].queue_priority;
-    return queueCreateInfo;
-}
-
 void gf3d_vqueues_setup_device_queues(VkDevice device)
 {
     if (gf3d_vqueues.queue_list[VQ_Graphics].queue_family != -1)
     {
-        vkGetDeviceQueue(device, gf3d_vqueues.queue_list[VQ_Graphics].queue_family, 0, &gf3d_vqueues.queue_list[VQ_Graphics].queue);
+        vkGetDeviceQueue(device, gf3d_vqueues.queue_list[VQ_Graphics].queue_family, gf3d_vqueues.queue_list[VQ_Graphics].queue_index, &gf3d_vqueues.queue_list[VQ_Graphics].queue);
     }
     if (gf3d_vqueues.queue_list[VQ_Present].queue_family != -1)
     {
-        vkGetDeviceQueue(device, gf3d_vqueues.queue_list[VQ_Present].queue_family, 0, &gf3d_vqueues.queue_list[VQ_Present].queue);
+        vkGetDeviceQueue(device, gf3d_vqueues.queue_list[VQ_Present].queue_family, gf3d_vqueues.queue_list[VQ_Present].queue_index, &gf3d_vqueues.queue_list[VQ_Present].queue);
     }
     if (gf3d_vqueues.queue_list[VQ_Transfer].queue_family != -1)
     {
-        vkGetDeviceQueue(device, gf3d_vqueues.queue_list[VQ_Transfer].queue_family, 0, &gf3d_vqueues.queue_list[VQ_Transfer].queue);
+        vkGetDeviceQueue(device, gf3d_vqueues.queue_list[VQ_Transfer].queue_family, gf3d_vqueues.queue_list[VQ_Transfer].queue_index, &gf3d_vqueues.queue_list[VQ_Transfer].queue);
     }
 }
 
@@ -291,6 +295,7 @@ void gf3d_vqueues_close()
     {
         free(gf3d_vqueues.queue_family_properties);
     }
+    if (gf3d_vqueues.lock)SDL_DestroyMutex(gf3d_vqueues.lock);
     memset(&gf3d_vqueues,0,sizeof(vQueues));
     slog("vqueues closed");
 }
@@ -324,4 +329,14 @@ VkQueue gf3d_vqueues_get_transfer_queue()
 {
     return gf3d_vqueues.queue_list[VQ_Transfer].queue;
 }
+
+void gf3d_vqueues_lock()
+{
+    if (gf3d_vqueues.lock)SDL_LockMutex(gf3d_vqueues.lock);
+}
+
+void gf3d_vqueues_unlock()
+{
+    if (gf3d_vqueues.lock)SDL_UnlockMutex(gf3d_vqueues.lock);
+}
 /*eol@eof*/
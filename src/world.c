@@ -4,6 +4,9 @@
 #include "gfc_types.h"
 #include "gfc_config.h"
 
+#include "gf3d_camera.h"
+#include "gf3d_indirect.h"
+
 #include "world.h"
 
 /*
@@ -16,6 +19,63 @@ typedef struct
 }World;
 */
 
+/**
+ * @purpose a model placed in the world that never moves
+ */
+typedef struct
+{
+    Model          *model;
+    Matrix4         modelMat;
+    IndirectObject *object;     /**<NULL if it is drawn by world_draw instead of the indirect scene*/
+}WorldProp;
+
+/**
+ * @brief place the props listed in the world config, through the indirect scene when it has room
+ */
+static void world_props_load(World *w,SJson *props)
+{
+    int i,c;
+    SJson *item;
+    const char *modelName;
+    Vector3D position,rotation,scale;
+    WorldProp *prop;
+    c = sj_array_get_count(props);
+    if (!c)return;
+    w->props = gfc_list_new();
+    for (i = 0; i < c; i++)
+    {
+        item = sj_array_get_nth(props,i);
+        if (!item)continue;
+        modelName = sj_get_string_value(sj_object_get_value(item,"model"));
+        if (!modelName)
+        {
+            slog("world prop %i has no model",i);
+            continue;
+        }
+        prop = gfc_allocate_array(sizeof(WorldProp),1);
+        if (!prop)continue;
+        prop->model = gf3d_model_load(modelName);
+        if (!prop->model)
+        {
+            free(prop);
+            continue;
+        }
+        position = vector3d(0,0,0);
+        rotation = vector3d(0,0,0);
+        scale = vector3d(1,1,1);
+        sj_value_as_vector3d(sj_object_get_value(item,"scale"),&scale);
+        sj_value_as_vector3d(sj_object_get_value(item,"position"),&position);
+        sj_value_as_vector3d(sj_object_get_value(item,"rotation"),&rotation);
+        gfc_matrix_identity(prop->modelMat);
+        gfc_matrix_scale(prop->modelMat,scale);
+        gfc_matrix_rotate_by_vector(prop->modelMat,prop->modelMat,rotation);
+        gfc_matrix_translate(prop->modelMat,position);
+        // props never move, so the indirect scene uploads them once and culls them on the GPU
+        prop->object = gf3d_indirect_object_new(prop->model,prop->modelMat,vector4d(1,1,1,1),vector4d(1,1,1,1));
+        w->props = gfc_list_append(w->props,prop);
+    }
+}
+
 World *world_load(char *filename)
 {
     SJson *json,*wjson;
@@ -42,6 +102,7 @@ World *world_load(char *filename)
         sj_free(json);
         return NULL;
     }
+    world_props_load(w,sj_object_get_value(wjson,"props"));
     modelName = sj_get_string_value(sj_object_get_value(wjson,"model"));
     if (!modelName)
     {
@@ -59,17 +120,60 @@ World *world_load(char *filename)
     return w;
 }
 
+/**
+ * @brief draw the props the indirect scene had no room for
+ */
+static void world_props_draw(World *world)
+{
+    int i,c;
+    float radius;
+    Vector3D center;
+    WorldProp *prop;
+    c = gfc_list_get_count(world->props);
+    for (i = 0; i < c; i++)
+    {
+        prop = gfc_list_get_nth(world->props,i);
+        if ((!prop)||(prop->object))continue;
+        if (prop->model->mesh)
+        {
+            radius = gf3d_frustum_transform_sphere(prop->modelMat,prop->model->mesh->center,prop->model->mesh->radius,&center);
+            if (!gf3d_frustum_sphere_visible(gf3d_camera_get_frustum(),center,radius))continue;
+        }
+        gf3d_model_draw(prop->model,prop->modelMat,vector4d(1,1,1,1),vector4d(1,1,1,1));
+    }
+}
+
 void world_draw(World *world)
 {
+    Vector3D center;
+    float radius;
     if (!world)return;
+    world_props_draw(world);
     if (!world->model)return;// no model to draw, do nothing
+    if (world->model->mesh)
+    {
+        radius = gf3d_frustum_transform_sphere(world->modelMat,world->model->mesh->center,world->model->mesh->radius,&center);
+        if (!gf3d_frustum_sphere_visible(gf3d_camera_get_frustum(),center,radius))return;
+    }
     gf3d_model_draw(world->model,world->modelMat,gfc_color_to_vector4f(world->color),vector4d(2,2,2,2));
     //gf3d_model_draw_highlight(world->worldModel,world->modelMat,vector4d(1,.5,.1,1));
 }
 
 void world_delete(World *world)
 {
+    int i,c;
+    WorldProp *prop;
     if (!world)return;
+    c = gfc_list_get_count(world->props);
+    for (i = 0; i < c; i++)
+    {
+        prop = gfc_list_get_nth(world->props,i);
+        if (!prop)continue;
+        gf3d_indirect_object_free(prop->object);
+        gf3d_model_free(prop->model);
+        free(prop);
+    }
+    gfc_list_delete(world->props);
     gf3d_model_free(world->model);
     free(world);
 }